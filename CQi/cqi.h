@@ -114,6 +114,14 @@
 #define CQI_CQP_ERROR_INVALID_FIELD 0x0503
 #define CQI_CQP_ERROR_OUT_OF_RANGE 0x0504
 /* various cases where a number is out of range                          */
+#define CQI_CQP_ERROR_NO_SUCH_CURSOR 0x0505
+/* invalid cursor handle, or cursor has already been closed              */
+#define CQI_CQP_ERROR_TOO_MANY_CURSORS 0x0506
+/* the client has too many open cursors (the limit is 64), or the        */
+/* frequency tables of its cursors would take up more than 64 MB         */
+#define CQI_CQP_ERROR_CURSOR_INVALIDATED 0x0507
+/* the subcorpus of a cursor has been changed or dropped, and there was  */
+/* not enough cursor memory left to keep a copy of the remaining values  */
 
 
 
@@ -146,6 +154,14 @@
 /* full-text error message for the last general error reported by        */
 /* the CQi server                                                        */
 
+#define CQI_CTRL_BATCH 0x1106
+/* INPUT: (INT n), followed by <n> complete CQi commands                 */
+/* OUTPUT: the responses to the <n> commands, in order                   */
+/* the responses are sent in one go after the last command of the batch */
+/* has been executed, so a client should send the entire batch before    */
+/* reading; a nested CQI_CTRL_BATCH returns CQI_ERROR_SYNTAX_ERROR;      */
+/* check CQI_ASK_FEATURE_CQI_BATCH first                                 */
+
 
 
 #define CQI_ASK_FEATURE 0x12
@@ -162,6 +178,16 @@
 /* INPUT: ()                                                             */
 /* OUTPUT: CQI_DATA_BOOL                                                 */
 
+#define CQI_ASK_FEATURE_CQI_BATCH 0x1204
+/* INPUT: ()                                                             */
+/* OUTPUT: CQI_DATA_BOOL                                                 */
+/* server supports CQI_CTRL_BATCH and CQI_CL_RANGES2STR                  */
+
+#define CQI_ASK_FEATURE_CQI_CURSOR 0x1205
+/* INPUT: ()                                                             */
+/* OUTPUT: CQI_DATA_BOOL                                                 */
+/* server supports the CQI_CQP_*_CURSOR commands                         */
+
 
 
 #define CQI_CORPUS 0x13
@@ -312,6 +338,16 @@
 /* OUTPUT: CQI_DATA_INT_INT_INT_INT                                      */
 /* returns (src_start, src_end, target_start, target_end)                */
 
+#define CQI_CL_RANGES2STR 0x1411
+/* INPUT:  (STRING_LIST attributes, INT_LIST start, INT_LIST end)        */
+/* OUTPUT: CQI_DATA_STRING_LIST                                          */
+/* returns the tokens <start[i]> .. <end[i]> of every range for each of  */
+/* the positional <attributes> ("concordance window"): for the first     */
+/* range, all its tokens on the first attribute, then all its tokens on  */
+/* the second attribute, etc., followed by the second range and so on;   */
+/* returns CQI_CL_ERROR_OUT_OF_RANGE if any range is empty (end < start) */
+/* or not within the corpus, or if the reply would be too large          */
+
 
 
 #define CQI_CQP 0x15
@@ -360,6 +396,46 @@
 /* returns <n> (id1, id2, frequency) pairs flattened into a list of size 3*<n> */
 /* NB: triples are sorted by frequency desc.                             */
 
+/* Cursors deliver the results of CQI_CQP_DUMP_SUBCORPUS and              */
+/* CQI_CQP_FDIST_1/2 in chunks of a size chosen by the client, which can  */
+/* stop fetching at any time; check CQI_ASK_FEATURE_CQI_CURSOR first;     */
+/* each of the OPEN commands returns CQI_CQP_ERROR_TOO_MANY_CURSORS if    */
+/* the client already has 64 open cursors                                 */
+/* (or if a frequency table exceeds the cursor memory of the client)      */
+#define CQI_CQP_OPEN_CURSOR 0x1520
+/* INPUT:  (STRING subcorpus, BYTE field)                                */
+/* OUTPUT: CQI_DATA_INT                                                  */
+/* returns a handle for a cursor on the values of <field> for all match  */
+/* ranges of <subcorpus> (cf. CQI_CQP_DUMP_SUBCORPUS); the values that   */
+/* have not been fetched yet are copied if <subcorpus> is changed or     */
+/* dropped, so this doesn't affect the cursor; if the copy would exceed  */
+/* the cursor memory of the client, the cursor is invalidated instead    */
+/* and CQI_CQP_FETCH_CURSOR returns CQI_CQP_ERROR_CURSOR_INVALIDATED     */
+
+#define CQI_CQP_OPEN_FDIST_1_CURSOR 0x1521
+/* INPUT:  (STRING subcorpus, INT cutoff, BYTE field, STRING attribute)  */
+/* OUTPUT: CQI_DATA_INT                                                  */
+/* returns a handle for a cursor on the (id, frequency) pairs that       */
+/* CQI_CQP_FDIST_1 would return                                          */
+
+#define CQI_CQP_OPEN_FDIST_2_CURSOR 0x1522
+/* INPUT:  (STRING subcorpus, INT cutoff, BYTE field1, STRING attribute1, BYTE field2, STRING attribute2) */
+/* OUTPUT: CQI_DATA_INT                                                  */
+/* returns a handle for a cursor on the (id1, id2, frequency) triples    */
+/* that CQI_CQP_FDIST_2 would return                                     */
+
+#define CQI_CQP_FETCH_CURSOR 0x1523
+/* INPUT:  (INT cursor, INT n)                                           */
+/* OUTPUT: CQI_DATA_INT_TABLE                                            */
+/* returns the next <n> rows (or fewer) from the cursor, with 1 column   */
+/* for subcorpus dumps and 2 or 3 columns for frequency distributions;   */
+/* a table with 0 rows means that the cursor is exhausted                */
+
+#define CQI_CQP_CLOSE_CURSOR 0x1524
+/* INPUT:  (INT cursor)                                                  */
+/* OUTPUT: CQI_STATUS_OK                                                 */
+/* discards a cursor, whether or not all its rows have been fetched      */
+
 
 
 /*  ***                                                                  */
@@ -22,7 +22,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 
 #include "../cl/cl.h"
 #include "../cl/macros.h"
@@ -550,8 +552,8 @@ do_cqi_cl_cpos2str(void)
 void
 do_cqi_cl_cpos2id(void)
 {
-  int *cposlist;
-  int len, i, id;
+  int *cposlist, *idlist;
+  int len, i;
   char *a;
   Attribute *attribute;
 
@@ -568,16 +570,17 @@ do_cqi_cl_cpos2id(void)
     cqi_command(cqi_errno);
   }
   else {
-    /* we assemble the CQI_DATA_INT_LIST() return command by hand,
-       so we don't have to allocate a temporary list */
+    /* look up all IDs in one go, so each block of a compressed attribute is decoded only once */
+    idlist = (len > 0) ? (int *)cl_malloc(len * sizeof(int)) : NULL;
+    if ((len > 0) && (cl_cpos2id_list(attribute, cposlist, len, idlist) < 0) && (cl_errno != CDA_EPOSORNG))
+      for (i=0; i<len; i++)
+        idlist[i] = -1;
+    /* we assemble the CQI_DATA_INT_LIST() return command by hand */
     cqi_send_word(CQI_DATA_INT_LIST);
     cqi_send_int(len);          /* list size */
-    for (i=0; i<len; i++) {
-      id = cl_cpos2id(attribute, cposlist[i]);
-      if (id < 0) 
-        id = -1;                        /* return -1 if cpos is out of range */
-      cqi_send_int(id);
-    }
+    for (i=0; i<len; i++)
+      cqi_send_int((idlist[i] < 0) ? -1 : idlist[i]); /* return -1 if cpos is out of range */
+    cl_free(idlist);
   }
   cqi_flush();
   if (cposlist != NULL)
@@ -930,6 +933,70 @@ do_cqi_cl_alg2cpos(void)
   free(a);                      /* don't forget to free allocated space */
 }
 
+void
+do_cqi_cl_ranges2str(void)
+{
+  char **names;
+  int *start, *end;
+  int n_att, n_start, n_end, i, j, cpos, max_cpos = INT_MAX, bad_range = 0;
+  double size = 0.0;            /* may exceed the range of an int */
+  Attribute **attributes = NULL;
+  Attribute *attribute = NULL;
+
+  n_att = cqi_read_string_list(&names);
+  n_start = cqi_read_int_list(&start);
+  n_end = cqi_read_int_list(&end);
+  if (server_debug) {
+    fprintf(stderr, "CQi: CQI_CL_RANGES2STR([");
+    for (j=0; j<n_att; j++)
+      fprintf(stderr, "'%s' ", names[j]);
+    fprintf(stderr, "], %d ranges)\n", n_start);
+  }
+
+  if (n_att > 0) {
+    attributes = (Attribute **) cl_malloc(n_att * sizeof(Attribute *));
+    for (j=0; j<n_att; j++) {
+      attribute = attributes[j] = cqi_lookup_attribute(names[j], ATT_POS);
+      if (attribute == NULL)
+        break;
+      if (cl_max_cpos(attribute) < max_cpos)
+        max_cpos = cl_max_cpos(attribute);
+    }
+  }
+  /* check all ranges before sending anything, since an error can't be reported in the middle of the reply */
+  for (i=0; i<n_start && i<n_end; i++) {
+    if (start[i] < 0 || end[i] < start[i] || end[i] >= max_cpos)
+      bad_range = 1;
+    else
+      size += ((double)end[i] - start[i] + 1) * n_att;
+  }
+
+  if (n_att > 0 && attribute == NULL)
+    cqi_command(cqi_errno);
+  else if (n_start != n_end)
+    cqi_command(CQI_ERROR_SYNTAX_ERROR);
+  else if (bad_range || size > INT_MAX)
+    cqi_command(CQI_CL_ERROR_OUT_OF_RANGE);
+  else {
+    /* we assemble the CQI_DATA_STRING_LIST() return command by hand,
+       so we don't have to allocate a temporary list */
+    cqi_send_word(CQI_DATA_STRING_LIST);
+    cqi_send_int((int)size);    /* list size */
+    for (i=0; i<n_start; i++)
+      for (j=0; j<n_att; j++)
+        for (cpos = start[i]; cpos <= end[i]; cpos++)
+          cqi_send_string(cl_cpos2str(attributes[j], cpos));
+  }
+  cqi_flush();
+
+  for (j=0; j<n_att; j++)
+    free(names[j]);
+  cl_free(names);
+  cl_free(attributes);
+  cl_free(start);
+  cl_free(end);
+}
+
 void
 do_cqi_cqp_list_subcorpora(void)
 {
@@ -1159,13 +1226,50 @@ do_cqi_send_minus_one_list(int n)
     cqi_send_int(-1);
 }
 
+/**
+ * Sends the values of a field for match ranges <first> .. <last> of a subcorpus
+ * (without list header), as needed for CQI_CQP_DUMP_SUBCORPUS.
+ */
+void
+do_cqi_send_field_values(CorpusList *cl, cqi_byte field, int first, int last)
+{
+  int i;
+
+  switch (field) {
+  case CQI_CONST_FIELD_MATCH:
+    for (i=first; i<=last; i++)
+      cqi_send_int(cl->range[i].start);
+    break;
+  case CQI_CONST_FIELD_MATCHEND:
+    for (i=first; i<=last; i++)
+      cqi_send_int(cl->range[i].end);
+    break;
+  case CQI_CONST_FIELD_TARGET:
+    if (cl->targets == NULL) 
+      do_cqi_send_minus_one_list(last - first + 1);
+    else 
+      for (i=first; i<=last; i++)
+        cqi_send_int(cl->targets[i]);
+    break;
+  case CQI_CONST_FIELD_KEYWORD:
+    if (cl->keywords == NULL) 
+      do_cqi_send_minus_one_list(last - first + 1);
+    else 
+      for (i=first; i<=last; i++)
+        cqi_send_int(cl->keywords[i]);
+    break;
+  default:
+    cqiserver_internal_error("do_cqi_send_field_values", "No handler for requested field.");
+  }
+}
+
 void
 do_cqi_cqp_dump_subcorpus(void)
 {
   char *subcorpus;
   CorpusList *cl;
   cqi_byte field;
-  int i, first, last, size;
+  int first, last;
   char *fieldname;
   int field_ok = 1;             /* field valid? */
 
@@ -1192,34 +1296,8 @@ do_cqi_cqp_dump_subcorpus(void)
     cqi_command(CQI_CQP_ERROR_OUT_OF_RANGE);
   else {
       cqi_send_word(CQI_DATA_INT_LIST); /* assemble by hand, so we don't have to allocate a temporary list */
-      size = last - first + 1;
-      cqi_send_int(size);
-      switch (field) {
-      case CQI_CONST_FIELD_MATCH:
-        for (i=first; i<=last; i++)
-          cqi_send_int(cl->range[i].start);
-        break;
-      case CQI_CONST_FIELD_MATCHEND:
-        for (i=first; i<=last; i++)
-          cqi_send_int(cl->range[i].end);
-        break;
-      case CQI_CONST_FIELD_TARGET:
-        if (cl->targets == NULL) 
-          do_cqi_send_minus_one_list(size);
-        else 
-          for (i=first; i<=last; i++)
-            cqi_send_int(cl->targets[i]);
-        break;
-      case CQI_CONST_FIELD_KEYWORD:
-        if (cl->keywords == NULL) 
-          do_cqi_send_minus_one_list(size);
-        else 
-          for (i=first; i<=last; i++)
-            cqi_send_int(cl->keywords[i]);
-        break;
-      default:
-        cqiserver_internal_error("do_cqi_cqp_dump_subcorpus", "No handler for requested field.");
-      }
+      cqi_send_int(last - first + 1);
+      do_cqi_send_field_values(cl, field, first, last);
       cqi_flush();
   }
 
@@ -1259,16 +1337,20 @@ do_cqi_cqp_drop_subcorpus(void)
 }
 
 /* temporary functions for CQI_CQP_FDIST_1() and CQI_CQP_FDIST_2() */
-void
-do_cqi_cqp_fdist_1(void)
+/**
+ * Reads the arguments of CQI_CQP_FDIST_1 (or of the corresponding cursor command <name>)
+ * and computes the frequency table. If this fails, an error is sent to the client
+ * and NULL is returned.
+ */
+Group *
+cqi_read_fdist_1(char *name)
 {
   char *subcorpus;
   CorpusList *cl;
   int cutoff;
   cqi_byte field;
   char *att;
-  Group *table;
-  int i, size;
+  Group *table = NULL;
   char *fieldname;
   FieldType fieldtype = NoField;
   int field_ok = 1;             /* field valid? */
@@ -1288,8 +1370,8 @@ do_cqi_cqp_fdist_1(void)
     fieldtype = field_name_to_type(fieldname);
   }
   if (server_debug) 
-    fprintf(stderr, "CQi: CQI_CQP_FDIST_1('%s', %d, %s, %s)\n", 
-            subcorpus, cutoff, fieldname, att);
+    fprintf(stderr, "CQi: %s('%s', %d, %s, %s)\n", 
+            name, subcorpus, cutoff, fieldname, att);
   
   cl = cqi_find_corpus(subcorpus);
   if (cl == NULL) 
@@ -1300,38 +1382,51 @@ do_cqi_cqp_fdist_1(void)
     /* compute_grouping() returns tokens with f > cutoff, but CQi specifies f >= cutoff */
     cutoff = (cutoff > 0) ? cutoff - 1 : 0;
     table = compute_grouping(cl, NoField, 0, NULL, fieldtype, 0, att, cutoff, 0);
-    if (table == NULL) {
+    if (table == NULL)
       cqi_command(CQI_CQP_ERROR_GENERAL);
-    }
-    else {
-      size = table->nr_cells;
-      cqi_send_word(CQI_DATA_INT_TABLE);        /* return table with 2 columns & <size> rows */
-      cqi_send_int(size);
-      cqi_send_int(2);
-      for (i=0; i < size; i++) {
-        cqi_send_int(table->count_cells[i].t);
-        cqi_send_int(table->count_cells[i].freq);
-      }
-      cqi_flush();
-      free_group(&table);
-    }
   }
 
   cl_free(subcorpus);
   cl_free(att);
+  return table;
 }
 
-
 void
-do_cqi_cqp_fdist_2(void)
+do_cqi_cqp_fdist_1(void)
+{
+  Group *table;
+  int i, size;
+
+  table = cqi_read_fdist_1("CQI_CQP_FDIST_1");
+  if (table != NULL) {
+    size = table->nr_cells;
+    cqi_send_word(CQI_DATA_INT_TABLE);        /* return table with 2 columns & <size> rows */
+    cqi_send_int(size);
+    cqi_send_int(2);
+    for (i=0; i < size; i++) {
+      cqi_send_int(table->count_cells[i].t);
+      cqi_send_int(table->count_cells[i].freq);
+    }
+    cqi_flush();
+    free_group(&table);
+  }
+}
+
+
+/**
+ * Reads the arguments of CQI_CQP_FDIST_2 (or of the corresponding cursor command <name>)
+ * and computes the frequency table. If this fails, an error is sent to the client
+ * and NULL is returned.
+ */
+Group *
+cqi_read_fdist_2(char *name)
 {
   char *subcorpus;
   CorpusList *cl;
   int cutoff;
   cqi_byte field1, field2;
   char *att1, *att2;
-  Group *table;
-  int i, size;
+  Group *table = NULL;
   char *fieldname1, *fieldname2;
   FieldType fieldtype1 = NoField, fieldtype2 = NoField;
   int fields_ok = 1;            /* (both) fields valid? */
@@ -1361,8 +1456,8 @@ do_cqi_cqp_fdist_2(void)
     fieldtype2 = field_name_to_type(fieldname2);
   }
   if (server_debug) 
-    fprintf(stderr, "CQi: CQI_CQP_FDIST_2('%s', %d, %s, %s, %s, %s)\n", 
-            subcorpus, cutoff, fieldname1, att1, fieldname2, att2);
+    fprintf(stderr, "CQi: %s('%s', %d, %s, %s, %s, %s)\n", 
+            name, subcorpus, cutoff, fieldname1, att1, fieldname2, att2);
   
   cl = cqi_find_corpus(subcorpus);
   if (cl == NULL) 
@@ -1373,27 +1468,313 @@ do_cqi_cqp_fdist_2(void)
     /* compute_grouping() returns tokens with f > cutoff, but CQi specifies f >= cutoff */
     cutoff = (cutoff > 0) ? cutoff - 1 : 0;
     table = compute_grouping(cl, fieldtype1, 0, att1, fieldtype2, 0, att2, cutoff, 0);
-    if (table == NULL) {
+    if (table == NULL)
       cqi_command(CQI_CQP_ERROR_GENERAL);
+  }
+
+  cl_free(subcorpus);
+  cl_free(att1);
+  cl_free(att2);
+  return table;
+}
+
+void
+do_cqi_cqp_fdist_2(void)
+{
+  Group *table;
+  int i, size;
+
+  table = cqi_read_fdist_2("CQI_CQP_FDIST_2");
+  if (table != NULL) {
+    size = table->nr_cells;
+    cqi_send_word(CQI_DATA_INT_TABLE);        /* return table with 3 columns & <size> rows */
+    cqi_send_int(size);
+    cqi_send_int(3);
+    for (i=0; i < size; i++) {
+      cqi_send_int(table->count_cells[i].s);
+      cqi_send_int(table->count_cells[i].t);
+      cqi_send_int(table->count_cells[i].freq);
     }
-    else {
-      size = table->nr_cells;
-      cqi_send_word(CQI_DATA_INT_TABLE);        /* return table with 3 columns & <size> rows */
-      cqi_send_int(size);
-      cqi_send_int(3);
-      for (i=0; i < size; i++) {
-        cqi_send_int(table->count_cells[i].s);
-        cqi_send_int(table->count_cells[i].t);
-        cqi_send_int(table->count_cells[i].freq);
+    cqi_flush();
+    free_group(&table);
+  }
+}
+
+
+/*
+ *
+ *  Cursors (chunked delivery of subcorpus dumps and frequency tables)
+ *
+ */
+
+/** Maximum number of cursors that a client can have open at the same time */
+#define MAX_CURSORS 64
+
+/** Maximum amount of memory (in bytes) that the frequency tables and subcorpus copies of a client's cursors may take up */
+#define MAX_CURSOR_MEMORY (64 * 1024 * 1024)
+
+/**
+ * A cursor on a subcorpus dump or frequency table, from which the client fetches rows in chunks.
+ *
+ * A cursor on a subcorpus dump refers to the subcorpus itself as long as it isn't changed;
+ * cursor_corpus_changed() copies the remaining values before it is changed or dropped.
+ */
+typedef struct {
+  int in_use;                   /**< Boolean: this slot holds an open cursor */
+  CorpusList *cl;               /**< subcorpus the values are read from (NULL for frequency tables and copied dumps) */
+  cqi_byte field;               /**< field of the subcorpus that is dumped */
+  int *values;                  /**< copy of the values from row <base> onwards, made when the subcorpus was changed (or NULL) */
+  int base;                     /**< row number of values[0] */
+  int size;                     /**< number of rows of a subcorpus dump */
+  Group *table;                 /**< frequency table (NULL for subcorpus dumps) */
+  int columns;                  /**< number of values per row: 1 for dumps, 2 or 3 for frequency tables */
+  int next;                     /**< index of the next row to be fetched */
+  size_t bytes;                 /**< memory taken up by <values> or <table>, counted against MAX_CURSOR_MEMORY */
+  int invalid;                  /**< Boolean: the subcorpus was changed, and there wasn't enough memory for a copy */
+} CQiCursor;
+
+CQiCursor *cursors = NULL;      /**< the open cursors of the current session; handles are indices into this array */
+int n_cursors = 0;              /**< number of slots in cursors[] */
+size_t cursor_memory = 0;       /**< total of the <bytes> of all open cursors */
+
+/**
+ * Allocates a new (empty) cursor and returns its handle.
+ *
+ * @return  The handle, or -1 if the client already has MAX_CURSORS open cursors.
+ */
+int
+new_cursor(void)
+{
+  int h;
+
+  for (h = 0; h < n_cursors; h++)
+    if (!cursors[h].in_use)
+      break;
+  if (h >= MAX_CURSORS)
+    return -1;
+  if (h >= n_cursors) {
+    n_cursors = (n_cursors > 0) ? 2 * n_cursors : 16;
+    cursors = (CQiCursor *) cl_realloc(cursors, n_cursors * sizeof(CQiCursor));
+    memset(cursors + h, 0, (n_cursors - h) * sizeof(CQiCursor));
+  }
+  memset(&cursors[h], 0, sizeof(CQiCursor));
+  cursors[h].in_use = 1;
+  return h;
+}
+
+/**
+ * Discards the cursor with the given handle (if it is open).
+ *
+ * @return  Boolean: true if the cursor was open.
+ */
+int
+release_cursor(int h)
+{
+  if (h < 0 || h >= n_cursors || !cursors[h].in_use)
+    return 0;
+  cl_free(cursors[h].values);
+  if (cursors[h].table != NULL)
+    free_group(&(cursors[h].table));
+  cursor_memory -= cursors[h].bytes;
+  cursors[h].in_use = 0;
+  return 1;
+}
+
+/**
+ * Discards all cursors at the end of a CQi session.
+ */
+void
+release_all_cursors(void)
+{
+  int h;
+
+  for (h = 0; h < n_cursors; h++)
+    release_cursor(h);
+  cl_free(cursors);
+  n_cursors = 0;
+  cursor_memory = 0;
+}
+
+/**
+ * Returns the value of a field for match range <i> of a subcorpus.
+ */
+int
+cursor_field_value(CorpusList *cl, cqi_byte field, int i)
+{
+  switch (field) {
+  case CQI_CONST_FIELD_MATCH:
+    return cl->range[i].start;
+  case CQI_CONST_FIELD_MATCHEND:
+    return cl->range[i].end;
+  case CQI_CONST_FIELD_TARGET:
+    return (cl->targets) ? cl->targets[i] : -1;
+  case CQI_CONST_FIELD_KEYWORD:
+    return (cl->keywords) ? cl->keywords[i] : -1;
+  default:
+    return -1;
+  }
+}
+
+/**
+ * Detaches the cursors on a subcorpus that is about to be changed or dropped (corpus_change_hook).
+ *
+ * The rows that haven't been fetched yet are copied, as long as this fits into MAX_CURSOR_MEMORY;
+ * otherwise the cursor is invalidated.
+ *
+ * @param cl  The subcorpus.
+ */
+void
+cursor_corpus_changed(CorpusList *cl)
+{
+  CQiCursor *cursor;
+  size_t bytes;
+  int h, i;
+
+  for (h = 0; h < n_cursors; h++) {
+    cursor = &cursors[h];
+    if (!cursor->in_use || cursor->cl != cl)
+      continue;
+    if (cursor->next < cursor->size) {
+      bytes = (size_t)(cursor->size - cursor->next) * sizeof(int);
+      if (bytes > MAX_CURSOR_MEMORY - cursor_memory)
+        cursor->invalid = 1;
+      else {
+        cursor->values = (int *) cl_malloc(bytes);
+        for (i = cursor->next; i < cursor->size; i++)
+          cursor->values[i - cursor->next] = cursor_field_value(cl, cursor->field, i);
+        cursor->base = cursor->next;
+        cursor->bytes = bytes;
+        cursor_memory += bytes;
       }
-      cqi_flush();
-      free_group(&table);
     }
+    cursor->cl = NULL;
   }
+}
+
+void
+do_cqi_cqp_open_cursor(void)
+{
+  char *subcorpus;
+  CorpusList *cl;
+  cqi_byte field;
+  int h;
+
+  subcorpus = cqi_read_string();
+  field = cqi_read_byte();
+  if (server_debug) 
+    fprintf(stderr, "CQi: CQI_CQP_OPEN_CURSOR('%s', %d)\n", subcorpus, field);
 
+  cl = cqi_find_corpus(subcorpus);
+  if (cl == NULL)
+    cqi_command(cqi_errno);
+  else if (cqi_field_name(field) == NULL)
+    cqi_command(CQI_CQP_ERROR_INVALID_FIELD);
+  else if ((h = new_cursor()) < 0)
+    cqi_command(CQI_CQP_ERROR_TOO_MANY_CURSORS);
+  else {
+    /* refer to the subcorpus; cursor_corpus_changed() makes a copy if it is changed or dropped */
+    cursors[h].cl = cl;
+    cursors[h].field = field;
+    cursors[h].size = cl->size;
+    cursors[h].columns = 1;
+    cqi_data_int(h);
+  }
   cl_free(subcorpus);
-  cl_free(att1);
-  cl_free(att2);
+}
+
+void
+do_cqi_cqp_open_fdist_cursor(int columns)
+{
+  Group *table;
+  size_t bytes;
+  int h;
+
+  if (columns == 2)
+    table = cqi_read_fdist_1("CQI_CQP_OPEN_FDIST_1_CURSOR");
+  else
+    table = cqi_read_fdist_2("CQI_CQP_OPEN_FDIST_2_CURSOR");
+  if (table != NULL) {
+    bytes = (size_t)table->nr_cells * sizeof(ID_Count_Mapping);
+    if (bytes > MAX_CURSOR_MEMORY - cursor_memory || (h = new_cursor()) < 0) {
+      free_group(&table);
+      cqi_command(CQI_CQP_ERROR_TOO_MANY_CURSORS);
+      return;
+    }
+    cursors[h].table = table;
+    cursors[h].columns = columns;
+    cursors[h].bytes = bytes;
+    cursor_memory += bytes;
+    cqi_data_int(h);
+  }
+}
+
+void
+do_cqi_cqp_fetch_cursor(void)
+{
+  int h, n, i, last;
+  CQiCursor *cursor;
+  int size;
+
+  h = cqi_read_int();
+  n = cqi_read_int();
+  if (server_debug) 
+    fprintf(stderr, "CQi: CQI_CQP_FETCH_CURSOR(%d, %d)\n", h, n);
+
+  if (h < 0 || h >= n_cursors || !cursors[h].in_use) {
+    cqi_command(CQI_CQP_ERROR_NO_SUCH_CURSOR);
+    return;
+  }
+  if (n <= 0) {
+    cqi_command(CQI_CQP_ERROR_OUT_OF_RANGE);
+    return;
+  }
+  cursor = &cursors[h];
+  if (cursor->invalid) {
+    cqi_command(CQI_CQP_ERROR_CURSOR_INVALIDATED);
+    return;
+  }
+
+  size = (cursor->table == NULL) ? cursor->size : cursor->table->nr_cells;
+
+  if (cursor->next > size)
+    cursor->next = size;
+  last = (n < size - cursor->next) ? cursor->next + n - 1 : size - 1;
+
+  cqi_send_word(CQI_DATA_INT_TABLE);    /* return table with <columns> columns & up to <n> rows */
+  cqi_send_int(last - cursor->next + 1);
+  cqi_send_int(cursor->columns);
+  if (cursor->cl != NULL) {
+    if (last >= cursor->next)
+      do_cqi_send_field_values(cursor->cl, cursor->field, cursor->next, last);
+  }
+  else if (cursor->table == NULL) {
+    for (i = cursor->next; i <= last; i++)
+      cqi_send_int(cursor->values[i - cursor->base]);
+  }
+  else {
+    for (i = cursor->next; i <= last; i++) {
+      if (cursor->columns == 3)
+        cqi_send_int(cursor->table->count_cells[i].s);
+      cqi_send_int(cursor->table->count_cells[i].t);
+      cqi_send_int(cursor->table->count_cells[i].freq);
+    }
+  }
+  cqi_flush();
+  cursor->next = last + 1;
+}
+
+void
+do_cqi_cqp_close_cursor(void)
+{
+  int h;
+
+  h = cqi_read_int();
+  if (server_debug) 
+    fprintf(stderr, "CQi: CQI_CQP_CLOSE_CURSOR(%d)\n", h);
+  if (release_cursor(h))
+    cqi_command(CQI_STATUS_OK);
+  else
+    cqi_command(CQI_CQP_ERROR_NO_SUCH_CURSOR);
 }
 
 
@@ -1411,6 +1792,8 @@ interpreter(void)
 {
   int cmd;
   int cmd_group;
+  int batch = 0;                /* number of commands left in the current CQI_CTRL_BATCH */
+  int n;
 
   while (42) {
     cmd = cqi_read_command();
@@ -1427,6 +1810,7 @@ interpreter(void)
       case CQI_CTRL_BYE:
         if (server_debug) 
           fprintf(stderr, "CQi: CQI_CTRL_BYE()\n");
+        cqi_deferred_flush = 0;   /* BYE ends a batch (sending all pending responses) */
         cqi_command(CQI_STATUS_BYE_OK);
         return;                 /* exit CQi command interpreter */
       case CQI_CTRL_USER_ABORT:
@@ -1443,6 +1827,21 @@ interpreter(void)
           fprintf(stderr, "CQi: CQI_CTRL_LAST_GENERAL_ERROR() => '%s'", cqi_error_string);
         cqi_data_string(cqi_error_string);
         break;
+      case CQI_CTRL_BATCH:
+        n = cqi_read_int();
+        if (batch > 0) {
+          if (server_debug)
+            fprintf(stderr, "CQi: CQI_CTRL_BATCH(%d) ... nested batch not allowed\n", n);
+          cqi_command(CQI_ERROR_SYNTAX_ERROR);
+          break;
+        }
+        batch = n;
+        if (server_debug)
+          fprintf(stderr, "CQi: CQI_CTRL_BATCH(%d)\n", batch);
+        /* hold back all responses until the last command of the batch has been executed */
+        if (batch > 0)
+          cqi_deferred_flush = 1;
+        continue;               /* the batch command itself has no response */
       default:
         cqiserver_unknown_command_error(cmd);
       }
@@ -1466,6 +1865,16 @@ interpreter(void)
           fprintf(stderr, "CQi: CQI_ASK_FEATURE_CQP_2_3 ... CQP v2.3 ok\n");
         cqi_data_bool(CQI_CONST_YES);
         break;
+      case CQI_ASK_FEATURE_CQI_BATCH:
+        if (server_debug)
+          fprintf(stderr, "CQi: CQI_ASK_FEATURE_CQI_BATCH ... batch commands ok\n");
+        cqi_data_bool(CQI_CONST_YES);
+        break;
+      case CQI_ASK_FEATURE_CQI_CURSOR:
+        if (server_debug)
+          fprintf(stderr, "CQi: CQI_ASK_FEATURE_CQI_CURSOR ... cursors ok\n");
+        cqi_data_bool(CQI_CONST_YES);
+        break;
       default:
         if (server_debug)
           fprintf(stderr, "CQi: CQI_ASK_FEATURE_* ... <unknown feature> not supported\n");
@@ -1562,6 +1971,9 @@ interpreter(void)
       case CQI_CL_ALG2CPOS:
         do_cqi_cl_alg2cpos();
         break;
+      case CQI_CL_RANGES2STR:
+        do_cqi_cl_ranges2str();
+        break;
       default:
         cqiserver_unknown_command_error(cmd);
       }
@@ -1594,6 +2006,21 @@ interpreter(void)
       case CQI_CQP_FDIST_2:
         do_cqi_cqp_fdist_2();
         break;
+      case CQI_CQP_OPEN_CURSOR:
+        do_cqi_cqp_open_cursor();
+        break;
+      case CQI_CQP_OPEN_FDIST_1_CURSOR:
+        do_cqi_cqp_open_fdist_cursor(2);
+        break;
+      case CQI_CQP_OPEN_FDIST_2_CURSOR:
+        do_cqi_cqp_open_fdist_cursor(3);
+        break;
+      case CQI_CQP_FETCH_CURSOR:
+        do_cqi_cqp_fetch_cursor();
+        break;
+      case CQI_CQP_CLOSE_CURSOR:
+        do_cqi_cqp_close_cursor();
+        break;
       default:
         cqiserver_unknown_command_error(cmd);
       }
@@ -1603,6 +2030,11 @@ interpreter(void)
       cqiserver_unknown_command_error(cmd);
 
     } /* end outer switch */
+
+    if (batch > 0 && --batch == 0) {
+      cqi_deferred_flush = 0;
+      cqi_flush();
+    }
     
   } /* end while 42 */
 
@@ -1610,14 +2042,69 @@ interpreter(void)
 
 
 
+/**
+ * Handles a single CQi connection: authenticates the client and runs the
+ * command interpreter until the client logs off.
+ */
+static void
+serve_connection(void)
+{
+  int cmd;
+
+  /* establish CQi connection: wait for CONNECT request */
+  cmd = cqi_read_command();
+  if (cmd != CQI_CTRL_CONNECT) {
+    if (server_log)
+      printf("CQPserver: Connection refused.\n");
+    cqiserver_wrong_command_error(cmd);
+  }
+  user = cqi_read_string();
+  passwd = cqi_read_string();
+  if (server_log)
+    printf("CQPserver: CONNECT  user = '%s'  passwd = '%s'  pid = %d\n", user, passwd, (int)getpid());
+
+  /* check password here (always required !!) */
+  if (!authenticate_user(user, passwd)) {
+    printf("CQPserver: Wrong username or password. Connection refused.\n"); /* TODO shouldn't this be to stderr as it is not conditional on server_log? */
+    cqi_command(CQI_ERROR_CONNECT_REFUSED);
+  }
+  else {
+    cqi_command(CQI_STATUS_CONNECT_OK);
+
+    /* re-randomize for query lock key generation */
+    cl_randomize();
+
+    /* check which corpora the user is granted access to */
+    {
+      CorpusList *cl = FirstCorpusFromList();
+      while (cl != NULL) {
+        if (!check_grant(user, cl->name))
+          dropcorpus(cl);
+        cl = NextCorpusFromList(cl);
+      }
+    }
+
+    /* start command interpreter loop */
+    corpus_change_hook = cursor_corpus_changed;
+    interpreter();
+    corpus_change_hook = NULL;
+    release_all_cursors();
+
+    if (server_log)
+      printf("CQPserver: User '%s' has logged off.\n", user);
+  }
+
+  cl_free(user);
+  cl_free(passwd);
+}
+
+
 /**
  * Main function for the cqpserver app.
  */
 int
 main(int argc, char *argv[])
 {
-  int cmd;
-
   which_app = cqpserver;
 
   /* TODO: shouldn't these come AFTER initialize_cqp(), as that function may overwrite these values with defaults?
@@ -1655,53 +2142,26 @@ main(int argc, char *argv[])
     add_host_to_list("127.0.0.1"); /* in -L mode, connections from localhost are automatically accepted  */
   }
 
-  if (0 < accept_connection(server_port)) {
-    if (server_log)
-      printf("CQPserver: Connected. Waiting for CONNECT request.\n");
-  }
-  else {
-    fprintf(stderr, "CQPserver: ERROR Connection failed.\n");
-    exit(1);
-  }
-
-  /* establish CQi connection: wait for CONNECT request */
-  cmd = cqi_read_command();
-  if (cmd != CQI_CTRL_CONNECT) {
-    if (server_log)
-      printf("CQPserver: Connection refused.\n");
-    cqiserver_wrong_command_error(cmd);
-  }
-  user = cqi_read_string();
-  passwd = cqi_read_string();
-  if (server_log)
-    printf("CQPserver: CONNECT  user = '%s'  passwd = '%s'  pid = %d\n", user, passwd, (int)getpid());
-
-  /* check password here (always required !!) */
-  if (!authenticate_user(user, passwd)) {
-    printf("CQPserver: Wrong username or password. Connection refused.\n"); /* TODO shouldn't this be to stderr as it is not conditional on server_log? */
-    cqi_command(CQI_ERROR_CONNECT_REFUSED);
-  }
-  else {
-    cqi_command(CQI_STATUS_CONNECT_OK);
-
-    /* re-randomize for query lock key generation */
-    cl_randomize();
-
-    /* check which corpora the user is granted access to */
-    {
-      CorpusList *cl = FirstCorpusFromList();
-      while (cl != NULL) {
-        if (!check_grant(user, cl->name))
-          dropcorpus(cl);
-        cl = NextCorpusFromList(cl);
-      }
+  while (42) {
+    if (0 < accept_connection(server_port)) {
+      if (server_log)
+        printf("CQPserver: Connected. Waiting for CONNECT request.\n");
+    }
+    else {
+      fprintf(stderr, "CQPserver: ERROR Connection failed.\n");
+      exit(1);
     }
 
-    /* start command interpreter loop */
-    interpreter();
+    serve_connection();
 
-    if (server_log)
-      printf("CQPserver: User '%s' has logged off.\n", user);
+    if (!close_connection())
+      break;
+
+    /* pool worker: restore the full list of corpora (access grants depend on the user) */
+    free_corpuslist();
+    check_available_corpora(UNDEF);
+    if (default_corpus)
+      set_current_corpus_name(default_corpus, 0);
   }
 
   /* connection terminated; clean up and exit */
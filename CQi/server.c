@@ -28,13 +28,16 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <sys/wait.h>
 #else
 #include <winsock2.h>
 #define socklen_t int
 #endif
 
 #include <signal.h>
+#include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdio.h>
 
@@ -47,6 +50,7 @@
 #include "../cqp/hash.h"
 
 #define NETBUFSIZE 512
+#define OUTBUFSIZE (256 * 1024)
 #define ATTHASHSIZE 16384
 #define GENERAL_ERROR_SIZE 1024
 
@@ -65,12 +69,15 @@
 
 int sockfd;                       /**< Connection in:  file-descriptor integer */
 int connfd;                       /**< Connection out: file-descriptor integer */
-FILE *conn_out;                   /**< Connection out: stream for buffered output (don't forget to flush()) */
+cqi_byte outbuf[OUTBUFSIZE];      /**< Connection out: buffer for outgoing data (don't forget to flush()) */
+int outbuf_fill = 0;              /**< Number of bytes currently held in outbuf[] */
+int cqi_deferred_flush = 0;       /**< Boolean: cqi_flush() keeps the data in outbuf[] (while executing a CQI_CTRL_BATCH) */
 struct sockaddr_in my_addr, client_addr;
 struct hostent *remote_host;
 char *remote_address;
 cqi_byte netbuf[NETBUFSIZE];      /* do we need it at all? */
 int bytes;                        /* always used for data held in netbuf[] */
+int server_listening = 0;         /**< Boolean: the listening socket has been opened (kept open by pool workers) */
 
 
 int cqi_errno = CQI_STATUS_OK;    /**< CQi last error */
@@ -157,35 +164,69 @@ cqi_general_error(char *errstring)
 
 
 
+#ifndef __MINGW__
 /**
- * Wait for, and then process, an attempt by a client to initiate a connection
- * to cqpserver via TCP/IP.
+ * Starts the worker processes of a CQPserver running in pool mode (option -w).
  *
- * Note that this function may or may not fork the cqpserver process.
- *
- * If forking happens, then the child handles the connection, whereas the parent carries
- * on waiting for further connections.
- *
- * On Windows, forking never happens (since Windows doesn't support it).
- *
- * On *nix, forking happens UNLESS the global private_server is true. (Actually, if
- * private_server is true, then forking still happens, but the parent process immeidately
- * exits.)
+ * The calling process becomes a supervisor and never returns from this function:
+ * it forks server_workers processes, which all accept connections on the shared
+ * listening socket, and replaces each worker that exits (e.g. because a client
+ * dropped its connection). The workers return to the caller.
+ */
+static void
+start_worker_pool(void)
+{
+  int running = 0;
+  pid_t pid;
+
+  /* we have to reap our own workers in order to replace them */
+  if (SIG_ERR == signal(SIGCHLD, SIG_DFL)) {
+    perror("ERROR Can't reset SIGCHLD handler");
+    exit(1);
+  }
+
+  while (42) {
+    while (running < server_workers) {
+      fflush(stdout);
+      pid = fork();
+      if (pid < 0) {
+        perror("ERROR can't fork() worker");
+        if (running == 0)
+          exit(1);
+        break;                  /* try again when the next worker exits */
+      }
+      if (pid == 0)
+        return;                 /* the worker goes on to accept connections */
+      running++;
+      if (server_log)
+        printf("Spawned CQPserver worker, pid = %d.\n", (int)pid);
+    }
+
+    pid = wait(NULL);
+    if (pid > 0)
+      running--;
+    else if (errno != EINTR) {
+      perror("ERROR wait() failed");
+      exit(1);
+    }
+  }
+}
+#endif
+
+/**
+ * Opens the socket that cqpserver listens on for incoming connections.
  *
- * TODO: a better name would be server_accept_connection or somesuch...
+ * With the -q option, the calling process forks and exits here, and in pool
+ * mode it turns into the supervisor of the worker processes (so that only the
+ * workers return from this function).
  *
  * @param port  The integer identifier of the port to listen on.
- * @return      A > 0 value (actually the socket ID of the incoming connection)
- *              if all is OK; otherwise -1.
+ * @return      0 if all is OK; otherwise -1.
  */
-int 
-accept_connection(int port)
+static int
+open_server_socket(int port)
 {
   const int on = 1;
-  socklen_t sin_size = sizeof(struct sockaddr_in);
-#ifndef __MINGW__
-  pid_t child_pid;
-#endif
 
 #ifndef __MINGW__
   if (SIG_ERR == signal(SIGCHLD, SIG_IGN)) {
@@ -194,10 +235,6 @@ accept_connection(int port)
   }
 #endif
 
-  if (port <= 0) {
-    port = CQI_PORT;
-  }
-
   if (server_debug) 
     fprintf(stderr, "CQi: Opening socket and binding to port %d\n", port);
 
@@ -263,6 +300,64 @@ accept_connection(int port)
   /* no forking in Windows! */
 #endif
 
+#ifndef __MINGW__
+  /* in pool mode, the calling process turns into the supervisor; only the workers return */
+  if (server_workers > 0)
+    start_worker_pool();
+#endif
+
+  return 0;
+}
+
+/**
+ * Wait for, and then process, an attempt by a client to initiate a connection
+ * to cqpserver via TCP/IP.
+ *
+ * Note that this function may or may not fork the cqpserver process.
+ *
+ * If forking happens, then the child handles the connection, whereas the parent carries
+ * on waiting for further connections.
+ *
+ * On Windows, forking never happens (since Windows doesn't support it).
+ *
+ * On *nix, forking happens UNLESS the global private_server is true. (Actually, if
+ * private_server is true, then forking still happens, but the parent process immeidately
+ * exits.)
+ *
+ * In pool mode (server_workers > 0), the worker processes are forked when the socket
+ * is opened on the first call. Each worker then handles its connections itself, and
+ * calls this function again after close_connection() to wait for the next client.
+ *
+ * TODO: a better name would be server_accept_connection or somesuch...
+ *
+ * @param port  The integer identifier of the port to listen on.
+ * @return      A > 0 value (actually the socket ID of the incoming connection)
+ *              if all is OK; otherwise -1.
+ */
+int 
+accept_connection(int port)
+{
+  socklen_t sin_size = sizeof(struct sockaddr_in);
+#ifndef __MINGW__
+  pid_t child_pid;
+#endif
+
+  if (port <= 0) {
+    port = CQI_PORT;
+  }
+
+  /* pool workers keep the listening socket open across connections */
+  if (!server_listening) {
+#ifdef __MINGW__
+    server_workers = 0;         /* no pool without fork() */
+#endif
+    if (private_server)
+      server_workers = 0;       /* pool mode makes no sense for a single connection */
+    if (0 != open_server_socket(port))
+      return -1;
+    server_listening = 1;
+  }
+
   while (42) {
     /* when run as a private server, we'll only wait for up to 10 seconds */
     if (private_server) {
@@ -299,6 +394,9 @@ accept_connection(int port)
     }
     
 #ifndef __MINGW__
+    if (server_workers > 0)
+      break;                    /* pool workers handle the connection themselves */
+
     /* spawn a server to handle the request */
     child_pid = fork();
     if (child_pid < 0) {
@@ -337,7 +435,8 @@ accept_connection(int port)
   /* this is the child serving the new CQi connection */
   if (server_debug) 
     fprintf(stderr, "CQi: ** new CQPserver created, initiating CQi session\n");
-  close(sockfd);
+  if (server_workers == 0)
+    close(sockfd);
 
   /* check if remote host is in validation list */
   if (!check_host(client_addr.sin_addr)) {
@@ -347,15 +446,7 @@ accept_connection(int port)
     exit(1);
   }
 
-#ifndef __MINGW__
-  /* create a buffered stream to the outgoing connection */
-  conn_out = fdopen(connfd, "w");
-  if (conn_out == NULL) {
-    perror("ERROR Can't switch CQi connection to buffered output");
-    close(connfd);
-    return -1;
-  }
-#endif
+  outbuf_fill = 0;
 
   if (server_debug) 
     fprintf(stderr, "CQi: creating attribute hash (size = %d)\n", ATTHASHSIZE);
@@ -364,6 +455,35 @@ accept_connection(int port)
   return connfd;
 }
 
+/**
+ * Ends the current CQi connection.
+ *
+ * A pool worker goes on to serve further clients, so the connection is closed and
+ * the per-connection state is discarded here; the attribute hash has to go as well,
+ * since it would bypass the access grants of the next user. In all other modes,
+ * the process exits after its connection, so nothing needs to be done.
+ *
+ * @return  Boolean: true if the calling process should accept another connection.
+ */
+int
+close_connection(void)
+{
+  if (server_workers <= 0)
+    return 0;
+
+#ifndef __MINGW__
+  if (server_debug)
+    fprintf(stderr, "CQi: closing connection, pool worker pid = %d waits for next client\n", (int)getpid());
+  close(connfd);
+#endif
+  outbuf_fill = 0;
+  cqi_deferred_flush = 0;
+  free_attribute_hash();
+  cqi_errno = CQI_STATUS_OK;
+  strcpy(cqi_error_string, "No error.");
+  return 1;
+}
+
 
 
 /* 
@@ -374,32 +494,56 @@ accept_connection(int port)
 
 /* communication primitives (no auto-flush; use cqi_flush()) */
 
+/**
+ * Writes the contents of the output buffer to the outgoing connection.
+ *
+ * @return  Boolean: true if everything OK, otherwise false.
+ */
+static int
+cqi_write_outbuf(void)
+{
+  int done = 0, n;
+
+  while (done < outbuf_fill) {
+#ifndef __MINGW__
+    n = write(connfd, outbuf + done, outbuf_fill - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+#else
+    n = send(connfd, (const char *)(outbuf + done), outbuf_fill - done, 0);
+#endif
+    if (n <= 0)
+      return 0;
+    done += n;
+  }
+  outbuf_fill = 0;
+  return 1;
+}
+
 /**
  * Flushes the stream from the CQP server to the client program,
  * emptying its buffer.
  *
- * Note that under windows, buffered output is not possible, so
- * this function does nothing.
+ * While cqi_deferred_flush is set, this function does nothing, so that the
+ * responses to all commands of a batch are sent together.
  *
  * @return  Boolean: true if everything OK, otherwise false.
  */
 int 
 cqi_flush(void)
 {
-#ifdef __MINGW__
-  return 1;
-#else
+  if (cqi_deferred_flush)
+    return 1;
   if (snoop) {
     fprintf(stderr, "CQi FLUSH\n");
   }
-  if (EOF == fflush(conn_out)) {
+  if (!cqi_write_outbuf()) {
     perror("ERROR cqi_flush()");
     return 0;
   }
   else {
     return 1;
   }
-#endif
 }
 
 /**
@@ -408,8 +552,8 @@ cqi_flush(void)
  * This function should be called via one of the cqi_data_* functions
  * and not on its own.
  *
- * This is the fundamental "sending" function, and the only one that calls the underlying
- * OS-specific file stream/socket functions.
+ * All sending functions append their data to the output buffer, which is
+ * written to the network when it is full or when cqi_flush() is called.
  *
  * @param n        The byte to send. NOTE that as the parameter is an int, numbers bigger than
  *                 0xff can be passed. BUT all content except the lowest-order 8-bits are discarded
@@ -420,29 +564,43 @@ cqi_flush(void)
 int 
 cqi_send_byte(int n, int nosnoop)
 {
-#ifdef __MINGW__
-  unsigned char prep;
-  prep = (unsigned char) 0xff & n;
-#endif
-
   if (snoop && !nosnoop) {
     fprintf(stderr, "CQi SEND BYTE   %02X        [= %d]\n", n, n);
   }
 
-  /* note that the actual sending is wrapped in an "if" whose content differs between OSes */
-  if (
-#ifndef __MINGW__
-      (EOF == putc(0xff & n, conn_out))
-#else
-      (1 != send(connfd, &prep, 1, MSG_WAITALL))
-#endif
-      )  {
+  if (outbuf_fill >= OUTBUFSIZE && !cqi_write_outbuf()) {
     perror("ERROR cqi_send_byte()");
     return 0;
   }
-  else {
-    return 1;
+  outbuf[outbuf_fill++] = 0xff & n;
+  return 1;
+}
+
+/**
+ * Sends a block of raw bytes to the client (without snooping).
+ *
+ * @param buf  pointer to the bytes to send.
+ * @param n    the number of bytes to send.
+ *
+ * @return  Boolean: true if everything OK, otherwise false.
+ */
+int
+cqi_send_bytes(cqi_byte *buf, int n)
+{
+  int chunk;
+
+  while (n > 0) {
+    if (outbuf_fill >= OUTBUFSIZE && !cqi_write_outbuf())
+      return 0;
+    chunk = OUTBUFSIZE - outbuf_fill;
+    if (chunk > n)
+      chunk = n;
+    memcpy(outbuf + outbuf_fill, buf, chunk);
+    outbuf_fill += chunk;
+    buf += chunk;
+    n -= chunk;
   }
+  return 1;
 }
 
 /**
@@ -490,20 +648,15 @@ cqi_send_int(int n)
   if (snoop) {
     fprintf(stderr, "CQi SEND INT    %08X  [= %d]\n", n, n);
   }
-  if (
-      /* exploit the fact that cqi_send_byte() only uses the lowest 8 bytes of its argument */
-      !(cqi_send_byte(n>>24, 1)) ||
-      !(cqi_send_byte(n>>16, 1)) ||
-      !(cqi_send_byte(n>>8, 1)) ||
-      !(cqi_send_byte(n, 1))
-      )
-    {
-      perror("ERROR cqi_send_int()");
-      return 0;
-    }
-  else {
-    return 1;
+  if (outbuf_fill + 4 > OUTBUFSIZE && !cqi_write_outbuf()) {
+    perror("ERROR cqi_send_int()");
+    return 0;
   }
+  outbuf[outbuf_fill++] = 0xff & (n >> 24);
+  outbuf[outbuf_fill++] = 0xff & (n >> 16);
+  outbuf[outbuf_fill++] = 0xff & (n >> 8);
+  outbuf[outbuf_fill++] = 0xff & n;
+  return 1;
 }
 
 
@@ -542,12 +695,9 @@ cqi_send_string(char *str)
   if (snoop) {
     fprintf(stderr, "CQi SEND CHAR[] '%s'\n", str);
  }
-  /* we can afford to mangle len and str because we're at the end of the function */
-  while (--len >= 0) {
-    if (!cqi_send_byte(*str++, 1)) {
-      perror("ERROR cqi_send_string()");
-      return 0;
-    }
+  if (!cqi_send_bytes((cqi_byte *)str, len)) {
+    perror("ERROR cqi_send_string()");
+    return 0;
   }
 
   return 1;
@@ -572,12 +722,18 @@ cqi_send_byte_list(cqi_byte *list, int l)
     perror("ERROR cqi_send_byte_list()");
     return 0;
   }
-  while (--l >= 0) {
-    if (!cqi_send_byte(*list++, 0)) {
-      perror("ERROR cqi_send_byte_list()");
-      return 0;
+  if (snoop) {
+    while (--l >= 0) {
+      if (!cqi_send_byte(*list++, 0)) {
+        perror("ERROR cqi_send_byte_list()");
+        return 0;
+      }
     }
   }
+  else if (!cqi_send_bytes(list, l)) {
+    perror("ERROR cqi_send_byte_list()");
+    return 0;
+  }
   return 1;
 }
 
@@ -595,15 +751,45 @@ cqi_send_byte_list(cqi_byte *list, int l)
 int 
 cqi_send_int_list(int *list, int l)
 {
+  int i, n;
+  cqi_byte *p;
+
   if (!cqi_send_int(l)) {
     perror("ERROR cqi_send_int_list()");
     return 0;
   }
-  while (--l >= 0) {
-    if (!cqi_send_int(*list++)) {
-      perror("ERROR cqi_send_int_list()");
-      return 0;
+  if (snoop) {
+    while (--l >= 0) {
+      if (!cqi_send_int(*list++)) {
+        perror("ERROR cqi_send_int_list()");
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  /* convert as many integers as fit into the output buffer at once, then write it out */
+  while (l > 0) {
+    n = (OUTBUFSIZE - outbuf_fill) / 4;
+    if (n == 0) {
+      if (!cqi_write_outbuf()) {
+        perror("ERROR cqi_send_int_list()");
+        return 0;
+      }
+      continue;
+    }
+    if (n > l)
+      n = l;
+    p = outbuf + outbuf_fill;
+    for (i = 0; i < n; i++, p += 4) {
+      p[0] = 0xff & (list[i] >> 24);
+      p[1] = 0xff & (list[i] >> 16);
+      p[2] = 0xff & (list[i] >> 8);
+      p[3] = 0xff & list[i];
     }
+    outbuf_fill += 4 * n;
+    list += n;
+    l -= n;
   }
   return 1;
 }
@@ -799,18 +985,26 @@ cqi_data_int_int_int_int(int n1, int n2, int n3, int n4)
  */
 
 int 
-cqi_recv_bytes(cqi_byte *buf, int bytes)
+cqi_recv_bytes(cqi_byte *buf, size_t bytes)
 {
-  if (bytes <= 0) {
+  if (bytes == 0) {
     return 1;
   }
   else {
+    ssize_t n;
+
     if (snoop) {
-      fprintf(stderr, "CQi RECV BYTE[%d]\n", bytes);
+      fprintf(stderr, "CQi RECV BYTE[%lu]\n", (unsigned long)bytes);
     }
-    if (bytes != recv(connfd, buf, bytes, MSG_WAITALL)) {
-      perror("ERROR cqi_recv_bytes()");
-      return 0;
+    /* large blocks may arrive in several pieces even with MSG_WAITALL */
+    while (bytes > 0) {
+      n = recv(connfd, buf, bytes, MSG_WAITALL);
+      if (n <= 0) {
+        perror("ERROR cqi_recv_bytes()");
+        return 0;
+      }
+      buf += n;
+      bytes -= n;
     }
     return 1;
   }
@@ -959,9 +1153,26 @@ cqi_read_int_list(int **list)
     return 0;
   }
   else {
-    *list = (int *) cl_malloc(len * sizeof(int));
-    for (i=0; i<len; i++)
-      (*list)[i] = cqi_read_int();
+    cqi_byte *p;
+    size_t bytes;
+
+    /* compute the size of the list in size_t, since len * 4 overflows an int for len > 2^29 */
+    if ((size_t)len > SIZE_MAX / 4)
+      cqi_recv_error("cqi_read_int_list");
+    bytes = (size_t)len * 4;
+
+    *list = (int *) cl_malloc(bytes);
+    if (snoop) {
+      for (i=0; i<len; i++)
+        (*list)[i] = cqi_read_int();
+    }
+    else {
+      /* receive the entire list at once and convert it to host byte order in place */
+      if (!cqi_recv_bytes((cqi_byte *)*list, bytes))
+        cqi_recv_error("cqi_read_int_list");
+      for (i=0, p = (cqi_byte *)*list; i<len; i++, p += 4)
+        (*list)[i] = (int)(((unsigned)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]);
+    }
     if (snoop)
       fprintf(stderr, "CQi READ INT[%d]\n", len);
     return len;
@@ -1186,9 +1397,14 @@ make_attribute_hash(int size)
 void 
 free_attribute_hash(void)
 {
+  int i;
+
   if (AttHash != NULL) {
-    if (AttHash->space != NULL) 
+    if (AttHash->space != NULL) {
+      for (i = 0; i < AttHash->size; i++)
+        cl_free(AttHash->space[i].string);
       free(AttHash->space);
+    }
     free(AttHash);
     AttHash = NULL;
   }
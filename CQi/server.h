@@ -38,9 +38,17 @@ void cqi_general_error(char *errstring);
    port  ...  bind to this port; uses CQI_PORT if port==0 */
 int accept_connection(int port);
 
+/* closes the current connection; returns true if the process should accept
+   another one (i.e. if it is a worker of a server pool) */
+int close_connection(void);
+
 /* CQi network primitives (no auto-flush) */
+/* while this flag is set, cqi_flush() doesn't send anything (used for batches of commands) */
+extern int cqi_deferred_flush;
+
 int cqi_flush(void);
 int cqi_send_byte(int n, int nosnoop);
+int cqi_send_bytes(cqi_byte *buf, int n);
 int cqi_send_word(int n);
 int cqi_send_int(int n);
 int cqi_send_string(char *str);	/* NULL pointer sends "" */
@@ -62,7 +70,7 @@ void cqi_data_int_int(int n1, int n2);
 void cqi_data_int_int_int_int(int n1, int n2, int n3, int n4);
 
 /* receive data from client */
-int cqi_recv_bytes(cqi_byte *buf, int n); /* receive exactly n bytes */
+int cqi_recv_bytes(cqi_byte *buf, size_t n); /* receive exactly n bytes */
 int cqi_recv_byte(void);             /* receive 1 byte from client (returns EOF on error*/
 
 /* advanced functions which read chunks of data [exit on error] */
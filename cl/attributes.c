@@ -17,6 +17,7 @@
 
 #include <ctype.h>
 #include <sys/types.h>
+#include <glib.h>
 
 #include "globals.h"
 
@@ -27,6 +28,8 @@
 #include "cdaccess.h"
 #include "makecomps.h"
 #include "list.h"
+#include "regex-cache.h"
+#include "compression.h"
 
 #include "attributes.h"
 
@@ -66,6 +69,12 @@
  */
 #define CL_ENSURE_COMPONENT_KEEP_SILENT
 
+/**
+ * Serialises loading of components by ensure_component(), so that the CL data access
+ * functions can be called for the same attribute from several threads.
+ */
+static GRecMutex component_load_lock;
+
 
 
 /*******************************************************************/
@@ -83,6 +92,8 @@ typedef struct component_field_spec {
   int using_atts;        /**< The attribute type of the Attributes that use this component */
   char *default_path;    /**< The default location of the file corresponding to this component;
                               can contain variables ($DIR=directory, $ANAME=attribute name) */
+  int access;            /**< Typical access pattern for the component's data (one of the MEMBLOB_ACCESS_*
+                              constants), passed to the operating system when the file is memory-mapped */
 } component_field_spec;
 
 /**
@@ -92,32 +103,34 @@ typedef struct component_field_spec {
  */
 static struct component_field_spec Component_Field_Specs[] =
 { 
-  { CompDirectory,    "DIR",     ATT_ALL,    "$APATH"},
+  { CompDirectory,    "DIR",     ATT_ALL,    "$APATH",                                  MEMBLOB_ACCESS_NORMAL},
 
-  { CompCorpus,       "CORPUS",  ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.corpus"},
-  { CompRevCorpus,    "REVCORP", ATT_POS,    "$CORPUS.rev"},
-  { CompRevCorpusIdx, "REVCIDX", ATT_POS,    "$CORPUS.rdx"},
-  { CompCorpusFreqs,  "FREQS",   ATT_POS,    "$CORPUS.cnt"},
-  { CompLexicon,      "LEXICON", ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.lexicon"},
-  { CompLexiconIdx,   "LEXIDX",  ATT_POS,    "$LEXICON.idx"},
-  { CompLexiconSrt,   "LEXSRT",  ATT_POS,    "$LEXICON.srt"},
+  { CompCorpus,       "CORPUS",  ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.corpus",  MEMBLOB_ACCESS_NORMAL},
+  { CompRevCorpus,    "REVCORP", ATT_POS,    "$CORPUS.rev",                             MEMBLOB_ACCESS_NORMAL},
+  { CompRevCorpusIdx, "REVCIDX", ATT_POS,    "$CORPUS.rdx",                             MEMBLOB_ACCESS_RANDOM},
+  { CompCorpusFreqs,  "FREQS",   ATT_POS,    "$CORPUS.cnt",                             MEMBLOB_ACCESS_NORMAL},
+  { CompLexicon,      "LEXICON", ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.lexicon", MEMBLOB_ACCESS_NORMAL},
+  { CompLexiconIdx,   "LEXIDX",  ATT_POS,    "$LEXICON.idx",                            MEMBLOB_ACCESS_RANDOM},
+  { CompLexiconSrt,   "LEXSRT",  ATT_POS,    "$LEXICON.srt",                            MEMBLOB_ACCESS_RANDOM},
 
 
-  { CompAlignData,    "ALIGN",   ATT_ALIGN,  "$DIR" SUBDIR_SEP_STRING "$ANAME.alg"},
-  { CompXAlignData,   "XALIGN",  ATT_ALIGN,  "$DIR" SUBDIR_SEP_STRING "$ANAME.alx"},
+  { CompAlignData,    "ALIGN",   ATT_ALIGN,  "$DIR" SUBDIR_SEP_STRING "$ANAME.alg",     MEMBLOB_ACCESS_NORMAL},
+  { CompXAlignData,   "XALIGN",  ATT_ALIGN,  "$DIR" SUBDIR_SEP_STRING "$ANAME.alx",     MEMBLOB_ACCESS_NORMAL},
 
-  { CompStrucData,    "STRUC",   ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.rng"},
-  { CompStrucAVS,     "STRAVS",  ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.avs"},
-  { CompStrucAVX,     "STRAVX",  ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.avx"},
+  { CompStrucData,    "STRUC",   ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.rng",     MEMBLOB_ACCESS_NORMAL},
+  { CompStrucAVS,     "STRAVS",  ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.avs",     MEMBLOB_ACCESS_NORMAL},
+  { CompStrucAVX,     "STRAVX",  ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.avx",     MEMBLOB_ACCESS_NORMAL},
+  { CompStrucAVI,     "STRAVI",  ATT_STRUC,  "$DIR" SUBDIR_SEP_STRING "$ANAME.avi",     MEMBLOB_ACCESS_NORMAL},
 
-  { CompHuffSeq,      "CIS",     ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.huf"},
-  { CompHuffCodes,    "CISCODE", ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.hcd"},
-  { CompHuffSync,     "CISSYNC", ATT_POS,    "$CIS.syn"},
+  { CompHuffSeq,      "CIS",     ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.huf",     MEMBLOB_ACCESS_NORMAL},
+  { CompHuffCodes,    "CISCODE", ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.hcd",     MEMBLOB_ACCESS_NORMAL},
+  { CompHuffSync,     "CISSYNC", ATT_POS,    "$CIS.syn",                                MEMBLOB_ACCESS_NORMAL},
 
-  { CompCompRF,       "CRC",     ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.crc"},
-  { CompCompRFX,      "CRCIDX",  ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.crx"},
+  { CompCompRF,       "CRC",     ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.crc",     MEMBLOB_ACCESS_NORMAL},
+  { CompCompRFX,      "CRCIDX",  ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.crx",     MEMBLOB_ACCESS_RANDOM},
+  { CompCompRFSkip,   "CRCSKIP", ATT_POS,    "$DIR" SUBDIR_SEP_STRING "$ANAME.crs",     MEMBLOB_ACCESS_RANDOM},
 
-  { CompLast,         "INVALID", 0,          "INVALID"}
+  { CompLast,         "INVALID", 0,          "INVALID",                                 0}
 };
 
 
@@ -392,11 +405,15 @@ setup_attribute(Corpus *corpus,
 
     case ATT_POS:
       attr->pos.hc = NULL;
+      attr->pos.hd = NULL;
       attr->pos.this_block_nr = -1;
+      attr->pos.this_block = NULL;
+      attr->pos.block_cache = NULL;
       break;
 
     case ATT_STRUC:
       attr->struc.has_attribute_values = -1; /* not yet known */
+      attr->struc.has_value_index = -1;
       break;
 
     default:
@@ -485,6 +502,101 @@ drop_attribute(Corpus *corpus,
     return cl_delete_attribute(cl_new_attribute_oldstyle(corpus, attribute_name, type, data));
 }
 
+/**
+ * Creates the cache of decompressed blocks for a p-attribute with a
+ * Huffman-compressed item sequence.
+ *
+ * An existing cache is replaced if its size does not match the current
+ * value of cl_block_cache_size; hit and miss counts are carried over.
+ *
+ * @see              cl_set_block_cache_size
+ * @param attribute  The (positional) attribute.
+ * @return           The cache object (never NULL).
+ */
+BlockCache *
+block_cache_new(Attribute *attribute)
+{
+  static unsigned int serial = 0;
+  BlockCache *cache;
+  unsigned long hits = 0, misses = 0;
+  int i;
+
+  assert(attribute && attribute->type == ATT_POS);
+
+  if (attribute->pos.block_cache) {
+    hits = attribute->pos.block_cache->hits;
+    misses = attribute->pos.block_cache->misses;
+    block_cache_delete(attribute);
+  }
+
+  cache = new(BlockCache);
+  cache->serial = ++serial;
+  g_mutex_init(&cache->lock);
+  cache->n_slots = (cl_block_cache_size > 0) ? cl_block_cache_size : 1;
+  for (cache->n_buckets = 1; cache->n_buckets < 2 * cache->n_slots; cache->n_buckets <<= 1)
+    ;
+  cache->bucket   = (int *)cl_malloc(cache->n_buckets * sizeof(int));
+  cache->chain    = (int *)cl_malloc(cache->n_slots * sizeof(int));
+  cache->block_nr = (int *)cl_malloc(cache->n_slots * sizeof(int));
+  cache->newer    = (int *)cl_malloc(cache->n_slots * sizeof(int));
+  cache->older    = (int *)cl_malloc(cache->n_slots * sizeof(int));
+  cache->data     = (int *)cl_malloc(cache->n_slots * SYNCHRONIZATION * sizeof(int));
+
+  for (i = 0; i < cache->n_buckets; i++)
+    cache->bucket[i] = -1;
+  /* unused slots form an LRU chain 0 (newest) .. n_slots-1 (oldest), so they are filled first */
+  for (i = 0; i < cache->n_slots; i++) {
+    cache->chain[i] = -1;
+    cache->block_nr[i] = -1;
+    cache->newer[i] = i - 1;
+    cache->older[i] = (i + 1 < cache->n_slots) ? i + 1 : -1;
+  }
+  cache->newest = 0;
+  cache->oldest = cache->n_slots - 1;
+  cache->hits = hits;
+  cache->misses = misses;
+
+  g_atomic_pointer_set(&attribute->pos.block_cache, cache);   /* see get_shared_block_cache() */
+  attribute->pos.this_block_nr = -1;
+  attribute->pos.this_block = NULL;
+  return cache;
+}
+
+/**
+ * Deletes the cache of decompressed blocks of a p-attribute (if there is one).
+ *
+ * If cl_debug is set, the hit rate of the cache is reported on stderr.
+ *
+ * @param attribute  The (positional) attribute.
+ */
+void
+block_cache_delete(Attribute *attribute)
+{
+  BlockCache *cache;
+
+  assert(attribute && attribute->type == ATT_POS);
+
+  if ((cache = attribute->pos.block_cache) == NULL)
+    return;
+
+  if (cl_debug && (cache->hits + cache->misses) > 0)
+    fprintf(stderr, "CL: block cache for %s.%s: %lu hits, %lu blocks decompressed (%.1f%% hit rate)\n",
+            (attribute->any.mother) ? attribute->any.mother->registry_name : "?",
+            attribute->any.name, cache->hits, cache->misses,
+            100.0 * cache->hits / (cache->hits + cache->misses));
+
+  cl_free(cache->bucket);
+  cl_free(cache->chain);
+  cl_free(cache->block_nr);
+  cl_free(cache->newer);
+  cl_free(cache->older);
+  cl_free(cache->data);
+  g_mutex_clear(&cache->lock);
+  cl_free(attribute->pos.block_cache);
+  attribute->pos.this_block_nr = -1;
+  attribute->pos.this_block = NULL;
+}
+
 /**
  * Deletes the specified Attribute object.
  *
@@ -530,6 +642,10 @@ cl_delete_attribute(Attribute *attribute)
       }
     }
       
+    /* forget cached regex2id results, which are keyed by the attribute's address */
+    if (attribute->type == ATT_POS)
+      regex_cache_forget_attribute(attribute);
+
     /* get rid of components */
     for (cid = CompDirectory; cid < CompLast; cid++)
       if (attribute->any.components[cid]) {
@@ -545,7 +661,10 @@ cl_delete_attribute(Attribute *attribute)
     switch (attribute->type) {
 
     case ATT_POS:
+      huffman_decoder_delete(attribute->pos.hd);
+      attribute->pos.hd = NULL;
       cl_free(attribute->pos.hc);
+      block_cache_delete(attribute);
       break;
 
     case ATT_DYN:
@@ -678,7 +797,9 @@ comp_component_state(Component *comp)
 {
   assert(comp);
 
-  if (comp->data.data != NULL)
+  /* pairs with the atomic store in load_component(): once the data pointer is visible,
+   * so are the size of the component (and the HCD block of the attribute) */
+  if (g_atomic_pointer_get(&(comp->data.data)) != NULL)
     return ComponentLoaded;
   else if (comp->id == CompDirectory)
     return ComponentDefined;
@@ -847,6 +968,28 @@ component_full_name(Attribute *attribute, ComponentID cid, char *path)
 
 /* ---------------------------------------------------------------------- */
 
+/**
+ * Copies a freshly loaded MemBlob into a component, setting the data pointer last.
+ *
+ * The data pointer is written with an atomic store (a full memory barrier), so that
+ * a thread that finds it set in comp_component_state() also sees the other fields
+ * of the MemBlob and everything load_component() set up before.
+ *
+ * This is a non-exported function.
+ *
+ * @param comp  The component to fill in (its data pointer must still be NULL).
+ * @param blob  The MemBlob holding the loaded data.
+ */
+static void
+publish_component_data(Component *comp, MemBlob *blob)
+{
+  int *data = blob->data;
+
+  blob->data = NULL;
+  comp->data = *blob;
+  g_atomic_pointer_set(&(comp->data.data), data);
+}
+
 /**
  * Loads the specified component for this attribute.
  *
@@ -883,41 +1026,51 @@ load_component(Attribute *attribute, ComponentID cid)
   }
   else if (comp_component_state(comp) == ComponentUnloaded) {
 
+    /* The component is filled in through a local copy of the MemBlob, and the data pointer
+     * is published last: another thread calling ensure_component() without the lock sees the
+     * component as loaded as soon as comp->data.data is set, so comp->size and the HCD block
+     * must be in place by then. */
+    MemBlob blob;
+
     assert(comp->path != NULL);
+    init_mblob(&blob);
 
     if (cid == CompHuffCodes) {
 
       if (cl_sequence_compressed(attribute)) {
 
-        if (read_file_into_blob(comp->path, MMAPPED, sizeof(int), &(comp->data)) == 0)
+        if (read_file_into_blob(comp->path, MMAPPED, sizeof(int), &blob) == 0)
           fprintf(stderr, "attributes:load_component(): Warning:\n"
                   "  Data of %s component of attribute %s can't be loaded\n",
                   cid_name(cid), attribute->any.name);
         else {
-          
+          HCD *hc;
+
           if (attribute->pos.hc != NULL)
             fprintf(stderr, "attributes:load_component: WARNING:\n\t"
                     "HCD block already loaded, overwritten.\n");
           
-          attribute->pos.hc = new(HCD);
-          /* bcopy(comp->data.data, attribute->pos.hc, sizeof(HCD)); */
-          memcpy(attribute->pos.hc, comp->data.data, sizeof(HCD));
+          hc = new(HCD);
+          /* bcopy(blob.data, hc, sizeof(HCD)); */
+          memcpy(hc, blob.data, sizeof(HCD));
 
           { /* convert network byte order to native integers */
             int i;
-            attribute->pos.hc->size = ntohl(attribute->pos.hc->size);
-            attribute->pos.hc->length = ntohl(attribute->pos.hc->length);
-            attribute->pos.hc->min_codelen = ntohl(attribute->pos.hc->min_codelen);
-            attribute->pos.hc->max_codelen = ntohl(attribute->pos.hc->max_codelen);
+            hc->size = ntohl(hc->size);
+            hc->length = ntohl(hc->length);
+            hc->min_codelen = ntohl(hc->min_codelen);
+            hc->max_codelen = ntohl(hc->max_codelen);
             for (i = 0; i < MAXCODELEN; i++) {
-              attribute->pos.hc->lcount[i] = ntohl(attribute->pos.hc->lcount[i]);
-              attribute->pos.hc->symindex[i] = ntohl(attribute->pos.hc->symindex[i]);
-              attribute->pos.hc->min_code[i] = ntohl(attribute->pos.hc->min_code[i]);
+              hc->lcount[i] = ntohl(hc->lcount[i]);
+              hc->symindex[i] = ntohl(hc->symindex[i]);
+              hc->min_code[i] = ntohl(hc->min_code[i]);
             }
           }
-          attribute->pos.hc->symbols = comp->data.data + (4+3*MAXCODELEN);
-        
-          comp->size = attribute->pos.hc->length;
+          hc->symbols = blob.data + (4+3*MAXCODELEN);
+
+          attribute->pos.hc = hc;
+          comp->size = hc->length;
+          publish_component_data(comp, &blob);
           assert(comp_component_state(comp) == ComponentLoaded);
         }
       }
@@ -930,12 +1083,15 @@ load_component(Attribute *attribute, ComponentID cid)
     else if ((cid > CompDirectory) && (cid < CompLast)) {
       /* i.e. any ComponentID value except CompDirectory / CompLast and CompHuffCodes */
 
-      if (read_file_into_blob(comp->path, MMAPPED, sizeof(int), &(comp->data)) == 0)
+      if (read_file_into_blob(comp->path, MMAPPED, sizeof(int), &blob) == 0)
         fprintf(stderr, "attributes:load_component(): Warning:\n"
                 "  Data of %s component of attribute %s can't be loaded\n",
                 cid_name(cid), attribute->any.name);
       else {
-        comp->size = comp->data.nr_items;
+        if (cl_access_hints)
+          memblob_advise(&blob, Component_Field_Specs[cid].access);
+        comp->size = blob.nr_items;
+        publish_component_data(comp, &blob);
         assert(comp_component_state(comp) == ComponentLoaded);
       }
     }
@@ -954,13 +1110,13 @@ load_component(Attribute *attribute, ComponentID cid)
  * Creates the specified component for the given Attribute.
  *
  * This function only works for the following components:
- * CompRevCorpus, CompRevCorpusIdx, CompLexiconSrt, CompCorpusFreqs.
+ * CompRevCorpus, CompRevCorpusIdx, CompLexiconSrt, CompCorpusFreqs, CompStrucAVI.
  * Also, it only works if the state of the component is
  * ComponentDefined.
  *
  * "Create" here means create the CWB data files.  This is accomplished by
  * calling one of the "creat_*" functions, of which there is one for each
- * of the four available component types. These are defined in makecomps.c.
+ * of the five available component types. These are defined in makecomps.c.
  *
  * Each of these functions reads in the data it needs, processes it, and then
  * writes a new file.
@@ -1017,6 +1173,7 @@ create_component(Attribute *attribute, ComponentID cid)
       
     case CompCompRF:
     case CompCompRFX:
+    case CompCompRFSkip:
       fprintf(stderr, "attributes:create_component(): Warning:\n"
               "  Can't create the '%s' component. Use 'compress-rdx' to create it"
               " out of the reversed file index\n",
@@ -1040,6 +1197,10 @@ create_component(Attribute *attribute, ComponentID cid)
       creat_freqs(comp);
       break;
 
+    case CompStrucAVI:
+      creat_struc_value_index(comp);
+      break;
+
     case CompAlignData:
     case CompXAlignData:
     case CompStrucData:
@@ -1116,7 +1277,11 @@ ensure_component(Attribute *attribute, ComponentID cid, int try_creation)
       break;
 
     case ComponentUnloaded:
-      (void) load_component(attribute, cid); /* try to load the component */
+      /* several threads may try to load the same component at once */
+      g_rec_mutex_lock(&component_load_lock);
+      if (comp_component_state(comp) != ComponentLoaded)
+        (void) load_component(attribute, cid); /* try to load the component */
+      g_rec_mutex_unlock(&component_load_lock);
       if (comp_component_state(comp) != ComponentLoaded) {
 #ifndef CL_ENSURE_COMPONENT_KEEP_SILENT
         fprintf(stderr, "attributes:ensure_component(): Warning:\n"
@@ -1205,6 +1370,107 @@ find_component(Attribute *attribute, ComponentID cid)
   return attribute->any.components[cid];
 }
 
+/**
+ * Reads all data files of an attribute into memory ahead of use.
+ *
+ * This loads every component that the CL access functions use for the
+ * attribute (e.g. only the compressed item sequence if there is one, not
+ * the uncompressed .corpus file as well) and pages in its data, so that
+ * subsequent queries don't wait for the disk.  It is meant as a warmup step
+ * for a freshly started CQP or CQPserver.
+ *
+ * @param attribute  The attribute to prefetch.
+ * @return           The number of components that were prefetched, or a
+ *                   negative error code if one of them could not be loaded.
+ */
+int
+cl_prefetch_attribute(Attribute *attribute)
+{
+  ComponentID cid;
+  ComponentState state;
+  Component *comp;
+  int seq_compressed = 0, idx_compressed = 0, extended_alg = 0, n = 0;
+
+  if (attribute == NULL) {
+    cl_errno = CDA_ENULLATT;
+    return CDA_ENULLATT;
+  }
+
+  if (attribute->any.type == ATT_POS) {
+    seq_compressed = cl_sequence_compressed(attribute);
+    idx_compressed = cl_index_compressed(attribute);
+  }
+  else if (attribute->any.type == ATT_ALIGN)
+    extended_alg = (component_state(attribute, CompXAlignData) == ComponentUnloaded ||
+                    component_state(attribute, CompXAlignData) == ComponentLoaded);
+
+  for (cid = CompDirectory + 1; cid < CompLast; cid++) {
+    /* skip the alternative representations that the access functions won't use */
+    if (seq_compressed ? (cid == CompCorpus) : (cid == CompHuffSeq || cid == CompHuffCodes || cid == CompHuffSync))
+      continue;
+    if (idx_compressed ? (cid == CompRevCorpus || cid == CompRevCorpusIdx)
+                       : (cid == CompCompRF || cid == CompCompRFX || cid == CompCompRFSkip))
+      continue;
+    if (extended_alg && cid == CompAlignData)
+      continue;
+
+    state = component_state(attribute, cid);
+    if (state != ComponentUnloaded && state != ComponentLoaded)
+      continue;
+    if ((comp = ensure_component(attribute, cid, 0)) == NULL) {
+      cl_errno = CDA_ENODATA;
+      return CDA_ENODATA;
+    }
+    memblob_prefetch(&(comp->data));
+    n++;
+  }
+
+  cl_errno = CDA_OK;
+  return n;
+}
+
+/**
+ * Tells the CL that the token stream of an attribute is about to be read front to back.
+ *
+ * The item sequence of a p-attribute is loaded without an access hint, since
+ * most lookups (e.g. for concordance lines, sort keys or group) go to
+ * scattered corpus positions.  Programs that scan the entire corpus can
+ * switch on sequential readahead for the duration of the scan with this
+ * function, and must switch it off again afterwards, so that the pages they
+ * have read aren't dropped ahead of later random lookups.  It has no effect
+ * if access hints have been disabled with cl_set_access_hints().
+ *
+ * @param attribute  The p-attribute to be scanned.
+ * @param state      1 before the scan, 0 after it.
+ * @return           CDA_OK, or a negative error code if the item sequence
+ *                   could not be loaded.
+ */
+int
+cl_sequential_access(Attribute *attribute, int state)
+{
+  Component *comp;
+
+  if (attribute == NULL) {
+    cl_errno = CDA_ENULLATT;
+    return CDA_ENULLATT;
+  }
+  if (attribute->any.type != ATT_POS) {
+    cl_errno = CDA_EATTTYPE;
+    return CDA_EATTTYPE;
+  }
+
+  comp = ensure_component(attribute, cl_sequence_compressed(attribute) ? CompHuffSeq : CompCorpus, 0);
+  if (comp == NULL) {
+    cl_errno = CDA_ENODATA;
+    return CDA_ENODATA;
+  }
+  if (cl_access_hints)
+    memblob_advise(&(comp->data), state ? MEMBLOB_ACCESS_SEQUENTIAL : MEMBLOB_ACCESS_NORMAL);
+
+  cl_errno = CDA_OK;
+  return CDA_OK;
+}
+
 /* ---------------------------------------------------------------------- */
 
 /**
@@ -1230,9 +1496,15 @@ comp_drop_component(Component *comp)
 
     /* it may be empty, since declare_component doesn't yet load the data */
 
+    huffman_decoder_delete(comp->attribute->pos.hd);
+    comp->attribute->pos.hd = NULL;
     cl_free(comp->attribute->pos.hc);
   }
 
+  /* decompressed blocks are no longer valid when the compressed item sequence goes away */
+  if (comp->id == CompHuffSeq || comp->id == CompHuffCodes || comp->id == CompHuffSync)
+    block_cache_delete(comp->attribute);
+
   mfree(&(comp->data));
   cl_free(comp->path);
   comp->corpus = NULL;
@@ -18,6 +18,8 @@
 #ifndef __attributes_h
 #define __attributes_h
 
+#include <glib.h>
+
 #include "globals.h"
 
 #include "storage.h"                /* gets sys/types.h, so we don't need it here */
@@ -106,6 +108,7 @@ typedef enum wattr_components {
   CompStrucData,                /**< structure data */
   CompStrucAVS,                 /**< structure attribute values */
   CompStrucAVX,                 /**< structure attribute value index */
+  CompStrucAVI,                 /**< index of distinct structure attribute values (optional) */
 
   /* compressed components involving Huffman coding (for a positional attribute) */
   CompHuffSeq,                  /**< Huffman compressed item sequence */
@@ -115,6 +118,7 @@ typedef enum wattr_components {
   /* compressed components for the reversed-index (for a positional attribute) */
   CompCompRF,                   /**< compressed reversed file (CompRevCorpus) */
   CompCompRFX,                  /**< index for CompCompRF (substitute for CompRevCorpusIdx) */
+  CompCompRFSkip,               /**< skip pointers into CompCompRF (optional) */
 
   CompLast                      /**< MUST BE THE LAST ELEMENT OF THIS ENUM
                                      -- it is used for limiting loops on component arrays
@@ -187,17 +191,49 @@ typedef struct {
   COMMON_ATTR_FIELDS;
 } Any_Attribute;
 
+/**
+ * The BlockCache object: an LRU cache of decompressed blocks of a
+ * Huffman-compressed item sequence.
+ *
+ * Each slot holds one block of SYNCHRONIZATION items. Slots are found
+ * through a small hash on the block number and are chained into a doubly
+ * linked list ordered by the time of last access, so that the least recently
+ * used block is the one that gets evicted.
+ *
+ * While cl_threads > 1, each thread decompresses blocks into a few slots of
+ * its own and only takes the cache's lock to copy blocks in or out of it.
+ */
+typedef struct _BlockCache {
+  int n_slots;                      /**< number of blocks the cache can hold */
+  int n_buckets;                    /**< size of the hash table (a power of 2) */
+  int *bucket;                      /**< hash table: first slot in each bucket (-1 = empty) */
+  int *chain;                       /**< next slot in the same hash bucket (-1 = end of chain) */
+  int *block_nr;                    /**< block number held by each slot (-1 = unused slot) */
+  int *newer;                       /**< LRU list: next more recently used slot (-1 = none) */
+  int *older;                       /**< LRU list: next less recently used slot (-1 = none) */
+  int newest;                       /**< most recently used slot */
+  int oldest;                       /**< least recently used slot (evicted next) */
+  int *data;                        /**< the decompressed blocks (n_slots * SYNCHRONIZATION items) */
+  unsigned long hits;               /**< number of block requests served from the cache */
+  unsigned long misses;             /**< number of block requests that had to decompress the block */
+  unsigned int serial;              /**< unique number of this cache (identifies the attribute in per-thread block slots) */
+  GMutex lock;                      /**< protects the cache while cl_threads > 1 */
+} BlockCache;
+
 typedef struct {
   COMMON_ATTR_FIELDS;
   HCD *hc;                          /**< positional attribute may have a huffman code descriptor block */
-  int this_block_nr;                /**< number of the current decompression block */
-  int this_block[SYNCHRONIZATION];  /**< the decompression block proper */
+  struct _huffman_decoder *hd;      /**< lookup tables for decoding hc (built on first access) */
+  int this_block_nr;                /**< number of the most recently used decompression block */
+  int *this_block;                  /**< the most recently used decompression block (points into block_cache) */
+  BlockCache *block_cache;          /**< LRU cache of decompressed blocks (allocated on first access) */
 } POS_Attribute;
 
 typedef struct {
   COMMON_ATTR_FIELDS;
   int has_attribute_values;         /**< boolean: whether or not instances of this s-attribute can have values
                                          @see structure_has_values */
+  int has_value_index;              /**< boolean: whether a valid value index (CompStrucAVI) is available (-1 = not yet known) */
 } Struc_Attribute;
 
 typedef struct {
@@ -256,6 +292,10 @@ int drop_attribute(Corpus *corpus,
                    int type,
                    char *data);  /* depends on type, either char* or int*, but ***UNUSED*** */
 
+BlockCache *block_cache_new(Attribute *attribute);
+
+void block_cache_delete(Attribute *attribute);
+
 
 
 /* ======================================== COMPONENT FUNCTIONS */
@@ -20,6 +20,7 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <errno.h>
+#include <glib.h>
 
 #include "globals.h"
 
@@ -30,6 +31,8 @@
 #include "bitio.h"
 #include "compression.h"
 #include "regopt.h"
+#include "regex-cache.h"
+#include "makecomps.h"
 
 #include "cdaccess.h"
 
@@ -41,8 +44,21 @@
 
 /**
  * Error number for CL: is set after access to any of various corpus-data-access functions.
+ *
+ * This is a thread-local variable (with GCC-compatible compilers), so that errors in one
+ * thread don't show up in another.
  */
+#if defined(__GNUC__)
+__thread int cl_errno = CDA_OK;
+#else
 int cl_errno = CDA_OK;
+#endif
+
+/**
+ * Protects the creation of block caches and Huffman decoders of compressed item sequences
+ * while cl_threads > 1, i.e. when CL functions may be called from several threads at once.
+ */
+static GMutex block_cache_lock;
 
 
 
@@ -724,24 +740,49 @@ cl_id2cpos_oldstyle(Attribute *attribute, int id, int *freq, int *restrictor_lis
 
   if (cl_index_compressed(attribute)) {
 
-    BStream bs;
-    unsigned int i, b, last_pos, gap, offset, ins_ptr, res_ptr;
+    GolombReader gr;
+    Component *revcskip;
+    int *skips = NULL;
+    int i, b, last_pos, gap, ins_ptr, res_ptr, start;
+    unsigned int offset;
+    int skip_interval = 0, n_skips = 0, next_skip = 0, lo, hi, mid;
 
     revcorp = ensure_component(attribute, CompCompRF, 0);
     revcidx = ensure_component(attribute, CompCompRFX, 0);
 
     if (revcorp == NULL || revcidx == NULL) {
       cl_errno = CDA_ENODATA;
+      cl_free(buffer);
       *freq = 0;
       return NULL;
     }
 
+    /* With a restrictor list, the optional skip table written by cwb-compress-rdx
+     * lets us jump over the parts of the posting list that precede each range.
+     * Layout: skip interval N, (number of types + 1) offsets of each type's entries
+     * (in ints from the start of the file), then the entries proper: for postings
+     * number N, 2N, 3N, ... of each type, a pair (cpos of the preceding posting,
+     * bit offset of the posting's code from the start of the type's posting list). */
+    if (restrictor_list && restrictor_list_size > 0) {
+      ComponentState state = component_state(attribute, CompCompRFSkip);
+      if ((state == ComponentLoaded || state == ComponentUnloaded) &&
+          (revcskip = ensure_component(attribute, CompCompRFSkip, 0)) != NULL &&
+          revcskip->size >= range + 2) {
+        int first = ntohl(revcskip->data.data[1 + id]);
+        int last  = ntohl(revcskip->data.data[2 + id]);
+        if (first <= last && last <= revcskip->size && ((last - first) % 2) == 0) {
+          skip_interval = ntohl(revcskip->data.data[0]);
+          skips = revcskip->data.data + first;
+          n_skips = (skip_interval > 0) ? (last - first) / 2 : 0;
+        }
+      }
+    }
+
     b = compute_ba(*freq, size);
 
     offset = ntohl(revcidx->data.data[id]); /* byte offset in RFC */
 
-    BSopen((unsigned char *)revcorp->data.data, "r", &bs);
-    BSseek(&bs, offset);
+    golomb_reader_init(&gr, (unsigned char *)revcorp->data.data, revcorp->data.size, (size_t)offset * 8, b);
 
     last_pos = 0;
     ins_ptr = 0;
@@ -749,12 +790,44 @@ cl_id2cpos_oldstyle(Attribute *attribute, int id, int *freq, int *restrictor_lis
 
     for (i = 0; i < *freq; i++) {
 
-      gap = read_golomb_code_bs(b, &bs);
-      last_pos += gap;
+      if (restrictor_list && restrictor_list_size > 0) {
+
+        /* when the end of the restrictor list is reached, we are done */
+        if (res_ptr >= restrictor_list_size)
+          break;
+
+        /* skip entry k describes posting (k+1) * N; forget the ones we have passed */
+        while (next_skip < n_skips && (next_skip + 1) * skip_interval <= i)
+          next_skip++;
+
+        start = restrictor_list[res_ptr * 2];
+        if (next_skip < n_skips && (int)ntohl(skips[2 * next_skip]) < start) {
+          /* find the last skip entry whose preceding posting is still before the range */
+          lo = next_skip;
+          hi = n_skips - 1;
+          while (lo < hi) {
+            mid = (lo + hi + 1) / 2;
+            if ((int)ntohl(skips[2 * mid]) < start)
+              lo = mid;
+            else
+              hi = mid - 1;
+          }
+          i = (lo + 1) * skip_interval;
+          last_pos = ntohl(skips[2 * lo]);
+          golomb_reader_init(&gr, (unsigned char *)revcorp->data.data, revcorp->data.size,
+                             (size_t)offset * 8 + (unsigned int)ntohl(skips[2 * lo + 1]), b);
+          next_skip = lo + 1;
+        }
+      }
 
-      /* when the end of the restrictor list is reached, we can
-           also leave the for loop above -- TODO
-           */
+      gap = golomb_reader_read(&gr);
+      if (gap < 0) {
+        cl_errno = CDA_EINTERNAL;
+        cl_free(buffer);
+        *freq = 0;
+        return NULL;
+      }
+      last_pos += gap;
 
       if (restrictor_list && restrictor_list_size > 0) {
         while (res_ptr < restrictor_list_size &&
@@ -774,8 +847,6 @@ cl_id2cpos_oldstyle(Attribute *attribute, int id, int *freq, int *restrictor_lis
       }
     }
 
-    BSclose(&bs);
-
     /* reduce, if possible */
 
     if (ins_ptr < *freq && ins_ptr != *freq) {
@@ -885,8 +956,8 @@ typedef struct _position_stream_rec_ {
 
   int is_compressed;            /**< Boolean: attribute REVCORP is compressed? */
 
-  /** for compressed streams, the stream is a BStream object rather than just a pointer. */
-  BStream bs;
+  /** for compressed streams, the stream is a GolombReader object rather than just a pointer. */
+  GolombReader gr;
   int b;                        /**< relevent for compressed streams */
   int last_pos;                 /**< relevent for compressed streams */
 
@@ -948,7 +1019,7 @@ cl_new_stream(Attribute *attribute,
 
   if (cl_index_compressed(attribute)) {
 
-    int offset;
+    unsigned int offset;
 
     ps->is_compressed = 1;
 
@@ -965,8 +1036,7 @@ cl_new_stream(Attribute *attribute,
 
     offset = ntohl(revcidx->data.data[id]); /* byte offset in RFC */
 
-    BSopen((unsigned char *)revcorp->data.data, "r", &(ps->bs));
-    BSseek(&(ps->bs), offset);
+    golomb_reader_init(&(ps->gr), (unsigned char *)revcorp->data.data, revcorp->data.size, (size_t)offset * 8, ps->b);
 
     ps->last_pos = 0;
 
@@ -1006,7 +1076,6 @@ cl_delete_stream(PositionStream *ps)
   (*ps)->is_compressed = 0;
 
   if ((*ps)->is_compressed) {
-    BSclose(&((*ps)->bs));
     (*ps)->b = 0;
     (*ps)->last_pos = 0;
   }
@@ -1063,7 +1132,11 @@ cl_read_stream(PositionStream ps,
 
     for (i = 0; i < items_to_read; i++,ps->nr_items++) {
 
-      gap = read_golomb_code_bs(ps->b, &(ps->bs));
+      gap = golomb_reader_read(&(ps->gr));
+      if (gap < 0) {
+        cl_errno = CDA_EINTERNAL;
+        return i;
+      }
       ps->last_pos += gap;
 
       *buffer = ps->last_pos;
@@ -1097,10 +1170,291 @@ cl_read_stream(PositionStream ps,
 
 
 
+/**
+ * Decompresses one block of a Huffman-compressed item sequence.
+ *
+ * @param attribute  The P-attribute (its Huffman code descriptor must be loaded).
+ * @param cis        The compressed item sequence component.
+ * @param cis_sync   The synchronisation component (offsets of the blocks).
+ * @param block      Number of the block to decompress.
+ * @param dest       Buffer for the decompressed items (at least SYNCHRONIZATION items).
+ * @return           Number of items decompressed (less than SYNCHRONIZATION only for
+ *                   the last block of the corpus), or a negative error code.
+ */
+static int
+decompress_block(Attribute *attribute, Component *cis, Component *cis_sync, int block, int *dest)
+{
+  unsigned int offset, max;
+
+  /* is the block we read the last block of the corpus? Then, we
+   * cannot read SYNC items, but only as much as there are left. */
+  max = attribute->pos.hc->length - block * SYNCHRONIZATION;
+  if (max > SYNCHRONIZATION)
+    max = SYNCHRONIZATION;
+
+  offset = ntohl(cis_sync->data.data[block]);
+
+  if (COMPRESS_DEBUG > 1)
+    fprintf(stderr, "-> Block %d, offset %d\n", block, offset);
+
+  if (attribute->pos.hd == NULL)
+    attribute->pos.hd = huffman_decoder_new(attribute->pos.hc, 1);
+
+  if (huffman_decode_block(attribute->pos.hd, (unsigned char *)cis->data.data, cis->data.size,
+                           offset, dest, max, NULL) < 0) {
+    fprintf(stderr, "cdaccess:decompressed read: Read error\n");
+    return CDA_ENODATA;
+  }
+
+  return max;
+}
+
+/**
+ * Finds a block in the block cache.
+ *
+ * @return  The slot holding the block, or -1 if it is not in the cache.
+ */
+static int
+block_cache_find(BlockCache *cache, int block)
+{
+  int slot;
+
+  for (slot = cache->bucket[block & (cache->n_buckets - 1)]; slot >= 0; slot = cache->chain[slot])
+    if (cache->block_nr[slot] == block)
+      return slot;
+  return -1;
+}
+
+/**
+ * Moves a slot of the block cache to the front of the LRU list.
+ */
+static void
+block_cache_touch(BlockCache *cache, int slot)
+{
+  int newer, older;
+
+  if (cache->newest == slot)
+    return;
+
+  /* unlink the slot (it has a newer neighbour, since it isn't the newest slot) */
+  newer = cache->newer[slot];
+  older = cache->older[slot];
+  cache->older[newer] = older;
+  if (older >= 0)
+    cache->newer[older] = newer;
+  else
+    cache->oldest = newer;
+
+  /* and insert it at the front */
+  cache->newer[slot] = -1;
+  cache->older[slot] = cache->newest;
+  cache->newer[cache->newest] = slot;
+  cache->newest = slot;
+}
+
+/**
+ * Removes the least recently used block from the block cache.
+ *
+ * @return  The slot that has been freed (it is still the least recently used slot).
+ */
+static int
+block_cache_evict(BlockCache *cache)
+{
+  int slot = cache->oldest, *p;
+
+  if (cache->block_nr[slot] >= 0) {
+    for (p = &cache->bucket[cache->block_nr[slot] & (cache->n_buckets - 1)]; *p != slot; p = &cache->chain[*p])
+      assert(*p >= 0);
+    *p = cache->chain[slot];
+    cache->block_nr[slot] = -1;
+  }
+  return slot;
+}
+
+/**
+ * Enters a block into a free slot of the block cache (see block_cache_evict()).
+ */
+static void
+block_cache_link(BlockCache *cache, int slot, int block)
+{
+  int h = block & (cache->n_buckets - 1);
+
+  cache->chain[slot] = cache->bucket[h];
+  cache->bucket[h] = slot;
+  cache->block_nr[slot] = block;
+}
+
+/**
+ * Gets a decompressed block of a Huffman-compressed item sequence.
+ *
+ * The block is taken from the attribute's block cache if possible; otherwise
+ * it is decompressed into the least recently used slot of the cache. The block
+ * also becomes the attribute's current block (pos.this_block_nr / pos.this_block).
+ *
+ * The returned pointer is valid until the next access to the item sequence.
+ *
+ * @return  Pointer to the decompressed items, or NULL on error (cl_errno is set).
+ */
+static int *
+get_decompressed_block(Attribute *attribute, Component *cis, Component *cis_sync, int block)
+{
+  BlockCache *cache = attribute->pos.block_cache;
+  int slot;
+  int *data;
+
+  if (cache == NULL || cache->n_slots != cl_block_cache_size)
+    cache = block_cache_new(attribute);
+
+  if ((slot = block_cache_find(cache, block)) >= 0) {
+    if (COMPRESS_DEBUG > 0)
+      fprintf(stderr, "Block hit: block %d in slot %d\n", block, slot);
+    cache->hits++;
+  }
+  else {
+    if (COMPRESS_DEBUG > 0)
+      fprintf(stderr, "Block miss: have %d, want %d\n", attribute->pos.this_block_nr, block);
+    cache->misses++;
+
+    slot = block_cache_evict(cache);
+    data = cache->data + slot * SYNCHRONIZATION;
+    if (decompress_block(attribute, cis, cis_sync, block, data) < 0) {
+      attribute->pos.this_block_nr = -1;
+      cl_errno = CDA_ENODATA;
+      return NULL;
+    }
+    block_cache_link(cache, slot, block);
+  }
+
+  block_cache_touch(cache, slot);
+  attribute->pos.this_block_nr = block;
+  attribute->pos.this_block = cache->data + slot * SYNCHRONIZATION;
+  return attribute->pos.this_block;
+}
+
+/** Number of decompressed blocks that each thread keeps for itself while cl_threads > 1 */
+#define THREAD_BLOCK_SLOTS 16
+
+/**
+ * The decompressed blocks of one thread (see get_thread_block()).
+ */
+typedef struct {
+  Attribute *attribute[THREAD_BLOCK_SLOTS];  /**< p-attribute of the block in each slot */
+  unsigned int serial[THREAD_BLOCK_SLOTS];   /**< serial number of its block cache (in case the memory of a deleted attribute is re-used) */
+  int block_nr[THREAD_BLOCK_SLOTS];          /**< block number in each slot (-1 = unused slot) */
+  int last;                                  /**< the slot that was used last (checked first) */
+  int next;                                  /**< the slot that is re-used next (round robin) */
+  int data[THREAD_BLOCK_SLOTS * SYNCHRONIZATION]; /**< the decompressed blocks */
+} ThreadBlocks;
+
+/** The ThreadBlocks of the calling thread (allocated on first use, freed when the thread exits) */
+static GPrivate thread_blocks = G_PRIVATE_INIT(free);
+
+/**
+ * Gets the block cache of a compressed p-attribute for use by several threads,
+ * creating it and the Huffman decoder if necessary (while cl_threads > 1).
+ *
+ * Unlike get_decompressed_block(), this doesn't replace a cache whose size doesn't
+ * match cl_block_cache_size, since other threads may be using it.
+ */
+static BlockCache *
+get_shared_block_cache(Attribute *attribute)
+{
+  BlockCache *cache = (BlockCache *) g_atomic_pointer_get(&attribute->pos.block_cache);
+
+  if (cache == NULL || g_atomic_pointer_get(&attribute->pos.hd) == NULL) {
+    g_mutex_lock(&block_cache_lock);
+    if (attribute->pos.hd == NULL)
+      g_atomic_pointer_set(&attribute->pos.hd, huffman_decoder_new(attribute->pos.hc, 1));
+    if ((cache = attribute->pos.block_cache) == NULL)
+      cache = block_cache_new(attribute);
+    g_mutex_unlock(&block_cache_lock);
+  }
+  return cache;
+}
+
+/**
+ * Gets a decompressed block of a Huffman-compressed item sequence while cl_threads > 1.
+ *
+ * Each thread keeps the blocks it has used last in slots of its own, so threads don't
+ * have to wait for each other while they read or decompress blocks.  Other blocks are
+ * copied from the attribute's block cache if possible; otherwise they are decompressed
+ * and a copy is entered into the block cache.  The cache is only locked while a block
+ * is looked up or copied.  Blocks found in the thread's own slots are not counted as
+ * hits of the block cache.
+ *
+ * The returned pointer is valid until the thread's next call to this function.
+ *
+ * @return  Pointer to the decompressed items, or NULL on error (cl_errno is set).
+ */
+static int *
+get_thread_block(Attribute *attribute, Component *cis, Component *cis_sync, int block)
+{
+  ThreadBlocks *tb = (ThreadBlocks *) g_private_get(&thread_blocks);
+  BlockCache *cache = get_shared_block_cache(attribute);
+  int slot, cached, *data;
+
+  if (tb == NULL) {
+    tb = (ThreadBlocks *) cl_calloc(1, sizeof(ThreadBlocks));
+    for (slot = 0; slot < THREAD_BLOCK_SLOTS; slot++)
+      tb->block_nr[slot] = -1;
+    g_private_set(&thread_blocks, tb);
+  }
+
+  slot = tb->last;
+  if (tb->block_nr[slot] == block && tb->attribute[slot] == attribute && tb->serial[slot] == cache->serial)
+    return tb->data + slot * SYNCHRONIZATION;
+  for (slot = 0; slot < THREAD_BLOCK_SLOTS; slot++)
+    if (tb->block_nr[slot] == block && tb->attribute[slot] == attribute && tb->serial[slot] == cache->serial) {
+      tb->last = slot;
+      return tb->data + slot * SYNCHRONIZATION;
+    }
+
+  slot = tb->next;
+  tb->next = (slot + 1) % THREAD_BLOCK_SLOTS;
+  tb->block_nr[slot] = -1;
+  data = tb->data + slot * SYNCHRONIZATION;
+
+  g_mutex_lock(&cache->lock);
+  if ((cached = block_cache_find(cache, block)) >= 0) {
+    memcpy(data, cache->data + cached * SYNCHRONIZATION, SYNCHRONIZATION * sizeof(int));
+    block_cache_touch(cache, cached);
+    cache->hits++;
+  }
+  g_mutex_unlock(&cache->lock);
+
+  if (cached < 0) {
+    if (decompress_block(attribute, cis, cis_sync, block, data) < 0) {
+      cl_errno = CDA_ENODATA;
+      return NULL;
+    }
+    g_mutex_lock(&cache->lock);
+    cache->misses++;
+    if (block_cache_find(cache, block) < 0) {   /* unless another thread has entered it in the meantime */
+      cached = block_cache_evict(cache);
+      if (attribute->pos.this_block == cache->data + cached * SYNCHRONIZATION)
+        attribute->pos.this_block_nr = -1;    /* for single-threaded access later on */
+      memcpy(cache->data + cached * SYNCHRONIZATION, data, SYNCHRONIZATION * sizeof(int));
+      block_cache_link(cache, cached, block);
+      block_cache_touch(cache, cached);
+    }
+    g_mutex_unlock(&cache->lock);
+  }
+
+  tb->attribute[slot] = attribute;
+  tb->serial[slot] = cache->serial;
+  tb->block_nr[slot] = block;
+  tb->last = slot;
+  return data;
+}
+
 /**
  * Gets the integer ID of the item at the specified
  * position on the given p-attribute.
  *
+ * On attributes with a Huffman-compressed item sequence, decompressed
+ * blocks are kept in a per-attribute LRU cache (see cl_set_block_cache_size()).
+ * Use cl_cpos2id_range() or cl_cpos2id_list() to look up many positions at once.
+ *
  * @param attribute  The P-attribute to look on.
  * @param position   The corpus position to look at.
  * @return           The id of the item at that position
@@ -1119,11 +1473,7 @@ cl_cpos2id(Attribute *attribute, int position)
     Component *cis;
     Component *cis_sync;
     Component *cis_map;
-    BStream bs;
-
-    unsigned char bit;
-    int item;
-    unsigned int block, rest, offset, max, v, l, i;
+    unsigned int block, rest;
 
     if (COMPRESS_DEBUG > 1)
       fprintf(stderr, "Accessing position %d of %s via compressed item sequence\n",
@@ -1139,89 +1489,242 @@ cl_cpos2id(Attribute *attribute, int position)
     }
 
     if ((position >= 0) && (position < attribute->pos.hc->length)) {
+      int *data;
 
       block = position / SYNCHRONIZATION;
       rest  = position % SYNCHRONIZATION;
+      assert(rest < SYNCHRONIZATION);
+
+      if (cl_threads > 1) {
+        if ((data = get_thread_block(attribute, cis, cis_sync, block)) == NULL)
+          return cl_errno;
+      }
+      else if (attribute->pos.this_block_nr == block) {
+        /* fast path: same block as last time */
+        attribute->pos.block_cache->hits++;
+        data = attribute->pos.this_block;
+      }
+      else if ((data = get_decompressed_block(attribute, cis, cis_sync, block)) == NULL)
+        return cl_errno;
+
+      cl_errno = CDA_OK;         /* hi 'Oli' ! */
+      return data[rest];
+    }
+    else {
+      cl_errno = CDA_EPOSORNG;
+      return CDA_EPOSORNG;
+    }
+  }
+  else {
 
-      if (attribute->pos.this_block_nr != block) {
+    corpus = ensure_component(attribute, CompCorpus, 0);
 
-        /* the current block in the decompression buffer is not the
-         * block we need. So we read the proper block into the buffer
-         * and hope that we'll get a cache hit next time. */
+    if (corpus == NULL) {
+      cl_errno = CDA_ENODATA;
+      return CDA_ENODATA;
+    }
 
-        if (COMPRESS_DEBUG > 0)
-          fprintf(stderr, "Block miss: have %d, want %d\n",
-                  attribute->pos.this_block_nr, block);
+    if ((position >= 0) && (position < corpus->size)) {
+      cl_errno = CDA_OK;
+      return ntohl(corpus->data.data[position]);
+    }
+    else {
+      cl_errno = CDA_EPOSORNG;
+      return CDA_EPOSORNG;
+    }
+  }
 
-        /* is the block we read the last block of the corpus? Then, we
-         * cannot read SYNC items, but only as much as there are left.
-         * */
+  assert("Not reached" && 0);
+  return 0;
+}
 
-        max = attribute->pos.hc->length - block * SYNCHRONIZATION;
-        if (max > SYNCHRONIZATION)
-          max = SYNCHRONIZATION;
+/**
+ * Gets the integer IDs of the items in a range of corpus positions.
+ *
+ * On a compressed item sequence, each block in the range is decompressed
+ * only once; blocks that lie entirely within the range are decompressed
+ * straight into the result buffer unless they are already cached.
+ *
+ * @param attribute  The P-attribute to look on.
+ * @param start      First corpus position of the range.
+ * @param end        Last corpus position of the range (inclusive).
+ * @param ids        Buffer for the item IDs; must have room for end - start + 1 integers.
+ * @return           CDA_OK, or a negative error code (the contents of ids are then undefined).
+ */
+int
+cl_cpos2id_range(Attribute *attribute, int start, int end, int *ids)
+{
+  Component *corpus;
+  int cpos, size;
 
+  check_arg(attribute, ATT_POS, cl_errno);
 
-        attribute->pos.this_block_nr = block;
+  size = cl_max_cpos(attribute);
+  if (size < 0)
+    return cl_errno;
+  if (start < 0 || end >= size || start > end) {
+    cl_errno = CDA_EPOSORNG;
+    return CDA_EPOSORNG;
+  }
 
+  if (item_sequence_is_compressed(attribute) == 1) {
 
-        offset = ntohl(cis_sync->data.data[block]);
+    Component *cis      = ensure_component(attribute, CompHuffSeq, 0);
+    Component *cis_sync = ensure_component(attribute, CompHuffSync, 0);
+    BlockCache *cache;
+    int block, rest, n, *data;
+    int status = CDA_OK, threaded = (cl_threads > 1);
 
-        if (COMPRESS_DEBUG > 1)
-          fprintf(stderr, "-> Block %d, rest %d, offset %d\n",
-                  block, rest, offset);
+    if ((cis == NULL) || (cis_sync == NULL) || (attribute->pos.hc == NULL)) {
+      cl_errno = CDA_ENODATA;
+      return CDA_ENODATA;
+    }
 
-        BSopen((unsigned char *)cis->data.data, "r", &bs);
-        BSseek(&bs, offset);
+    if (threaded)
+      (void) get_shared_block_cache(attribute);
+    for (cpos = start; (cpos <= end) && (status == CDA_OK); cpos += n) {
+      block = cpos / SYNCHRONIZATION;
+      rest  = cpos % SYNCHRONIZATION;
+      n = SYNCHRONIZATION - rest;
+      if (n > end - cpos + 1)
+        n = end - cpos + 1;
+
+      cache = attribute->pos.block_cache;
+      if (n == SYNCHRONIZATION && threaded) {
+        /* full block: decompress it straight into the result (without looking at the shared cache) */
+        if (decompress_block(attribute, cis, cis_sync, block, ids + (cpos - start)) < 0)
+          status = CDA_ENODATA;
+      }
+      else if (n == SYNCHRONIZATION && cache && cache->n_slots == cl_block_cache_size
+               && block_cache_find(cache, block) < 0) {
+        /* full block that isn't cached: don't bother to put it in the cache */
+        cache->misses++;
+        if (decompress_block(attribute, cis, cis_sync, block, ids + (cpos - start)) < 0)
+          status = CDA_ENODATA;
+      }
+      else {
+        data = (threaded) ? get_thread_block(attribute, cis, cis_sync, block)
+                          : get_decompressed_block(attribute, cis, cis_sync, block);
+        if (data == NULL)
+          status = cl_errno;
+        else
+          memcpy(ids + (cpos - start), data + rest, n * sizeof(int));
+      }
+    }
 
-        for (i = 0; i < max; i++) {
+    if (status != CDA_OK) {
+      cl_errno = status;
+      return status;
+    }
+  }
+  else {
 
-          if (!BSread(&bit, 1, &bs)) {
-            fprintf(stderr, "cdaccess:decompressed read: Read error/1\n");
-            cl_errno = CDA_ENODATA;
-            return cl_errno;
-          }
+    corpus = ensure_component(attribute, CompCorpus, 0);
 
-          v = (bit ? 1 : 0);
-          l = 1;
+    if (corpus == NULL) {
+      cl_errno = CDA_ENODATA;
+      return CDA_ENODATA;
+    }
 
-          while (v < attribute->pos.hc->min_code[l]) {
+    for (cpos = start; cpos <= end; cpos++)
+      ids[cpos - start] = ntohl(corpus->data.data[cpos]);
+  }
 
-            if (!BSread(&bit, 1, &bs)) {
-              fprintf(stderr, "cdaccess:decompressed read: Read error/2\n");
-              cl_errno = CDA_ENODATA;
-              return cl_errno;
-            }
+  cl_errno = CDA_OK;
+  return CDA_OK;
+}
 
-            v <<= 1;
-            if (bit)
-              v++;
-            l++;
-          }
+/** An element of a cpos list, remembering its index in the list (for sorting in cl_cpos2id_list()). */
+typedef struct {
+  int cpos;
+  int index;
+} IndexedCpos;
 
-          /* we now have the item - store it in the decompression block */
+/** qsort() callback for sorting IndexedCpos objects by corpus position. */
+static int
+compare_indexed_cpos(const void *a, const void *b)
+{
+  int x = ((IndexedCpos *)a)->cpos, y = ((IndexedCpos *)b)->cpos;
+  return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
 
-          item = ntohl(attribute->pos.hc->symbols[attribute->pos.hc->symindex[l] + v -
-                                                 attribute->pos.hc->min_code[l]]);
+/**
+ * Gets the integer IDs of the items at a list of corpus positions.
+ *
+ * On a compressed item sequence, each block that is needed is decompressed
+ * only once, even if the list is not sorted.
+ *
+ * @param attribute  The P-attribute to look on.
+ * @param cposlist   List of corpus positions (in any order).
+ * @param length     Number of elements in cposlist.
+ * @param ids        Buffer for the item IDs; must have room for length integers.
+ *                   Positions that are out of range yield CDA_EPOSORNG.
+ * @return           CDA_OK; CDA_EPOSORNG if some of the positions were out of range;
+ *                   or another negative error code (the contents of ids are then undefined).
+ */
+int
+cl_cpos2id_list(Attribute *attribute, int *cposlist, int length, int *ids)
+{
+  Component *corpus;
+  int i, size, sorted, result = CDA_OK;
 
-          attribute->pos.this_block[i] = item;
-        }
+  check_arg(attribute, ATT_POS, cl_errno);
 
-        BSclose(&bs);
+  size = cl_max_cpos(attribute);
+  if (size < 0)
+    return cl_errno;
 
-      }
-      else if (COMPRESS_DEBUG > 0)
-        fprintf(stderr, "Block hit: block[%d,%d]\n", block, rest);
+  if (item_sequence_is_compressed(attribute) == 1) {
 
-      assert(rest < SYNCHRONIZATION);
+    Component *cis      = ensure_component(attribute, CompHuffSeq, 0);
+    Component *cis_sync = ensure_component(attribute, CompHuffSync, 0);
+    IndexedCpos *order = NULL;
+    int j, cpos, block, *data = NULL;
+    int threaded = (cl_threads > 1), failed = 0;
 
-      cl_errno = CDA_OK;         /* hi 'Oli' ! */
-      return attribute->pos.this_block[rest];
+    if ((cis == NULL) || (cis_sync == NULL) || (attribute->pos.hc == NULL)) {
+      cl_errno = CDA_ENODATA;
+      return CDA_ENODATA;
     }
-    else {
-      cl_errno = CDA_EPOSORNG;
-      return CDA_EPOSORNG;
+
+    sorted = 1;
+    for (i = 1; i < length && sorted; i++)
+      if (cposlist[i] < cposlist[i-1])
+        sorted = 0;
+
+    if (!sorted) {
+      order = (IndexedCpos *)cl_malloc(length * sizeof(IndexedCpos));
+      for (i = 0; i < length; i++) {
+        order[i].cpos = cposlist[i];
+        order[i].index = i;
+      }
+      qsort(order, length, sizeof(IndexedCpos), compare_indexed_cpos);
+    }
+
+    block = -1;
+    for (i = 0; i < length; i++) {
+      j = (order) ? order[i].index : i;
+      cpos = cposlist[j];
+      if (cpos < 0 || cpos >= size) {
+        ids[j] = CDA_EPOSORNG;
+        result = CDA_EPOSORNG;
+        continue;
+      }
+      if (cpos / SYNCHRONIZATION != block) {
+        block = cpos / SYNCHRONIZATION;
+        data = (threaded) ? get_thread_block(attribute, cis, cis_sync, block)
+                          : get_decompressed_block(attribute, cis, cis_sync, block);
+        if (data == NULL) {
+          failed = 1;
+          break;
+        }
+      }
+      ids[j] = data[cpos % SYNCHRONIZATION];
     }
+
+    cl_free(order);
+    if (failed)
+      return cl_errno;
   }
   else {
 
@@ -1232,18 +1735,44 @@ cl_cpos2id(Attribute *attribute, int position)
       return CDA_ENODATA;
     }
 
-    if ((position >= 0) && (position < corpus->size)) {
-      cl_errno = CDA_OK;
-      return ntohl(corpus->data.data[position]);
-    }
-    else {
-      cl_errno = CDA_EPOSORNG;
-      return CDA_EPOSORNG;
+    for (i = 0; i < length; i++) {
+      if (cposlist[i] < 0 || cposlist[i] >= size) {
+        ids[i] = CDA_EPOSORNG;
+        result = CDA_EPOSORNG;
+      }
+      else
+        ids[i] = ntohl(corpus->data.data[cposlist[i]]);
     }
   }
 
-  assert("Not reached" && 0);
-  return 0;
+  cl_errno = result;
+  return result;
+}
+
+/**
+ * Gets the hit statistics of the block cache of a compressed p-attribute.
+ *
+ * A "hit" is a request for a block that was found in the cache; a "miss"
+ * is a request that had to decompress the block.  While cl_threads > 1,
+ * requests for blocks that a thread holds in its own slots are not counted.
+ *
+ * @see              cl_set_block_cache_size
+ * @param attribute  The P-attribute.
+ * @param hits       The number of cache hits is written here.
+ * @param misses     The number of cache misses is written here.
+ * @return           Boolean: true if the attribute has a block cache, false otherwise
+ *                   (i.e. it is not compressed, or has not been accessed yet).
+ */
+int
+cl_block_cache_stats(Attribute *attribute, unsigned long *hits, unsigned long *misses)
+{
+  *hits = *misses = 0;
+  check_arg(attribute, ATT_POS, 0);
+  if (attribute->pos.block_cache == NULL)
+    return 0;
+  *hits = attribute->pos.block_cache->hits;
+  *misses = attribute->pos.block_cache->misses;
+  return 1;
 }
 
 
@@ -1314,30 +1843,95 @@ cl_id2all(Attribute *attribute, int index, int *freq, int *slen)
 
 
 /**
- * Gets a list of the ids of those items on a given Attribute that
- * match a particular regular-expression pattern.
+ * Minimum number of lexicon entries handled by each thread in a parallel
+ * lexicon scan; smaller lexicons are always scanned by a single thread.
+ */
+#define REGEX2ID_MIN_SHARD_SIZE 32768
+
+/**
+ * Data for one shard of a (possibly parallel) lexicon scan in cl_regex2id().
+ */
+typedef struct {
+  CL_Regex rx;                  /**< regex object used by this shard (a private clone in a worker thread) */
+  int *lexidx_data;             /**< the lexicon index (network byte order) */
+  char *lex_data;               /**< the lexicon strings */
+  int first;                    /**< first lexicon ID in this shard (always a multiple of 8) */
+  int last;                     /**< lexicon ID after the end of this shard */
+  unsigned char *bitmap;        /**< the shared result bitmap: one bit per lexicon item */
+  int match_count;              /**< number of matching IDs in this shard */
+} Regex2IdShard;
+
+/**
+ * Matches the lexicon entries in one shard against the shard's regex, setting the
+ * corresponding bits in the result bitmap.
  *
- * The pattern is interpreted internally with the CL regex engine, q.v.
+ * Since each shard starts on a byte boundary of the bitmap, parallel threads never
+ * write to the same byte.
  *
- * The function returns a pointer to a sequence of ints of size number_of_matches. The list
- * is allocated with malloc(), so do a cl_free() when you don't need it any more.
+ * This function has the signature of a GThreadFunc so that it can be run in a worker thread.
  *
- * @see cl_new_regex
- * @param attribute          The p-attribute to look on.
- * @param pattern            String containing the pattern against which to match each item on the attribute.
- *                           Note: this pattern is a regular expression, but it is passed as a string, not
- *                           a CL_Regex object. The CL_Regex object is created internally.
- * @param flags              Flags for the regular expression system via cl_new_regex.
- * @param number_of_matches  This is set to the number of item ids found, i.e. the size of the returned buffer.
- * @return                   A pointer to the list of item ids.
+ * @param data  Pointer to a Regex2IdShard object.
+ * @return      Always NULL.
  */
-int *
-cl_regex2id(Attribute *attribute, char *pattern, int flags, int *number_of_matches)
+static gpointer
+regex2id_scan_shard(gpointer data)
 {
-  Component *lexidx;
-  Component *lex;
-  int *lexidx_data;
-  char *lex_data;
+  Regex2IdShard *shard = (Regex2IdShard *) data;
+  int idx;
+  int bitmap_offset = shard->first / 8;   /* current bitmap offset (in bytes) */
+  unsigned char bitmap_mask = 0x80;       /* current bitmap offset (within-byte part, as bit mask) */
+  char *word;
+
+  shard->match_count = 0;
+  for (idx = shard->first; idx < shard->last; idx++) {
+    word = shard->lex_data + ntohl(shard->lexidx_data[idx]);
+
+    if (cl_regex_match(shard->rx, word, 0)) {    /* regex match */
+      shard->bitmap[bitmap_offset] |= bitmap_mask; /* set bit */
+      shard->match_count++;
+    }
+
+    bitmap_mask >>= 1;
+    if (bitmap_mask == 0) {
+      bitmap_offset++;
+      bitmap_mask = 0x80;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Gets a list of the ids of those items on a given Attribute that
+ * match a particular regular-expression pattern.
+ *
+ * The pattern is interpreted internally with the CL regex engine, q.v.
+ *
+ * If more than one thread has been enabled with cl_set_threads(), a large lexicon
+ * is split into ID ranges which are matched in parallel, each thread using its own
+ * clone of the regex object.
+ *
+ * If the regex cache has been enabled with cl_set_regex_cache_size(), the result
+ * of a previous call with the same attribute, pattern and flags is returned without
+ * scanning the lexicon again.
+ *
+ * The function returns a pointer to a sequence of ints of size number_of_matches. The list
+ * is allocated with malloc(), so do a cl_free() when you don't need it any more.
+ *
+ * @see cl_new_regex
+ * @param attribute          The p-attribute to look on.
+ * @param pattern            String containing the pattern against which to match each item on the attribute.
+ *                           Note: this pattern is a regular expression, but it is passed as a string, not
+ *                           a CL_Regex object. The CL_Regex object is created internally.
+ * @param flags              Flags for the regular expression system via cl_new_regex.
+ * @param number_of_matches  This is set to the number of item ids found, i.e. the size of the returned buffer.
+ * @return                   A pointer to the list of item ids.
+ */
+int *
+cl_regex2id(Attribute *attribute, char *pattern, int flags, int *number_of_matches)
+{
+  Component *lexidx;
+  Component *lex;
 
   int *table;                   /* list of matching IDs */
   int match_count;              /* count matches in local variable while scanning */
@@ -1349,12 +1943,15 @@ cl_regex2id(Attribute *attribute, char *pattern, int flags, int *number_of_match
   int bitmap_offset;            /* current bitmap offset (in bytes) */
   unsigned char bitmap_mask;    /* current bitmap offset (within-byte part, as bit mask) */
   /* TODO might move bitmap to static variable and re-allocate only when necessary ... */
-  
-  int regex_result, idx, i, len, lexsize;
-  int optimised, grain_match;
+
+  int idx, i, lexsize;
+  int optimised;
+
+  Regex2IdShard shards[CL_MAX_THREADS];
+  GThread *workers[CL_MAX_THREADS];
+  int n_shards, shard_size;
 
   CL_Regex rx;
-  char *word, *preprocessed_string;
 
   check_arg(attribute, ATT_POS, NULL);
 
@@ -1366,9 +1963,12 @@ cl_regex2id(Attribute *attribute, char *pattern, int flags, int *number_of_match
     return NULL;
   }
   
+  if (regex_cache_lookup(attribute, pattern, flags, &table, number_of_matches)) {
+    cl_errno = CDA_OK;
+    return table;
+  }
+
   lexsize = lexidx->size;
-  lexidx_data = (int *) lexidx->data.data;
-  lex_data = (char *) lex->data.data;
   match_count = 0;
 
   rx = cl_new_regex(pattern, flags, attribute->pos.mother->charset);
@@ -1382,43 +1982,44 @@ cl_regex2id(Attribute *attribute, char *pattern, int flags, int *number_of_match
   /* allocate bitmap for matching IDs */
   bitmap_size = (lexsize + 7) / 8;  /* this is the exact number of bytes needed, I hope */
   bitmap = (unsigned char *) cl_calloc(bitmap_size, sizeof(unsigned char)); /* initialise: no bits set */
-  bitmap_offset = 0;
-  bitmap_mask = 0x80;           /* start with MSB of first byte */
 
   cl_regopt_count_reset();      /* report how often we have a grain match when using optimised search */
 
-  /* for each index in the lexicon... */
-  for (idx = 0; idx < lexsize; idx++) {
-    int off_start, off_end;     /* start and end offset of current lexicon entry */
-    char *p;
-    int i;
-
-    /* compute start offset and length of current lexicon entry from lexidx, if possible)
-     *  -- no longer necessary because we can't pass len to cl_regex_match
-     *  -- although 'twould be a good optimisation if possible to avoid calling strlen
-     *  -- pass in via a global variable cl_regopt_haystack_strlenin? */
-    off_start = ntohl(lexidx_data[idx]);
-    word = lex_data + off_start;
-    if (idx < lexsize-1) {
-      off_end = ntohl(lexidx_data[idx + 1]) - 1;
-      /* len = off_end - off_start; */
-    }
-    else {
-      /* len = strlen(word); */
-    }
-
-    if (cl_regex_match(rx, word, 0)) {    /* regex match */
-      bitmap[bitmap_offset] |= bitmap_mask; /* set bit */
-      match_count++;
-    }
-
-    bitmap_mask >>= 1;
-    if (bitmap_mask == 0) {
-      bitmap_offset++;
-      bitmap_mask = 0x80;
+  /* split the lexicon into byte-aligned shards of at least REGEX2ID_MIN_SHARD_SIZE items (one per thread) */
+  n_shards = lexsize / REGEX2ID_MIN_SHARD_SIZE;
+  if (n_shards > cl_threads)
+    n_shards = cl_threads;
+  if (n_shards < 1)
+    n_shards = 1;
+  shard_size = ((lexsize / n_shards + 7) / 8) * 8;
+
+  for (i = 0; i < n_shards; i++) {
+    shards[i].rx = (i == 0) ? rx : cl_regex_clone(rx);
+    shards[i].lexidx_data = (int *) lexidx->data.data;
+    shards[i].lex_data = (char *) lex->data.data;
+    shards[i].first = i * shard_size;
+    shards[i].last = (i == n_shards - 1) ? lexsize : (i + 1) * shard_size;
+    shards[i].bitmap = bitmap;
+  }
+
+  if (n_shards == 1)
+    regex2id_scan_shard(&shards[0]);
+  else {
+    /* the first shard is scanned by the calling thread while the others run in worker threads */
+    for (i = 1; i < n_shards; i++)
+      workers[i] = g_thread_new("cl_regex2id", regex2id_scan_shard, &shards[i]);
+    regex2id_scan_shard(&shards[0]);
+    for (i = 1; i < n_shards; i++) {
+      g_thread_join(workers[i]);
+      cl_regopt_successes += shards[i].rx->optimiser_rejects;
+      cl_delete_regex(shards[i].rx);
     }
+    if (cl_debug)
+      fprintf(stderr, "CL: lexicon of %d entries scanned by %d threads\n", lexsize, n_shards);
+  }
 
-  } /* endfor (loop across lexicon items) */
+  for (i = 0; i < n_shards; i++)
+    match_count += shards[i].match_count;
 
   if (cl_debug && optimised) 
     fprintf(stderr, "CL: regexp optimiser avoided calling regex engine for %d candidates out of %d strings\n"
@@ -1446,6 +2047,7 @@ cl_regex2id(Attribute *attribute, char *pattern, int flags, int *number_of_match
     assert((idx == match_count) && "cl_regex2id(): bitmap inconsistency");
   }
   *number_of_matches = match_count;
+  regex_cache_store(attribute, pattern, flags, table, match_count);
 
   cl_free(bitmap);
   cl_delete_regex(rx);
@@ -1497,14 +2099,62 @@ int cl_idlist2freq(Attribute *attribute,
   return 0;
 }
 
-/* this is the way qsort(..) is meant to be used: give it void * args
-   and cast them to the actual type in the compare function;
-   this definition conforms to ANSI and POSIX standards according to the LDP */
-/** internal function for use with qsort */
-static int intcompare(const void *i, const void *j)
-{ return(*(int *)i - *(int *)j); }
-/* this is used in the following function, thus why it's here. */
+/**
+ * Merges sorted lists of corpus positions into a single sorted list.
+ *
+ * This is a k-way merge with a binary heap of the lists' current heads,
+ * i.e. it takes O(total * log(n_lists)) steps.  Non-exported function.
+ *
+ * @param lists    The sorted lists (NULL entries are allowed if the length is 0).
+ * @param lengths  The number of positions in each list.
+ * @param n_lists  The number of lists.
+ * @param table    Output table with room for the total number of positions.
+ */
+static void
+merge_cpos_lists(int **lists, int *lengths, int n_lists, int *table)
+{
+  int *heap, *ptr;
+  int n_heap, k, i, child, tmp, out;
+
+  heap = (int *)cl_malloc((n_lists > 0 ? n_lists : 1) * sizeof(int));
+  ptr = (int *)cl_calloc((n_lists > 0 ? n_lists : 1), sizeof(int));
+
+  /* heap of the indices of all non-empty lists, ordered by their current head */
+  n_heap = 0;
+  for (k = 0; k < n_lists; k++) {
+    if (lengths[k] <= 0)
+      continue;
+    i = n_heap++;
+    while (i > 0 && lists[heap[(i - 1) / 2]][0] > lists[k][0]) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i] = k;
+  }
+
+  out = 0;
+  while (n_heap > 0) {
+    k = heap[0];
+    table[out++] = lists[k][ptr[k]++];
+    if (ptr[k] >= lengths[k])
+      k = heap[--n_heap];       /* list exhausted: sift down the last heap entry instead */
+    /* sift k down from the root */
+    i = 0;
+    while ((child = 2 * i + 1) < n_heap) {
+      if (child + 1 < n_heap && lists[heap[child + 1]][ptr[heap[child + 1]]] < lists[heap[child]][ptr[heap[child]]])
+        child++;
+      if (lists[heap[child]][ptr[heap[child]]] >= lists[k][ptr[k]])
+        break;
+      heap[i] = heap[child];
+      i = child;
+    }
+    if (n_heap > 0)
+      heap[i] = k;
+  }
 
+  cl_free(ptr);
+  cl_free(heap);
+}
 
 /**
  * Gets a list of corpus positions matching a list of ids.
@@ -1531,15 +2181,14 @@ static int intcompare(const void *i, const void *j)
  * parameters, which are not available through the "newstyle" function
  * cl_idlist2cpos() (which is currently just a macro to this).
  *
- * A note on the last two parameters, which are currently unused:
- * restrictor_list is a list of integer pairs [a,b] which means that
- * the returned value only contains positions which fall within at
- * least one of these intervals. The list must be sorted by the start
- * positions, and secondarily by b. restrictor_list_size is the number of
- * integers in this list, NOT THE NUMBER OF PAIRS.
- * WARNING: CURRENTLY UNIMPLEMENTED
- * {NB -- this description of restrictor_list_size DOESN'T MATCH
- * the one for get_positions(), which this function calls...
+ * A note on the last two parameters: restrictor_list is a list of
+ * integer pairs [a,b] which means that the returned value only contains
+ * positions which fall within at least one of these intervals (as for
+ * get_positions(), e.g. the ranges of a subcorpus). The list must be
+ * sorted by the start positions, and secondarily by b.
+ * restrictor_list_size is the number of PAIRS in this list. If a
+ * restrictor list is given, the returned list is always sorted, and
+ * size_of_table may be smaller than the total frequency of the ids.
  *
  * REMEMBER: this monster returns a list of corpus indices, not a list
  * of ids.
@@ -1592,6 +2241,46 @@ cl_idlist2cpos_oldstyle(Attribute *attribute,
 
   if (size > 0) {
 
+    if (sort || (restrictor_list && restrictor_list_size > 0)) {
+      /* the position list of each id is sorted (and restricted by get_positions(), which
+         can use the skip table of a compressed index), so a k-way merge gives the result */
+      int **lists = (int **)cl_calloc(number_of_words, sizeof(int *));
+      int *lengths = (int *)cl_calloc(number_of_words, sizeof(int));
+
+      size = 0;
+      for (k = 0; k < number_of_words; k++) {
+        word_id = word_ids[k];
+        if ((word_id < 0) || (word_id >= lexidx->size))
+          cl_errno = CDA_EIDORNG;
+        else
+          lists[k] = get_positions(attribute, word_id, &freq, restrictor_list, restrictor_list_size);
+        if (cl_errno != CDA_OK || freq < 0) {
+          for (p = 0; p <= k; p++)
+            cl_free(lists[p]);
+          cl_free(lists);
+          cl_free(lengths);
+          return NULL;
+        }
+        lengths[k] = (lists[k] != NULL) ? freq : 0;
+        size += lengths[k];
+      }
+
+      table = NULL;
+      if (size > 0) {
+        table = (int *)cl_malloc(size * sizeof(int));
+        merge_cpos_lists(lists, lengths, number_of_words, table);
+      }
+
+      for (k = 0; k < number_of_words; k++)
+        cl_free(lists[k]);
+      cl_free(lists);
+      cl_free(lengths);
+
+      *size_of_table = size;
+      cl_errno = CDA_OK;
+      return table;
+    }
+
     table = (int *)cl_malloc(size * sizeof(int));
 
     p = 0;
@@ -1622,9 +2311,6 @@ cl_idlist2cpos_oldstyle(Attribute *attribute,
       
     assert(p == size);
       
-    if (sort)
-      qsort(table, size, sizeof(int), intcompare);
-      
     *size_of_table = size;
     cl_errno = CDA_OK;
     return table;
@@ -2109,6 +2795,509 @@ structure_value_at_position(Attribute *struc, int position)
 }
 
 
+/**
+ * Gets the value index (CompStrucAVI) of an s-attribute, if it is available.
+ *
+ * The index is only used if the fingerprints of the .avs and .avx components recorded
+ * in its header (size, modification time and checksum) match the current files,
+ * since it might not have been rebuilt after the annotations were re-encoded.
+ * This is a non-exported function.
+ *
+ * @see write_struc_value_index
+ * @param attribute  An s-attribute.
+ * @return           Pointer to the data of the value index (in network byte order),
+ *                   or NULL if there is no (valid) value index.
+ */
+static int *
+get_struc_value_index(Attribute *attribute)
+{
+  Component *avi, *avs, *avx;
+  ComponentState state;
+  int n_values, n_regions, i;
+  int fingerprint[2 * FILE_FINGERPRINT_SIZE];
+
+  if (attribute->struc.has_value_index < 0) {
+    attribute->struc.has_value_index = 0;
+    state = component_state(attribute, CompStrucAVI);
+    if (cl_struc_values(attribute) && (state == ComponentLoaded || state == ComponentUnloaded)) {
+      avi = ensure_component(attribute, CompStrucAVI, 0);
+      avs = ensure_component(attribute, CompStrucAVS, 0);
+      avx = ensure_component(attribute, CompStrucAVX, 0);
+      if (avi && avs && avx && avi->size >= STRUC_VALUE_INDEX_HEADER) {
+        n_values = ntohl(avi->data.data[0]);
+        n_regions = ntohl(avi->data.data[1]);
+        if (n_values >= 0 && n_regions >= 0 &&
+            avi->size == STRUC_VALUE_INDEX_HEADER + 1 + 2 * (long) n_values + 2 * (long) n_regions &&
+            n_regions == avx->size / 2) {
+          file_fingerprint(avs->path, avs->data.data, avs->data.size, fingerprint);
+          file_fingerprint(avx->path, avx->data.data, avx->data.size, fingerprint + FILE_FINGERPRINT_SIZE);
+          for (i = 0; i < 2 * FILE_FINGERPRINT_SIZE; i++)
+            if (ntohl(avi->data.data[2 + i]) != fingerprint[i])
+              break;
+          if (i == 2 * FILE_FINGERPRINT_SIZE)
+            attribute->struc.has_value_index = 1;
+        }
+      }
+      if (!attribute->struc.has_value_index && cl_debug)
+        fprintf(stderr, "CL: value index of s-attribute %s is out of date (ignored)\n", attribute->any.name);
+    }
+  }
+
+  return (attribute->struc.has_value_index) ? find_component(attribute, CompStrucAVI)->data.data : NULL;
+}
+
+/**
+ * Gets the number of distinct annotation values of an s-attribute.
+ *
+ * Annotation values are identified by integer IDs from 0 to cl_max_struc_value() - 1,
+ * which are assigned in sort order.  This requires the optional value index
+ * (component STRAVI), which is created by cwb-makeall.
+ *
+ * @param attribute  An s-attribute with annotations.
+ * @return           The number of distinct values, or a negative error code (CDA_ENODATA
+ *                   if the s-attribute doesn't have a value index).
+ */
+int
+cl_max_struc_value(Attribute *attribute)
+{
+  int *avi;
+
+  check_arg(attribute, ATT_STRUC, cl_errno);
+
+  if ((avi = get_struc_value_index(attribute)) == NULL) {
+    cl_errno = CDA_ENODATA;
+    return cl_errno;
+  }
+  cl_errno = CDA_OK;
+  return ntohl(avi[0]);
+}
+
+/**
+ * Gets the annotation string of a value ID.
+ *
+ * @see cl_max_struc_value
+ * @param attribute  An s-attribute with annotations.
+ * @param value      The value ID.
+ * @return           The annotation string (which must not be freed), or NULL on error.
+ */
+char *
+cl_struc_value2str(Attribute *attribute, int value)
+{
+  int *avi;
+  Component *avs;
+
+  check_arg(attribute, ATT_STRUC, NULL);
+
+  if ((avi = get_struc_value_index(attribute)) == NULL) {
+    cl_errno = CDA_ENODATA;
+    return NULL;
+  }
+  if (value < 0 || value >= ntohl(avi[0])) {
+    cl_errno = CDA_EIDORNG;
+    return NULL;
+  }
+  avs = find_component(attribute, CompStrucAVS);
+  cl_errno = CDA_OK;
+  return (char *) avs->data.data + ntohl(avi[STRUC_VALUE_INDEX_HEADER + value]);
+}
+
+/**
+ * Looks up the value ID of an annotation string.
+ *
+ * @see cl_max_struc_value
+ * @param attribute  An s-attribute with annotations.
+ * @param str        The annotation string to look up.
+ * @return           The value ID, or a negative error code (CDA_EOTHER if
+ *                   no region has this annotation).
+ */
+int
+cl_str2struc_value(Attribute *attribute, char *str)
+{
+  int *avi;
+  char *values;
+  int low, high, mid, comp;
+
+  check_arg(attribute, ATT_STRUC, cl_errno);
+
+  if ((avi = get_struc_value_index(attribute)) == NULL) {
+    cl_errno = CDA_ENODATA;
+    return cl_errno;
+  }
+  values = (char *) find_component(attribute, CompStrucAVS)->data.data;
+
+  /* binary search in the sorted value lexicon */
+  low = 0;
+  high = ntohl(avi[0]) - 1;
+  while (low <= high) {
+    mid = (low + high) / 2;
+    comp = strcmp(str, values + ntohl(avi[STRUC_VALUE_INDEX_HEADER + mid]));
+    if (comp == 0) {
+      cl_errno = CDA_OK;
+      return mid;
+    }
+    else if (comp < 0)
+      high = mid - 1;
+    else
+      low = mid + 1;
+  }
+  cl_errno = CDA_EOTHER;
+  return cl_errno;
+}
+
+/**
+ * Gets the value ID of the annotation of a region.
+ *
+ * @see cl_max_struc_value
+ * @param attribute  An s-attribute with annotations.
+ * @param struc_num  Number of the region.
+ * @return           The value ID, or a negative error code.
+ */
+int
+cl_struc2value(Attribute *attribute, int struc_num)
+{
+  int *avi, n_values;
+
+  check_arg(attribute, ATT_STRUC, cl_errno);
+
+  if ((avi = get_struc_value_index(attribute)) == NULL) {
+    cl_errno = CDA_ENODATA;
+    return cl_errno;
+  }
+  if (struc_num < 0 || struc_num >= ntohl(avi[1])) {
+    cl_errno = CDA_EIDXORNG;
+    return cl_errno;
+  }
+  n_values = ntohl(avi[0]);
+  cl_errno = CDA_OK;
+  return ntohl(avi[STRUC_VALUE_INDEX_HEADER + n_values + struc_num]);
+}
+
+/**
+ * Gets the number of regions with a given annotation value.
+ *
+ * @see cl_max_struc_value
+ * @param attribute  An s-attribute with annotations.
+ * @param value      The value ID.
+ * @return           The number of regions, or a negative error code.
+ */
+int
+cl_struc_value2freq(Attribute *attribute, int value)
+{
+  int *avi, *start;
+
+  check_arg(attribute, ATT_STRUC, cl_errno);
+
+  if ((avi = get_struc_value_index(attribute)) == NULL) {
+    cl_errno = CDA_ENODATA;
+    return cl_errno;
+  }
+  if (value < 0 || value >= ntohl(avi[0])) {
+    cl_errno = CDA_EIDORNG;
+    return cl_errno;
+  }
+  start = avi + STRUC_VALUE_INDEX_HEADER + ntohl(avi[0]) + ntohl(avi[1]);
+  cl_errno = CDA_OK;
+  return ntohl(start[value + 1]) - ntohl(start[value]);
+}
+
+/**
+ * Gets all regions with a given annotation value.
+ *
+ * This is the s-attribute equivalent of cl_id2cpos(): the regions are read
+ * directly from the value index.
+ *
+ * @see cl_max_struc_value
+ * @param attribute  An s-attribute with annotations.
+ * @param value      The value ID.
+ * @param freq       The number of regions (i.e. the size of the returned
+ *                   list) is written to this location.
+ * @return           Pointer to a list of region numbers in ascending order, which
+ *                   must be freed by the caller; NULL on error (or if freq is 0).
+ */
+int *
+cl_struc_value2strucs(Attribute *attribute, int value, int *freq)
+{
+  int *avi, *start, *strucs, *result, n_values, n_regions, first, i;
+
+  *freq = 0;
+  check_arg(attribute, ATT_STRUC, NULL);
+
+  if ((avi = get_struc_value_index(attribute)) == NULL) {
+    cl_errno = CDA_ENODATA;
+    return NULL;
+  }
+  n_values = ntohl(avi[0]);
+  n_regions = ntohl(avi[1]);
+  if (value < 0 || value >= n_values) {
+    cl_errno = CDA_EIDORNG;
+    return NULL;
+  }
+  start = avi + STRUC_VALUE_INDEX_HEADER + n_values + n_regions;
+  strucs = start + n_values + 1;
+  first = ntohl(start[value]);
+  *freq = ntohl(start[value + 1]) - first;
+  cl_errno = CDA_OK;
+  if (*freq <= 0)
+    return NULL;
+
+  result = (int *) cl_malloc(*freq * sizeof(int));
+  for (i = 0; i < *freq; i++)
+    result[i] = ntohl(strucs[first + i]);
+  return result;
+}
+
+
+/* ---------------------------------------- incremental region lookup */
+
+/**
+ * Maximum number of regions a cl_struc_cursor steps over one by one before
+ * it falls back to a binary search (for large jumps in the corpus).
+ */
+#define STRUC_CURSOR_MAX_STEPS 8
+
+/**
+ * Underlying structure for the cl_struc_cursor object.
+ *
+ * The cursor remembers the first region whose end is at or after the current
+ * corpus position (i.e. the region containing that position, if any, or the
+ * next region to the right). Moving to a nearby position, in either direction,
+ * then only needs to look at a few adjacent regions.
+ */
+struct _cl_struc_cursor {
+  Attribute *attribute;   /**< The s-attribute on which this cursor has been opened. */
+  int *rng;               /**< Region boundaries from the STRUC component (network byte order). */
+  int n_regions;          /**< Number of regions of the s-attribute. */
+  int *avx;               /**< (region, offset) pairs from the STRUCAVX component, NULL if not annotated. */
+  int n_avx;              /**< Number of entries in avx. */
+  char *avs;              /**< Annotation strings from the STRUCAVS component. */
+  int avs_size;           /**< Size of avs in bytes. */
+  int cpos;               /**< Current corpus position. */
+  int next;               /**< First region whose end is >= cpos (may be == n_regions). */
+  int flags;              /**< STRUC_* flags for the current position, 0 if outside a region. */
+};
+
+/**
+ * Creates a new cl_struc_cursor object.
+ *
+ * The cursor is initially positioned before the start of the corpus.
+ *
+ * @param attribute  The s-attribute to open the cursor on.
+ * @return           The new object, or NULL in case of problem.
+ */
+cl_struc_cursor
+cl_new_struc_cursor(Attribute *attribute)
+{
+  Component *struc_data, *avs, *avx;
+  cl_struc_cursor sc;
+
+  check_arg(attribute, ATT_STRUC, NULL);
+
+  struc_data = ensure_component(attribute, CompStrucData, 0);
+  if (struc_data == NULL) {
+    cl_errno = CDA_ENODATA;
+    return NULL;
+  }
+
+  sc = new(struct _cl_struc_cursor);
+  sc->attribute = attribute;
+  sc->rng = struc_data->data.data;
+  sc->n_regions = struc_data->size / 2;
+  sc->avx = NULL;
+  sc->n_avx = 0;
+  sc->avs = NULL;
+  sc->avs_size = 0;
+  sc->cpos = -1;
+  sc->next = 0;
+  sc->flags = 0;
+
+  if (cl_struc_values(attribute)) {
+    avs = ensure_component(attribute, CompStrucAVS, 0);
+    avx = ensure_component(attribute, CompStrucAVX, 0);
+    if (avs == NULL || avx == NULL) {
+      cl_errno = CDA_ENODATA;
+      cl_free(sc);
+      return NULL;
+    }
+    sc->avx = avx->data.data;
+    sc->n_avx = avx->size / 2;
+    sc->avs = (char *)avs->data.data;
+    sc->avs_size = avs->data.size;
+  }
+
+  cl_errno = CDA_OK;
+  return sc;
+}
+
+/**
+ * Deletes a cl_struc_cursor object.
+ */
+void
+cl_delete_struc_cursor(cl_struc_cursor sc)
+{
+  cl_free(sc);
+}
+
+/**
+ * Finds the first region in the range [low, high) whose end is at or after cpos.
+ *
+ * This is a non-exported function.
+ *
+ * @return  Index of the region, or high if there is none.
+ */
+static int
+struc_cursor_bsearch(int *rng, int low, int high, int cpos)
+{
+  int mid;
+
+  while (low < high) {
+    mid = low + (high - low) / 2;
+    if ((int) ntohl(rng[2 * mid + 1]) < cpos)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low;
+}
+
+/**
+ * Moves a cl_struc_cursor to the specified corpus position.
+ *
+ * Moving to the next corpus position (or anywhere nearby) takes constant
+ * time, so a sequential scan of the corpus costs amortised O(1) per token.
+ * Large jumps, as well as moving backwards, are allowed, but may cost a
+ * binary search.
+ *
+ * @see STRUC_INSIDE
+ * @see STRUC_LBOUND
+ * @see STRUC_RBOUND
+ *
+ * @param sc    The cursor.
+ * @param cpos  The new corpus position.
+ * @return      Some combination of the STRUC_* flags if cpos is within a region
+ *              (with STRUC_LBOUND / STRUC_RBOUND indicating that a region
+ *              starts / ends here); 0 if cpos is outside all regions.
+ */
+int
+cl_struc_cursor_seek(cl_struc_cursor sc, int cpos)
+{
+  int *rng = sc->rng;
+  int n = sc->n_regions;
+  int next = sc->next;
+  int steps = 0;
+  int start, end;
+
+  if (cpos >= sc->cpos) {
+    while (next < n && (int) ntohl(rng[2 * next + 1]) < cpos) {
+      if (++steps > STRUC_CURSOR_MAX_STEPS) {
+        next = struc_cursor_bsearch(rng, next, n, cpos);
+        break;
+      }
+      next++;
+    }
+  }
+  else {
+    while (next > 0 && (int) ntohl(rng[2 * next - 1]) >= cpos) {
+      if (++steps > STRUC_CURSOR_MAX_STEPS) {
+        next = struc_cursor_bsearch(rng, 0, next, cpos);
+        break;
+      }
+      next--;
+    }
+  }
+
+  sc->cpos = cpos;
+  sc->next = next;
+  sc->flags = 0;
+  if (next < n) {
+    start = ntohl(rng[2 * next]);
+    if (start <= cpos) {
+      end = ntohl(rng[2 * next + 1]);
+      sc->flags = STRUC_INSIDE;
+      if (cpos == start)
+        sc->flags |= STRUC_LBOUND;
+      if (cpos == end)
+        sc->flags |= STRUC_RBOUND;
+    }
+  }
+
+  cl_errno = CDA_OK;
+  return sc->flags;
+}
+
+/**
+ * Gets the number of the region at the current position of a cl_struc_cursor.
+ *
+ * @return  The region number, or CDA_ESTRUC if the current position is not within a region.
+ */
+int
+cl_struc_cursor_struc(cl_struc_cursor sc)
+{
+  if (!sc->flags) {
+    cl_errno = CDA_ESTRUC;
+    return CDA_ESTRUC;
+  }
+  cl_errno = CDA_OK;
+  return sc->next;
+}
+
+/**
+ * Gets the start and end positions of the region at the current position of a cl_struc_cursor.
+ *
+ * @param sc           The cursor.
+ * @param struc_start  Location for the start position of the region.
+ * @param struc_end    Location for the end position of the region.
+ * @return             Boolean: true if the current position is within a region, false otherwise.
+ */
+int
+cl_struc_cursor_region(cl_struc_cursor sc, int *struc_start, int *struc_end)
+{
+  if (!sc->flags) {
+    cl_errno = CDA_ESTRUC;
+    return 0;
+  }
+  *struc_start = ntohl(sc->rng[2 * sc->next]);
+  *struc_end   = ntohl(sc->rng[2 * sc->next + 1]);
+  cl_errno = CDA_OK;
+  return 1;
+}
+
+/**
+ * Gets the annotation of the region at the current position of a cl_struc_cursor.
+ *
+ * @return  The annotation string (which must not be freed); NULL if the
+ *          s-attribute has no annotations, if the current position is not
+ *          within a region, or in case of error.
+ */
+char *
+cl_struc_cursor_value(cl_struc_cursor sc)
+{
+  int struc = sc->next;
+  int offset;
+
+  if (!sc->flags) {
+    cl_errno = CDA_ESTRUC;
+    return NULL;
+  }
+  if (sc->avx == NULL) {
+    cl_errno = CDA_OK;
+    return NULL;
+  }
+
+  /* the avx component normally has one entry per region, so try the direct lookup before the binary search */
+  if (struc < sc->n_avx && (int) ntohl(sc->avx[2 * struc]) == struc) {
+    offset = ntohl(sc->avx[2 * struc + 1]);
+    if (offset >= 0 && offset < sc->avs_size) {
+      cl_errno = CDA_OK;
+      return sc->avs + offset;
+    }
+    cl_errno = CDA_EINTERNAL;
+    return NULL;
+  }
+  return cl_struc2str(sc->attribute, struc);
+}
+
+
+
 
 
 
@@ -167,8 +167,13 @@
 #define CDA_EPOSIX      -21       /**< Error code: POSIX-level error: check errno or perror() */
 #define CDA_CPOSUNDEF   INT_MIN   /**< Error code: undefined corpus position (use this code to avoid ambiguity with negative cpos) */
 
-/* a global variable which will always be set to one of the above constants! */
+/* a global variable which will always be set to one of the above constants!
+ * (each thread has its own copy, where the compiler supports it) */
+#if defined(__GNUC__)
+extern __thread int cl_errno;
+#else
 extern int cl_errno;
+#endif
 
 /* error handling functions */
 void cl_error(char *message);
@@ -271,6 +276,11 @@ double cl_runif(void);
 void cl_set_debug_level(int level);       /* 0 = none (default), 1 = some, 2 = all */
 void cl_set_optimize(int state);          /* 0 = off, 1 = on */
 void cl_set_memory_limit(int megabytes);  /* 0 or less turns limit off */
+void cl_set_threads(int n);               /* 1 = single-threaded (default), 0 or less = one per processor */
+void cl_set_regex_cache_size(int megabytes);  /* cache for cl_regex2id() results; 0 = off (default) */
+void cl_set_regex_cache_persistent(int state); /* 0 = off (default), 1 = keep cache in sidecar files */
+void cl_set_block_cache_size(int blocks);     /* decompressed blocks cached per compressed p-attribute (default 64) */
+void cl_set_access_hints(int state);          /* madvise() hints for memory-mapped components: 0 = off, 1 = on (default) */
 
 
 
@@ -299,6 +309,19 @@ void cl_set_memory_limit(int megabytes);  /* 0 or less turns limit off */
  */
 #define CL_MAX_CORPUS_SIZE 2147483647
 
+/**
+ * Maximum size of a data file that is addressed by byte offsets.
+ *
+ * The lexicon index (.lexicon.idx), the compressed index offsets (.crx)
+ * and the Huffman sync points (.huf.syn) store byte offsets into the
+ * .lexicon, .crc and .huf files as unsigned 32-bit integers, so these files
+ * can be at most 2^32 - 1 bytes (4 GiB) large.  The encoding and compression
+ * tools abort rather than write an offset that does not fit.  (Annotation
+ * strings of s-attributes are still limited to 2 GiB, since .avx offsets
+ * are signed.)
+ */
+#define CL_MAX_FILE_OFFSET 4294967295U
+
 /**
  * General string buffer size constant.
  *
@@ -320,6 +343,13 @@ void cl_set_memory_limit(int megabytes);  /* 0 or less turns limit off */
  */
 #define CL_MAX_FILENAME_LENGTH 1024
 
+/**
+ * Maximum number of worker threads.
+ *
+ * Upper limit for the value set with cl_set_threads().
+ */
+#define CL_MAX_THREADS 256
+
 
 
 
@@ -608,6 +638,8 @@ Attribute *cl_new_attribute_oldstyle(Corpus *corpus,
 int cl_delete_attribute(Attribute *attribute);
 int cl_sequence_compressed(Attribute *attribute);
 int cl_index_compressed(Attribute *attribute);
+int cl_prefetch_attribute(Attribute *attribute);    /* read all data files of the attribute into memory */
+int cl_sequential_access(Attribute *attribute, int state); /* readahead for a scan of the token stream: 1 = on, 0 = off */
 
 /* get the Corpus object of which the Attribute is a daughter */
 Corpus *cl_attribute_mother_corpus(Attribute *attribute);
@@ -643,6 +675,9 @@ int *cl_id2cpos_oldstyle(Attribute *attribute,
                          int *restrictor_list,
                          int restrictor_list_size);
 int cl_cpos2id(Attribute *attribute, int position);
+int cl_cpos2id_range(Attribute *attribute, int start, int end, int *ids);
+int cl_cpos2id_list(Attribute *attribute, int *cposlist, int length, int *ids);
+int cl_block_cache_stats(Attribute *attribute, unsigned long *hits, unsigned long *misses);
 char *cl_cpos2str(Attribute *attribute, int position);
 
 /* ========== some high-level constructs */
@@ -693,7 +728,7 @@ int cl_cpos2struc_oldstyle(Attribute *attribute,
                            int position,
                            int *struc_num);
 
-/* flags set in return values of cl_cpos2boundary() function */
+/* flags set in return values of cl_cpos2boundary() and cl_struc_cursor_seek() functions */
 #define STRUC_INSIDE 1  /**< cl_cpos2boundary() return flag: specified position is WITHIN a region of this s-attribute */
 #define STRUC_LBOUND 2  /**< cl_cpos2boundary() return flag: specified position is AT THE START BOUNDARY OF a region of this s-attribute */
 #define STRUC_RBOUND 4  /**< cl_cpos2boundary() return flag: specified position is AT THE END BOUNDARY OF a region of this s-attribute */
@@ -708,6 +743,27 @@ int cl_max_struc_oldstyle(Attribute *attribute, int *nr_strucs);         /* depr
 int cl_struc_values(Attribute *attribute);
 char *cl_struc2str(Attribute *attribute, int struc_num);
 char *cl_cpos2struc2str(Attribute *attribute, int position);
+/* annotation values of s-attributes by value ID (requires the optional value index) */
+int cl_max_struc_value(Attribute *attribute);
+char *cl_struc_value2str(Attribute *attribute, int value);
+int cl_str2struc_value(Attribute *attribute, char *str);
+int cl_struc2value(Attribute *attribute, int struc_num);
+int cl_struc_value2freq(Attribute *attribute, int value);
+int *cl_struc_value2strucs(Attribute *attribute, int value, int *freq);
+
+/**
+ * The cl_struc_cursor object: tracks the s-attribute region at the current
+ * position of a sequential scan through the corpus, so that successive
+ * lookups for increasing corpus positions do not each need a binary search.
+ */
+typedef struct _cl_struc_cursor *cl_struc_cursor;
+
+cl_struc_cursor cl_new_struc_cursor(Attribute *attribute);
+void cl_delete_struc_cursor(cl_struc_cursor sc);
+int cl_struc_cursor_seek(cl_struc_cursor sc, int cpos);            /* returns STRUC_* flags, 0 if outside region */
+int cl_struc_cursor_struc(cl_struc_cursor sc);
+int cl_struc_cursor_region(cl_struc_cursor sc, int *struc_start, int *struc_end);
+char *cl_struc_cursor_value(cl_struc_cursor sc);
 
 /* attribute access functions: extended alignment attributes (with fallback to old alignment) */
 int cl_has_extended_alignment(Attribute *attribute);
@@ -998,10 +1054,11 @@ int cl_regopt_count_get(void);
  *  represents an entire table of such things; individual string-to-int
  *  links are represented by cl_lexhash_entry objects.
  *
- *  Within the cl_lexhash, the entries are grouped into buckets. A
- *  bucket is the term for a "slot" on the hash table. The linked-list
- *  in a given bucket represent all the different string-keys that map
- *  to one particular index value.
+ *  The cl_lexhash is an open-addressing hash table: each bucket (i.e.
+ *  "slot" of the hash table) holds at most one entry, and collisions
+ *  are resolved by linear probing. Entries are allocated from a string
+ *  arena owned by the cl_lexhash, so they stay at the same address
+ *  until the cl_lexhash is deleted.
  *
  *  Each entry contains the key itself (for search-and-retrieval),
  *  the frequency of that type (incremented when a token is added that
@@ -1030,11 +1087,6 @@ typedef struct _cl_lexhash *cl_lexhash;
  * cl_lexhash_find() and cl_lexhash_add() is allowed.
  */
 typedef struct _cl_lexhash_entry {
-  /**
-   * Note that the fields of this structure have been re-ordered to
-   * ensure proper alignment without any padding.
-   */
-  struct _cl_lexhash_entry *next;   /**< next entry on the linked-list (ie in the bucket) */
   unsigned int freq;                /**< frequency of this type */
   int id;                           /**< the id code of this type */
   /**
@@ -1102,9 +1154,12 @@ cl_lexhash_entry cl_lexhash_iterator_next(cl_lexhash hash);
  *  unique n-gram IDs and no support for user data (a "payload").
  *  The sole purpose of the implementation is to enable fast and
  *  memory-efficient frequency counts for very large sets of n-grams.
+ *  Entries are stored directly in an open-addressing hash table, and
+ *  may optionally be spilled to temporary files when the table exceeds
+ *  a memory limit (see cl_ngram_hash_set_memory_limit()).
  *
- *  WARNING: cl_ngram_hash objects cannot store more than 2^32 - 1
- *  entries. Bad things will happen if you try to do so!
+ *  WARNING: cl_ngram_hash objects cannot hold more than 2^31 - 1
+ *  entries in memory. Bad things will happen if you try to do so!
  * 
  */
 typedef struct _cl_ngram_hash *cl_ngram_hash;
@@ -1118,10 +1173,11 @@ typedef struct _cl_ngram_hash *cl_ngram_hash;
  * of the tuple members with entry->ngram[0], entry->ngram[1], ...
  *
  * Entries MUST NOT be allocated, copied or modified directly by
- * an application!
+ * an application!  Since entries are stored directly in the hash
+ * table, pointers to entries are only valid until the next update
+ * of the n-gram hash.
  */
 typedef struct _cl_ngram_hash_entry {
-  struct _cl_ngram_hash_entry *next; /**< next entry on the linked-list (i.e. in the bucket) */
   unsigned int freq;                 /**< frequency of this type */
   int ngram[1];                      /**< ngram data embedded in struct */
 } *cl_ngram_hash_entry;
@@ -1133,6 +1189,13 @@ cl_ngram_hash cl_new_ngram_hash(int N, int buckets);
 void cl_delete_ngram_hash(cl_ngram_hash hash);
 void cl_ngram_hash_auto_grow(cl_ngram_hash hash, int flag);
 void cl_ngram_hash_auto_grow_fillrate(cl_ngram_hash hash, double limit, double target);
+/**
+ * Limit memory used by the hash table to the specified number of bytes. When the
+ * limit is reached, entries are spilled to temporary files in tmp_dir (NULL = default)
+ * and merged by the iterator; other functions only see the entries held in memory.
+ */
+void cl_ngram_hash_set_memory_limit(cl_ngram_hash hash, size_t limit, char *tmp_dir);
+int cl_ngram_hash_spilled(cl_ngram_hash hash);
 cl_ngram_hash_entry cl_ngram_hash_add(cl_ngram_hash hash, int *ngram, unsigned int f);
 cl_ngram_hash_entry cl_ngram_hash_find(cl_ngram_hash hash, int *ngram);
 int cl_ngram_hash_del(cl_ngram_hash hash, int *ngram);
@@ -1147,12 +1210,14 @@ cl_ngram_hash_entry *cl_ngram_hash_get_entries(cl_ngram_hash hash, int *ret_size
 /**
  * Simple iterator for the entries of an n-gram hash. There is only a single
  * iterator for each cl_ngram_hash object. The iterator is invalidated by all
- * updates of the n-gram hash and will need to be reset afterwards.
+ * updates of the n-gram hash and will need to be reset afterwards. If entries
+ * have been spilled to disk, the iterator returns the merged frequency counts
+ * sorted by ID tuple (and the entry returned is only valid until the next call).
  */
 void cl_ngram_hash_iterator_reset(cl_ngram_hash hash);
 cl_ngram_hash_entry cl_ngram_hash_iterator_next(cl_ngram_hash hash);
 /**
- * Statistics on bucket fill rates for debugging purposes
+ * Statistics on probe sequence lengths for debugging purposes
  */
 int *cl_ngram_hash_stats(cl_ngram_hash hash, int max_n);
 void cl_ngram_hash_print_stats(cl_ngram_hash hash, int max_n);
@@ -46,7 +46,6 @@ drop_single_mapping(SingleMapping *smap);
 
 
 
-/* note this DUPLICATES intcompare in cdaccess.c where it is also static... */
 static
 int 
 intcompare(const void *i, const void *j)
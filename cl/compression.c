@@ -16,9 +16,11 @@
  */
 
 #include <math.h>
+#include <glib.h>
 
 #include "globals.h"
 
+#include "endian.h"
 #include "bitio.h"
 
 #include "compression.h"
@@ -299,3 +301,276 @@ int write_golomb_code(int x, int b, BFile *bf)
 ********************************************************************
 
 #endif
+
+
+
+/** Maximal number of bits resolved by the lookup tables of a HuffDecoder (table size is 2^bits) */
+#define HUFFMAN_LOOKUP_BITS 12
+
+/**
+ * Tops up a left-aligned 64-bit buffer of input bits.
+ *
+ * If there are at least 8 bytes of input left, a complete 64-bit word is loaded
+ * (bits of a partially loaded byte at the end of buf are overwritten with the
+ * same values); otherwise the remaining bytes are loaded one at a time.
+ * Afterwards, the buffer holds at least 56 valid bits unless the input is exhausted.
+ *
+ * @param p      Pointer to the next input byte (advanced past the bytes loaded).
+ * @param end    End of the input data.
+ * @param buf    The bit buffer.
+ * @param nbits  Number of valid bits in buf.
+ * @return       The new number of valid bits in buf.
+ */
+static int
+fill_bit_buffer(unsigned char **p, unsigned char *end, guint64 *buf, int nbits)
+{
+  unsigned char *q = *p;
+  guint64 word;
+  int bytes;
+
+  if (q + 8 <= end) {
+    word = ((guint64)q[0] << 56) | ((guint64)q[1] << 48) | ((guint64)q[2] << 40) | ((guint64)q[3] << 32)
+      | ((guint64)q[4] << 24) | ((guint64)q[5] << 16) | ((guint64)q[6] << 8) | (guint64)q[7];
+    *buf |= word >> nbits;
+    bytes = (63 - nbits) >> 3;
+    *p = q + bytes;
+    return nbits + (bytes << 3);
+  }
+  else {
+    while (nbits <= 56 && q < end) {
+      *buf |= (guint64)*q++ << (56 - nbits);
+      nbits += 8;
+    }
+    *p = q;
+    return nbits;
+  }
+}
+
+/**
+ * Creates lookup tables for fast decoding of a canonical Huffman code.
+ *
+ * The HCD block must remain valid as long as the decoder is in use,
+ * since its symbols table is not copied.
+ *
+ * @param hc             The Huffman code descriptor block.
+ * @param network_order  Boolean: the symbols table of hc is in network byte order
+ *                       (as in a memory-mapped .hcd file) rather than in native byte order.
+ * @return               The new decoder object.
+ */
+HuffDecoder *
+huffman_decoder_new(HCD *hc, int network_order)
+{
+  HuffDecoder *hd;
+  unsigned int prefix, v, table_size;
+  int l, index;
+
+  hd = (HuffDecoder *)cl_malloc(sizeof(HuffDecoder));
+  hd->max_codelen = (hc->max_codelen < MAXCODELEN) ? hc->max_codelen : MAXCODELEN - 1;
+  hd->size = hc->size;
+  for (l = 0; l < MAXCODELEN; l++) {
+    hd->min_code[l] = hc->min_code[l];
+    hd->symindex[l] = hc->symindex[l];
+  }
+  hd->symbols = hc->symbols;
+  hd->network_order = network_order;
+
+  hd->lookup_bits = (hd->max_codelen < HUFFMAN_LOOKUP_BITS) ? hd->max_codelen : HUFFMAN_LOOKUP_BITS;
+  if (hd->lookup_bits < 1)
+    hd->lookup_bits = 1;
+  table_size = 1 << hd->lookup_bits;
+  hd->length = (unsigned char *)cl_malloc(table_size);
+  hd->item = (int *)cl_malloc(table_size * sizeof(int));
+
+  /* for each prefix, find the shortest code length l at which the bit-by-bit decoder would stop */
+  for (prefix = 0; prefix < table_size; prefix++) {
+    hd->length[prefix] = 0;
+    hd->item[prefix] = -1;
+    for (l = 1; l <= hd->lookup_bits; l++) {
+      v = prefix >> (hd->lookup_bits - l);
+      if (v >= hd->min_code[l]) {
+        index = hd->symindex[l] + v - hd->min_code[l];
+        if (index < 0 || index >= hd->size)
+          hd->length[prefix] = HUFFMAN_BAD_CODE;
+        else {
+          hd->length[prefix] = l;
+          hd->item[prefix] = network_order ? ntohl(hd->symbols[index]) : hd->symbols[index];
+        }
+        break;
+      }
+    }
+  }
+
+  return hd;
+}
+
+/**
+ * Deletes a HuffDecoder object.
+ */
+void
+huffman_decoder_delete(HuffDecoder *hd)
+{
+  if (hd) {
+    cl_free(hd->length);
+    cl_free(hd->item);
+    cl_free(hd);
+  }
+}
+
+/**
+ * Decodes a sequence of Huffman-coded items from a memory buffer.
+ *
+ * The input is read a 64-bit word at a time, and codes are resolved
+ * with the lookup tables of the decoder. The result is the same as
+ * reading the codes bit by bit with BSread() and comparing against
+ * the min_code[] array of the Huffman code descriptor.
+ *
+ * @param hd          The decoder (see huffman_decoder_new()).
+ * @param data        The compressed data.
+ * @param size        Size of the compressed data in bytes (no data beyond this point is read).
+ * @param offset      Byte offset in data where decoding starts (e.g. from the .huf.syn file).
+ * @param dest        Buffer for the decoded items.
+ * @param n           Number of items to decode.
+ * @param end_offset  If not NULL, the offset of the first byte after the last code is stored here
+ *                    (i.e. the start of the next synchronisation block).
+ * @return            n, or -1 if the data is corrupt or ends prematurely.
+ */
+int
+huffman_decode_block(HuffDecoder *hd, unsigned char *data, size_t size, size_t offset,
+                     int *dest, int n, size_t *end_offset)
+{
+  unsigned char *p = data + offset, *data_end = data + size;
+  guint64 buf = 0;              /* input bits, left-aligned */
+  int nbits = 0;                /* number of valid bits in buf */
+  int shift = 64 - hd->lookup_bits;
+  int i, l, index;
+  unsigned int prefix, v;
+
+  if (offset > size)
+    return -1;
+
+  for (i = 0; i < n; i++) {
+
+    /* make sure the buffer holds a complete code (codes are shorter than MAXCODELEN bits) */
+    if (nbits < MAXCODELEN)
+      nbits = fill_bit_buffer(&p, data_end, &buf, nbits);
+
+    prefix = (unsigned int)(buf >> shift);
+    l = hd->length[prefix];
+    if (l == 0) {
+      /* code is longer than lookup_bits: continue bit by bit */
+      for (l = hd->lookup_bits + 1; l <= hd->max_codelen; l++) {
+        v = (unsigned int)(buf >> (64 - l));
+        if (v >= hd->min_code[l])
+          break;
+      }
+      if (l > hd->max_codelen)
+        return -1;
+      index = hd->symindex[l] + v - hd->min_code[l];
+      if (index < 0 || index >= hd->size)
+        return -1;
+      dest[i] = hd->network_order ? ntohl(hd->symbols[index]) : hd->symbols[index];
+    }
+    else if (l == HUFFMAN_BAD_CODE)
+      return -1;
+    else
+      dest[i] = hd->item[prefix];
+
+    if (l > nbits)
+      return -1;                /* ran past the end of the data */
+    buf <<= l;
+    nbits -= l;
+  }
+
+  if (end_offset)
+    *end_offset = (p - data) - (nbits >> 3);
+  return n;
+}
+
+
+/**
+ * Sets up a GolombReader for a sequence of Golomb codes in a memory buffer.
+ *
+ * @param gr          The reader object.
+ * @param data        The compressed data (e.g. the CompCompRF component).
+ * @param size        Size of the compressed data in bytes (no data beyond this point is read).
+ * @param bit_offset  Position of the first code, in bits from the start of data.
+ * @param b           The Golomb parameter (see compute_ba()).
+ */
+void
+golomb_reader_init(GolombReader *gr, unsigned char *data, size_t size, size_t bit_offset, int b)
+{
+  int skip = bit_offset & 7;
+
+  gr->end = data + size;
+  gr->p = data + (bit_offset >> 3);
+  if (gr->p > gr->end)
+    gr->p = gr->end;
+  gr->buf = 0;
+  gr->nbits = fill_bit_buffer(&gr->p, gr->end, &gr->buf, 0);
+  gr->buf <<= skip;
+  gr->nbits -= skip;
+
+  gr->b = b;
+  gr->ub = ceil(log2(b * 1.0));
+  gr->lb = gr->ub - 1;
+  gr->nr_sc = (1 << gr->ub) - b;
+}
+
+/**
+ * Reads the next integer from a GolombReader.
+ *
+ * Gives the same results as read_golomb_code_bs(), but the unary part is
+ * scanned a 64-bit word at a time and the binary part is extracted in one go.
+ *
+ * @param gr  The reader object (see golomb_reader_init()).
+ * @return    The integer that is read, or -1 if the input ends prematurely.
+ */
+int
+golomb_reader_read(GolombReader *gr)
+{
+  guint64 inverse;
+  int q, ones, n;
+  unsigned int r;
+
+  /* read unary part (a run of 1 bits terminated by a 0 bit) */
+  q = 0;
+  while (1) {
+    if (gr->nbits < 32)
+      gr->nbits = fill_bit_buffer(&gr->p, gr->end, &gr->buf, gr->nbits);
+    if (gr->nbits <= 0)
+      return -1;
+    inverse = ~gr->buf;
+#ifdef __GNUC__
+    ones = (inverse == 0) ? 64 : __builtin_clzll(inverse);
+#else
+    for (ones = 0; ones < 64 && (inverse & ((guint64)1 << 63)) == 0; ones++)
+      inverse <<= 1;
+#endif
+    if (ones < gr->nbits)
+      break;
+    /* all bits in the buffer are 1s: discard them and continue with the next bytes */
+    q += gr->nbits;
+    gr->buf = 0;
+    gr->nbits = 0;
+  }
+  q += ones;
+  n = ones + 1;
+  gr->buf = (n < 64) ? gr->buf << n : 0;
+  gr->nbits -= n;
+
+  /* read binary part: lb bits, plus one more bit if the value is >= nr_sc */
+  if (gr->nbits < 32)
+    gr->nbits = fill_bit_buffer(&gr->p, gr->end, &gr->buf, gr->nbits);
+  n = gr->lb;
+  r = (n > 0) ? (unsigned int)(gr->buf >> (64 - n)) : 0;
+  if (r >= gr->nr_sc) {
+    n++;
+    r = (unsigned int)(gr->buf >> (64 - n)) - gr->nr_sc;
+  }
+  if (n > gr->nbits)
+    return -1;
+  gr->buf <<= n;
+  gr->nbits -= n;
+
+  return r + q * gr->b;
+}
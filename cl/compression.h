@@ -18,9 +18,51 @@
 #ifndef _COMPRESSION_H_
 #define _COMPRESSION_H_
 
+#include <glib.h>
+
 #include "globals.h"
 
 #include "bitio.h"
+#include "attributes.h"
+
+/**
+ * Lookup tables for decoding a canonical Huffman code (as described by a HCD block)
+ * several bits at a time.
+ *
+ * Codes of up to lookup_bits bits are resolved by a single table lookup on the
+ * next lookup_bits bits of input; longer codes are completed by comparing the
+ * input against min_code[], as in the bit-by-bit algorithm.
+ */
+typedef struct _huffman_decoder {
+  int lookup_bits;                  /**< number of bits resolved by the lookup tables */
+  int max_codelen;                  /**< maximal code length (copied from HCD) */
+  int size;                         /**< number of symbols (copied from HCD) */
+  unsigned int min_code[MAXCODELEN];/**< minimal code of length i (copied from HCD) */
+  int symindex[MAXCODELEN];         /**< starting point of codes of length i in symbols (copied from HCD) */
+  unsigned char *length;            /**< length of the code starting with each lookup_bits prefix;
+                                         0 = longer than lookup_bits, HUFFMAN_BAD_CODE = invalid */
+  int *item;                        /**< the decoded item for each lookup_bits prefix (if length is set) */
+  int *symbols;                     /**< the code->id mapping table of the HCD block (not copied) */
+  int network_order;                /**< boolean: symbols are stored in network byte order */
+} HuffDecoder;
+
+/** Marks prefixes in the lookup table of a HuffDecoder that do not start a valid code */
+#define HUFFMAN_BAD_CODE 255
+
+/**
+ * A reader for Golomb-coded integers in a memory buffer, which extracts
+ * codes from a 64-bit bit buffer rather than reading them bit by bit.
+ */
+typedef struct _golomb_reader {
+  unsigned char *p;                 /**< next byte of input to be loaded into buf */
+  unsigned char *end;               /**< end of the input data */
+  guint64 buf;                      /**< input bits, left-aligned */
+  int nbits;                        /**< number of valid bits in buf */
+  int b;                            /**< the Golomb parameter */
+  int lb;                           /**< minimal length of the binary part */
+  int ub;                           /**< maximal length of the binary part */
+  unsigned int nr_sc;               /**< number of short codes for the binary part */
+} GolombReader;
 
 int compute_ba(int ft, int corpus_size);
 
@@ -29,4 +71,12 @@ int read_golomb_code_bf(int b, BFile *bf);
 
 int write_golomb_code(int x, int b, BFile *bf);
 
+void golomb_reader_init(GolombReader *gr, unsigned char *data, size_t size, size_t bit_offset, int b);
+int golomb_reader_read(GolombReader *gr);
+
+HuffDecoder *huffman_decoder_new(HCD *hc, int network_order);
+void huffman_decoder_delete(HuffDecoder *hd);
+int huffman_decode_block(HuffDecoder *hd, unsigned char *data, size_t size, size_t offset,
+                         int *dest, int n, size_t *end_offset);
+
 #endif
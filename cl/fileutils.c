@@ -101,6 +101,72 @@ fprobe(char *fname)
 }
 
 
+/** Files up to this size are checksummed completely by file_fingerprint() */
+#define FINGERPRINT_FULL_SIZE (1024 * 1024)
+/** Number of blocks sampled for the checksum of larger files */
+#define FINGERPRINT_BLOCKS 1024
+/** Size of the blocks sampled for the checksum of larger files */
+#define FINGERPRINT_BLOCK_SIZE 64
+
+/**
+ * Computes a fingerprint of a data file, which can be stored in a derived file
+ * (such as an index or cache) to detect when the data file has been changed.
+ *
+ * The fingerprint consists of FILE_FINGERPRINT_SIZE integers: the size of the
+ * file (as two 32-bit halves), its modification time (seconds as two 32-bit
+ * halves, and nanoseconds where the platform provides them) and a checksum of
+ * the data.  Files up to 1 MB are checksummed completely; for larger files,
+ * 1024 evenly spaced blocks of 64 bytes are sampled, which keeps the cost low
+ * while the modification time catches any re-encoding.  The checksum doesn't
+ * depend on byte order, so fingerprints can be stored in network byte order.
+ *
+ * @param filename     Name of the file (used to get its modification time).
+ * @param data         Contents of the file (may be NULL if size is 0).
+ * @param size         Size of the file in bytes.
+ * @param fingerprint  Array of FILE_FINGERPRINT_SIZE integers to fill in.
+ */
+void
+file_fingerprint(char *filename, void *data, size_t size, int *fingerprint)
+{
+  struct stat stat_buf;
+  unsigned char *bytes = (unsigned char *) data;
+  unsigned int checksum = 2166136261U;  /* FNV-1a */
+  size_t block, offset, i;
+  long long sec = 0;
+  long nsec = 0;
+
+  if (stat(filename, &stat_buf) == 0) {
+    sec = (long long) stat_buf.st_mtime;
+#if defined(__APPLE__)
+    nsec = stat_buf.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    nsec = stat_buf.st_mtim.tv_nsec;
+#endif
+  }
+
+  if (size <= FINGERPRINT_FULL_SIZE) {
+    for (i = 0; i < size; i++)
+      checksum = (checksum ^ bytes[i]) * 16777619U;
+  }
+  else {
+    for (block = 0; block < FINGERPRINT_BLOCKS; block++) {
+      offset = (size - FINGERPRINT_BLOCK_SIZE) / (FINGERPRINT_BLOCKS - 1) * block;
+      if (block == FINGERPRINT_BLOCKS - 1)
+        offset = size - FINGERPRINT_BLOCK_SIZE;     /* always include the end of the file */
+      for (i = offset; i < offset + FINGERPRINT_BLOCK_SIZE; i++)
+        checksum = (checksum ^ bytes[i]) * 16777619U;
+    }
+  }
+
+  fingerprint[0] = (int) ((unsigned long long) size >> 32);
+  fingerprint[1] = (int) ((unsigned long long) size & 0xffffffffU);
+  fingerprint[2] = (int) ((unsigned long long) sec >> 32);
+  fingerprint[3] = (int) ((unsigned long long) sec & 0xffffffffU);
+  fingerprint[4] = (int) nsec;
+  fingerprint[5] = (int) checksum;
+}
+
+
 /**
  * Checks whether the specified path indicates a directory.
  *
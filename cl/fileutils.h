@@ -28,6 +28,10 @@ off_t fi_file_length(int fileno);
 
 long fprobe(char *fname);
 
+/** Number of integers in a file fingerprint (see file_fingerprint()) */
+#define FILE_FINGERPRINT_SIZE 6
+void file_fingerprint(char *filename, void *data, size_t size, int *fingerprint);
+
 int is_directory(char *path);
 int is_file(char *path);
 int is_link(char *path);
@@ -15,6 +15,8 @@
  *  WWW at http://www.gnu.org/copyleft/gpl.html).
  */
 
+#include <glib.h>
+
 #include "globals.h"
 
 /**
@@ -40,6 +42,40 @@ int cl_optimize = 0;
  *  (ensure memory limit > 2GB is correctly converted to byte size or number of ints)
  */
 size_t cl_memory_limit = 0;
+/**
+ *  global configuration variable: number of threads.
+ *
+ *  Upper limit on the number of worker threads that CL functions with
+ *  a parallel implementation may use; 1 = single-threaded (default).
+ */
+int cl_threads = 1;
+/**
+ *  global configuration variable: size of the regex cache.
+ *
+ *  In megabytes; 0 (the default) disables the cache of cl_regex2id() results.
+ */
+int cl_regex_cache_size = 0;
+/**
+ *  global configuration variable: persistent regex cache.
+ *
+ *  If true, entries of the regex cache are also stored in sidecar files
+ *  next to the lexicon of each attribute.
+ */
+int cl_regex_cache_persistent = 0;
+/**
+ *  global configuration variable: size of the block cache.
+ *
+ *  Number of decompressed blocks of a Huffman-compressed item sequence
+ *  that are kept in memory for each p-attribute.
+ */
+int cl_block_cache_size = 64;
+/**
+ *  global configuration variable: access hints.
+ *
+ *  If true (the default), memory-mapped components are loaded with
+ *  access hints for the operating system (see memblob_advise()).
+ */
+int cl_access_hints = 1;
 
 
 
@@ -87,3 +123,67 @@ cl_set_memory_limit(int megabytes) {
     cl_memory_limit = megabytes;
   }
 }
+
+/**
+ * Sets the number of worker threads used by CL functions that can run in parallel.
+ *
+ * A value of 0 or less selects the number of processors available on the machine;
+ * 1 (the default) means that all CL functions are single-threaded.
+ *
+ * @see cl_threads
+ * @param n  Number of threads.
+ */
+void
+cl_set_threads(int n) {
+  if (n <= 0)
+    n = g_get_num_processors();
+  cl_threads = (n > CL_MAX_THREADS) ? CL_MAX_THREADS : n;
+}
+
+/**
+ * Sets the maximum amount of memory used by the cache of cl_regex2id() results.
+ *
+ * @see cl_regex_cache_size
+ * @param megabytes  Size of the cache in megabytes; 0 or less disables the cache.
+ */
+void
+cl_set_regex_cache_size(int megabytes) {
+  cl_regex_cache_size = (megabytes > 0) ? megabytes : 0;
+}
+
+/**
+ * Turns the persistent regex cache on or off.
+ *
+ * @see cl_regex_cache_persistent
+ * @param state  Boolean (true turns it on, false turns it off).
+ */
+void
+cl_set_regex_cache_persistent(int state) {
+  cl_regex_cache_persistent = (state) ? 1 : 0;
+}
+
+/**
+ * Sets the number of decompressed blocks cached for each compressed p-attribute.
+ *
+ * The new size takes effect the next time an attribute's item sequence is accessed.
+ *
+ * @see cl_block_cache_size
+ * @param blocks  Number of blocks (of SYNCHRONIZATION items each); values less than 1 are set to 1.
+ */
+void
+cl_set_block_cache_size(int blocks) {
+  cl_block_cache_size = (blocks > 1) ? blocks : 1;
+}
+
+/**
+ * Turns access hints for memory-mapped components on or off.
+ *
+ * Only affects components that are loaded after the call.
+ *
+ * @see cl_access_hints
+ * @param state  Boolean (true turns them on, false turns them off).
+ */
+void
+cl_set_access_hints(int state) {
+  cl_access_hints = (state) ? 1 : 0;
+}
@@ -36,6 +36,11 @@
 extern int cl_debug;
 extern int cl_optimize;
 extern size_t cl_memory_limit;
+extern int cl_threads;
+extern int cl_regex_cache_size;
+extern int cl_regex_cache_persistent;
+extern int cl_block_cache_size;
+extern int cl_access_hints;
 
 
 /* macros for path-handling: different between Unix and Windows */
@@ -21,17 +21,34 @@
 #include "lexhash.h"
 
 #include <math.h>
+#include <stddef.h>
+#include <stdint.h>
 
 
-/** Defines the default number of buckets in a lexhash. */
+/** Defines the default number of buckets (i.e. slots of the open-addressing table) in a lexhash. */
 #define DEFAULT_NR_OF_BUCKETS 250000
 
 /** Default parameters for auto-growing the table of buckets (@see cl_lexhash_auto_grow_fillrate for details). */
-#define DEFAULT_FILLRATE_LIMIT 2.0
-#define DEFAULT_FILLRATE_TARGET 0.4
+#define DEFAULT_FILLRATE_LIMIT 0.75
+#define DEFAULT_FILLRATE_TARGET 0.35
 
-/** Maximum number of buckets lexhash will try to allocate when auto-growing. */
-#define MAX_BUCKETS 1000000007  /* 1 billion (incremented to next prime number) */
+/** The table is always expanded at this fill rate, even if auto-grow is disabled (an open-addressing table cannot overflow). */
+#define MAX_FILLRATE 0.9
+
+/** Maximum number of buckets a lexhash will allocate (must be a power of 2). */
+#define MAX_BUCKETS 0x80000000U  /* 2^31 */
+
+/** Alignment of entries in the string arena (in bytes). */
+#define ARENA_ALIGN 8
+/** Number of bits of an arena reference used for the offset of an entry within its block (in units of ARENA_ALIGN). */
+#define ARENA_OFFSET_BITS 20
+#define ARENA_OFFSET_MASK ((1U << ARENA_OFFSET_BITS) - 1)
+/** Maximum number of blocks in the string arena (limited by the remaining bits of an arena reference). */
+#define ARENA_MAX_BLOCKS ((1 << (32 - ARENA_OFFSET_BITS)) - 1)
+/** Size of the first block of the string arena; subsequent blocks double in size up to ARENA_MAX_BLOCK_SIZE. */
+#define ARENA_MIN_BLOCK_SIZE 4096
+/** Maximum size of a block of the string arena (8 MiB; larger blocks are only allocated for very long keys). */
+#define ARENA_MAX_BLOCK_SIZE (ARENA_ALIGN << ARENA_OFFSET_BITS)
 
 
 /*
@@ -102,9 +119,59 @@ see http://en.wikipedia.org/wiki/MurmurHash
 Experimental comparison:
 http://programmers.stackexchange.com/questions/49550/which-hashing-algorithm-is-best-for-uniqueness-and-speed
 
+cl_lexhash itself now uses MurmurHash64A with power-of-2 tables (see lexhash_hash() below);
+hash_string() is still used by the other (prime-sized, chained) hash tables.
+
 ***/
 
 
+/**
+ * Computes the 32bit hash value used by cl_lexhash for a string of known length.
+ *
+ * This is the MurmurHash64A algorithm by Austin Appleby (public domain), which
+ * processes 8 bytes at a time and distributes keys well enough for a power-of-2
+ * table that uses the low bits of the hash value.  Unlike hash_string(), the
+ * hash values depend on the byte order of the machine, so they must not be stored
+ * on disk.
+ *
+ * @param string  The string to hash.
+ * @param len     Its length in bytes (not counting the terminating NUL).
+ * @return        The hash value.
+ */
+static unsigned int
+lexhash_hash(const char *string, size_t len)
+{
+  const uint64_t m = 0xc6a4a7935bd1e995ULL;
+  const int r = 47;
+  const unsigned char *s = (const unsigned char *)string;
+  uint64_t h = 0x5bd1e995ULL ^ (len * m);
+  uint64_t k;
+
+  for ( ; len >= 8; len -= 8, s += 8) {
+    memcpy(&k, s, 8);           /* unaligned load */
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  switch (len) {
+  case 7: h ^= (uint64_t)s[6] << 48; /* fall through */
+  case 6: h ^= (uint64_t)s[5] << 40; /* fall through */
+  case 5: h ^= (uint64_t)s[4] << 32; /* fall through */
+  case 4: h ^= (uint64_t)s[3] << 24; /* fall through */
+  case 3: h ^= (uint64_t)s[2] << 16; /* fall through */
+  case 2: h ^= (uint64_t)s[1] << 8;  /* fall through */
+  case 1: h ^= (uint64_t)s[0];
+    h *= m;
+  }
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return (unsigned int)(h ^ (h >> 32));
+}
+
+
 /*
  * cl_lexhash / cl_lexhash_entry  object definition
  */
@@ -118,27 +185,58 @@ http://programmers.stackexchange.com/questions/49550/which-hashing-algorithm-is-
  */
 typedef void (*cl_lexhash_cleanup_func)(cl_lexhash_entry);
 
+/**
+ * A bucket of the open-addressing table: a reference to an entry together with its full hash value.
+ *
+ * Storing the hash value means that most unsuccessful comparisons never touch the
+ * entry itself, and that the table can be expanded without rehashing the keys.
+ * Entries are referenced by their position in the string arena rather than by pointer,
+ * which keeps buckets at 8 bytes: the upper bits of ref hold the number of the arena
+ * block (starting from 1), the lower ARENA_OFFSET_BITS bits the offset of the entry
+ * within the block (in units of ARENA_ALIGN bytes).
+ */
+typedef struct _cl_lexhash_bucket {
+  unsigned int hash;            /**< hash value of the entry's key (undefined for empty buckets) */
+  unsigned int ref;             /**< arena reference of the entry stored in this bucket, or 0 if the bucket is empty */
+} cl_lexhash_bucket;
+
+/**
+ * A block of the string arena from which entries (with embedded keys) are allocated.
+ */
+typedef struct _cl_lexhash_block {
+  size_t size;                    /**< number of bytes available in data[] */
+  size_t used;                    /**< number of bytes of data[] used by entries */
+  double data[1];                 /**< storage for entries (declared as double for proper alignment) */
+} *cl_lexhash_block;
+
 /* typedef struct _cl_lexhash *cl_lexhash; in <cl.h> */
 
 
 /**
  * Underlying structure for the cl_lexhash object.
  *
- * A cl_lexhash contains a number of buckets. Each bucket is
- * a linked-list of cl_lexhash_entry objects.
- *
+ * A cl_lexhash is an open-addressing hash table with linear probing.
+ * The number of buckets is always a power of 2, and each bucket holds a
+ * reference to an entry together with the hash value of its key.
+ * Entries (with embedded key strings) are allocated from a bump-pointer arena,
+ * so there is no per-entry malloc() overhead and the entries of a lexhash are
+ * stored compactly in memory.  Entries never move once allocated, so pointers
+ * returned by cl_lexhash_add() remain valid until the lexhash is deleted.
  */
 struct _cl_lexhash {
-  cl_lexhash_entry *table;      /**< table of buckets; each "bucket" is a pointer to the list of entries that make up that bucket */
-  unsigned int buckets;         /**< number of buckets in the hash table */
+  cl_lexhash_bucket *table;     /**< table of buckets */
+  unsigned int buckets;         /**< number of buckets in the hash table (power of 2) */
   int next_id;                  /**< ID that will be assigned to next new entry */
   int entries;                  /**< current number of entries in this hash */
   cl_lexhash_cleanup_func cleanup_func; /**< callback function used when deleting entries (see cl.h) */
   int auto_grow;                /**< boolean: whether to expand this hash automatically; true by default */
   double fillrate_limit;        /**< fillrate limit that triggers expansion of bucket table (with auto_grow) */
   double fillrate_target;       /**< target fillrate after expansion of bucket table (with auto_grow) */
-  int iter_bucket;              /**< bucket currently processed by the single iterator of the hash table */
-  cl_lexhash_entry iter_point;  /**< next entry to be returned by the iterator (NULL -> go to next bucket) */
+  cl_lexhash_block *arena;      /**< blocks of the string arena, in order of allocation */
+  int arena_blocks;             /**< number of blocks in the arena */
+  int arena_size;               /**< allocated size of the arena vector */
+  int iter_block;               /**< arena block currently processed by the single iterator of the hash table */
+  size_t iter_offset;           /**< offset of next entry to be examined by the iterator within this block */
 };
 
 
@@ -146,11 +244,60 @@ struct _cl_lexhash {
  * cl_lexhash methods
  */
 
+/**
+ * Computes the number of bytes taken up in the arena by an entry with a key of the specified length.
+ *
+ * The size is rounded up to preserve the alignment of the next entry.
+ *
+ * This is a non-exported function.
+ */
+size_t
+cl_lexhash_entry_size(size_t keylen)
+{
+  size_t size = offsetof(struct _cl_lexhash_entry, key) + keylen + 1;
+  return (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+}
+
+/**
+ * Looks up an entry from its arena reference.
+ *
+ * This is a non-exported function.
+ */
+static cl_lexhash_entry
+cl_lexhash_deref(cl_lexhash hash, unsigned int ref)
+{
+  return (cl_lexhash_entry)
+    ((char *) hash->arena[(ref >> ARENA_OFFSET_BITS) - 1]->data + (size_t)(ref & ARENA_OFFSET_MASK) * ARENA_ALIGN);
+}
+
+/**
+ * Allocates a new bucket table for a lexhash, with at least the specified number of buckets.
+ *
+ * The number of buckets is rounded up to the next power of 2.
+ *
+ * This is a non-exported function.
+ *
+ * @param buckets      Minimum number of buckets.
+ * @param ret_buckets  Will be set to the actual number of buckets allocated.
+ * @return             The new (empty) bucket table.
+ */
+cl_lexhash_bucket *
+cl_lexhash_new_table(double buckets, unsigned int *ret_buckets)
+{
+  unsigned int size = 16;
+
+  while (size < buckets && size < MAX_BUCKETS)
+    size *= 2;
+  *ret_buckets = size;
+  return (cl_lexhash_bucket *) cl_calloc(size, sizeof(cl_lexhash_bucket));
+}
+
 /**
  * Creates a new cl_lexhash object.
  *
- * @param buckets    The number of buckets in the newly-created cl_lexhash;
- *                   set to 0 to use the default number of buckets.
+ * @param buckets    The number of buckets in the newly-created cl_lexhash
+ *                   (rounded up to a power of 2); set to 0 to use the default
+ *                   number of buckets.
  * @return           The new cl_lexhash.
  */
 cl_lexhash 
@@ -161,24 +308,73 @@ cl_new_lexhash(int buckets)
   if (buckets <= 0)
     buckets = DEFAULT_NR_OF_BUCKETS;
   hash = (cl_lexhash) cl_malloc(sizeof(struct _cl_lexhash));
-  hash->buckets = find_prime(buckets);
-  hash->table = cl_calloc(hash->buckets, sizeof(cl_lexhash_entry));
+  hash->table = cl_lexhash_new_table(buckets, &hash->buckets);
   hash->next_id = 0;
   hash->entries = 0;
   hash->cleanup_func = NULL;
   hash->auto_grow = 1;
   hash->fillrate_limit = DEFAULT_FILLRATE_LIMIT;
   hash->fillrate_target = DEFAULT_FILLRATE_TARGET;
-  hash->iter_bucket = -1;
-  hash->iter_point = NULL;
+  hash->arena = NULL;
+  hash->arena_blocks = 0;
+  hash->arena_size = 0;
+  hash->iter_block = 0;
+  hash->iter_offset = 0;
   return hash;
 }
 
 
 /**
- * Deallocates a cl_lexhash_entry object and its key string.
+ * Allocates memory for a new entry with a key of the specified length from the arena of a lexhash.
  *
- * Also, the cleanup function is run on the entry.
+ * This is a non-exported function.
+ *
+ * @param hash     The lexhash the entry belongs to.
+ * @param keylen   Length of the key string (not counting the terminating NUL).
+ * @param ret_ref  Will be set to the arena reference of the new entry.
+ * @return         Pointer to uninitialised memory for the entry, suitably aligned.
+ */
+cl_lexhash_entry
+cl_lexhash_alloc_entry(cl_lexhash hash, size_t keylen, unsigned int *ret_ref)
+{
+  cl_lexhash_block block;
+  size_t size, block_size;
+
+  size = cl_lexhash_entry_size(keylen);
+  block = (hash->arena_blocks > 0) ? hash->arena[hash->arena_blocks - 1] : NULL;
+
+  if (block == NULL || size > block->size - block->used) {
+    /* start with small blocks, so that small lexhashes don't waste memory */
+    block_size = (block != NULL) ? 2 * block->size : ARENA_MIN_BLOCK_SIZE;
+    if (block_size > ARENA_MAX_BLOCK_SIZE)
+      block_size = ARENA_MAX_BLOCK_SIZE;
+    if (block_size < size)
+      block_size = size;        /* dedicated block for a very long key */
+    if (hash->arena_blocks >= ARENA_MAX_BLOCKS) {
+      fprintf(stderr, "CL: lexhash size limit exceeded (%d entries). (killed)\n", hash->entries);
+      exit(1);
+    }
+    if (hash->arena_blocks >= hash->arena_size) {
+      hash->arena_size = (hash->arena_size > 0) ? 2 * hash->arena_size : 16;
+      hash->arena = (cl_lexhash_block *) cl_realloc(hash->arena, hash->arena_size * sizeof(cl_lexhash_block));
+    }
+    block = (cl_lexhash_block) cl_malloc(offsetof(struct _cl_lexhash_block, data) + block_size);
+    block->size = block_size;
+    block->used = 0;
+    hash->arena[hash->arena_blocks++] = block;
+  }
+
+  *ret_ref = ((unsigned int) hash->arena_blocks << ARENA_OFFSET_BITS) | (unsigned int)(block->used / ARENA_ALIGN);
+  block->used += size;
+  return (cl_lexhash_entry) ((char *) block->data + (block->used - size));
+}
+
+
+/**
+ * Runs the cleanup function on a cl_lexhash_entry that is about to be deleted.
+ *
+ * The memory of the entry (and its key string) is part of the lexhash's arena
+ * and will only be released when the lexhash itself is deleted.
  *
  * Usage: cl_delete_lexhash_entry(lexhash, entry);
  *
@@ -192,20 +388,15 @@ cl_new_lexhash(int buckets)
 void
 cl_delete_lexhash_entry(cl_lexhash hash, cl_lexhash_entry entry)
 {
-  if (hash != NULL) {
-    /* if necessary, let cleanup callback delete objects associated with the data field */
-    if (hash->cleanup_func != NULL) {
-      (*(hash->cleanup_func))(entry);
-    }
-    /* key is embedded in struct, so it mustn't be deallocated separately */
-    cl_free(entry);
-  }
+  /* if necessary, let cleanup callback delete objects associated with the data field */
+  if (hash != NULL && hash->cleanup_func != NULL)
+    (*(hash->cleanup_func))(entry);
 }
 
 /**
  * Deletes a cl_lexhash object.
  *
- * This deletes all the entries in all the buckets in the lexhash,
+ * This deletes all the entries in the lexhash,
  * plus the cl_lexhash itself.
  *
  * @param hash  The cl_lexhash to delete.
@@ -213,19 +404,19 @@ cl_delete_lexhash_entry(cl_lexhash hash, cl_lexhash_entry entry)
 void 
 cl_delete_lexhash(cl_lexhash hash)
 {
+  cl_lexhash_entry entry;
   int i;
-  cl_lexhash_entry entry, temp;
-  
-  if (hash != NULL && hash->table != NULL) {
-    for (i = 0; i < hash->buckets; i++) {
-      entry = hash->table[i];
-      while (entry != NULL) {
-        temp = entry;
-        entry = entry->next;
-        cl_delete_lexhash_entry(hash, temp);
-      }
-    }
+
+  if (hash == NULL)
+    return;
+  if (hash->cleanup_func != NULL) {
+    cl_lexhash_iterator_reset(hash);
+    while ((entry = cl_lexhash_iterator_next(hash)) != NULL)
+      cl_delete_lexhash_entry(hash, entry);
   }
+  for (i = 0; i < hash->arena_blocks; i++)
+    cl_free(hash->arena[i]);
+  cl_free(hash->arena);
   cl_free(hash->table);
   cl_free(hash);
 }
@@ -257,6 +448,10 @@ cl_lexhash_set_cleanup_function(cl_lexhash hash, cl_lexhash_cleanup_func func)
  *
  * Note the default value for this setting is SWITCHED ON.
  *
+ * Since an open-addressing table cannot hold more entries than it
+ * has buckets, a lexhash is always doubled in size when its fill rate
+ * reaches 90%, even if auto-grow has been switched off.
+ *
  * @see         cl_lexhash_check_grow
  * @param hash  The hash that will be affected.
  * @param flag  New value for autogrow setting: boolean where
@@ -275,23 +470,20 @@ cl_lexhash_auto_grow(cl_lexhash hash, int flag)
  * These settings are only relevant if auto-growing is enabled.
  *
  * The decision to expand the bucket table of a lexhash is based
- * on its fill rate, i.e. the average number of entries in each
- * bucket. Under normal circumstances, this value corresponds to 
- * the average number of comparisons required to insert a new 
- * entry into the hash (locating an existing value should require
- * roughly half as many comparisons).
+ * on its fill rate, i.e. the proportion of buckets that are in use.
+ * With linear probing, the average number of comparisons needed
+ * to insert a new entry grows quickly as the fill rate approaches 1.
  *
  * Auto-growing is triggered if the fill rate exceeds a specified
  * limit.  The new number of buckets is chosen so that the fill
- * rate after expansion corresponds to the specified target value.
- *
- * The limit should not be set too low in order to reduce memory
- * overhead and avoid frequent reallocation due to expansion in 
- * small increments.  Good values seem to be in the range 2.0-5.0;
- * depending on whether speed or memory efficiency is more important.
- * A reasonable value for the target fill rate is 0.4, which corresponds
- * to a 42% overhead over the storage required for entry data structures
- * (48 bytes per entry vs. 8 bytes for each bucket).
+ * rate after expansion is at most the specified target value
+ * (the number of buckets is always a power of 2).
+ *
+ * Good values for the limit are in the range 0.5-0.8, depending on
+ * whether speed or memory efficiency is more important; the limit
+ * is capped at 0.9.  Since each bucket takes 8 bytes, the default
+ * target of 0.35 corresponds to an overhead of about 23 bytes per
+ * entry right after expansion.
  * 
  * @see          cl_lexhash_auto_grow, cl_lexhash_check_grow
  * @param hash   The hash that will be affected.
@@ -304,7 +496,11 @@ cl_lexhash_auto_grow_fillrate(cl_lexhash hash, double limit, double target)
   if (hash != NULL) {
     /* set parameters with basic sanity checks */
     hash->fillrate_target = (target > 0.01) ? target : 0.01;
+    if (hash->fillrate_target > MAX_FILLRATE / 2)
+      hash->fillrate_target = MAX_FILLRATE / 2;
     hash->fillrate_limit = (limit > 2 * hash->fillrate_target) ? limit : 2 * hash->fillrate_target;
+    if (hash->fillrate_limit > MAX_FILLRATE)
+      hash->fillrate_limit = MAX_FILLRATE;
   }
 }
 
@@ -319,12 +515,14 @@ cl_lexhash_auto_grow_fillrate(cl_lexhash hash, double limit, double target)
  * by increasing the number of buckets, such that the new average fill rate
  * corresponds to the specified target value.  This gives the
  * hash better performance and makes it capable of absorbing more keys.
+ * If the fill rate reaches MAX_FILLRATE, the table is doubled in size
+ * regardless of the auto_grow setting.
  *
- * If the bucket table would be expanded to more than MAX_BUCKETS entries,
- * auto-grow is automatically disabled for this lexhash.
+ * Entries are moved to their new buckets using the stored hash values,
+ * so the keys don't have to be rehashed.
  *
- * Note: this function also implements the hashing algorithm and must be
- * consistent with cl_lexhash_find_i().
+ * If the bucket table cannot be expanded beyond MAX_BUCKETS entries and
+ * is full, the program is aborted.
  *
  * Usage: expanded = cl_lexhash_check_grow(cl_lexhash hash);
  *
@@ -332,69 +530,55 @@ cl_lexhash_auto_grow_fillrate(cl_lexhash hash, double limit, double target)
  *
  * @see         cl_lexhash_auto_grow, cl_lexhash_auto_grow_fillrate
  * @param hash  The lexhash to autogrow.
- * @return      Always 0.
+ * @return      1 if the hash was expanded, 0 otherwise.
  */
 int
 cl_lexhash_check_grow(cl_lexhash hash)
 {
   double fill_rate, target_size;
-  cl_lexhash temp;
-  cl_lexhash_entry entry, next;
-  int idx, offset, old_buckets, new_buckets;
+  cl_lexhash_bucket *old_table, *new_table;
+  unsigned int idx, offset, mask, old_buckets, new_buckets;
 
   old_buckets = hash->buckets;
   fill_rate = ((double) hash->entries) / old_buckets;
-  if (hash->auto_grow && (fill_rate > hash->fillrate_limit)) {
-    /* auto-grow is triggered */
-    target_size = floor(((double) hash->entries) / hash->fillrate_target);
-    if (target_size > MAX_BUCKETS) {
-      if (cl_debug) {
-        fprintf(stderr, "[lexhash autogrow: size limit %f exceeded by new target size %f, auto-growing will be disabled]\n",
-                (double) MAX_BUCKETS, target_size);
-      }
-      hash->auto_grow = 0; /* disable auto-grow to avoid further unnecessary attempts */
-      /* grow lexhash to maximum size, but not if this would extend bucket vector by less than 2x (to avoid large reallocation for little benefit) */
-      if (old_buckets > target_size / 2.0) {
-        return 0;
-      }
-      else {
-        target_size = MAX_BUCKETS;
-      }
-    }
-    /* now grow bucket table from old_buckets entries to new_buckets entries */
-    new_buckets = (int) target_size;
-    old_buckets = hash->buckets;
-    if (cl_debug) {
-      fprintf(stderr, "[lexhash autogrow: triggered by fill rate = %3.1f (%d/%d)]\n",
-              fill_rate, hash->entries, old_buckets);
-    }
-    temp = cl_new_lexhash(new_buckets); /* create new hash with target fill rate */
-    new_buckets = temp->buckets; /* the actual number of entries (next prime number) */
-    /* move all entries from hash to the appropriate bucket in temp */
-    for (idx = 0; idx < old_buckets; idx++) {
-      entry = hash->table[idx];
-      while (entry != NULL) {
-        next = entry->next;     /* remember pointer to next entry */
-        offset = hash_string(entry->key) % new_buckets;
-        entry->next = temp->table[offset]; /* insert entry into its bucket in temp (most buckets should contain only 1 entry, as long as hash->fillrate_target is less than 1) */
-        temp->table[offset] = entry;
-        temp->entries++;
-        entry = next;           /* continue while loop */
-      }
-    }
-    assert((temp->entries == hash->entries) && "lexhash.c: inconsistency during hash expansion");
-    cl_free(hash->table);               /* old hash table should be empty and can be deallocated */
-    hash->table = temp->table;          /* update hash from temp (copy hash table and its size) */
-    hash->buckets = temp->buckets;
-    cl_free(temp);                      /* we can simply deallocate temp now, having stolen its hash table */
-    if (cl_debug) {
-      fill_rate = ((double) hash->entries) / hash->buckets;
-      fprintf(stderr, "[lexhash autogrow: new fill rate = %3.1f (%d/%d)]\n",
-              fill_rate, hash->entries, hash->buckets);
+  if (fill_rate >= MAX_FILLRATE)
+    target_size = 2.0 * old_buckets;
+  else if (hash->auto_grow && (fill_rate > hash->fillrate_limit))
+    target_size = ((double) hash->entries) / hash->fillrate_target;
+  else
+    return 0;
+
+  if (old_buckets >= MAX_BUCKETS) {
+    if (hash->entries < old_buckets - 1)
+      return 0;                 /* keep going until the table is completely full */
+    fprintf(stderr, "CL: lexhash size limit exceeded (%d entries). (killed)\n", hash->entries);
+    exit(1);
+  }
+
+  if (cl_debug) {
+    fprintf(stderr, "[lexhash autogrow: triggered by fill rate = %4.2f (%d/%u)]\n",
+            fill_rate, hash->entries, old_buckets);
+  }
+  new_table = cl_lexhash_new_table(target_size, &new_buckets);
+  mask = new_buckets - 1;
+  old_table = hash->table;
+  for (idx = 0; idx < old_buckets; idx++) {
+    if (old_table[idx].ref != 0) {
+      offset = old_table[idx].hash & mask;
+      while (new_table[offset].ref != 0)
+        offset = (offset + 1) & mask;
+      new_table[offset] = old_table[idx];
     }
-    return 1;
   }
-  return 0;
+  cl_free(old_table);
+  hash->table = new_table;
+  hash->buckets = new_buckets;
+  if (cl_debug) {
+    fill_rate = ((double) hash->entries) / hash->buckets;
+    fprintf(stderr, "[lexhash autogrow: new fill rate = %4.2f (%d/%u)]\n",
+            fill_rate, hash->entries, hash->buckets);
+  }
+  return 1;
 }
 
 
@@ -403,40 +587,57 @@ cl_lexhash_check_grow(cl_lexhash hash)
  * Finds the entry corresponding to a particular string in a cl_lexhash.
  *
  * This function is the same as cl_lexhash_find(), but *ret_offset is set to
- * the hashtable offset computed for token (i.e. the index of the bucket within
- * the hashtable), unless *ret_offset == NULL.
+ * the index of the bucket where the token was found or -- if the token is
+ * not in the hash -- the empty bucket where it would be inserted, unless
+ * ret_offset == NULL.  Likewise, *ret_hash is set to the hash value of
+ * the token unless ret_hash == NULL.
  *
  * Note that this function hides the hashing algorithm details from the
- * rest of the lexhash implementation (except cl_lexhash_check_grow, which 
- * re-implements the hashing algorithm for performance reasons).
+ * rest of the lexhash implementation.
  *
- * Usage: entry = cl_lexhash_find_i(cl_lexhash hash, char *token, unsigned int *ret_offset);
+ * Usage: entry = cl_lexhash_find_i(cl_lexhash hash, char *token, unsigned int *ret_offset, unsigned int *ret_hash);
  *
  * This is a non-exported function.
  *
  * @param hash        The hash to search.
  * @param token       The key-string to look for.
  * @param ret_offset  This integer address will be filled with the token's
- *                    hashtable offset (can be NULL, in which case, ignored).
+ *                    bucket index (can be NULL, in which case, ignored).
+ * @param ret_hash    This integer address will be filled with the token's
+ *                    hash value (can be NULL, in which case, ignored).
  * @return            The entry that is found (or NULL if the string is not
  *                    in the hash).
  */
 cl_lexhash_entry
-cl_lexhash_find_i(cl_lexhash hash, char *token, unsigned int *ret_offset)
+cl_lexhash_find_i(cl_lexhash hash, char *token, unsigned int *ret_offset, unsigned int *ret_hash)
 {
-  unsigned int offset;
-  cl_lexhash_entry entry;
+  unsigned int h, offset, mask;
+  size_t len;
+  cl_lexhash_bucket *bucket;
+  cl_lexhash_entry entry = NULL;
 
   assert((hash != NULL && hash->table != NULL && hash->buckets > 0) && "cl_lexhash object was not properly initialised");
 
-  /* get the offset of the bucket to look in by computing the hash of the string */
-  offset = hash_string(token) % hash->buckets;
+  len = strlen(token);
+  h = lexhash_hash(token, len);
+  if (ret_hash != NULL)
+    *ret_hash = h;
+  mask = hash->buckets - 1;
+  /* linear probing: check buckets until we find the key or an empty bucket
+     (there is always at least one empty bucket because fill rate is capped at MAX_FILLRATE) */
+  for (offset = h & mask; ; offset = (offset + 1) & mask) {
+    bucket = &hash->table[offset];
+    if (bucket->ref == 0)
+      break;
+    if (bucket->hash == h) {
+      entry = cl_lexhash_deref(hash, bucket->ref);
+      if (memcmp(entry->key, token, len + 1) == 0)
+        break;
+      entry = NULL;
+    }
+  }
   if (ret_offset != NULL)
     *ret_offset = offset;
-  /* check all entries in this bucket against the specified key */
-  entry = hash->table[offset];
-  while (entry != NULL && strcmp(entry->key, token) != 0)
-    entry = entry->next;
   return entry;
 }
 
@@ -455,7 +656,7 @@ cl_lexhash_find_i(cl_lexhash hash, char *token, unsigned int *ret_offset)
 cl_lexhash_entry
 cl_lexhash_find(cl_lexhash hash, char *token)
 {
-  return cl_lexhash_find_i(hash, token, NULL);
+  return cl_lexhash_find_i(hash, token, NULL, NULL);
 }
 
 
@@ -478,45 +679,36 @@ cl_lexhash_find(cl_lexhash hash, char *token)
 cl_lexhash_entry
 cl_lexhash_add(cl_lexhash hash, char *token)
 {
-  cl_lexhash_entry entry, insert_point;
+  cl_lexhash_entry entry;
   unsigned int offset;          /* this will be set to the index of the bucket this token should go in
                                    by the call to cl_lexhash_find_i                                     */
-  
-  entry = cl_lexhash_find_i(hash, token, &offset);
+  unsigned int h, ref;
+  size_t keylen;
+
+  entry = cl_lexhash_find_i(hash, token, &offset, &h);
 
   if (entry != NULL) {
     /* token already in hash -> increment frequency count */
     entry->freq++;
   }
   else {
-    /* token not in hash -> add new entry for this token */
-    int keylen = strlen(token);
-    /* allocate enough space for key string appended to the struct */
-    entry = (cl_lexhash_entry) cl_malloc(sizeof(struct _cl_lexhash_entry) + keylen);
-    strcpy(entry->key, token); /* embed copy of key in struct */
+    /* token not in hash -> add new entry for this token (with embedded copy of key) */
+    keylen = strlen(token);
+    entry = cl_lexhash_alloc_entry(hash, keylen, &ref);
+    memcpy(entry->key, token, keylen + 1);
     entry->freq = 1;
     entry->id = (hash->next_id)++;
     entry->data.integer = 0;            /* initialise data fields to zero values */
     entry->data.numeric = 0.0;
     entry->data.pointer = NULL;
-    entry->next = NULL;
 
-    /* insert entry into its bucket in the hash table */
-    insert_point = hash->table[offset];
-    if (insert_point == NULL) {
-      hash->table[offset] = entry;      /* only entry in this bucket so far */
-    }
-    else {
-      /* always insert a new entry as the last entry in its bucket (because of Zipf's Law:
-       * frequent lexemes tend to occur early in the corpus and should be first in their buckets for faster access) */
-      while (insert_point->next != NULL)
-        insert_point = insert_point->next;
-      insert_point->next = entry;
-    }
+    /* insert entry into the empty bucket found by cl_lexhash_find_i */
+    hash->table[offset].hash = h;
+    hash->table[offset].ref = ref;
     hash->entries++;
     
-    /* check whether hash needs to auto-grow */
-    if (hash->auto_grow && hash->entries > (hash->fillrate_limit * hash->buckets))
+    /* check whether hash needs to grow */
+    if (hash->entries > (hash->fillrate_limit * hash->buckets))
       cl_lexhash_check_grow(hash);
   }
   return entry;
@@ -540,7 +732,7 @@ cl_lexhash_id(cl_lexhash hash, char *token)
 {
   cl_lexhash_entry entry;
 
-  entry = cl_lexhash_find_i(hash, token, NULL);
+  entry = cl_lexhash_find_i(hash, token, NULL, NULL);
   return (entry != NULL) ? entry->id : -1;
 } 
 
@@ -559,7 +751,7 @@ cl_lexhash_freq(cl_lexhash hash, char *token)
 {
   cl_lexhash_entry entry;
 
-  entry = cl_lexhash_find_i(hash, token, NULL);
+  entry = cl_lexhash_find_i(hash, token, NULL, NULL);
   return (entry != NULL) ? entry->freq : 0;
 } 
 
@@ -571,6 +763,9 @@ cl_lexhash_freq(cl_lexhash hash, char *token)
  * removed from the lexhash. If the string is not in the
  * lexhash to begin with, no action is taken.
  *
+ * The memory used by the entry is only released when the
+ * lexhash itself is deleted.
+ *
  * @param hash   The hash to alter.
  * @param token  The string to remove.
  * @return       The frequency of the deleted entry (0 if the string was not found in the hash).
@@ -578,26 +773,34 @@ cl_lexhash_freq(cl_lexhash hash, char *token)
 int 
 cl_lexhash_del(cl_lexhash hash, char *token)
 {
-  cl_lexhash_entry entry, previous;
-  unsigned int offset, f;
+  cl_lexhash_entry entry;
+  unsigned int hole, offset, home, mask, f;
 
-  entry = cl_lexhash_find_i(hash, token, &offset);
+  entry = cl_lexhash_find_i(hash, token, &hole, NULL);
   if (entry == NULL) {
     return 0;                   /* not in lexhash */
   }
   else {
     f = entry->freq;
-    if (hash->table[offset] == entry) {
-      hash->table[offset] = entry->next;
-    }
-    else {
-      previous = hash->table[offset];
-      while (previous->next != entry)
-        previous = previous->next;
-      previous->next = entry->next;
-    }
     cl_delete_lexhash_entry(hash, entry);
+    entry->id = -1;             /* mark as deleted, so the iterator will skip the entry */
     hash->entries--;
+
+    /* backward-shift deletion: move following entries of the probe sequence into the hole
+       if the hole lies between their home bucket and their current position */
+    mask = hash->buckets - 1;
+    offset = hole;
+    while (1) {
+      offset = (offset + 1) & mask;
+      if (hash->table[offset].ref == 0)
+        break;
+      home = hash->table[offset].hash & mask;
+      if (((offset - home) & mask) >= ((offset - hole) & mask)) {
+        hash->table[hole] = hash->table[offset];
+        hole = offset;
+      }
+    }
+    hash->table[hole].ref = 0;
     return f;
   }
 }
@@ -634,15 +837,17 @@ void
 cl_lexhash_iterator_reset(cl_lexhash hash)
 {
   assert((hash != NULL && hash->table != NULL && hash->buckets > 0) && "cl_lexhash object was not properly initialised");
-  hash->iter_bucket = -1;
-  hash->iter_point = NULL;
+  hash->iter_block = 0;
+  hash->iter_offset = 0;
 }
 
 /**
  * Gets the next entry from the hash's entry-iterator.
  *
  * This function returns the next entry from the hash, or NULL if there are
- * no more entries. Keep in mind that the hash is traversed in an unspecified order.
+ * no more entries. Keep in mind that the hash is traversed in an unspecified order
+ * (the current implementation walks through the string arena, i.e. returns entries
+ * in the order of their IDs).
  *
  * The iterator allows access over all the entries in a lexhash.
  *
@@ -655,15 +860,20 @@ cl_lexhash_iterator_reset(cl_lexhash hash)
 cl_lexhash_entry
 cl_lexhash_iterator_next(cl_lexhash hash)
 {
+  cl_lexhash_block block;
   cl_lexhash_entry point;
 
-  point = hash->iter_point;
-  while (point == NULL) {
-    hash->iter_bucket++;
-    if (hash->iter_bucket >= hash->buckets)
-      return NULL; /* we've reached the end of the hash */
-    point = hash->table[hash->iter_bucket];
+  while (hash->iter_block < hash->arena_blocks) {
+    block = hash->arena[hash->iter_block];
+    if (hash->iter_offset >= block->used) {
+      hash->iter_block++;
+      hash->iter_offset = 0;
+      continue;
+    }
+    point = (cl_lexhash_entry) ((char *) block->data + hash->iter_offset);
+    hash->iter_offset += cl_lexhash_entry_size(strlen(point->key));
+    if (point->id >= 0)         /* skip deleted entries */
+      return point;
   }
-  hash->iter_point = point->next;
-  return point;
+  return NULL; /* we've reached the end of the hash */
 }
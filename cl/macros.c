@@ -487,7 +487,7 @@ cl_cpos_offset(int cpos, int offset, int corpus_size, int clamp) {
       return cpos + offset;
   }
   else if (offset < 0) {
-    if (corpus_size + offset < 0)
+    if (cpos + offset < 0)
       return(clamp ? 0 : CDA_EPOSORNG);
     else
       return cpos + offset;
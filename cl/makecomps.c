@@ -27,6 +27,7 @@
 
 #include <ctype.h>
 #include <sys/types.h>
+#include <glib.h>
 
 
 #include "globals.h"
@@ -51,25 +52,190 @@ char errmsg[CL_MAX_LINE_LENGTH];
 
 /* ------------------------------------------------------------ SORTED LEXICONS */
 
+/** Partitions with at most this many strings are sorted by insertion sort */
+#define LEXSORT_INSERTION_THRESHOLD 16
 
-static MemBlob *SortLexicon;
-static MemBlob *SortIndex;
+/**
+ * A lexicon entry to be sorted: pointer to the string and its lexicon ID.
+ *
+ * Strings are accessed as signed char, since this is the order defined by cl_strcmp().
+ */
+typedef struct _LexSortItem {
+  signed char *s;
+  int id;
+} LexSortItem;
+
+/**
+ * Data shared by the threads that sort the buckets of a lexicon (see lexsort_worker).
+ */
+typedef struct _LexSortJob {
+  LexSortItem *items;           /**< lexicon entries, already distributed into buckets by their first byte */
+  int start[257];               /**< start of each bucket in <items>, in cl_strcmp order of the first byte */
+  int next;                     /**< next bucket to be sorted */
+  GMutex lock;                  /**< protects <next> */
+} LexSortJob;
 
 
 /**
- * Sorts two lexicon entries using cl_strcmp.
+ * Sorts lexicon entries that share the first <depth> bytes by insertion sort.
+ */
+static void
+lexsort_insertion(LexSortItem *a, int n, int depth)
+{
+  LexSortItem tmp;
+  signed char *s1, *s2;
+  int i, j;
+
+  for (i = 1; i < n; i++) {
+    tmp = a[i];
+    for (j = i; j > 0; j--) {
+      /* same as cl_strcmp(), but skipping the common prefix */
+      for (s1 = a[j-1].s + depth, s2 = tmp.s + depth; (*s1 == *s2) && (*s1 != '\0'); s1++, s2++)
+        ;
+      if (*s1 <= *s2)
+        break;
+      a[j] = a[j-1];
+    }
+    a[j] = tmp;
+  }
+}
+
+/**
+ * Sorts lexicon entries that share the first <depth> bytes in cl_strcmp() order.
  *
- * This function is for use with qsort().
+ * This is a multikey quicksort (Bentley & Sedgewick 1997): entries are split three ways
+ * on the byte at offset <depth>, and only the middle part moves on to the next byte.
+ * Each byte of a string is thus looked at only a few times, rather than in every
+ * comparison as with qsort().
  */
-static int
-scompare(const void *idx1, const void *idx2)
+static void
+lexsort_mkqs(LexSortItem *a, int n, int depth)
 {
-  /* this is the way qsort(..) is meant to be used: give it void*
-     and cast them to the actual type in the compare function;
-     the definition below conforms to ANSI and POSIX standards according to the LDP */
-  return
-    cl_strcmp((char *) SortLexicon->data + ntohl(SortIndex->data[*(int *)idx1]),
-              (char *) SortLexicon->data + ntohl(SortIndex->data[*(int *)idx2]));
+  LexSortItem tmp;
+  int lt, gt, i;
+  signed char v, c1, c2, c3;
+
+  while (n > LEXSORT_INSERTION_THRESHOLD) {
+    /* pivot: median of three */
+    c1 = a[0].s[depth];
+    c2 = a[n/2].s[depth];
+    c3 = a[n-1].s[depth];
+    if (c1 > c2) { v = c1; c1 = c2; c2 = v; }
+    v = (c3 < c1) ? c1 : (c3 > c2) ? c2 : c3;
+
+    /* three-way partition: a[0 .. lt-1] < v, a[lt .. gt] == v, a[gt+1 .. n-1] > v */
+    lt = 0;
+    gt = n - 1;
+    i = 0;
+    while (i <= gt) {
+      if (a[i].s[depth] < v) {
+        tmp = a[lt]; a[lt] = a[i]; a[i] = tmp;
+        lt++;
+        i++;
+      }
+      else if (a[i].s[depth] > v) {
+        tmp = a[gt]; a[gt] = a[i]; a[i] = tmp;
+        gt--;
+      }
+      else
+        i++;
+    }
+
+    lexsort_mkqs(a, lt, depth);
+    if (v != '\0')  /* otherwise, the middle part consists of identical strings */
+      lexsort_mkqs(a + lt, gt - lt + 1, depth + 1);
+    a += gt + 1;
+    n -= gt + 1;
+  }
+  lexsort_insertion(a, n, depth);
+}
+
+/**
+ * Thread function that sorts buckets of a LexSortJob until none are left.
+ */
+static gpointer
+lexsort_worker(gpointer data)
+{
+  LexSortJob *job = (LexSortJob *) data;
+  int b;
+
+  while (1) {
+    g_mutex_lock(&job->lock);
+    b = job->next++;
+    g_mutex_unlock(&job->lock);
+    if (b >= 256)
+      break;
+    /* bucket 128 holds the empty string, if any (byte 0 in signed order) */
+    if (b != 128)
+      lexsort_mkqs(job->items + job->start[b], job->start[b+1] - job->start[b], 1);
+  }
+
+  return NULL;
+}
+
+/**
+ * Computes the cl_strcmp() order of all entries in a lexicon.
+ *
+ * The entries are first distributed into buckets according to their first byte
+ * (an MSD radix sort step), and each bucket is then sorted with lexsort_mkqs().
+ * Buckets are sorted by up to cl_threads threads in parallel.
+ *
+ * @param lexicon   The lexicon strings.
+ * @param lexidx    Offsets of the lexicon strings (in network byte order).
+ * @param n         Number of lexicon entries.
+ * @param sorted    Will be filled with the lexicon IDs in sort order.
+ */
+void
+lexsort(char *lexicon, int *lexidx, int n, int *sorted)
+{
+  LexSortJob job;
+  LexSortItem *items;
+  GThread *workers[CL_MAX_THREADS];
+  int count[256];
+  int pos[256];
+  int i, b, n_threads;
+  signed char *s;
+
+  /* count entries per bucket; bucket index of signed char c is c + 128, giving the cl_strcmp order */
+  memset(count, 0, sizeof(count));
+  for (i = 0; i < n; i++) {
+    s = (signed char *) lexicon + ntohl(lexidx[i]);
+    count[*s + 128]++;
+  }
+  job.start[0] = 0;
+  for (b = 0; b < 256; b++) {
+    pos[b] = job.start[b];
+    job.start[b+1] = job.start[b] + count[b];
+  }
+
+  items = (LexSortItem *) cl_malloc(sizeof(LexSortItem) * (n > 0 ? n : 1));
+  for (i = 0; i < n; i++) {
+    s = (signed char *) lexicon + ntohl(lexidx[i]);
+    b = *s + 128;
+    items[pos[b]].s = s;
+    items[pos[b]].id = i;
+    pos[b]++;
+  }
+
+  job.items = items;
+  job.next = 0;
+  g_mutex_init(&job.lock);
+
+  n_threads = (cl_threads > 1) ? cl_threads : 1;
+  if (n < 1024)
+    n_threads = 1;
+  /* the calling thread sorts buckets as well */
+  for (i = 1; i < n_threads; i++)
+    workers[i] = g_thread_new("lexsort", lexsort_worker, &job);
+  lexsort_worker(&job);
+  for (i = 1; i < n_threads; i++)
+    g_thread_join(workers[i]);
+  g_mutex_clear(&job.lock);
+
+  for (i = 0; i < n; i++)
+    sorted[i] = items[i].id;
+
+  cl_free(items);
 }
 
 
@@ -82,6 +248,8 @@ scompare(const void *idx1, const void *idx2)
 /**
  * creates a sorted index from the (already existing) lexicon index of the Attribute.
  *
+ * The sort is done by lexsort(); utils/lexsort-bench compares it with a plain qsort().
+ *
  * @see create_component
  */
 int
@@ -123,15 +291,8 @@ creat_sort_lexicon(Component *lexsrt)
 
   lexsrt->size = lexidx->size;
 
-  /* fill the area with ascending indices */
-  for (i = 0; i < lexsrt->data.nr_items; i++)
-    lexsrt->data.data[i] = i;
-
   /* now sort the indices according to the strings they index to */
-
-  SortLexicon = &(lex->data);                /* for the comparison function */
-  SortIndex = &(lexidx->data);
-  qsort(lexsrt->data.data, lexsrt->size, sizeof(int), scompare);
+  lexsort((char *) lex->data.data, lexidx->data.data, lexsrt->size, lexsrt->data.data);
 
   if (write_file_from_blob(lexsrt->path, &(lexsrt->data), 1)) {
 
@@ -227,6 +388,186 @@ creat_freqs(Component *freqs)
 }
 
 
+/* ------------------------------------------------------------ REVERSED CORPUS */
+
+/** Maximum number of bucket files filled in a single pass through the token stream */
+#define REVCORP_MAX_BUCKETS 256
+
+/** Number of (id, cpos) pairs staged in memory for each bucket file before they are written to disk */
+#define REVCORP_STAGE_SIZE 1024
+
+/**
+ * One bucket of the reversed corpus, i.e. a range of lexicon IDs whose occurrences
+ * are sorted in memory in one go.
+ *
+ * While the token stream is read, occurrences of the IDs in the bucket are appended to
+ * a temporary file as (id, cpos) pairs in native byte order; the bucket is then filled
+ * from this file, independently of all other buckets.
+ */
+typedef struct _RevcorpBucket {
+  int first_id;                 /**< first lexicon ID in this bucket */
+  int last_id;                  /**< last lexicon ID in this bucket (inclusive) */
+  int size;                     /**< total frequency of IDs in the bucket, i.e. number of entries in REVCORP */
+  char *tmp_fn;                 /**< filename of the temporary bucket file */
+  FILE *tmp_fd;                 /**< temporary bucket file */
+  int *stage;                   /**< (id, cpos) pairs waiting to be written to the bucket file */
+  int n_staged;                 /**< number of pairs in <stage> */
+  /* the following fields are used while the bucket is filled */
+  int *freqs;                   /**< the frequency table (in network byte order) */
+  int *buffer;                  /**< buffer for REVCORP entries of this bucket (room for <size> INTs) */
+  int **ptab;                   /**< pointers into <buffer>, indexed by lexicon ID */
+  int ok;                       /**< false if the bucket file was inconsistent with the frequency table */
+} RevcorpBucket;
+
+/**
+ * Writes the staged (id, cpos) pairs of a bucket to its temporary file.
+ */
+static void
+revcorp_bucket_flush(RevcorpBucket *bucket)
+{
+  if (bucket->n_staged > 0) {
+    if (fwrite(bucket->stage, 2 * sizeof(int), bucket->n_staged, bucket->tmp_fd) != bucket->n_staged) {
+      perror(bucket->tmp_fn);
+      exit(1);
+    }
+    bucket->n_staged = 0;
+  }
+}
+
+/**
+ * Sorts the occurrences collected in a bucket file into the bucket's buffer.
+ *
+ * This is a counting sort keyed on lexicon ID; since the bucket file lists occurrences
+ * in corpus order, the result is exactly the corresponding stretch of the REVCORP
+ * component, which is left in <bucket->buffer> in network byte order.
+ *
+ * Different buckets use disjoint ranges of <ptab> and may be filled in parallel threads.
+ *
+ * @param data  Pointer to the RevcorpBucket.
+ */
+static gpointer
+revcorp_bucket_fill(gpointer data)
+{
+  RevcorpBucket *bucket = (RevcorpBucket *) data;
+  int *pairs;
+  int *ptr;
+  int i, n, id;
+
+  ptr = bucket->buffer;
+  for (id = bucket->first_id; id <= bucket->last_id; id++) {
+    bucket->ptab[id] = ptr;
+    ptr += ntohl(bucket->freqs[id]);
+  }
+
+  bucket->ok = 1;
+  pairs = (int *) cl_malloc(2 * sizeof(int) * BUFSIZE);
+  rewind(bucket->tmp_fd);
+  do {
+    n = fread(pairs, 2 * sizeof(int), BUFSIZE, bucket->tmp_fd);
+    for (i = 0; i < 2 * n; i += 2) {
+      id = pairs[i];
+      if ((id < bucket->first_id) || (id > bucket->last_id) || (bucket->ptab[id] >= bucket->buffer + bucket->size)) {
+        bucket->ok = 0;
+        break;
+      }
+      *(bucket->ptab[id]++) = pairs[i + 1];
+    }
+  } while (bucket->ok && (n == BUFSIZE));
+  cl_free(pairs);
+  if (!bucket->ok)
+    return NULL;
+
+  /* check pointers (i.e. observed frequencies vs. data from FREQS component) */
+  ptr = bucket->buffer;
+  for (id = bucket->first_id; id <= bucket->last_id; id++) {
+    ptr += ntohl(bucket->freqs[id]);
+    if (ptr != bucket->ptab[id]) {
+      bucket->ok = 0;
+      return NULL;
+    }
+  }
+
+  /* convert to network byte order here, so that the calling thread only has to write the buffer */
+  for (i = 0; i < bucket->size; i++)
+    bucket->buffer[i] = htonl(bucket->buffer[i]);
+
+  return NULL;
+}
+
+/**
+ * Copies a bucket that consists of a single lexicon ID straight from its temporary file
+ * to the REVCORP file.
+ *
+ * This is used for types whose frequency exceeds the buffer size: since the bucket
+ * file lists occurrences in corpus order, no sorting is required.
+ *
+ * @return  Number of INTs written.
+ */
+static int
+revcorp_bucket_copy(RevcorpBucket *bucket, FILE *revcorp_fd)
+{
+  int *pairs;
+  int i, n, written = 0;
+
+  pairs = (int *) cl_malloc(2 * sizeof(int) * BUFSIZE);
+  rewind(bucket->tmp_fd);
+  do {
+    n = fread(pairs, 2 * sizeof(int), BUFSIZE, bucket->tmp_fd);
+    for (i = 0; i < n; i++) {
+      if (pairs[2 * i] != bucket->first_id) {
+        fprintf(stderr, "CL makecomps: Inconsistent bucket file %s. Aborting.\n", bucket->tmp_fn);
+        exit(1);
+      }
+      NwriteInt(pairs[2 * i + 1], revcorp_fd);
+    }
+    written += n;
+  } while (n == BUFSIZE);
+  cl_free(pairs);
+
+  return written;
+}
+
+/**
+ * Fills a run of buckets in parallel and appends them to the REVCORP file in order.
+ *
+ * @param buckets     The buckets to fill (at most one per worker buffer).
+ * @param n           Number of buckets.
+ * @param buffers     One buffer per bucket, each with room for the largest bucket.
+ * @param revcorp_fd  The REVCORP file.
+ * @return            Number of INTs written.
+ */
+static int
+revcorp_fill_buckets(RevcorpBucket *buckets, int n, int **buffers, FILE *revcorp_fd)
+{
+  GThread *workers[CL_MAX_THREADS];
+  int i, written = 0;
+
+  for (i = 0; i < n; i++)
+    buckets[i].buffer = buffers[i];
+
+  /* the first bucket is filled by the calling thread while the others run in worker threads */
+  for (i = 1; i < n; i++)
+    workers[i] = g_thread_new("creat_rev_corpus", revcorp_bucket_fill, &buckets[i]);
+  revcorp_bucket_fill(&buckets[0]);
+  for (i = 1; i < n; i++)
+    g_thread_join(workers[i]);
+
+  for (i = 0; i < n; i++) {
+    if (!buckets[i].ok) {
+      fprintf(stderr, "CL makecomps: Pointer inconsistency in IDs %d .. %d. Aborting.\n", buckets[i].first_id, buckets[i].last_id);
+      exit(1);
+    }
+    /* buffer is already in network byte order */
+    if (fwrite(buckets[i].buffer, sizeof(int), buckets[i].size, revcorp_fd) != buckets[i].size) {
+      fprintf(stderr, "CL makecomps: Write error on REVCORP file. Aborting.\n");
+      exit(1);
+    }
+    written += buckets[i].size;
+  }
+
+  return written;
+}
+
 /**
  * Creates a reversed corpus component.
  *
@@ -234,6 +575,14 @@ creat_freqs(Component *freqs)
  * which must make sure that the lexicon and (possibly) compressed token stream have been
  * created by now, so CL access to the token stream works.
  *
+ * If the whole index fits into the memory allowed by cl_memory_limit, it is sorted in
+ * memory after a single pass through the token stream. Otherwise, the lexicon is split
+ * into buckets of consecutive IDs that fit into the buffer; occurrences are distributed
+ * to temporary bucket files (up to REVCORP_MAX_BUCKETS per pass through the token stream),
+ * and the buckets are then sorted in memory one after the other, or by cl_threads
+ * threads in parallel (splitting the memory limit between them). Either way, the
+ * resulting file is the same.
+ *
  * @see create_component
  * @see makeall_do_attribute
  * @return  number of passes made through the corpus.
@@ -245,11 +594,17 @@ creat_rev_corpus(Component *revcorp)
   int cpos = 0, f, id, ints_written, pass;
 
   int datasize;
-  int primus, secundus, lexsize, buf_used;
+  int lexsize, n_buckets, n_threads, max_bucket;
+  int first_bucket, last_bucket, n_run;
   int *buffer;
+  int *buffers[CL_MAX_THREADS];
   size_t bufsize;                     /* size of buffer (measured in number of 4-byte integers) */
+  size_t bucket_limit;                /* max. size of a bucket (may be exceeded by a single lexicon ID) */
   int **ptab;                         /* pointers into <buffer> */
-  int *ptr;
+  int ids[BUFSIZE];
+  int i, k, n, lo, hi, mid;
+
+  RevcorpBucket *buckets, *bucket;
 
   FILE *revcorp_fd;
   Attribute *attr;                    /* the attribute we're working on */
@@ -277,7 +632,6 @@ creat_rev_corpus(Component *revcorp)
   if (datasize < bufsize) {
     bufsize = datasize;                /* shrink buffer if full size isn't needed */
   }
-  buffer = cl_malloc(4 * bufsize); /* allocate buffer with 4 bytes per integer */
 
   /* open REVCORP data file for writing */
   if ((revcorp_fd = fopen(revcorp->path, "wb")) == NULL) {
@@ -285,77 +639,184 @@ creat_rev_corpus(Component *revcorp)
     exit(1);
   }
 
-  /*
-     NEW multi-pass algorithm.
-     In each pass through the corpus, occurrences of lex ID <primus> are directly written
-     to the REVCORP file, and occurrences of IDs <primus>+1 ... <secundus> are stored in
-     <buffer> (which has room for <bufsize> INTs), then written to REVCORP file.
-  */
-
   if (cl_debug) {
     fprintf(stderr, "\nCreating REVCORP component as '%s' ... \n", revcorp->path);
     fprintf(stderr, "Size = %d INTs,  Buffer Size = %ld INTs\n", datasize, bufsize);
   }
 
-  primus = 0;
   ints_written = 0;                /* check data sizes (written to file VS. corpus size VS. processed */
   pass = 0;                        /* count pass for debugging output */
-  while (primus < lexsize) {
-
-    /* see how many lexicon IDs fit into the buffer in one pass */
-    buf_used = 0;                /* how many buffer entries are used */
-    for (secundus = primus + 1; secundus < lexsize; secundus++) {
-      /* increment secundus to fit as many IDs as possible into the buffer for this pass */
-      f = cl_id2freq(attr, secundus);
-      if (buf_used + f > bufsize) {
-        break;
-      }
-      else {
-        ptab[secundus] = buffer + buf_used; /* pointer to first occurrence of lex. ID <secundus> in <buffer> */
-        buf_used += f;
-      }
-    }
-    secundus--; /* this is the last valid lexicon ID we're indexing in this pass */
 
-    pass++;
-    if (cl_debug) {
-      double perc = (100.0 * secundus) / lexsize;
-      fprintf(stderr, "CL makecomps: Pass #%-3d (%6.2f%c complete)\n", pass, perc, '%');
+  cl_sequential_access(attr, 1);   /* every pass reads the token stream front to back */
+
+  if (bufsize == datasize) {
+    /* everything fits into memory: a single pass through the corpus fills the buffer */
+    buffer = cl_malloc(sizeof(int) * (bufsize > 0 ? bufsize : 1));
+    for (id = 0, f = 0; id < lexsize; id++) {
+      ptab[id] = buffer + f;
+      f += cl_id2freq(attr, id);
     }
 
-    for (cpos = 0; cpos < datasize; cpos++) {
-      id = cl_cpos2id(attr, cpos);          /* id contains the lex. ID of the token found at <cpos> */
-      assert((id >= 0) && (id < lexsize) && "CL makecomps: Lexicon ID out of range. Abort.");
-      if (id == primus) {
-        NwriteInt(cpos, revcorp_fd); /* converts to network byte order */
-        ints_written++;
+    pass++;
+    for (cpos = 0; cpos < datasize; cpos += n) {
+      n = (datasize - cpos < BUFSIZE) ? datasize - cpos : BUFSIZE;
+      if (cl_cpos2id_range(attr, cpos, cpos + n - 1, ids) != CDA_OK) {
+        fprintf(stderr, "CL makecomps: Can't read token stream at cpos=%d. Abort.\n", cpos);
+        exit(1);
       }
-      else if ((id > primus) && (id <= secundus)) {
-        *(ptab[id]++) = cpos;        /* store occurrence in buffer and update pointer */
+      for (k = 0; k < n; k++) {
+        id = ids[k];
+        assert((id >= 0) && (id < lexsize) && "CL makecomps: Lexicon ID out of range. Abort.");
+        *(ptab[id]++) = cpos + k;        /* store occurrence in buffer and update pointer */
       }
     }
 
     /* check pointers (i.e. observed frequencies vs. data from FREQS component) */
-    ptr = buffer;
-    for (id = primus + 1; id <= secundus; id++) {
-      ptr += cl_id2freq(attr, id);
-      if (ptr != ptab[id]) {
+    for (id = 0, f = 0; id < lexsize; id++) {
+      f += cl_id2freq(attr, id);
+      if (buffer + f != ptab[id]) {
         fprintf(stderr, "CL makecomps: Pointer inconsistency for id=%d. Aborting.\n", id);
         exit(1);
       }
     }
 
     /* write buffered data to REVCORP file (converts to network byte-order) */
-    NwriteInts(buffer, buf_used, revcorp_fd);
-    ints_written += buf_used;
+    NwriteInts(buffer, datasize, revcorp_fd);
+    ints_written = datasize;
 
-    /* now start next pass ... */
-    primus = secundus + 1;
+    cl_free(buffer);
+  }
+  else {
+    /* external-memory algorithm: split the memory limit between the threads that fill buckets */
+    n_threads = (cl_threads > 1) ? cl_threads : 1;
+    bucket_limit = bufsize / n_threads;
+    if (bucket_limit < BUFSIZE) {
+      bucket_limit = BUFSIZE;
+      n_threads = (bufsize / BUFSIZE > 0) ? bufsize / BUFSIZE : 1;
+    }
 
-  } /* endwhile (primus < lexsize) */
+    /* partition the lexicon into buckets of consecutive IDs with total frequency <= bucket_limit;
+     * an ID with higher frequency forms a bucket of its own, which is copied rather than sorted */
+    buckets = NULL;
+    n_buckets = 0;
+    max_bucket = 0;
+    for (id = 0; id < lexsize; id++) {
+      f = cl_id2freq(attr, id);
+      if ((n_buckets == 0) || (buckets[n_buckets - 1].size + (size_t) f > bucket_limit)) {
+        if (n_buckets % 64 == 0)
+          buckets = (RevcorpBucket *) cl_realloc(buckets, sizeof(RevcorpBucket) * (n_buckets + 64));
+        bucket = &buckets[n_buckets++];
+        memset(bucket, 0, sizeof(RevcorpBucket));
+        bucket->first_id = id;
+        bucket->freqs = freqs->data.data;
+        bucket->ptab = ptab;
+      }
+      bucket = &buckets[n_buckets - 1];
+      bucket->last_id = id;
+      bucket->size += f;
+      if (bucket->size <= bucket_limit && bucket->size > max_bucket)
+        max_bucket = bucket->size;
+    }
+
+    if (n_threads > n_buckets)
+      n_threads = n_buckets;
+    for (i = 0; i < n_threads; i++)
+      buffers[i] = (int *) cl_malloc(sizeof(int) * (max_bucket > 0 ? max_bucket : 1));
+
+    if (cl_debug)
+      fprintf(stderr, "CL makecomps: %d buckets of up to %ld INTs, filled by %d thread(s)\n", n_buckets, bucket_limit, n_threads);
+
+    for (first_bucket = 0; first_bucket < n_buckets; first_bucket = last_bucket + 1) {
+      last_bucket = first_bucket + REVCORP_MAX_BUCKETS - 1;
+      if (last_bucket >= n_buckets)
+        last_bucket = n_buckets - 1;
+
+      pass++;
+      if (cl_debug) {
+        double perc = (100.0 * buckets[last_bucket].last_id) / lexsize;
+        fprintf(stderr, "CL makecomps: Pass #%-3d (%6.2f%c complete)\n", pass, perc, '%');
+      }
+
+      /* create bucket files for this pass */
+      for (i = first_bucket; i <= last_bucket; i++) {
+        bucket = &buckets[i];
+        bucket->tmp_fn = (char *) cl_malloc(strlen(revcorp->path) + 16);
+        sprintf(bucket->tmp_fn, "%s.tmp%d", revcorp->path, i);
+        if ((bucket->tmp_fd = fopen(bucket->tmp_fn, "w+b")) == NULL) {
+          perror(bucket->tmp_fn);
+          exit(1);
+        }
+        bucket->stage = (int *) cl_malloc(2 * sizeof(int) * REVCORP_STAGE_SIZE);
+        bucket->n_staged = 0;
+      }
+
+      /* distribute occurrences of all IDs in this pass to bucket files */
+      for (cpos = 0; cpos < datasize; cpos += n) {
+        n = (datasize - cpos < BUFSIZE) ? datasize - cpos : BUFSIZE;
+        if (cl_cpos2id_range(attr, cpos, cpos + n - 1, ids) != CDA_OK) {
+          fprintf(stderr, "CL makecomps: Can't read token stream at cpos=%d. Abort.\n", cpos);
+          exit(1);
+        }
+        for (k = 0; k < n; k++) {
+          id = ids[k];
+          assert((id >= 0) && (id < lexsize) && "CL makecomps: Lexicon ID out of range. Abort.");
+          if ((id < buckets[first_bucket].first_id) || (id > buckets[last_bucket].last_id))
+            continue;
+          /* binary search for the bucket containing <id> */
+          lo = first_bucket;
+          hi = last_bucket;
+          while (lo < hi) {
+            mid = (lo + hi + 1) / 2;
+            if (buckets[mid].first_id <= id)
+              lo = mid;
+            else
+              hi = mid - 1;
+          }
+          bucket = &buckets[lo];
+          bucket->stage[2 * bucket->n_staged] = id;
+          bucket->stage[2 * bucket->n_staged + 1] = cpos + k;
+          if (++bucket->n_staged >= REVCORP_STAGE_SIZE)
+            revcorp_bucket_flush(bucket);
+        }
+      }
+      for (i = first_bucket; i <= last_bucket; i++) {
+        revcorp_bucket_flush(&buckets[i]);
+        cl_free(buckets[i].stage);
+        fflush(buckets[i].tmp_fd);
+      }
+
+      /* fill runs of up to <n_threads> buckets in parallel and append them to REVCORP in order */
+      n_run = 0;
+      for (i = first_bucket; i <= last_bucket + 1; i++) {
+        if ((i > last_bucket) || (buckets[i].size > bucket_limit) || (n_run == n_threads)) {
+          if (n_run > 0)
+            ints_written += revcorp_fill_buckets(&buckets[i - n_run], n_run, buffers, revcorp_fd);
+          n_run = 0;
+        }
+        if (i > last_bucket)
+          break;
+        if (buckets[i].size > bucket_limit)
+          ints_written += revcorp_bucket_copy(&buckets[i], revcorp_fd);
+        else
+          n_run++;
+      }
+
+      /* remove bucket files */
+      for (i = first_bucket; i <= last_bucket; i++) {
+        fclose(buckets[i].tmp_fd);
+        unlink(buckets[i].tmp_fn);
+        cl_free(buckets[i].tmp_fn);
+      }
+    }
+
+    for (i = 0; i < n_threads; i++)
+      cl_free(buffers[i]);
+    cl_free(buckets);
+  }
 
   /* we're done: close REVCORP filehandle */
   fclose(revcorp_fd);
+  cl_sequential_access(attr, 0);
 
   /* finally, check amount of data read/written vs. expected */
   if ((ints_written != cpos) || (ints_written != datasize)) {
@@ -364,7 +825,6 @@ creat_rev_corpus(Component *revcorp)
   }
 
   /* free allocated memory */
-  cl_free(buffer);
   cl_free(ptab);
 
   /*   (void) load_component(attr, CompRevCorpus);  */
@@ -435,3 +895,189 @@ creat_rev_corpus_idx(Component *revcidx)
 
   return 1;
 }
+
+
+/* ------------------------------------------------------------ STRUCTURE VALUE INDEX */
+
+/** Annotation strings of an s-attribute (.avs data), used by the comparison function for sorting values */
+static char *SortValues;
+
+/** qsort callback: compares two offsets into SortValues by the strings they point to (non-exported). */
+static int
+avi_compare(const void *p1, const void *p2)
+{
+  return strcmp(SortValues + *((const int *) p1), SortValues + *((const int *) p2));
+}
+
+/** qsort callback: compares two integers (non-exported). */
+static int
+avi_intcompare(const void *p1, const void *p2)
+{
+  int i1 = *((const int *) p1), i2 = *((const int *) p2);
+  return (i1 < i2) ? -1 : (i1 > i2) ? 1 : 0;
+}
+
+/**
+ * Writes the value index (CompStrucAVI) of an s-attribute with annotations to a file.
+ *
+ * The value index assigns an ID to each distinct annotation string, in sort order, so
+ * that constraints on the annotations can be evaluated once per distinct value instead
+ * of once per region.  The file consists of the following blocks of integers, all in
+ * network byte order (where V is the number of distinct values and R the number of regions):
+ *
+ *  - a header with V, R and fingerprints of the .avs and .avx files (size, modification
+ *    time and checksum, see file_fingerprint(); to detect a stale index)
+ *  - V offsets into the .avs file, sorted by the strings they point to (= the value lexicon)
+ *  - R value IDs (one for each region)
+ *  - V + 1 start positions of the regions of each value in the following block
+ *  - R region numbers, grouped by value ID (and in ascending order for each value)
+ *
+ * This function works directly on files, so it can be used by the encoding tools
+ * before the s-attribute has been declared in a registry file.
+ *
+ * @param avs_path  Filename of the annotation strings (.avs).
+ * @param avx_path  Filename of the annotation index (.avx).
+ * @param avi_path  Filename of the value index to be written.
+ * @return          Boolean: true for success, false for failure.
+ */
+int
+write_struc_value_index(char *avs_path, char *avx_path, char *avi_path)
+{
+  MemBlob avs, avx;
+  FILE *fd;
+  int n_regions, n_values, i, v, offset, header[STRUC_VALUE_INDEX_HEADER];
+  int *offsets, *lexicon, *value_of, *start, *next, *strucs;
+
+  init_mblob(&avs);
+  init_mblob(&avx);
+  if (file_length(avx_path) == 0) {
+    /* no regions: write an empty index (the .avs file is empty as well and can't be memory-mapped) */
+    if ((fd = fopen(avi_path, "wb")) == NULL) {
+      perror(avi_path);
+      return 0;
+    }
+    header[0] = header[1] = 0;
+    file_fingerprint(avs_path, NULL, 0, header + 2);
+    file_fingerprint(avx_path, NULL, 0, header + 2 + FILE_FINGERPRINT_SIZE);
+    NwriteInts(header, STRUC_VALUE_INDEX_HEADER, fd);
+    NwriteInt(0, fd);
+    return (EOF != fclose(fd));
+  }
+  if (!read_file_into_blob(avs_path, MMAPPED, sizeof(char), &avs) ||
+      !read_file_into_blob(avx_path, MMAPPED, sizeof(int), &avx)) {
+    fprintf(stderr, "CL makecomps: Can't read annotations %s / %s, can't create value index\n", avs_path, avx_path);
+    mfree(&avs);
+    mfree(&avx);
+    return 0;
+  }
+  n_regions = avx.nr_items / 2;
+
+  /* annotations are stored only once in the .avs file, so each distinct value has its own offset */
+  offsets = (int *) cl_malloc((n_regions > 0 ? n_regions : 1) * sizeof(int));
+  for (i = 0; i < n_regions; i++) {
+    if (ntohl(avx.data[2 * i]) != i) {
+      fprintf(stderr, "CL makecomps: %s has annotations for non-consecutive regions, can't create value index\n", avx_path);
+      cl_free(offsets);
+      mfree(&avs);
+      mfree(&avx);
+      return 0;
+    }
+    offsets[i] = ntohl(avx.data[2 * i + 1]);
+  }
+  qsort(offsets, n_regions, sizeof(int), avi_intcompare);
+  n_values = 0;
+  for (i = 0; i < n_regions; i++)
+    if (i == 0 || offsets[i] != offsets[n_values - 1])
+      offsets[n_values++] = offsets[i];
+
+  /* the value lexicon: offsets sorted by annotation strings */
+  lexicon = (int *) cl_malloc((n_values > 0 ? n_values : 1) * sizeof(int));
+  memcpy(lexicon, offsets, n_values * sizeof(int));
+  SortValues = (char *) avs.data;
+  qsort(lexicon, n_values, sizeof(int), avi_compare);
+
+  /* value ID of each offset (<offsets> is sorted, so we can look up the position of each offset by binary search) */
+  value_of = (int *) cl_malloc((n_values > 0 ? n_values : 1) * sizeof(int));
+  for (v = 0; v < n_values; v++) {
+    int *p = (int *) bsearch(&(lexicon[v]), offsets, n_values, sizeof(int), avi_intcompare);
+    value_of[p - offsets] = v;
+  }
+
+  /* value IDs of regions and reverse index (counting sort by value ID) */
+  start = (int *) cl_calloc(n_values + 1, sizeof(int));
+  next = (int *) cl_malloc((n_values > 0 ? n_values : 1) * sizeof(int));
+  strucs = (int *) cl_malloc((n_regions > 0 ? n_regions : 1) * sizeof(int));
+  for (i = 0; i < n_regions; i++) {
+    offset = ntohl(avx.data[2 * i + 1]);
+    v = value_of[(int *) bsearch(&offset, offsets, n_values, sizeof(int), avi_intcompare) - offsets];
+    strucs[i] = v;                /* temporarily store value IDs of regions here */
+    start[v + 1]++;
+  }
+  for (v = 0; v < n_values; v++) {
+    start[v + 1] += start[v];
+    next[v] = start[v];
+  }
+
+  if ((fd = fopen(avi_path, "wb")) == NULL) {
+    perror(avi_path);
+    fprintf(stderr, "CL makecomps: Can't open %s for writing\n", avi_path);
+    cl_free(offsets); cl_free(lexicon); cl_free(value_of); cl_free(start); cl_free(next); cl_free(strucs);
+    mfree(&avs);
+    mfree(&avx);
+    return 0;
+  }
+  header[0] = n_values;
+  header[1] = n_regions;
+  file_fingerprint(avs_path, avs.data, avs.size, header + 2);
+  file_fingerprint(avx_path, avx.data, avx.size, header + 2 + FILE_FINGERPRINT_SIZE);
+  NwriteInts(header, STRUC_VALUE_INDEX_HEADER, fd);
+  NwriteInts(lexicon, n_values, fd);
+  NwriteInts(strucs, n_regions, fd);
+  NwriteInts(start, n_values + 1, fd);
+  /* <offsets> isn't needed any more and is re-used for the list of regions by value ID */
+  for (i = 0; i < n_regions; i++)
+    offsets[next[strucs[i]]++] = i;
+  NwriteInts(offsets, n_regions, fd);
+
+  i = ferror(fd);
+  if (EOF == fclose(fd) || i) {
+    perror(avi_path);
+    fprintf(stderr, "CL makecomps: Error writing %s\n", avi_path);
+    i = 1;
+  }
+
+  cl_free(offsets); cl_free(lexicon); cl_free(value_of); cl_free(start); cl_free(next); cl_free(strucs);
+  mfree(&avs);
+  mfree(&avx);
+  return (i == 0);
+}
+
+/**
+ * Creates the CompStrucAVI component (value index of an s-attribute with annotations).
+ *
+ * @see write_struc_value_index
+ * @see create_component
+ */
+int
+creat_struc_value_index(Component *avi)
+{
+  Component *avs, *avx;
+
+  assert(avi && "creat_struc_value_index called with NULL component");
+  assert(avi->attribute && "attribute of component is null");
+  assert(avi->path != NULL);
+
+  avs = find_component(avi->attribute, CompStrucAVS);
+  avx = find_component(avi->attribute, CompStrucAVX);
+  if (!cl_struc_values(avi->attribute) || avs == NULL || avx == NULL) {
+    fprintf(stderr, "CL makecomps: s-attribute %s has no annotations, can't create value index\n", avi->attribute->any.name);
+    return 0;
+  }
+
+  if (!write_struc_value_index(avs->path, avx->path, avi->path))
+    return 0;
+
+  /* load the new component, so that it is ready for use */
+  (void) load_component(avi->attribute, CompStrucAVI);
+  return 1;
+}
@@ -21,7 +21,13 @@
 #include "globals.h"
 
 #include "attributes.h"
+#include "fileutils.h"
 
+/** Number of header integers in the value index (CompStrucAVI): V, R and fingerprints of the .avs and .avx files */
+#define STRUC_VALUE_INDEX_HEADER (2 + 2 * FILE_FINGERPRINT_SIZE)
+
+
+void lexsort(char *lexicon, int *lexidx, int n, int *sorted);
 
 int creat_sort_lexicon(Component *lexsrt);
 
@@ -31,4 +37,8 @@ int creat_rev_corpus(Component *component);
 
 int creat_rev_corpus_idx(Component *component);
 
+int creat_struc_value_index(Component *avi);
+
+int write_struc_value_index(char *avs_path, char *avx_path, char *avi_path);
+
 #endif
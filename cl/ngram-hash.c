@@ -16,39 +16,43 @@
  */
 
 
+#include <glib.h>
+#include <math.h>
+#include <stdint.h>
+#ifndef __MINGW__
+#include <unistd.h>
+#endif
+
 #include "globals.h"
 #include "macros.h"
 #include "lexhash.h"
 #include "ngram-hash.h"
 
-#include <math.h>
-
 
 /** Defines the default number of buckets in an n-gram hash. */
 #define DEFAULT_NR_OF_BUCKETS 250000
 
 /** Default parameters for auto-growing the table of buckets (@see cl_ngram_hash_auto_grow_fillrate for details). */
-#define DEFAULT_FILLRATE_LIMIT(n) 5.0
-#define DEFAULT_FILLRATE_TARGET(n) 1.0 /**< keep memory overhead for bucket table below 50% */
+#define DEFAULT_FILLRATE_LIMIT 0.8
+#define DEFAULT_FILLRATE_TARGET 0.4
 
-/* -- fill rate limits could also be adapted to n-gram size, but this doesn't seem to improve speed much --
-#define DEFAULT_FILLRATE_LIMIT(n) ((n >=5) ? 3.0 : 5.0)
-#define DEFAULT_FILLRATE_TARGET(n) ((n >= 5) ? 0.5 : 1.0)
-*/
+/** The table is always expanded (or spilled to disk) at this fill rate, even if auto-grow is disabled. */
+#define MAX_FILLRATE 0.9
 
-/** Maximum number of buckets n-gram hash will try to allocate when auto-growing. */
-#define MAX_BUCKETS 1000000007  /**< 1 billion (incremented to next prime number) */
+/** Maximum number of buckets an n-gram hash will allocate (must be a power of 2). */
+#define MAX_BUCKETS 0x80000000U  /* 2^31 */
 
 /** Maximum number of entries that can be stored in the n-gram hash */
 #define MAX_ENTRIES 2147483647  /**< 2^31 - 1 */
 
+/** Tests whether bucket i of the n-gram hash is in use. */
+#define BUCKET_USED(hash, i) ((hash)->used[(i) >> 3] & (1 << ((i) & 7)))
+
 
 /*
  * basic utility functions
  */
 
-/* find_prime() has been imported from "lexhash.h" */
-
 /** Computes 32bit hash value for n-gram */
 unsigned int
 hash_ngram(int N, int *tuple)
@@ -63,8 +67,35 @@ hash_ngram(int N, int *tuple)
   return result;
 }
 
+/**
+ * Computes the hash value used by cl_ngram_hash for an n-gram.
+ *
+ * Unlike hash_ngram(), this function works on whole integers (one multiplication per
+ * tuple element) and finishes with the 64-bit mixing function of MurmurHash3, so that the
+ * low bits used to index a power-of-2 table are well distributed.
+ *
+ * @param N      N-gram size.
+ * @param tuple  The n-gram.
+ * @return       The hash value.
+ */
+static unsigned int
+ngram_hash_tuple(int N, int *tuple)
+{
+  uint64_t h = (uint64_t) N;
+  int i;
 
-/** TODO: consider alternative hash functions (see cl/lexhash.h) */
+  for (i = 0; i < N; i++) {
+    h ^= (uint32_t) tuple[i];
+    h *= 0x9e3779b97f4a7c15ULL;
+    h ^= h >> 32;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return (unsigned int) h;
+}
 
 
 /*
@@ -79,20 +110,36 @@ hash_ngram(int N, int *tuple)
 /**
  * Underlying structure for the cl_ngram_hash object.
  *
- * A cl_ngram_hash contains a number of buckets. Each bucket is
- * a linked-list of cl_ngram_hash_entry objects.
+ * A cl_ngram_hash is an open-addressing hash table with linear probing,
+ * whose entries are stored directly in the table.  Each bucket consists of
+ * N+1 integers: the frequency count followed by the n-gram, i.e. exactly the
+ * layout of a cl_ngram_hash_entry.  A bit vector records which buckets are in
+ * use, so no values have to be reserved as empty markers.  The number of
+ * buckets is always a power of 2.
  *
+ * If a memory limit has been set, the hash table is not expanded beyond this
+ * limit.  Instead, all entries are sorted and written to a temporary file (a
+ * "run"), and the table is cleared.  The iterator then merges the runs.
  */
 struct _cl_ngram_hash {
-  cl_ngram_hash_entry *table;   /**< table of buckets; each "bucket" is a pointer to the list of entries that make up that bucket */
-  unsigned int buckets;         /**< number of buckets in the hash table */
+  int *table;                   /**< table of buckets, each consisting of N+1 integers (freq, ngram[0], ..., ngram[N-1]) */
+  unsigned char *used;          /**< bit vector marking buckets that are in use */
+  unsigned int buckets;         /**< number of buckets in the hash table (power of 2) */
   int N;                        /**< n-gram size */
-  int entries;                  /**< current number of entries in this hash */
+  int entries;                  /**< current number of entries in this hash (in memory) */
   int auto_grow;                /**< boolean: whether to expand this hash automatically; true by default */
   double fillrate_limit;        /**< fillrate limit that triggers expansion of bucket table (with auto_grow) */
   double fillrate_target;       /**< target fillrate after expansion of bucket table (with auto_grow) */
-  int iter_bucket;              /**< bucket currently processed by the single iterator of the hash table */
-  cl_ngram_hash_entry iter_point;   /**< next entry to be returned by the iterator (NULL -> go to next bucket) */
+  unsigned int iter_bucket;     /**< next bucket to be examined by the single iterator of the hash table */
+  size_t memory_limit;          /**< maximum size of the bucket table in bytes (0 = unlimited) */
+  char *tmp_dir;                /**< directory for temporary files (NULL = system default) */
+  FILE **runs;                  /**< temporary files with sorted runs of entries spilled from the table */
+  int n_runs;                   /**< number of runs spilled to disk */
+  int *merge_records;           /**< current record of each run during a merge (N+1 integers per run) */
+  int *merge_heap;              /**< heap of run numbers, ordered by their current records */
+  int merge_heap_size;          /**< number of runs that have not been exhausted yet */
+  int *merge_entry;             /**< the merged entry returned by the iterator (N+1 integers) */
+  int merging;                  /**< boolean: whether the iterator merges runs */
 };
 
 
@@ -100,12 +147,47 @@ struct _cl_ngram_hash {
  * cl_ngram_hash methods
  */
 
+/**
+ * Computes the number of bytes needed for a bucket table of the specified size.
+ *
+ * This is a non-exported function.
+ */
+size_t
+cl_ngram_hash_table_bytes(int N, unsigned int buckets)
+{
+  return (size_t) buckets * (N + 1) * sizeof(int) + (buckets + 7) / 8;
+}
+
+/**
+ * Allocates a new (empty) bucket table for an n-gram hash, with at least the specified number of buckets.
+ *
+ * The number of buckets is rounded up to the next power of 2.  Both hash->table and
+ * hash->used are overwritten, so they must have been saved or freed by the caller.
+ *
+ * This is a non-exported function.
+ *
+ * @param hash     The n-gram hash.
+ * @param buckets  Minimum number of buckets.
+ */
+void
+cl_ngram_hash_new_table(cl_ngram_hash hash, double buckets)
+{
+  unsigned int size = 16;
+
+  while (size < buckets && size < MAX_BUCKETS)
+    size *= 2;
+  hash->buckets = size;
+  hash->table = (int *) cl_malloc((size_t) size * (hash->N + 1) * sizeof(int));
+  hash->used = (unsigned char *) cl_calloc((size + 7) / 8, 1);
+}
+
 /**
  * Creates a new cl_ngram_hash object.
  *
  * @param N          N-gram size
- * @param buckets    The number of buckets in the newly-created cl_ngram_hash;
- *                   set to 0 to use the default number of buckets.
+ * @param buckets    The number of buckets in the newly-created cl_ngram_hash
+ *                   (rounded up to a power of 2); set to 0 to use the default
+ *                   number of buckets.
  * @return           The new cl_ngram_hash.
  */
 cl_ngram_hash 
@@ -119,14 +201,21 @@ cl_new_ngram_hash(int N, int buckets)
   
   hash = (cl_ngram_hash) cl_malloc(sizeof(struct _cl_ngram_hash));
   hash->N = N;
-  hash->buckets = find_prime(buckets);
-  hash->table = cl_calloc(hash->buckets, sizeof(cl_ngram_hash_entry));
+  cl_ngram_hash_new_table(hash, buckets);
   hash->entries = 0;
   hash->auto_grow = 1;
-  hash->fillrate_limit = DEFAULT_FILLRATE_LIMIT(N);
-  hash->fillrate_target = DEFAULT_FILLRATE_TARGET(N);
-  hash->iter_bucket = -1;
-  hash->iter_point = NULL;
+  hash->fillrate_limit = DEFAULT_FILLRATE_LIMIT;
+  hash->fillrate_target = DEFAULT_FILLRATE_TARGET;
+  hash->iter_bucket = 0;
+  hash->memory_limit = 0;
+  hash->tmp_dir = NULL;
+  hash->runs = NULL;
+  hash->n_runs = 0;
+  hash->merge_records = NULL;
+  hash->merge_heap = NULL;
+  hash->merge_heap_size = 0;
+  hash->merge_entry = NULL;
+  hash->merging = 0;
   return hash;
 }
 
@@ -134,8 +223,8 @@ cl_new_ngram_hash(int N, int buckets)
 /**
  * Deletes a cl_ngram_hash object.
  *
- * This deletes all the entries in all the buckets in the ngram_hash,
- * plus the cl_ngram_hash itself.
+ * This deletes all the entries in the ngram_hash and any
+ * temporary files, plus the cl_ngram_hash itself.
  *
  * @param hash  The cl_ngram_hash to delete.
  */
@@ -143,19 +232,18 @@ void
 cl_delete_ngram_hash(cl_ngram_hash hash)
 {
   int i;
-  cl_ngram_hash_entry entry, temp;
-  
-  if (hash != NULL && hash->table != NULL) {
-    for (i = 0; i < hash->buckets; i++) {
-      entry = hash->table[i];
-      while (entry != NULL) {
-        temp = entry;
-        entry = entry->next;
-        cl_free(entry);
-      }
-    }
-  }
+
+  if (hash == NULL)
+    return;
+  for (i = 0; i < hash->n_runs; i++)
+    fclose(hash->runs[i]);      /* temporary files are removed automatically */
+  cl_free(hash->runs);
+  cl_free(hash->merge_records);
+  cl_free(hash->merge_heap);
+  cl_free(hash->merge_entry);
+  cl_free(hash->tmp_dir);
   cl_free(hash->table);
+  cl_free(hash->used);
   cl_free(hash);
 }
 
@@ -168,6 +256,11 @@ cl_delete_ngram_hash(cl_ngram_hash hash)
  *
  * Note the default value for this setting is SWITCHED ON.
  *
+ * Since an open-addressing table cannot hold more entries than it
+ * has buckets, an n-gram hash is always doubled in size (or spilled
+ * to disk, @see cl_ngram_hash_set_memory_limit) when its fill rate
+ * reaches 90%, even if auto-grow has been switched off.
+ *
  * @see         cl_ngram_hash_auto_grow_fillrate, cl_ngram_hash_check_grow
  * @param hash  The hash that will be affected.
  * @param flag  New value for autogrow setting: boolean where
@@ -186,41 +279,24 @@ cl_ngram_hash_auto_grow(cl_ngram_hash hash, int flag)
  * These settings are only relevant if auto-growing is enabled.
  *
  * The decision to expand the bucket table of a ngram_hash is based
- * on its fill rate, i.e. the average number of entries in each
- * bucket. Under normal circumstances, this value corresponds to 
- * the average number of comparisons required to insert a new 
- * entry into the hash (locating an existing value should require
- * roughly half as many comparisons).
+ * on its fill rate, i.e. the proportion of buckets that are in use.
+ * With linear probing, the average number of buckets that have to be
+ * checked for each hash access grows quickly as the fill rate approaches 1.
  *
  * Auto-growing is triggered if the fill rate exceeds a specified
  * limit.  The new number of buckets is chosen so that the fill
- * rate after expansion corresponds to the specified target value.
+ * rate after expansion is at most the specified target value
+ * (the number of buckets is always a power of 2).
  * 
  * The two fill rate parameters represent a trade-off between memory
- * overhead (8 bytes for each bucket) and performance (average number
- * of entries that have been checked for each hash access), which
- * depends crucially on the value of N (i.e. n-gram size).
- *
- * For N=1, a bucket table with low fill rate incurs a substantial
- * memory overhead, which may even exceed the storage required for the
- * entries themselves.  For large N, the relative memory overhead is
- * much smaller, while checking the list of entries in a bucket becomes
- * more expensive (N integer comparisons for each item).
- *
- * Note that the ratio limit / target determines how often the bucket
- * table has to be reallocated; it should not be smaller than 4.0.
- * 
- * A reasonable values for the fill rate limit seems to be around 5.0;
- * if speed is crucial, N is relatively large, and memory footprint 
- * isn't a concern, smaller values down to 2.0 might be chosen.
- * The target fill rate should not be set too low for small N. 
- * If N=1, a target fill rate of 0.5 results in 100% memory overhead
- * after expansion of the bucket table (16 bytes per entry vs. 8 bytes
- * each for twice as many buckets as there are entries).
- *
- * When working on very large data sets, it is recommended to disable
- * auto-grow and initialise the n-gram hash with a sufficiently large
- * number of buckets.
+ * overhead and performance.  Since each bucket takes (N+1) * 4 bytes,
+ * i.e. the same amount of memory as an entry, the memory overhead is
+ * (1 - fill rate) / fill rate; e.g. 100% at a fill rate of 0.5.
+ * Good values for the limit are in the range 0.5-0.8; the limit is
+ * capped at 0.9.
+ *
+ * When working on very large data sets, it is recommended to set a
+ * memory limit with cl_ngram_hash_set_memory_limit().
  *  
  * @see          cl_ngram_hash_auto_grow, cl_ngram_hash_check_grow
  * @param hash   The hash that will be affected.
@@ -233,145 +309,326 @@ cl_ngram_hash_auto_grow_fillrate(cl_ngram_hash hash, double limit, double target
   if (hash != NULL) {
     /* set parameters with basic sanity checks */
     hash->fillrate_target = (target > 0.01) ? target : 0.01;
+    if (hash->fillrate_target > MAX_FILLRATE / 2)
+      hash->fillrate_target = MAX_FILLRATE / 2;
     hash->fillrate_limit = (limit > 2 * hash->fillrate_target) ? limit : 2 * hash->fillrate_target;
+    if (hash->fillrate_limit > MAX_FILLRATE)
+      hash->fillrate_limit = MAX_FILLRATE;
   }
 }
 
-
-
 /**
- * Grows a ngram_hash table, increasing the number of buckets, if necessary.
+ * Sets a memory limit for the bucket table of an n-gram hash.
  *
- * This functions is called after inserting a new entry into the n-gram hash.
- * If checks whether the current fill rate exceeds the specified limit. 
- * If this is the case, and auto_grow is enabled, then the hash is expanded
- * by increasing the number of buckets, such that the new average fill rate
- * corresponds to the specified target value.  This gives the
- * hash better performance and makes it capable of absorbing more keys.
+ * If expanding the bucket table would exceed this limit (counting both the
+ * old and the new table, which are needed at the same time during expansion),
+ * all entries are instead sorted and written to a temporary file, and
+ * counting continues with an empty table.  The iterator merges the partial
+ * counts from these temporary files ("runs") with the remaining entries in
+ * memory.  This makes it possible to count n-grams over very large corpora,
+ * provided there is enough disk space.
  *
- * If the bucket table would be expanded to more than MAX_BUCKETS entries,
- * auto-grow is automatically disabled for this ngram_hash.
+ * Once entries have been spilled to disk, cl_ngram_hash_find(),
+ * cl_ngram_hash_freq(), cl_ngram_hash_del(), cl_ngram_hash_size() and
+ * cl_ngram_hash_get_entries() only see the entries currently held in memory;
+ * use the iterator to obtain the complete frequency counts.
  *
- * Note: this function also implements the hashing algorithm and must be
- * consistent with cl_ngram_hash_find_i().
+ * @param hash     The hash that will be affected.
+ * @param limit    Memory limit in bytes (0 = no limit, which is the default).
+ * @param tmp_dir  Directory for temporary files (NULL to use the system default).
+ */
+void
+cl_ngram_hash_set_memory_limit(cl_ngram_hash hash, size_t limit, char *tmp_dir)
+{
+  if (hash != NULL) {
+    hash->memory_limit = limit;
+    cl_free(hash->tmp_dir);
+    if (tmp_dir != NULL)
+      hash->tmp_dir = cl_strdup(tmp_dir);
+  }
+}
+
+/**
+ * Returns the number of runs an n-gram hash has spilled to disk.
  *
- * Usage: expanded = cl_ngram_hash_check_grow(cl_ngram_hash hash);
+ * If the return value is non-zero, the complete frequency counts are only
+ * available through the iterator (@see cl_ngram_hash_set_memory_limit).
+ *
+ * @param hash  The n-gram hash.
+ * @return      Number of runs written to temporary files.
+ */
+int
+cl_ngram_hash_spilled(cl_ngram_hash hash)
+{
+  return (hash != NULL) ? hash->n_runs : 0;
+}
+
+
+
+/**
+ * Finds the bucket for a particular n-gram.
+ *
+ * This function is called with a constant N from cl_ngram_hash_find_i(), so
+ * that the compiler can generate specialised versions for small N.
  *
  * This is a non-exported function.
  *
- * @see         cl_ngram_hash_auto_grow, cl_ngram_hash_auto_grow_fillrate
- * @param hash  The cl_ngram_hash to autogrow.
- * @return      Always 0.
+ * @param hash   The hash to search.
+ * @param ngram  The n-gram to look for.
+ * @param N      N-gram size (must be equal to hash->N).
+ * @param found  Will be set to true if the n-gram is in the hash, false otherwise.
+ * @return       Index of the bucket containing the n-gram, or of the empty
+ *               bucket where it should be inserted.
  */
-int
-cl_ngram_hash_check_grow(cl_ngram_hash hash)
+static unsigned int
+cl_ngram_hash_probe(cl_ngram_hash hash, int *ngram, int N, int *found)
 {
-  double fill_rate, target_size;
-  cl_ngram_hash temp;
-  cl_ngram_hash_entry entry, next;
-  int idx, offset, old_buckets, new_buckets, N;
+  unsigned int offset, mask;
+  int *bucket;
+  int i;
 
-  old_buckets = hash->buckets;
-  fill_rate = ((double) hash->entries) / old_buckets;
-  if (hash->auto_grow && (fill_rate > hash->fillrate_limit)) {
-    /* auto-grow is triggered */
-    target_size = floor(((double) hash->entries) / hash->fillrate_target);
-    if (target_size > MAX_BUCKETS) {
-      if (cl_debug) {
-        fprintf(stderr, "[n-gram hash autogrow: size limit %f exceeded by new target size %f, auto-growing will be disabled]\n",
-                (double) MAX_BUCKETS, target_size);
-      }
-      hash->auto_grow = 0; /* disable auto-grow to avoid further unnecessary attempts */
-      /* grow ngram_hash to maximum size, but not if this would extend bucket vector by less than 2x (to avoid large reallocation for little benefit) */
-      if (old_buckets > target_size / 2.0) {
-        return 0;
-      }
-      else {
-        target_size = MAX_BUCKETS;
-      }
+  mask = hash->buckets - 1;
+  for (offset = ngram_hash_tuple(N, ngram) & mask; BUCKET_USED(hash, offset); offset = (offset + 1) & mask) {
+    bucket = hash->table + (size_t) offset * (N + 1);
+    for (i = 0; i < N; i++)
+      if (bucket[i + 1] != ngram[i])
+        break;
+    if (i == N) {
+      *found = 1;
+      return offset;
     }
-    /* now grow bucket table from old_buckets entries to new_buckets entries */
-    new_buckets = (int) target_size;
-    old_buckets = hash->buckets;
-    if (cl_debug) {
-      fprintf(stderr, "[n-gram hash autogrow: triggered by fill rate = %3.1f (%d/%d)]\n",
-              fill_rate, hash->entries, old_buckets);
-      if (cl_debug >= 2)
-        cl_ngram_hash_print_stats(hash, 12);
-    }
-    N = hash->N;
-    temp = cl_new_ngram_hash(N, new_buckets); /* create new hash with target fill rate */
-    new_buckets = temp->buckets; /* the actual number of entries (next prime number) */
-    /* move all entries from hash to the appropriate bucket in temp */
-    for (idx = 0; idx < old_buckets; idx++) {
-      entry = hash->table[idx];
-      while (entry != NULL) {
-        next = entry->next;     /* remember pointer to next entry */
-        offset = hash_ngram(N, entry->ngram) % new_buckets;
-        entry->next = temp->table[offset]; /* insert entry into its bucket in temp (most buckets should contain only 1 entry, as long as hash->fillrate_target is less than 1) */
-        temp->table[offset] = entry;
-        temp->entries++;
-        entry = next;           /* continue while loop */
-      }
-    }
-    assert((temp->entries == hash->entries) && "ngram-hash.c: inconsistency during hash expansion");
-    cl_free(hash->table);               /* old hash table should be empty and can be deallocated */
-    hash->table = temp->table;          /* update hash from temp (copy hash table and its size) */
-    hash->buckets = temp->buckets;
-    cl_free(temp);                      /* we can simply deallocate temp now, having stolen its hash table */
-    if (cl_debug) {
-      fill_rate = ((double) hash->entries) / hash->buckets;
-      fprintf(stderr, "[n-gram hash autogrow: new fill rate = %3.1f (%d/%d)]\n",
-              fill_rate, hash->entries, hash->buckets);
-    }
-    return 1;
   }
-  return 0;
+  *found = 0;
+  return offset;
 }
 
-
-
 /**
  * Finds the entry corresponding to a particular n-gram in a cl_ngram_hash.
  *
  * This function is the same as cl_ngram_hash_find(), but *ret_offset is set to
- * the hashtable offset computed for token (i.e. the index of the bucket within
- * the hashtable), unless *ret_offset == NULL.
+ * the index of the bucket where the n-gram was found or -- if it is not in the
+ * hash -- the empty bucket where it would be inserted, unless ret_offset == NULL.
  *
  * Note that this function hides the hashing algorithm details from the
- * rest of the n-gram hash implementation (except cl_ngram_hash_check_grow, which 
- * re-implements the hashing algorithm for performance reasons).
+ * rest of the n-gram hash implementation.
  *
- * Usage: entry = cl_ngram_hash_find_i(cl_ngram_hash hash, char *token, unsigned int *ret_offset);
+ * Usage: entry = cl_ngram_hash_find_i(cl_ngram_hash hash, int *ngram, unsigned int *ret_offset);
  *
  * This is a non-exported function.
  *
  * @param hash        The hash to search.
  * @param ngram       The ngram to look for.
- * @param ret_offset  This integer address will be filled with the token's
- *                    hashtable offset (can be NULL, in which case, ignored).
- * @return            The entry that is found (or NULL if the string is not
+ * @param ret_offset  This integer address will be filled with the n-gram's
+ *                    bucket index (can be NULL, in which case, ignored).
+ * @return            The entry that is found (or NULL if the n-gram is not
  *                    in the hash).
  */
 cl_ngram_hash_entry
 cl_ngram_hash_find_i(cl_ngram_hash hash, int *ngram, unsigned int *ret_offset)
 {
   unsigned int offset;
-  int N;
-  cl_ngram_hash_entry entry;
+  int found;
 
   assert((hash != NULL && hash->table != NULL && hash->buckets > 0) && "cl_ngram_hash object was not properly initialised");
-  N = hash->N;
 
-  /* get the offset of the bucket to look in by computing the hash of the string */
-  offset = hash_ngram(N, ngram) % hash->buckets;
+  /* specialised code for common n-gram sizes */
+  switch (hash->N) {
+  case 1:
+    offset = cl_ngram_hash_probe(hash, ngram, 1, &found);
+    break;
+  case 2:
+    offset = cl_ngram_hash_probe(hash, ngram, 2, &found);
+    break;
+  case 3:
+    offset = cl_ngram_hash_probe(hash, ngram, 3, &found);
+    break;
+  case 4:
+    offset = cl_ngram_hash_probe(hash, ngram, 4, &found);
+    break;
+  default:
+    offset = cl_ngram_hash_probe(hash, ngram, hash->N, &found);
+    break;
+  }
   if (ret_offset != NULL)
     *ret_offset = offset;
-  /* check all entries in this bucket against the specified key */
-  entry = hash->table[offset];
-  while (entry != NULL && memcmp(entry->ngram, ngram, N * sizeof(int)) != 0)
-    entry = entry->next;
-  return entry;
+  return found ? (cl_ngram_hash_entry) (hash->table + (size_t) offset * (hash->N + 1)) : NULL;
+}
+
+
+/**
+ * Compares two n-gram hash entries, i.e. their n-grams as sequences of signed integers
+ * (callback for g_qsort_with_data()).
+ *
+ * This is a non-exported function.
+ *
+ * @param a     Pointer to first entry.
+ * @param b     Pointer to second entry.
+ * @param data  Pointer to N (int).
+ */
+int
+cl_ngram_hash_compare_entries(gconstpointer a, gconstpointer b, gpointer data)
+{
+  const int *A = (const int *) a, *B = (const int *) b;
+  int N = *((int *) data);
+  int i;
+
+  for (i = 1; i <= N; i++) {
+    if (A[i] != B[i])
+      return (A[i] < B[i]) ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+ * Writes all entries of an n-gram hash to a new temporary file, sorted by n-gram, and clears the table.
+ *
+ * This is a non-exported function.
+ *
+ * @param hash  The n-gram hash.
+ */
+void
+cl_ngram_hash_spill(cl_ngram_hash hash)
+{
+  size_t width = (hash->N + 1);
+  unsigned int idx, n;
+  FILE *fh = NULL;
+
+  if (hash->entries == 0)
+    return;
+
+  /* move all entries to the start of the table, then sort them */
+  n = 0;
+  for (idx = 0; idx < hash->buckets; idx++) {
+    if (BUCKET_USED(hash, idx)) {
+      if (n < idx)
+        memcpy(hash->table + n * width, hash->table + idx * width, width * sizeof(int));
+      n++;
+    }
+  }
+  assert((n == hash->entries) && "ngram-hash.c: major internal inconsistency");
+  g_qsort_with_data(hash->table, n, width * sizeof(int), cl_ngram_hash_compare_entries, &(hash->N));
+
+  /* create temporary file, which will be deleted automatically when it is closed */
+#ifndef __MINGW__
+  if (hash->tmp_dir != NULL) {
+    char *template = (char *) cl_malloc(strlen(hash->tmp_dir) + 32);
+    int fd;
+
+    sprintf(template, "%s" SUBDIR_SEP_STRING "cwb-ngrams-XXXXXX", hash->tmp_dir);
+    fd = mkstemp(template);
+    if (fd >= 0) {
+      unlink(template);
+      fh = fdopen(fd, "w+b");
+    }
+    cl_free(template);
+  }
+  else
+#endif
+    fh = tmpfile();
+  if (fh == NULL) {
+    perror("CL: can't create temporary file for n-gram hash");
+    exit(1);
+  }
+  if (fwrite(hash->table, width * sizeof(int), n, fh) != n || fflush(fh) != 0) {
+    perror("CL: can't write temporary file for n-gram hash");
+    exit(1);
+  }
+  if (cl_debug)
+    fprintf(stderr, "[n-gram hash: spilled %u entries to disk (run #%d)]\n", n, hash->n_runs + 1);
+
+  hash->runs = (FILE **) cl_realloc(hash->runs, (hash->n_runs + 1) * sizeof(FILE *));
+  hash->runs[hash->n_runs++] = fh;
+  memset(hash->used, 0, (hash->buckets + 7) / 8);
+  hash->entries = 0;
+}
+
+/**
+ * Grows an n-gram hash table, increasing the number of buckets, if necessary.
+ *
+ * This functions is called after inserting a new entry into the n-gram hash.
+ * If checks whether the current fill rate exceeds the specified limit. 
+ * If this is the case, and auto_grow is enabled, then the hash is expanded
+ * by increasing the number of buckets, such that the new average fill rate
+ * corresponds to the specified target value.  This gives the
+ * hash better performance and makes it capable of absorbing more keys.
+ * If the fill rate reaches MAX_FILLRATE, the table is doubled in size
+ * regardless of the auto_grow setting.
+ *
+ * If the expanded table would exceed the memory limit (or MAX_BUCKETS),
+ * the entries are spilled to disk instead (@see cl_ngram_hash_set_memory_limit).
+ * Without a memory limit, the program is aborted when the table is full.
+ *
+ * Usage: expanded = cl_ngram_hash_check_grow(cl_ngram_hash hash);
+ *
+ * This is a non-exported function.
+ *
+ * @see         cl_ngram_hash_auto_grow, cl_ngram_hash_auto_grow_fillrate
+ * @param hash  The cl_ngram_hash to autogrow.
+ * @return      1 if the hash was expanded, 0 otherwise.
+ */
+int
+cl_ngram_hash_check_grow(cl_ngram_hash hash)
+{
+  double fill_rate, target_size;
+  int *old_table, *bucket;
+  unsigned char *old_used;
+  unsigned int idx, old_buckets, new_offset;
+  size_t width;
+  int found, full;
+
+  old_buckets = hash->buckets;
+  fill_rate = ((double) hash->entries) / old_buckets;
+  full = (fill_rate >= MAX_FILLRATE);
+  if (full)
+    target_size = 2.0 * old_buckets;
+  else if (hash->auto_grow && (fill_rate > hash->fillrate_limit))
+    target_size = ((double) hash->entries) / hash->fillrate_target;
+  else
+    return 0;
+
+  /* check whether the expanded table would fit into the memory limit */
+  if (old_buckets >= MAX_BUCKETS ||
+      (hash->memory_limit > 0 &&
+       cl_ngram_hash_table_bytes(hash->N, old_buckets) +
+       cl_ngram_hash_table_bytes(hash->N, (target_size > MAX_BUCKETS) ? MAX_BUCKETS : target_size) > hash->memory_limit)) {
+    if (!full)
+      return 0;                 /* keep filling the table up to MAX_FILLRATE */
+    if (hash->memory_limit > 0) {
+      cl_ngram_hash_spill(hash);
+      return 0;
+    }
+    fprintf(stderr, "CL: n-gram hash size limit exceeded (%d entries). (killed)\n", hash->entries);
+    exit(1);
+  }
+
+  if (cl_debug) {
+    fprintf(stderr, "[n-gram hash autogrow: triggered by fill rate = %4.2f (%d/%u)]\n",
+            fill_rate, hash->entries, old_buckets);
+    if (cl_debug >= 2)
+      cl_ngram_hash_print_stats(hash, 12);
+  }
+
+  width = hash->N + 1;
+  old_table = hash->table;
+  old_used = hash->used;
+  cl_ngram_hash_new_table(hash, target_size);
+  /* move all entries to their buckets in the new table */
+  for (idx = 0; idx < old_buckets; idx++) {
+    if (old_used[idx >> 3] & (1 << (idx & 7))) {
+      bucket = old_table + idx * width;
+      new_offset = cl_ngram_hash_probe(hash, bucket + 1, hash->N, &found);
+      memcpy(hash->table + new_offset * width, bucket, width * sizeof(int));
+      hash->used[new_offset >> 3] |= 1 << (new_offset & 7);
+    }
+  }
+  cl_free(old_table);
+  cl_free(old_used);
+  if (cl_debug) {
+    fill_rate = ((double) hash->entries) / hash->buckets;
+    fprintf(stderr, "[n-gram hash autogrow: new fill rate = %4.2f (%d/%u)]\n",
+            fill_rate, hash->entries, hash->buckets);
+  }
+  return 1;
 }
 
 
@@ -401,9 +658,12 @@ cl_ngram_hash_find(cl_ngram_hash hash, int *ngram)
  * is increased by the specified value f.
  *
  * Otherwise, a new entry is created and its frequency count
- * is set to f.  The n-gram is embedded in the new hash entry,
+ * is set to f.  The n-gram is copied into the hash table,
  * so the original array does not need to be kept in memory.
  *
+ * Note that entries are stored directly in the hash table, so the
+ * returned pointer is only valid until the next update of the hash.
+ *
  * @param hash   The hash table to add to.
  * @param ngram  The n-gram to add.
  * @param f      Frequency count of the n-gram.
@@ -412,8 +672,8 @@ cl_ngram_hash_find(cl_ngram_hash hash, int *ngram)
 cl_ngram_hash_entry
 cl_ngram_hash_add(cl_ngram_hash hash, int *ngram, unsigned int f)
 {
-  cl_ngram_hash_entry entry, insert_point;
-  unsigned int offset;          /* this will be set to the index of the bucket this token should go in
+  cl_ngram_hash_entry entry;
+  unsigned int offset;          /* this will be set to the index of the bucket this n-gram should go in
                                    by the call to cl_ngram_hash_find_i                                     */
   int N;
   
@@ -421,36 +681,26 @@ cl_ngram_hash_add(cl_ngram_hash hash, int *ngram, unsigned int f)
   N = hash->N;
 
   if (entry != NULL) {
-    /* token already in hash -> increment frequency count */
+    /* n-gram already in hash -> increment frequency count */
     entry->freq += f;
   }
   else {
-    /* token not in hash -> add new entry for this token */
+    /* n-gram not in hash -> copy it into the empty bucket found by cl_ngram_hash_find_i */
     assert((hash->entries < MAX_ENTRIES) && "ngram-hash.c: maximum capacity of n-gram hash exceeded -- program abort");
     
-    /* allocate enough space for n-gram appended to the struct */
-    entry = (cl_ngram_hash_entry) cl_malloc(sizeof(struct _cl_ngram_hash_entry) + (N - 1) * sizeof(int));
-    memcpy(entry->ngram, ngram, N * sizeof(int)); /* embed copy of n-gram in struct */
+    entry = (cl_ngram_hash_entry) (hash->table + (size_t) offset * (N + 1));
     entry->freq = f;
-    entry->next = NULL;
-
-    /* insert entry into its bucket in the hash table */
-    insert_point = hash->table[offset];
-    if (insert_point == NULL) {
-      hash->table[offset] = entry;      /* only entry in this bucket so far */
-    }
-    else {
-      /* always insert a new entry as the last entry in its bucket (because of Zipf's Law:
-       * frequent lexemes tend to occur early in the corpus and should be first in their buckets for faster access) */
-      while (insert_point->next != NULL)
-        insert_point = insert_point->next;
-      insert_point->next = entry;
-    }
+    memcpy(entry->ngram, ngram, N * sizeof(int));
+    hash->used[offset >> 3] |= 1 << (offset & 7);
     hash->entries++;
     
-    /* check whether hash needs to auto-grow */
-    if (hash->auto_grow && hash->entries > (hash->fillrate_limit * hash->buckets))
-      cl_ngram_hash_check_grow(hash);
+    /* check whether hash needs to grow (which moves the new entry) */
+    if (hash->entries > (hash->fillrate_limit * hash->buckets)) {
+      if (cl_ngram_hash_check_grow(hash))
+        entry = cl_ngram_hash_find_i(hash, ngram, NULL);
+      else if (hash->entries == 0)
+        entry = NULL;           /* entry has been spilled to disk */
+    }
   }
   return entry;
 }
@@ -486,26 +736,34 @@ cl_ngram_hash_freq(cl_ngram_hash hash, int *ngram)
 int 
 cl_ngram_hash_del(cl_ngram_hash hash, int *ngram)
 {
-  cl_ngram_hash_entry entry, previous;
-  unsigned int offset, f;
+  cl_ngram_hash_entry entry;
+  unsigned int hole, offset, home, mask, f;
+  size_t width;
 
-  entry = cl_ngram_hash_find_i(hash, ngram, &offset);
+  entry = cl_ngram_hash_find_i(hash, ngram, &hole);
   if (entry == NULL) {
     return 0;                   /* not in n-gram hash */
   }
   else {
     f = entry->freq;
-    if (hash->table[offset] == entry) {
-      hash->table[offset] = entry->next;
-    }
-    else {
-      previous = hash->table[offset];
-      while (previous->next != entry)
-        previous = previous->next;
-      previous->next = entry->next;
-    }
-    cl_free(entry);
     hash->entries--;
+
+    /* backward-shift deletion: move following entries of the probe sequence into the hole
+       if the hole lies between their home bucket and their current position */
+    width = hash->N + 1;
+    mask = hash->buckets - 1;
+    offset = hole;
+    while (1) {
+      offset = (offset + 1) & mask;
+      if (!BUCKET_USED(hash, offset))
+        break;
+      home = ngram_hash_tuple(hash->N, hash->table + offset * width + 1) & mask;
+      if (((offset - home) & mask) >= ((offset - hole) & mask)) {
+        memcpy(hash->table + hole * width, hash->table + offset * width, width * sizeof(int));
+        hole = offset;
+      }
+    }
+    hash->used[hole >> 3] &= ~(1 << (hole & 7));
     return f;
   }
 }
@@ -515,8 +773,8 @@ cl_ngram_hash_del(cl_ngram_hash hash, int *ngram)
 /**
  * Gets the number of distinct n-grams stored in a cl_ngram_hash.
  *
- * This returns the total number of entries in all the
- * buckets in the whole hash table.
+ * This returns the total number of entries in the hash table
+ * (not including entries spilled to disk).
  *
  * @param hash  The hash to size up.
  */
@@ -532,6 +790,7 @@ cl_ngram_hash_size(cl_ngram_hash hash)
  *
  * This function returns a newly allocated array of cl_ngram_hash_entry
  * pointers enumerating all entries of the hash in an unspecified order.
+ * Entries that have been spilled to disk are not included.
  *
  * @param hash      The n-gram hash to operate on.
  * @param ret_size  If not NULL, the number of entries in the returned
@@ -540,7 +799,7 @@ cl_ngram_hash_size(cl_ngram_hash hash)
 cl_ngram_hash_entry *
 cl_ngram_hash_get_entries(cl_ngram_hash hash, int *ret_size)
 {
-  cl_ngram_hash_entry *result, entry;
+  cl_ngram_hash_entry *result;
   int size, point;
   unsigned int offset;
   
@@ -555,11 +814,9 @@ cl_ngram_hash_get_entries(cl_ngram_hash hash, int *ret_size)
   /* traverse hash and insert all entries into the array */
   point = 0;
   for (offset = 0; offset < hash->buckets; offset++) {
-    entry = hash->table[offset];
-    while (entry != NULL) {
+    if (BUCKET_USED(hash, offset)) {
       assert((point < size) && "ngram-hash.c: major internal inconsistency");
-      result[point++] = entry;
-      entry = entry->next;
+      result[point++] = (cl_ngram_hash_entry) (hash->table + (size_t) offset * (hash->N + 1));
     }
   }
   assert((point == size) && "ngram-hash.c: major internal inconsistency");
@@ -569,6 +826,55 @@ cl_ngram_hash_get_entries(cl_ngram_hash hash, int *ret_size)
 
 
 
+/**
+ * Reads the next record of a run into its slot in hash->merge_records.
+ *
+ * This is a non-exported function.
+ *
+ * @return  True if a record was read, false if the run is exhausted.
+ */
+int
+cl_ngram_hash_read_run(cl_ngram_hash hash, int run)
+{
+  size_t width = hash->N + 1;
+
+  if (fread(hash->merge_records + run * width, width * sizeof(int), 1, hash->runs[run]) == 1)
+    return 1;
+  if (ferror(hash->runs[run])) {
+    perror("CL: can't read temporary file for n-gram hash");
+    exit(1);
+  }
+  return 0;
+}
+
+/**
+ * Restores the heap property of the merge heap, starting from position i.
+ *
+ * This is a non-exported function.
+ */
+void
+cl_ngram_hash_merge_sift_down(cl_ngram_hash hash, int i)
+{
+  int *heap = hash->merge_heap;
+  int size = hash->merge_heap_size;
+  size_t width = hash->N + 1;
+  int child, temp;
+
+  while ((child = 2 * i + 1) < size) {
+    if (child + 1 < size &&
+        cl_ngram_hash_compare_entries(hash->merge_records + heap[child + 1] * width,
+                                      hash->merge_records + heap[child] * width, &(hash->N)) < 0)
+      child++;
+    if (cl_ngram_hash_compare_entries(hash->merge_records + heap[child] * width,
+                                      hash->merge_records + heap[i] * width, &(hash->N)) >= 0)
+      break;
+    temp = heap[i];
+    heap[i] = heap[child];
+    heap[child] = temp;
+    i = child;
+  }
+}
+
 /**
  * Iterate over all entries in an n-gram hash.
  *
@@ -578,14 +884,35 @@ cl_ngram_hash_get_entries(cl_ngram_hash hash, int *ret_size)
  *
  * This function resets the iterator to the start of the hash.
  *
+ * If entries have been spilled to disk, the remaining entries are spilled
+ * as well, and the iterator merges all runs.
+ *
  * @param hash      The n-gram hash to iterate over.
  */
 void
 cl_ngram_hash_iterator_reset(cl_ngram_hash hash)
 {
+  int i;
+
   assert((hash != NULL && hash->table != NULL && hash->buckets > 0) && "cl_ngram_hash object was not properly initialised");
-  hash->iter_bucket = -1;
-  hash->iter_point = NULL;
+  hash->iter_bucket = 0;
+  hash->merging = 0;
+
+  if (hash->n_runs > 0) {
+    cl_ngram_hash_spill(hash);
+    hash->merge_records = (int *) cl_realloc(hash->merge_records, hash->n_runs * (hash->N + 1) * sizeof(int));
+    hash->merge_heap = (int *) cl_realloc(hash->merge_heap, hash->n_runs * sizeof(int));
+    hash->merge_entry = (int *) cl_realloc(hash->merge_entry, (hash->N + 1) * sizeof(int));
+    hash->merge_heap_size = 0;
+    for (i = 0; i < hash->n_runs; i++) {
+      rewind(hash->runs[i]);
+      if (cl_ngram_hash_read_run(hash, i))
+        hash->merge_heap[hash->merge_heap_size++] = i;
+    }
+    for (i = hash->merge_heap_size / 2 - 1; i >= 0; i--)
+      cl_ngram_hash_merge_sift_down(hash, i);
+    hash->merging = 1;
+  }
 }
 
 /**
@@ -596,98 +923,109 @@ cl_ngram_hash_iterator_reset(cl_ngram_hash hash)
  * the hash at the same time.
  *
  * This function returns the next entry from the hash, or NULL if there are 
- * no more entries.  Keep in mind that the hash is traversed in an unspecified order.
+ * no more entries.  Keep in mind that the hash is traversed in an unspecified order
+ * (when runs spilled to disk are merged, n-grams are returned in ascending order of
+ * their integer tuples).
  *
  * @param hash      The n-gram hash to iterate over.
  */
 cl_ngram_hash_entry
 cl_ngram_hash_iterator_next(cl_ngram_hash hash)
 {
-  cl_ngram_hash_entry point;
-  
-  point = hash->iter_point;
-  while (point == NULL) {
+  size_t width = hash->N + 1;
+  int *record;
+  int run;
+
+  if (hash->merging) {
+    if (hash->merge_heap_size == 0)
+      return NULL;
+    /* take smallest n-gram from heap, then add up frequencies of the same n-gram from other runs */
+    memcpy(hash->merge_entry, hash->merge_records + hash->merge_heap[0] * width, width * sizeof(int));
+    hash->merge_entry[0] = 0;
+    while (hash->merge_heap_size > 0) {
+      run = hash->merge_heap[0];
+      record = hash->merge_records + run * width;
+      if (cl_ngram_hash_compare_entries(record, hash->merge_entry, &(hash->N)) != 0)
+        break;
+      ((cl_ngram_hash_entry) hash->merge_entry)->freq += (unsigned int) record[0];
+      if (!cl_ngram_hash_read_run(hash, run))
+        hash->merge_heap[0] = hash->merge_heap[--hash->merge_heap_size];
+      cl_ngram_hash_merge_sift_down(hash, 0);
+    }
+    return (cl_ngram_hash_entry) hash->merge_entry;
+  }
+
+  while (hash->iter_bucket < hash->buckets) {
+    if (BUCKET_USED(hash, hash->iter_bucket))
+      return (cl_ngram_hash_entry) (hash->table + (size_t) (hash->iter_bucket++) * width);
     hash->iter_bucket++;
-    if (hash->iter_bucket >= hash->buckets) 
-      return NULL; /* we've reached the end of the hash */
-    point = hash->table[hash->iter_bucket];
   }
-  hash->iter_point = point->next;
-  return point;
+  return NULL; /* we've reached the end of the hash */
 }
 
 /**
- * Compute statistics on bucket fill rates (for debugging and optimization).
+ * Compute statistics on probe sequence lengths (for debugging and optimization).
  *
  * This function returns an allocated integer array of length max_n + 1, whose
- * i-th entry specifies the number of buckets containing i keys.  For i == 0, this
- * is the number of empty buckets. The last entry (i == max_n) is the cumulative
- * number of buckets containing i or more entries.
+ * i-th entry specifies the number of entries stored i buckets away from their home
+ * bucket, i.e. the number of entries that require i + 1 comparisons to be found.
+ * The last entry (i == max_n) is the cumulative number of entries with a distance
+ * of i or more buckets.
  *
  * @param hash      The n-gram hash.
- * @param max_n     Count buckets with up to max_n entries.
+ * @param max_n     Count entries with distance up to max_n.
  */
 int *
 cl_ngram_hash_stats(cl_ngram_hash hash, int max_n)
 {
   int *stats;
-  int i, n;
-  cl_ngram_hash_entry point;
+  unsigned int i, n, mask;
   
   assert(max_n > 0);
   assert((hash != NULL && hash->table != NULL && hash->buckets > 0) && "cl_ngram_hash object was not properly initialised");
   stats = cl_calloc(max_n + 1, sizeof(int));
 
+  mask = hash->buckets - 1;
   for (i = 0; i < hash->buckets; i++) {
-    point = hash->table[i];
-    n = 0;
-    while (point) {
-      point = point->next;
-      n++;
+    if (BUCKET_USED(hash, i)) {
+      n = (i - ngram_hash_tuple(hash->N, hash->table + (size_t) i * (hash->N + 1) + 1)) & mask;
+      if (n >= max_n)
+        stats[max_n]++;
+      else
+        stats[n]++;
     }
-    if (n >= max_n)
-      stats[max_n]++;
-    else
-      stats[n]++;
   }
   return stats;
 }
 
 /**
- * Display statistics on bucket fill rates (for debugging and optimization).
+ * Display statistics on probe sequence lengths (for debugging and optimization).
  *
- * This function prints a table showing the distribution of bucket sizes, i.e.
- * how many buckets contain a given number of keys.  The table will be printed
- * to STDERR, as all debugging output in CWB.
+ * This function prints a table showing the distribution of distances of entries
+ * from their home buckets.  The table will be printed to STDERR, as all debugging
+ * output in CWB.
  *
  * @param hash      The n-gram hash.
- * @param max_n      Count buckets with up to max_n entries.
+ * @param max_n     Count entries with distance up to max_n.
  */
 void
 cl_ngram_hash_print_stats(cl_ngram_hash hash, int max_n)
 {
   int *stats = cl_ngram_hash_stats(hash, max_n);  /* also performs sanity checks */
-  double rate, p;
+  double rate;
   int i;
   
   rate = ((double) hash->entries) / hash->buckets;
-  fprintf(stderr, "N-gram hash fill rate: %5.2f (%d entries in %d buckets)\n",
-          rate, hash->entries, hash->buckets);
-  fprintf(stderr, "# entries: ");
+  fprintf(stderr, "N-gram hash fill rate: %5.2f (%d entries in %u buckets, %d runs on disk)\n",
+          rate, hash->entries, hash->buckets, hash->n_runs);
+  fprintf(stderr, "distance:  ");
   for (i = 0; i <= max_n; i++)
     fprintf(stderr, "%8d", i);
   fprintf(stderr, "+\n");
-  fprintf(stderr, "bucket cnt:");
+  fprintf(stderr, "entries:   ");
   for (i = 0; i <= max_n; i++)
     fprintf(stderr, "%8d", stats[i]);
   fprintf(stderr, "\n");
-  fprintf(stderr, "expected:  ");
-  p = exp(-rate); /* expected number of entries for ideal hash function (Poisson distribution) */
-  for (i = 0; i < max_n; i++) {
-    fprintf(stderr, "%8.0f", p * hash->buckets);
-    p *= rate / (i + 1);
-  }
-  fprintf(stderr, "\n");
 
   cl_free(stats);
 }
@@ -0,0 +1,559 @@
+/*
+ *  IMS Open Corpus Workbench (CWB)
+ *  Copyright (C) 1993-2006 by IMS, University of Stuttgart
+ *  Copyright (C) 2007-     by the respective contributers (see file AUTHORS)
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2, or (at your option) any later
+ *  version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ *  Public License for more details (in the file "COPYING", or available via
+ *  WWW at http://www.gnu.org/copyleft/gpl.html).
+ */
+
+
+/**
+ * @file
+ *
+ * The regex cache remembers the lists of lexicon IDs returned by cl_regex2id(),
+ * so that repeated lexical constraints don't have to scan the full lexicon again.
+ *
+ * Entries are keyed by attribute, regular expression and flags (%c, %d, ...).
+ * The cache is a single LRU list shared by all attributes, whose total memory
+ * footprint is bounded by cl_regex_cache_size (in megabytes; 0 disables the cache).
+ *
+ * If cl_regex_cache_persistent is set, every new entry is also appended to a
+ * sidecar file next to the lexicon of the attribute (e.g. "word.lexicon.rxc"),
+ * and the sidecar file is read back the first time the attribute is used in a
+ * later process. This is what makes the cache useful for cqpserver, which forks
+ * a new process for every client. The file header records fingerprints (size,
+ * modification time and checksum) of the lexicon and its offset index, so stale
+ * files from a re-encoded corpus are detected and replaced. Failure to
+ * read or write sidecar files (e.g. for a read-only corpus directory) is silently
+ * ignored, since the cache is only an optimisation.
+ *
+ * Sidecar file format (all integers 32-bit in network byte order):
+ *  - header: RXC_MAGIC, number of lexicon entries, fingerprints of .lexicon and .lexicon.idx
+ *    (FILE_FINGERPRINT_SIZE integers each, see file_fingerprint())
+ *  - records: flags, length of pattern, number of IDs, pattern (without NUL), IDs
+ */
+
+#include "globals.h"
+#include "endian.h"
+#include "macros.h"
+#include "lexhash.h"
+#include "attributes.h"
+#include "fileutils.h"
+#include "regex-cache.h"
+
+
+/** Number of buckets in the hash table of cache entries. */
+#define RXC_BUCKETS 4096
+
+/** Magic number at the start of a sidecar file ("RXC2"). */
+#define RXC_MAGIC 0x52584332
+
+/** Number of integers in the header of a sidecar file. */
+#define RXC_HEADER_SIZE (2 + 2 * FILE_FINGERPRINT_SIZE)
+
+/** Suffix appended to the lexicon filename for the sidecar file. */
+#define RXC_SUFFIX ".rxc"
+
+/** Sanity limit for the length of a pattern read from a sidecar file. */
+#define RXC_MAX_PATTERN_LENGTH 0x1000000
+
+/**
+ * An entry in the regex cache.
+ */
+typedef struct _RxCacheEntry {
+  Attribute *attribute;             /**< the p-attribute the regex was matched against */
+  char *pattern;                    /**< the regular expression */
+  int flags;                        /**< the regex flags */
+  unsigned int hash;                /**< hash value computed from attribute, pattern and flags */
+  int *ids;                         /**< the list of matching lexicon IDs (NULL if there are none) */
+  int n_ids;                        /**< number of matching lexicon IDs */
+  size_t bytes;                     /**< memory used by this entry */
+  struct _RxCacheEntry *next;       /**< next entry in the same bucket */
+  struct _RxCacheEntry *newer;      /**< neighbour in the LRU list towards the most recently used entry */
+  struct _RxCacheEntry *older;      /**< neighbour in the LRU list towards the least recently used entry */
+} RxCacheEntry;
+
+/**
+ * Persistence state of the regex cache for one attribute.
+ */
+typedef struct _RxCacheFile {
+  Attribute *attribute;             /**< the p-attribute */
+  char *filename;                   /**< full path of the sidecar file */
+  int lexicon_size;                 /**< number of lexicon entries */
+  int header[RXC_HEADER_SIZE];      /**< file header for the current lexicon (written to / checked against file) */
+  int valid;                        /**< boolean: sidecar file exists and matches the current lexicon */
+  struct _RxCacheFile *next;
+} RxCacheFile;
+
+static RxCacheEntry *rxc_table[RXC_BUCKETS];
+static RxCacheEntry *rxc_newest = NULL;     /**< head of LRU list */
+static RxCacheEntry *rxc_oldest = NULL;     /**< tail of LRU list */
+static size_t rxc_bytes = 0;                /**< total memory used by cache entries */
+static RxCacheFile *rxc_files = NULL;       /**< attributes whose sidecar files have been read */
+
+static int rxc_hits = 0;                    /**< number of cache hits (reported if cl_debug is set) */
+static int rxc_misses = 0;                  /**< number of cache misses (reported if cl_debug is set) */
+
+
+/** Computes the hash value of a cache key. */
+static unsigned int
+rxc_hash(Attribute *attribute, char *pattern, int flags)
+{
+  unsigned int h = hash_string(pattern);
+  h = (h * 33) ^ (unsigned int) flags;
+  h = (h * 33) ^ (unsigned int) ((size_t) attribute >> 4);
+  return h;
+}
+
+/** Unlinks an entry from the LRU list. */
+static void
+rxc_lru_unlink(RxCacheEntry *entry)
+{
+  if (entry->newer)
+    entry->newer->older = entry->older;
+  else
+    rxc_newest = entry->older;
+  if (entry->older)
+    entry->older->newer = entry->newer;
+  else
+    rxc_oldest = entry->newer;
+  entry->newer = entry->older = NULL;
+}
+
+/** Inserts an entry at the head of the LRU list (most recently used). */
+static void
+rxc_lru_push(RxCacheEntry *entry)
+{
+  entry->older = rxc_newest;
+  entry->newer = NULL;
+  if (rxc_newest)
+    rxc_newest->newer = entry;
+  rxc_newest = entry;
+  if (!rxc_oldest)
+    rxc_oldest = entry;
+}
+
+/** Removes an entry from the cache and frees it. */
+static void
+rxc_delete_entry(RxCacheEntry *entry)
+{
+  RxCacheEntry **p;
+
+  for (p = &rxc_table[entry->hash % RXC_BUCKETS]; *p != entry; p = &(*p)->next)
+    assert(*p && "regex cache: entry not found in hash table");
+  *p = entry->next;
+  rxc_lru_unlink(entry);
+
+  rxc_bytes -= entry->bytes;
+  cl_free(entry->pattern);
+  cl_free(entry->ids);
+  cl_free(entry);
+}
+
+/** Evicts least recently used entries until the cache fits into the specified number of bytes. */
+static void
+rxc_trim(size_t limit)
+{
+  while (rxc_oldest && rxc_bytes > limit)
+    rxc_delete_entry(rxc_oldest);
+}
+
+/** Finds the cache entry for a given key (returns NULL if there is none). */
+static RxCacheEntry *
+rxc_find(Attribute *attribute, char *pattern, int flags, unsigned int hash)
+{
+  RxCacheEntry *entry;
+
+  for (entry = rxc_table[hash % RXC_BUCKETS]; entry; entry = entry->next)
+    if (entry->hash == hash && entry->attribute == attribute && entry->flags == flags
+        && STREQ(entry->pattern, pattern))
+      return entry;
+  return NULL;
+}
+
+/**
+ * Adds a list of IDs to the cache (or replaces the list if the key is already there).
+ *
+ * The pattern and the ID list are copied.
+ *
+ * @return  The new cache entry, or NULL if the ID list is too large to be cached.
+ */
+static RxCacheEntry *
+rxc_insert(Attribute *attribute, char *pattern, int flags, int *ids, int n_ids)
+{
+  size_t limit = cl_regex_cache_size * ((size_t) 1024 * 1024);
+  unsigned int hash = rxc_hash(attribute, pattern, flags);
+  RxCacheEntry *entry;
+  size_t bytes = sizeof(RxCacheEntry) + strlen(pattern) + 1 + n_ids * sizeof(int);
+
+  if ((entry = rxc_find(attribute, pattern, flags, hash)) != NULL)
+    rxc_delete_entry(entry);
+  if (bytes > limit)
+    return NULL;
+
+  entry = (RxCacheEntry *) cl_malloc(sizeof(RxCacheEntry));
+  entry->attribute = attribute;
+  entry->pattern = cl_strdup(pattern);
+  entry->flags = flags;
+  entry->hash = hash;
+  entry->n_ids = n_ids;
+  if (n_ids > 0) {
+    entry->ids = (int *) cl_malloc(n_ids * sizeof(int));
+    memcpy(entry->ids, ids, n_ids * sizeof(int));
+  }
+  else
+    entry->ids = NULL;
+  entry->bytes = bytes;
+
+  entry->next = rxc_table[hash % RXC_BUCKETS];
+  rxc_table[hash % RXC_BUCKETS] = entry;
+  rxc_lru_push(entry);
+  rxc_bytes += bytes;
+
+  rxc_trim(limit);
+  return entry;
+}
+
+
+/*
+ * sidecar files
+ */
+
+/** Writes a cache entry in sidecar file format to an open stream (returns false on error). */
+static int
+rxc_write_record(FILE *fd, RxCacheEntry *entry)
+{
+  int len = strlen(entry->pattern);
+  size_t record_size = 3 * sizeof(int) + len + entry->n_ids * sizeof(int);
+  char *record = (char *) cl_malloc(record_size);
+  char *p = record;
+  int i, word, ok;
+
+  /* build the complete record in memory so it is appended with a single write() */
+  word = htonl(entry->flags);
+  memcpy(p, &word, sizeof(int)); p += sizeof(int);
+  word = htonl(len);
+  memcpy(p, &word, sizeof(int)); p += sizeof(int);
+  word = htonl(entry->n_ids);
+  memcpy(p, &word, sizeof(int)); p += sizeof(int);
+  memcpy(p, entry->pattern, len); p += len;
+  for (i = 0; i < entry->n_ids; i++) {
+    word = htonl(entry->ids[i]);
+    memcpy(p, &word, sizeof(int)); p += sizeof(int);
+  }
+
+  ok = (fwrite(record, record_size, 1, fd) == 1);
+  cl_free(record);
+  return ok;
+}
+
+/**
+ * Replaces the sidecar file of an attribute with the entries currently cached for this attribute.
+ *
+ * The new file is written to a temporary file first and then renamed, so other processes
+ * never see an incomplete header.
+ */
+static void
+rxc_rewrite_file(RxCacheFile *file)
+{
+  char tmp_name[CL_MAX_FILENAME_LENGTH];
+  RxCacheEntry *entry;
+  FILE *fd;
+  int header[RXC_HEADER_SIZE], i, ok;
+
+  sprintf(tmp_name, "%s.%d", file->filename, (int) getpid());
+  if ((fd = fopen(tmp_name, "wb")) == NULL) {
+    if (cl_debug)
+      fprintf(stderr, "CL: can't write regex cache file %s (ignored)\n", file->filename);
+    return;
+  }
+
+  for (i = 0; i < RXC_HEADER_SIZE; i++)
+    header[i] = htonl(file->header[i]);
+  ok = (fwrite(header, sizeof(int), RXC_HEADER_SIZE, fd) == RXC_HEADER_SIZE);
+
+  /* oldest entries first, so the most recent ones survive when the file is read into a smaller cache */
+  for (entry = rxc_oldest; ok && entry; entry = entry->newer)
+    if (entry->attribute == file->attribute)
+      ok = rxc_write_record(fd, entry);
+
+  if (fclose(fd) != 0 || !ok || rename(tmp_name, file->filename) != 0) {
+    if (cl_debug)
+      fprintf(stderr, "CL: failed to write regex cache file %s (ignored)\n", file->filename);
+    unlink(tmp_name);
+  }
+  else
+    file->valid = 1;
+}
+
+/** Reads one integer in network byte order from a stream (returns false at end of file). */
+static int
+rxc_read_int(FILE *fd, int *val)
+{
+  int word;
+  if (fread(&word, sizeof(int), 1, fd) != 1)
+    return 0;
+  *val = ntohl(word);
+  return 1;
+}
+
+/**
+ * Reads the sidecar file of an attribute into the cache, validating it against the current lexicon.
+ *
+ * A file that is stale, corrupt or has accumulated many duplicate or evicted records is rewritten.
+ * If any record contains a lexicon ID out of range, none of the entries from the file are used.
+ */
+static void
+rxc_read_file(RxCacheFile *file)
+{
+  FILE *fd;
+  int header[RXC_HEADER_SIZE];
+  int flags, len, n_ids, i;
+  int records = 0, retained = 0, corrupt = 0, invalid = 0;
+  char *pattern;
+  int *ids;
+  RxCacheEntry *entry, *older;
+
+  if ((fd = fopen(file->filename, "rb")) == NULL)
+    return;                     /* no sidecar file yet; will be created when the first entry is stored */
+
+  for (i = 0; i < RXC_HEADER_SIZE; i++)
+    if (!rxc_read_int(fd, &(header[i])) || header[i] != file->header[i])
+      break;
+  if (i < RXC_HEADER_SIZE) {
+    if (cl_debug)
+      fprintf(stderr, "CL: regex cache file %s does not match lexicon (will be replaced)\n", file->filename);
+    fclose(fd);
+    return;
+  }
+  file->valid = 1;
+
+  while (rxc_read_int(fd, &flags)) {
+    if (!rxc_read_int(fd, &len) || !rxc_read_int(fd, &n_ids)
+        || len < 0 || len > RXC_MAX_PATTERN_LENGTH || n_ids < 0 || n_ids > file->lexicon_size) {
+      corrupt = 1;
+      break;
+    }
+    pattern = (char *) cl_malloc(len + 1);
+    ids = (int *) cl_malloc((n_ids + 1) * sizeof(int));
+    if (fread(pattern, 1, len, fd) != len || fread(ids, sizeof(int), n_ids, fd) != n_ids) {
+      cl_free(pattern);
+      cl_free(ids);
+      corrupt = 1;
+      break;
+    }
+    pattern[len] = '\0';
+    for (i = 0; i < n_ids; i++) {
+      ids[i] = ntohl(ids[i]);
+      if (ids[i] < 0 || ids[i] >= file->lexicon_size)
+        break;
+    }
+    if (i < n_ids) {
+      /* the IDs would index the .rdx/.rev components, so don't trust anything from this file */
+      cl_free(pattern);
+      cl_free(ids);
+      invalid = 1;
+      break;
+    }
+    rxc_insert(file->attribute, pattern, flags, ids, n_ids);
+    records++;
+    cl_free(pattern);
+    cl_free(ids);
+  }
+  fclose(fd);
+
+  if (invalid) {
+    /* reject the whole file: the regexes will be matched against the lexicon again */
+    if (cl_debug)
+      fprintf(stderr, "CL: regex cache file %s contains invalid lexicon IDs (will be replaced)\n", file->filename);
+    for (entry = rxc_newest; entry; entry = older) {
+      older = entry->older;
+      if (entry->attribute == file->attribute)
+        rxc_delete_entry(entry);
+    }
+    rxc_rewrite_file(file);
+    return;
+  }
+
+  for (entry = rxc_newest; entry; entry = entry->older)
+    if (entry->attribute == file->attribute)
+      retained++;
+  if (cl_debug)
+    fprintf(stderr, "CL: read %d entries from regex cache file %s (%d retained)\n", records, file->filename, retained);
+
+  if (corrupt || records > 2 * retained + 16)
+    rxc_rewrite_file(file);
+}
+
+/**
+ * Gets the persistence state for an attribute, reading its sidecar file on first access.
+ */
+static RxCacheFile *
+rxc_file_for(Attribute *attribute)
+{
+  RxCacheFile *file;
+  Component *lex, *lexidx;
+  char *lex_path;
+
+  for (file = rxc_files; file; file = file->next)
+    if (file->attribute == attribute)
+      return file;
+
+  lex = ensure_component(attribute, CompLexicon, 0);
+  lexidx = ensure_component(attribute, CompLexiconIdx, 0);
+  lex_path = component_full_name(attribute, CompLexicon, NULL);
+  if (lex == NULL || lexidx == NULL || lex_path == NULL)
+    return NULL;
+
+  file = (RxCacheFile *) cl_malloc(sizeof(RxCacheFile));
+  file->attribute = attribute;
+  file->filename = (char *) cl_malloc(strlen(lex_path) + strlen(RXC_SUFFIX) + 1);
+  sprintf(file->filename, "%s%s", lex_path, RXC_SUFFIX);
+  file->lexicon_size = cl_max_id(attribute);
+  file->header[0] = RXC_MAGIC;
+  file->header[1] = file->lexicon_size;
+  file_fingerprint(lex->path, lex->data.data, lex->data.size, file->header + 2);
+  file_fingerprint(lexidx->path, lexidx->data.data, lexidx->data.size, file->header + 2 + FILE_FINGERPRINT_SIZE);
+  file->valid = 0;
+  file->next = rxc_files;
+  rxc_files = file;
+
+  rxc_read_file(file);
+  return file;
+}
+
+/** Appends a new cache entry to the sidecar file of its attribute (or creates the file). */
+static void
+rxc_append_to_file(RxCacheEntry *entry)
+{
+  RxCacheFile *file = rxc_file_for(entry->attribute);
+  FILE *fd;
+
+  if (file == NULL)
+    return;
+  if (!file->valid) {
+    rxc_rewrite_file(file);     /* also writes the new entry */
+    return;
+  }
+
+  if ((fd = fopen(file->filename, "ab")) == NULL)
+    return;
+  setvbuf(fd, NULL, _IONBF, 0); /* unbuffered: the record is appended in one piece even if other processes write to the file */
+  if (!rxc_write_record(fd, entry) && cl_debug)
+    fprintf(stderr, "CL: failed to append to regex cache file %s (ignored)\n", file->filename);
+  fclose(fd);
+}
+
+
+/*
+ * interface functions (used by cl_regex2id() and cl_delete_attribute())
+ */
+
+/**
+ * Looks up the result of a cl_regex2id() call in the regex cache.
+ *
+ * @param attribute          The p-attribute.
+ * @param pattern            The regular expression.
+ * @param flags              The regex flags.
+ * @param ids                If the key was found, set to a newly allocated copy of the cached ID list
+ *                           (or NULL if the regex doesn't match any lexicon entries).
+ * @param number_of_matches  If the key was found, set to the number of IDs in the list.
+ * @return                   Boolean: true if the key was found in the cache.
+ */
+int
+regex_cache_lookup(Attribute *attribute, char *pattern, int flags, int **ids, int *number_of_matches)
+{
+  RxCacheEntry *entry;
+
+  if (cl_regex_cache_size <= 0) {
+    rxc_trim(0);                /* release memory if the cache has been switched off */
+    return 0;
+  }
+  if (cl_regex_cache_persistent)
+    rxc_file_for(attribute);
+
+  entry = rxc_find(attribute, pattern, flags, rxc_hash(attribute, pattern, flags));
+  if (entry == NULL) {
+    rxc_misses++;
+    if (cl_debug)
+      fprintf(stderr, "CL: regex cache miss for /%s/ (%d hits, %d misses)\n", pattern, rxc_hits, rxc_misses);
+    return 0;
+  }
+
+  rxc_hits++;
+  if (cl_debug)
+    fprintf(stderr, "CL: regex cache hit for /%s/ (%d hits, %d misses)\n", pattern, rxc_hits, rxc_misses);
+
+  rxc_lru_unlink(entry);
+  rxc_lru_push(entry);
+
+  *number_of_matches = entry->n_ids;
+  if (entry->n_ids > 0) {
+    *ids = (int *) cl_malloc(entry->n_ids * sizeof(int));
+    memcpy(*ids, entry->ids, entry->n_ids * sizeof(int));
+  }
+  else
+    *ids = NULL;
+  return 1;
+}
+
+/**
+ * Stores the result of a cl_regex2id() call in the regex cache.
+ *
+ * If cl_regex_cache_persistent is set, the entry is also appended to the sidecar file.
+ *
+ * @param attribute          The p-attribute.
+ * @param pattern            The regular expression.
+ * @param flags              The regex flags.
+ * @param ids                The list of matching IDs (will be copied).
+ * @param number_of_matches  The number of IDs in the list.
+ */
+void
+regex_cache_store(Attribute *attribute, char *pattern, int flags, int *ids, int number_of_matches)
+{
+  RxCacheEntry *entry;
+
+  if (cl_regex_cache_size <= 0)
+    return;
+
+  entry = rxc_insert(attribute, pattern, flags, ids, number_of_matches);
+  if (entry && cl_regex_cache_persistent)
+    rxc_append_to_file(entry);
+}
+
+/**
+ * Removes all cache entries for an attribute that is about to be deleted.
+ *
+ * @param attribute  The p-attribute.
+ */
+void
+regex_cache_forget_attribute(Attribute *attribute)
+{
+  RxCacheEntry *entry, *older;
+  RxCacheFile **p, *file;
+
+  for (entry = rxc_newest; entry; entry = older) {
+    older = entry->older;
+    if (entry->attribute == attribute)
+      rxc_delete_entry(entry);
+  }
+
+  for (p = &rxc_files; *p; )
+    if ((*p)->attribute == attribute) {
+      file = *p;
+      *p = file->next;
+      cl_free(file->filename);
+      cl_free(file);
+    }
+    else
+      p = &(*p)->next;
+}
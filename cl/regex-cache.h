@@ -0,0 +1,33 @@
+/*
+ *  IMS Open Corpus Workbench (CWB)
+ *  Copyright (C) 1993-2006 by IMS, University of Stuttgart
+ *  Copyright (C) 2007-     by the respective contributers (see file AUTHORS)
+ *
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2, or (at your option) any later
+ *  version.
+ *
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ *  Public License for more details (in the file "COPYING", or available via
+ *  WWW at http://www.gnu.org/copyleft/gpl.html).
+ */
+
+
+#ifndef _regex_cache_h_
+#define _regex_cache_h_
+
+#include "globals.h"
+#include "attributes.h"
+
+/* configuration functions cl_set_regex_cache_size() and cl_set_regex_cache_persistent() are in <cl.h> */
+
+int regex_cache_lookup(Attribute *attribute, char *pattern, int flags, int **ids, int *number_of_matches);
+
+void regex_cache_store(Attribute *attribute, char *pattern, int flags, int *ids, int number_of_matches);
+
+void regex_cache_forget_attribute(Attribute *attribute);
+
+#endif
@@ -174,6 +174,8 @@ cl_new_regex(char *regex, int flags, CorpusCharset charset)
   rx->icase = (flags & IGNORE_CASE); /* handled separately in CWB 3.4.10+ */
   rx->idiac = (flags & IGNORE_DIAC);
   rx->grains = 0; /* indicates no optimisation -> other optimizer-related fields are invalid */
+  rx->is_clone = 0;
+  rx->optimiser_rejects = 0;
 
   /* pre-process regular expression (translate latex escapes, normalize, fold accents if required) */
   cl_string_latex2iso(regex, delatexed_regex, l);
@@ -388,7 +390,10 @@ cl_regex_match(CL_Regex rx, char *str, int normalize_utf8)
    * but if there wasn't a grain-match, we know that PCRE won't match; so we don't bother calling it. */
 
   if (!grain_match) { /* enabled since version 2.2.b94 (14 Feb 2006) -- before: && cl_optimize */
-    cl_regopt_successes++;
+    if (rx->is_clone)
+      rx->optimiser_rejects++; /* clones may run in parallel threads, so they must not touch the global counter */
+    else
+      cl_regopt_successes++;
     result = PCRE_ERROR_NOMATCH;  /* the return code from PCRE when there is, um, no match */
   }
 #if 1
@@ -439,22 +444,62 @@ cl_delete_regex(CL_Regex rx)
   if (!rx)
     return;
 
-  if (rx->needle)
-    pcre_free(rx->needle);         /* free PCRE regex buffer */
-  if (rx->extra)
+  cl_free(rx->haystack_buf);       /* free string buffers if they were allocated */
+  cl_free(rx->haystack_casefold);
+
+  /* a clone only owns its string buffers; everything else belongs to the original */
+  if (!rx->is_clone) {
+    if (rx->needle)
+      pcre_free(rx->needle);         /* free PCRE regex buffer */
+    if (rx->extra)
 #ifdef PCRE_CONFIG_JIT
-    pcre_free_study(rx->extra);    /* and "extra" buffer (iff JIT was a possibility)*/
+      pcre_free_study(rx->extra);    /* and "extra" buffer (iff JIT was a possibility)*/
 #else
-    pcre_free(rx->extra);          /* and "extra" buffer (iff we know for certain there was no JIT) */
+      pcre_free(rx->extra);          /* and "extra" buffer (iff we know for certain there was no JIT) */
 #endif
-  cl_free(rx->haystack_buf);       /* free string buffers if they were allocated */
-  cl_free(rx->haystack_casefold);
-  for (i = 0; i < rx->grains; i++)
-    cl_free(rx->grain[i]);         /* free grain strings if regex was optimised */
+    for (i = 0; i < rx->grains; i++)
+      cl_free(rx->grain[i]);         /* free grain strings if regex was optimised */
+  }
 
   cl_free(rx);
 }
 
+/**
+ * Makes a copy of a CL_Regex object that can be used in a different thread.
+ *
+ * cl_regex_match() is not re-entrant for a single CL_Regex, because it writes the
+ * (accent- or case-folded) subject string into the haystack buffers of the object.
+ * The copy returned by this function has its own haystack buffers, but shares the
+ * compiled PCRE pattern and the optimiser's grains with the original (which PCRE
+ * allows to be used by several threads at the same time). Grain-filter rejections
+ * are counted in the clone's optimiser_rejects member rather than the global counter
+ * reported by cl_regopt_count_get(), so the caller should add them up after the
+ * threads have finished.
+ *
+ * The clone must be deleted with cl_delete_regex() before the original is.
+ *
+ * @param rx  The CL_Regex to copy (which must not itself be a clone).
+ * @return    A new CL_Regex object sharing the pattern of rx.
+ */
+CL_Regex
+cl_regex_clone(CL_Regex rx)
+{
+  CL_Regex clone;
+
+  assert(rx && !rx->is_clone);
+
+  clone = (CL_Regex) cl_malloc(sizeof(struct _CL_Regex));
+  memcpy(clone, rx, sizeof(struct _CL_Regex));
+  clone->is_clone = 1;
+  clone->optimiser_rejects = 0;
+
+  /* the string buffers are the only thing that is modified by cl_regex_match() */
+  clone->haystack_buf = (rx->haystack_buf) ? (char *) cl_malloc(CL_MAX_LINE_LENGTH) : NULL;
+  clone->haystack_casefold = (rx->haystack_casefold) ? (char *) cl_malloc(2 * CL_MAX_LINE_LENGTH) : NULL;
+
+  return clone;
+}
+
 /*
  * ================================
  * helper functions (for optimiser)
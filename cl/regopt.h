@@ -56,12 +56,19 @@ struct _CL_Regex {
   int anchor_start;                  /**< @see cl_regopt_anchor_start */
   int anchor_end;                    /**< @see cl_regopt_anchor_end */
   int jumptable[256];                /**< @see cl_regopt_jumptable @see make_jump_table */
+
+  /* thread-private copies made by cl_regex_clone() */
+  int is_clone;                      /**< true if this object shares its PCRE and grain data with another CL_Regex */
+  int optimiser_rejects;             /**< a clone counts grain-filter rejections here rather than in the global counter */
 };
 
 
 /* interface function prototypes are in <cl.h>; internal functions declared here */
 
+extern int cl_regopt_successes;
+
 void regopt_data_copy_to_regex_object(CL_Regex rx);
 int cl_regopt_analyse(char *regex);
+CL_Regex cl_regex_clone(CL_Regex rx);
 
 #endif
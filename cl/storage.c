@@ -234,7 +234,7 @@ alloc_mblob(MemBlob *blob, int nr_items, int item_size, int clear_blob)
 void 
 mfree(MemBlob *blob)
 {
-  unsigned int map_len;
+  size_t map_len;
 
   assert((blob != NULL) && "You can't pass a NULL blob to mfree");
 
@@ -360,6 +360,95 @@ mmapfile(char *filename, size_t *len_ptr, char *mode)
 }
 
 
+/**
+ * Minimum size of a memory-mapped MemBlob for which transparent huge pages are requested.
+ * @see memblob_advise
+ */
+#define HUGEPAGE_MIN_SIZE (4 * 1024 * 1024)
+
+/**
+ * Tells the operating system how the data of a memory-mapped MemBlob will be accessed.
+ *
+ * This sets the readahead policy for the mapping with madvise(): a sequential
+ * hint reads large chunks ahead of the current position, while a random hint
+ * switches off readahead so that index lookups don't pull in data that will
+ * never be used.  A normal hint restores the default policy, e.g. at the end
+ * of a scan.  Large blobs are also marked as candidates for transparent
+ * huge pages, which the kernel may or may not be able to use for file data.
+ *
+ * The hints are purely advisory; nothing happens for blobs that aren't
+ * memory-mapped or on platforms without madvise().
+ *
+ * @param blob    The MemBlob.
+ * @param access  One of the MEMBLOB_ACCESS_* constants.
+ */
+void
+memblob_advise(MemBlob *blob, int access)
+{
+#if !defined(__MINGW__) && defined(MADV_NORMAL)
+  if (blob->allocation_method != MMAPPED || blob->data == NULL || blob->size == 0)
+    return;
+
+  switch (access) {
+  case MEMBLOB_ACCESS_NORMAL:
+    madvise((void *)blob->data, blob->size, MADV_NORMAL);
+    break;
+  case MEMBLOB_ACCESS_SEQUENTIAL:
+    madvise((void *)blob->data, blob->size, MADV_SEQUENTIAL);
+    break;
+  case MEMBLOB_ACCESS_RANDOM:
+    madvise((void *)blob->data, blob->size, MADV_RANDOM);
+    break;
+  }
+#ifdef MADV_HUGEPAGE
+  if (blob->size >= HUGEPAGE_MIN_SIZE)
+    madvise((void *)blob->data, blob->size, MADV_HUGEPAGE);
+#endif
+#endif
+}
+
+/**
+ * Reads the data of a memory-mapped MemBlob into memory ahead of use.
+ *
+ * When this function returns, the data is in the page cache and mapped into the
+ * address space of the process, so the first accesses won't have to wait for
+ * the disk.  Where the kernel can't populate the mapping directly, one byte of
+ * every page is read.
+ *
+ * @param blob  The MemBlob.
+ * @return      Number of bytes prefetched (0 if the blob isn't memory-mapped).
+ */
+size_t
+memblob_prefetch(MemBlob *blob)
+{
+  volatile unsigned char sum = 0;
+  unsigned char *data;
+  size_t page_size, offset;
+
+  if (blob->allocation_method != MMAPPED || blob->data == NULL || blob->size == 0)
+    return 0;
+
+#ifndef __MINGW__
+#ifdef MADV_POPULATE_READ
+  if (madvise((void *)blob->data, blob->size, MADV_POPULATE_READ) == 0)
+    return blob->size;
+#endif
+#ifdef MADV_WILLNEED
+  madvise((void *)blob->data, blob->size, MADV_WILLNEED); /* start reading the whole file asynchronously */
+#endif
+  page_size = sysconf(_SC_PAGESIZE);
+#else
+  page_size = 4096;
+#endif
+
+  data = (unsigned char *)blob->data;
+  for (offset = 0; offset < blob->size; offset += page_size)
+    sum += data[offset];
+
+  return blob->size;
+}
+
+
 /**
  * Maps a file into memory.
  *
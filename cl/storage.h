@@ -37,6 +37,11 @@
 #define MMAPPED  1    /**< Flag: indicates use of mmap() to allocate memory  in a MemBlob*/
 #define MALLOCED 2    /**< Flag: indicates use of malloc() to allocate memory */
 
+/* expected access patterns of a memory-mapped MemBlob, for memblob_advise() */
+#define MEMBLOB_ACCESS_NORMAL     0   /**< Access pattern: no hint (system default readahead) */
+#define MEMBLOB_ACCESS_SEQUENTIAL 1   /**< Access pattern: mostly read front to back (e.g. corpus scans) */
+#define MEMBLOB_ACCESS_RANDOM     2   /**< Access pattern: scattered small reads (e.g. index lookups) */
+
 /* TODO use these new, clearer macros in future */
 #define MEMBLOB_UNALLOCATED 0 /**< Flag: indicates no memory has been allocated */
 #define MEMBLOB_MMAPPED  1    /**< Flag: indicates use of mmap() to allocate memory in a MemBlob */
@@ -125,6 +130,9 @@ int write_file_from_blob(char *filename,
 void *mmapfile(char *filename, size_t *len_ptr, char *mode);
 void *mallocfile(char *filename, size_t *len_ptr, char *mode);
 
+void memblob_advise(MemBlob *blob, int access);
+size_t memblob_prefetch(MemBlob *blob);
+
 /* a new-style API for MemBlobs */
 /* TODO argument orders for the read/write functions are wrong... */
 #define memblob_read_from_file read_file_into_blob
@@ -181,6 +181,45 @@ sort_s_att_regions(void) {
   return;
 }
 
+/* region cursors for the selected s-attributes in cd->strucAttributes (in list order), valid while a KWIC line is built */
+cl_struc_cursor sar_cursors[MAX_S_ATTRS];
+Attribute *sar_cursor_attrs[MAX_S_ATTRS];
+int N_sar_cursors = 0;
+
+/**
+ * Opens region cursors for the s-attributes whose tags are shown in a concordance line.
+ *
+ * Since get_position_values() is called for runs of adjacent tokens, the cursors
+ * can find the regions at each position without a binary search.
+ */
+static void
+open_struc_cursors(ContextDescriptor *cd)
+{
+  AttributeInfo *ai;
+
+  N_sar_cursors = 0;
+  if (cd->strucAttributes)
+    for (ai = cd->strucAttributes->list; ai && N_sar_cursors < MAX_S_ATTRS; ai = ai->next)
+      if (ai->status) {
+        sar_cursor_attrs[N_sar_cursors] = ai->attribute;
+        sar_cursors[N_sar_cursors++] = cl_new_struc_cursor(ai->attribute);
+      }
+}
+
+/**
+ * Deletes the region cursors created by open_struc_cursors().
+ */
+static void
+close_struc_cursors(void)
+{
+  int i;
+
+  for (i = 0; i < N_sar_cursors; i++)
+    if (sar_cursors[i])
+      cl_delete_struc_cursor(sar_cursors[i]);
+  N_sar_cursors = 0;
+}
+
 
 /**
  * Get values at the given corpus position.
@@ -208,21 +247,17 @@ get_position_values(ContextDescriptor *cd,
      then sort them to ensure proper nesting, and print from the list */
   N_sar = 0;
   if (cd->strucAttributes) {
-    for (ai = cd->strucAttributes->list; ai; ai = ai->next)
-      if (ai->status) {
-        int s_start, s_end, snum;
+    for (i = 0; i < N_sar_cursors; i++)
+      if (sar_cursors[i]) {
+        int s_start, s_end;
         
-        if ( ((snum = cl_cpos2struc(ai->attribute, position)) >= 0) &&
-             (cl_struc2cpos(ai->attribute, snum, &s_start, &s_end)) &&
-             ((position == s_start) || (position == s_end)) ) {
+        if ( (cl_struc_cursor_seek(sar_cursors[i], position) & (STRUC_LBOUND|STRUC_RBOUND)) &&
+             (cl_struc_cursor_region(sar_cursors[i], &s_start, &s_end)) ) {
 
-          s_att_regions[N_sar].name = ai->attribute->any.name;
+          s_att_regions[N_sar].name = sar_cursor_attrs[i]->any.name;
           s_att_regions[N_sar].start = s_start;
           s_att_regions[N_sar].end = s_end;
-          if (cl_struc_values(ai->attribute))
-            s_att_regions[N_sar].annot = cl_struc2str(ai->attribute, snum);
-          else
-            s_att_regions[N_sar].annot = NULL;
+          s_att_regions[N_sar].annot = cl_struc_cursor_value(sar_cursors[i]);
           N_sar++;
           }
 
@@ -619,6 +654,8 @@ compose_kwic_line(Corpus *corpus,
    * WE ARE NOW READY TO START BUILDING US A KWIC LINE !!! Hurray!
    */
 
+  open_struc_cursors(cd);
+
   get_print_attribute_values(cd, match_start, 
                              line, &line_p, 
                              MAXKWICLINELEN, 
@@ -1204,6 +1241,7 @@ compose_kwic_line(Corpus *corpus,
 
   *length = line->len;
 
+  close_struc_cursors();
   return cl_strdup(cl_autostring_ptr(line));
 
   /* TODO: returned_positions richtig setzen */
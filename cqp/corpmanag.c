@@ -24,6 +24,9 @@
 #include <string.h>
 #include <ctype.h>
 #include <math.h>
+#ifndef __MINGW__
+#include <sys/mman.h>
+#endif
 
 #include "../cl/globals.h"
 #include "../cl/macros.h"
@@ -49,6 +52,35 @@
 /* the sum of the original programmers' birthdays: 15081963 (Max) + 21111965 (Oli) */
 
 
+/**
+ * Header of a saved query file in the memory-mapped format (magic number SUBCORPMAGIC+2).
+ *
+ * The header is followed by the registry directory and the name of the mother corpus
+ * (as '\0'-terminated strings), then by the data columns: the Range array and the
+ * optional sort index, target and keyword vectors.  Column offsets are given in units
+ * of the alignment, which is SUBCORP_PAGE_SIZE unless the Range array is smaller than
+ * a page.  With page-aligned columns, the whole file can be mmap()ed and used as it is,
+ * so a saved query is only read from disk as far as it is actually accessed.
+ */
+typedef struct {
+  int magic;            /**< SUBCORPMAGIC + 2                                         */
+  int size;             /**< number of ranges                                         */
+  int align;            /**< alignment of the columns (in bytes)                      */
+  int range;            /**< offset of the Range array (in units of align, 0 = empty) */
+  int sortidx;          /**< offset of the sort index (0 = none)                      */
+  int targets;          /**< offset of the target vector (0 = none)                   */
+  int keywords;         /**< offset of the keyword vector (0 = none)                  */
+  int reserved;         /**< always 0                                                 */
+} SubcorpusHeader;
+
+/** Alignment of the data columns in large saved query files */
+#define SUBCORP_PAGE_SIZE 4096
+
+/** True iff pointer p points into the memory-mapped saved query file of cl */
+#define IN_MAPPED_SUBCORPUS(cl, p) \
+  ((cl)->mapped && (char *)(p) >= (char *)(cl)->mapped && (char *)(p) < (char *)(cl)->mapped + (cl)->mapped_len)
+
+
 /* typedef struct { */
 /*   int magic; */
 /*   char *regdir; */
@@ -61,6 +93,7 @@
 static Boolean attach_subcorpus(CorpusList *cl,
                                 char *advertised_directory,
                                 char *advertised_filename);
+static void unmap_subcorpus(CorpusList *cl);
 
 CorpusList *GetSystemCorpus(char *name, char *registry);
 
@@ -69,6 +102,9 @@ CorpusList *GetSystemCorpus(char *name, char *registry);
 /** Global list of currently-loaded corpora */
 CorpusList *corpuslist;
 
+/** Called by initialize_cl() and detach_subcorpus(), i.e. before a corpus is changed or discarded */
+void (*corpus_change_hook)(CorpusList *cl) = NULL;
+
 
 /**
  * Initialises the global corpus list (sets it to NULL, no matter what its value was).
@@ -93,11 +129,15 @@ init_corpuslist(void)
 void
 initialize_cl(CorpusList *cl, int free_name)
 {
+  if (corpus_change_hook)
+    corpus_change_hook(cl);
+
   if (free_name) {
     cl_free(cl->name);
     cl_free(cl->mother_name);
     cl->mother_size = 0;
   }
+  unmap_subcorpus(cl);
   cl_free(cl->registry);
   cl_free(cl->range);
   cl_free(cl->abs_fn);
@@ -169,6 +209,8 @@ NewCL(void)
   cl->sortidx = NULL;
   cl->targets = NULL;
   cl->keywords = NULL;
+  cl->mapped = NULL;
+  cl->mapped_len = 0;
 
   cl->cd = NULL;
 
@@ -1130,7 +1172,7 @@ check_stamp(char *directory, char *fname)
 
   if (((fd = open_file(full_name, "rb")) == NULL) ||
       (fread(&magic, sizeof(int), 1, fd) == 0) ||
-      ((magic != SUBCORPMAGIC) && (magic != SUBCORPMAGIC+1)))
+      ((magic != SUBCORPMAGIC) && (magic != SUBCORPMAGIC+1) && (magic != SUBCORPMAGIC+2)))
     ok = 0;
   else
     ok = 1;
@@ -1387,6 +1429,242 @@ ensure_syscorpus(char *registry, char *name)
 }
 
 
+/**
+ * Releases the memory-mapped saved query file of a subcorpus.
+ *
+ * Any of the range, sortidx, targets and keywords vectors that point into the
+ * mapping are set to NULL; vectors that have been allocated in the meantime
+ * are left alone.
+ *
+ * @param cl  The subcorpus.
+ */
+static void
+unmap_subcorpus(CorpusList *cl)
+{
+  if (cl->mapped == NULL)
+    return;
+
+  if (IN_MAPPED_SUBCORPUS(cl, cl->range))
+    cl->range = NULL;
+  if (IN_MAPPED_SUBCORPUS(cl, cl->sortidx))
+    cl->sortidx = NULL;
+  if (IN_MAPPED_SUBCORPUS(cl, cl->targets))
+    cl->targets = NULL;
+  if (IN_MAPPED_SUBCORPUS(cl, cl->keywords))
+    cl->keywords = NULL;
+
+#ifndef __MINGW__
+  munmap(cl->mapped, cl->mapped_len);
+#endif
+  cl->mapped = NULL;
+  cl->mapped_len = 0;
+}
+
+/**
+ * Returns an allocated copy of a vector of the subcorpus if it points into the
+ * memory-mapped file, or the vector itself otherwise (helper for detach_subcorpus()).
+ */
+static void *
+copy_mapped_column(CorpusList *cl, void *column, size_t item_size)
+{
+  void *copy;
+
+  if (!IN_MAPPED_SUBCORPUS(cl, column))
+    return column;
+  if (cl->size <= 0)
+    return NULL;
+
+  copy = cl_malloc(item_size * cl->size);
+  memcpy(copy, column, item_size * cl->size);
+  return copy;
+}
+
+/**
+ * Copies the data of a memory-mapped subcorpus into allocated memory.
+ *
+ * The range, sortidx, targets and keywords vectors of a subcorpus loaded from
+ * a saved query file in the memory-mapped format point directly into the file,
+ * so they must not be freed or reallocated.  Any function that does this (e.g.
+ * to sort, reduce or re-target a subcorpus) has to call detach_subcorpus()
+ * first.  Nothing happens if the subcorpus isn't memory-mapped (except that
+ * corpus_change_hook is called in any case).
+ *
+ * @param cl  The subcorpus.
+ */
+void
+detach_subcorpus(CorpusList *cl)
+{
+  if (cl != NULL && corpus_change_hook)
+    corpus_change_hook(cl);
+
+  if (cl == NULL || cl->mapped == NULL)
+    return;
+
+  cl->range = (Range *)copy_mapped_column(cl, cl->range, sizeof(Range));
+  cl->sortidx = (int *)copy_mapped_column(cl, cl->sortidx, sizeof(int));
+  cl->targets = (int *)copy_mapped_column(cl, cl->targets, sizeof(int));
+  cl->keywords = (int *)copy_mapped_column(cl, cl->keywords, sizeof(int));
+
+  unmap_subcorpus(cl);
+}
+
+/**
+ * Reads a data column of a saved query file into allocated memory
+ * (used by attach_mapped_subcorpus() where the file can't be mapped).
+ *
+ * @return  The column, or NULL on read error.
+ */
+static void *
+read_subcorpus_column(FILE *fp, off_t offset, int n, size_t item_size)
+{
+  void *column = cl_malloc(item_size * n);
+
+  if (fseek(fp, (long)offset, SEEK_SET) != 0 || fread(column, item_size, n, fp) != n)
+    cl_free(column);
+  return column;
+}
+
+/**
+ * Loads a saved query file in the memory-mapped format (helper for attach_subcorpus()).
+ *
+ * Only the header is read from the file.  The data columns are mapped into
+ * memory as they are, so that cl->range etc. point into the file and pages are
+ * only read from disk when they're accessed (e.g. for "cat A 1000 1099;").
+ * If the file can't be mapped, the columns are read into allocated memory.
+ *
+ * @param cl        The subcorpus (which has been cleared with initialize_cl()).
+ * @param fp        The saved query file.
+ * @param fullname  Path of the file.
+ * @return          Boolean: whether the file was loaded correctly.
+ */
+static Boolean
+attach_mapped_subcorpus(CorpusList *cl, FILE *fp, char *fullname)
+{
+  SubcorpusHeader header;
+  CorpusList *mother;
+  off_t len, head_end, strings_end = 0;
+  char *head, *p, *base;
+  int n_strings;
+
+  len = fd_file_length(fp);
+  rewind(fp);
+
+  /* the alignment must be a power of two that keeps the int columns aligned (and no larger than a page) */
+  if (fread(&header, sizeof(SubcorpusHeader), 1, fp) != 1 ||
+      header.size < 0 || header.align < (int)sizeof(int) || header.align > SUBCORP_PAGE_SIZE ||
+      (header.align & (header.align - 1)) != 0 ||
+      header.range < 0 || header.sortidx < 0 || header.targets < 0 || header.keywords < 0 ||
+      (header.size > 0 && header.range == 0)) {
+    fprintf(stderr, "Read error while reading subcorpus %s (invalid header in %s)\n", cl->name, fullname);
+    return False;
+  }
+
+  /* all data columns must be within the file */
+  if ((off_t)header.range * header.align + (off_t)header.size * sizeof(Range) > len ||
+      (off_t)header.sortidx * header.align + (off_t)header.size * sizeof(int) > len ||
+      (off_t)header.targets * header.align + (off_t)header.size * sizeof(int) > len ||
+      (off_t)header.keywords * header.align + (off_t)header.size * sizeof(int) > len) {
+    fprintf(stderr, "Read error while reading subcorpus %s (%s is truncated)\n", cl->name, fullname);
+    return False;
+  }
+
+  /* read the registry directory and name of the mother corpus, which are followed by the first column */
+  head_end = (header.size > 0) ? (off_t)header.range * header.align : len;
+  if (head_end <= (off_t)sizeof(SubcorpusHeader)) {
+    fprintf(stderr, "Read error while reading subcorpus %s (invalid header in %s)\n", cl->name, fullname);
+    return False;
+  }
+  head = (char *)cl_malloc(head_end - sizeof(SubcorpusHeader) + 1);
+  if (fread(head, 1, head_end - sizeof(SubcorpusHeader), fp) != head_end - sizeof(SubcorpusHeader)) {
+    fprintf(stderr, "Read error while reading subcorpus %s\n", cl->name);
+    cl_free(head);
+    return False;
+  }
+  head[head_end - sizeof(SubcorpusHeader)] = '\0';
+  for (p = head, n_strings = 0; p < head + (head_end - sizeof(SubcorpusHeader)); p++)
+    if (*p == '\0')
+      n_strings++;
+  /* no column may overlap the header or the two strings */
+  if (n_strings >= 2) {
+    strings_end = sizeof(SubcorpusHeader) + strlen(head) + 1;
+    strings_end += strlen(head + strings_end - sizeof(SubcorpusHeader)) + 1;
+  }
+  if (n_strings < 2 ||
+      (header.range && (off_t)header.range * header.align < strings_end) ||
+      (header.sortidx && (off_t)header.sortidx * header.align < strings_end) ||
+      (header.targets && (off_t)header.targets * header.align < strings_end) ||
+      (header.keywords && (off_t)header.keywords * header.align < strings_end)) {
+    fprintf(stderr, "Read error while reading subcorpus %s (invalid header in %s)\n", cl->name, fullname);
+    cl_free(head);
+    return False;
+  }
+
+  cl->registry = cl_strdup(head);
+  cl_free(cl->mother_name);
+  cl->mother_name = cl_strdup(head + strlen(head) + 1);
+  cl_free(head);
+
+  mother = ensure_syscorpus(cl->registry, cl->mother_name);
+
+  if (mother == NULL || mother->corpus == NULL) {
+    cqpmessage(Warning, "When trying to load subcorpus %s:\n\t"
+               "Can't access mother corpus %s",
+               cl->name, cl->mother_name);
+    return False;
+  }
+
+  cl->corpus = mother->corpus;
+  cl->mother_size = mother->mother_size;
+  cl->size = header.size;
+
+  if (cl->size > 0) {
+    base = NULL;
+#ifndef __MINGW__
+    /* a private mapping, so that writing to the vectors never changes the file */
+    base = (char *)mmap(NULL, (size_t)len, PROT_READ|PROT_WRITE, MAP_PRIVATE, fileno(fp), 0);
+    if (base == (char *)MAP_FAILED)
+      base = NULL;
+#endif
+    if (base) {
+      cl->mapped = base;
+      cl->mapped_len = (size_t)len;
+      cl->range = (Range *)(base + (off_t)header.range * header.align);
+      cl->sortidx = header.sortidx ? (int *)(base + (off_t)header.sortidx * header.align) : NULL;
+      cl->targets = header.targets ? (int *)(base + (off_t)header.targets * header.align) : NULL;
+      cl->keywords = header.keywords ? (int *)(base + (off_t)header.keywords * header.align) : NULL;
+    }
+    else {
+      cl->range = (Range *)read_subcorpus_column(fp, (off_t)header.range * header.align, cl->size, sizeof(Range));
+      if (header.sortidx)
+        cl->sortidx = (int *)read_subcorpus_column(fp, (off_t)header.sortidx * header.align, cl->size, sizeof(int));
+      if (header.targets)
+        cl->targets = (int *)read_subcorpus_column(fp, (off_t)header.targets * header.align, cl->size, sizeof(int));
+      if (header.keywords)
+        cl->keywords = (int *)read_subcorpus_column(fp, (off_t)header.keywords * header.align, cl->size, sizeof(int));
+      if (!cl->range || (header.sortidx && !cl->sortidx) ||
+          (header.targets && !cl->targets) || (header.keywords && !cl->keywords)) {
+        fprintf(stderr, "Read error while reading subcorpus %s\n", cl->name);
+        return False;
+      }
+    }
+  }
+
+  if (subcorpload_debug)
+    fprintf(stderr,
+            "Nr Matches: %d\n"
+            "Alignment: %d\n"
+            "Memory-mapped: %s\n"
+            "regdir: %s\n"
+            "regname: %s\n",
+            cl->size, header.align, cl->mapped ? "yes" : "no", cl->registry, cl->mother_name);
+
+  cl->type = SUB;
+  cl->saved = True;
+  cl->loaded = True;
+  cl->needs_update = False;
+  return True;
+}
+
 /**
  * @param cl
  * @param advertised_directory
@@ -1398,7 +1676,7 @@ attach_subcorpus(CorpusList *cl,
                  char *advertised_directory,
                  char *advertised_filename)
 {
-  int         j, len;
+  int         j, len, magic;
   char       *fullname;
   FILE       *fp;
 
@@ -1437,7 +1715,16 @@ attach_subcorpus(CorpusList *cl,
     if (fp == NULL)
       fprintf(stderr, "Subcorpus %s not accessible (can't open %s for reading)\n",
               cl->name, fullname);
+    else if (fread(&magic, sizeof(int), 1, fp) == 1 && magic == SUBCORPMAGIC + 2) {
+      /* memory-mapped format: only the header is read here */
+      if ((load_ok = attach_mapped_subcorpus(cl, fp, fullname))) {
+        cl->abs_fn = fullname;
+        fullname = NULL;
+      }
+      fclose(fp);
+    }
     else {
+      rewind(fp);
       len = file_length(fullname);
 
       if (len <= 0)
@@ -1457,7 +1744,6 @@ attach_subcorpus(CorpusList *cl,
         else {
 
           CorpusList *mother;
-          int magic;
 
           magic = *((int *)field);
 
@@ -1600,13 +1886,63 @@ attach_subcorpus(CorpusList *cl,
   return load_ok;
 }
 
+/**
+ * Computes the position of a data column in a saved query file (helper for save_subcorpus()).
+ *
+ * @param pos        Current end of the file; updated to the end of the column.
+ * @param align      Alignment of the column.
+ * @param n          Number of items in the column.
+ * @param item_size  Size of each item.
+ * @return           Offset of the column in units of align.
+ */
+static int
+place_subcorpus_column(off_t *pos, int align, int n, size_t item_size)
+{
+  int offset = (int)((*pos + align - 1) / align);
+
+  *pos = (off_t)offset * align + (off_t)n * item_size;
+  return offset;
+}
+
+/**
+ * Writes a data column to a saved query file, padding the file up to the
+ * offset of the column (helper for save_subcorpus()).
+ *
+ * @param fp         The file.
+ * @param pos        Number of bytes written so far; updated.
+ * @param offset     Byte offset of the column.
+ * @param column     The data.
+ * @param n          Number of items in the column.
+ * @param item_size  Size of each item.
+ */
+static void
+write_subcorpus_column(FILE *fp, off_t *pos, off_t offset, void *column, int n, size_t item_size)
+{
+  for ( ; *pos < offset; (*pos)++)
+    fputc('\0', fp);
+  fwrite(column, item_size, n, fp);
+  *pos += (off_t)n * item_size;
+}
+
+/**
+ * Saves a subcorpus (i.e. a named query result) to disk.
+ *
+ * The file uses the memory-mapped format (see SubcorpusHeader), which older
+ * versions of CQP can't read.
+ *
+ * @param cl     The subcorpus to save.
+ * @param fname  File to write to; if NULL, the subcorpus is saved in its
+ *               own file in the data directory.
+ * @return       Boolean: true for success (or if there was nothing to do).
+ */
 Boolean
 save_subcorpus(CorpusList *cl, char *fname)
 {
-  int i, l1, l2, magic;
+  int l1, l2, write_error;
 
   FILE *fp;
   char outfn[CL_MAX_FILENAME_LENGTH];
+  char tmpfn[CL_MAX_FILENAME_LENGTH + 4];
 
   if (cl == NULL)
     return False;
@@ -1640,65 +1976,67 @@ save_subcorpus(CorpusList *cl, char *fname)
       }
     }
 
-    if ((fp = open_file(fname, "wb")) != NULL) {
-
-      int zero;
-      zero = 0;
-
-      magic = SUBCORPMAGIC + 1; /* new format -- Mon Jul 31 17:19:27 1995 (oli) */
+    /* write to a temporary file first, so that other processes which have mapped
+       the old version of the file into memory can continue to use it */
+#ifndef __MINGW__
+    sprintf(tmpfn, "%s.tmp", fname);
+#else
+    strcpy(tmpfn, fname);
+#endif
 
-      fwrite(&magic, sizeof(int), 1, fp);
+    if ((fp = open_file(tmpfn, "wb")) != NULL) {
 
-      l1 = fwrite(cl->registry, 1, strlen(cl->registry) + 1, fp);
-      l2 = fwrite(cl->mother_name, 1, strlen(cl->mother_name) + 1, fp);
+      SubcorpusHeader header;
+      off_t pos;
 
-      /* fill up */
-      for (i = 0; (i+l1+l2)%4 != 0; i++)
-        fputc('\0', fp);
+      l1 = strlen(cl->registry) + 1;
+      l2 = strlen(cl->mother_name) + 1;
 
-      /* write the size (the number of ranges) */
-
-      fwrite(&cl->size, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
+      /* page-aligned columns (except for small files, where they would only waste space) */
+      header.magic = SUBCORPMAGIC + 2;
+      header.size = cl->size;
+      header.align = (cl->size * sizeof(Range) >= SUBCORP_PAGE_SIZE) ? SUBCORP_PAGE_SIZE : sizeof(Range);
+      header.range = header.sortidx = header.targets = header.keywords = header.reserved = 0;
 
+      pos = sizeof(SubcorpusHeader) + l1 + l2;
       if (cl->size > 0) {
+        header.range = place_subcorpus_column(&pos, header.align, cl->size, sizeof(Range));
+        if (cl->sortidx)
+          header.sortidx = place_subcorpus_column(&pos, header.align, cl->size, sizeof(int));
+        if (cl->targets)
+          header.targets = place_subcorpus_column(&pos, header.align, cl->size, sizeof(int));
+        if (cl->keywords)
+          header.keywords = place_subcorpus_column(&pos, header.align, cl->size, sizeof(int));
+      }
 
-        fwrite((char *)cl->range, sizeof(Range), cl->size, fp);
-
-        /* write the sort index  new Mon Jul 31 17:24:52 1995 (oli) */
-
-        if (cl->sortidx) {
-          fwrite(&cl->size, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
-          fwrite((char *)cl->sortidx, sizeof(int), cl->size, fp);
-        }
-        else
-          fwrite(&zero, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
-
-
-        /* write the targets new Mon Jul 31 17:24:59 1995 (oli) */
-
-        if (cl->targets) {
-          fwrite(&cl->size, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
-          fwrite((char *)cl->targets, sizeof(int), cl->size, fp);
-        }
-        else
-          fwrite(&zero, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
-
-
-        /* write the keywords new Mon Jul 31 17:25:02 1995 (oli) */
-
-
-        if (cl->keywords) {
-          fwrite(&cl->size, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
-          fwrite((char *)cl->keywords, sizeof(int), cl->size, fp);
-        }
-        else
-          fwrite(&zero, sizeof(int), 1, fp); /* new Mon Jul 31 17:24:47 1995 (oli) */
-
+      fwrite(&header, sizeof(SubcorpusHeader), 1, fp);
+      fwrite(cl->registry, 1, l1, fp);
+      fwrite(cl->mother_name, 1, l2, fp);
+      pos = sizeof(SubcorpusHeader) + l1 + l2;
 
+      if (cl->size > 0) {
+        write_subcorpus_column(fp, &pos, (off_t)header.range * header.align, cl->range, cl->size, sizeof(Range));
+        if (cl->sortidx)
+          write_subcorpus_column(fp, &pos, (off_t)header.sortidx * header.align, cl->sortidx, cl->size, sizeof(int));
+        if (cl->targets)
+          write_subcorpus_column(fp, &pos, (off_t)header.targets * header.align, cl->targets, cl->size, sizeof(int));
+        if (cl->keywords)
+          write_subcorpus_column(fp, &pos, (off_t)header.keywords * header.align, cl->keywords, cl->size, sizeof(int));
       }
 
-
-      fclose(fp);
+      write_error = ferror(fp);
+      if (fclose(fp) != 0 || write_error) {
+        fprintf(stderr, "write error on output file %s\n", tmpfn);
+        remove(tmpfn);
+        return(False);
+      }
+#ifndef __MINGW__
+      if (rename(tmpfn, fname) != 0) {
+        fprintf(stderr, "cannot rename %s to %s\n", tmpfn, fname);
+        remove(tmpfn);
+        return(False);
+      }
+#endif
 
       cl->saved = True;
       cl->needs_update = False;
@@ -1706,7 +2044,7 @@ save_subcorpus(CorpusList *cl, char *fname)
       return(True);
     }
     else {
-      fprintf(stderr, "cannot open output file %s\n", fname);
+      fprintf(stderr, "cannot open output file %s\n", tmpfn);
       return(False);
     }
   }
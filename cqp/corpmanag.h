@@ -110,6 +110,11 @@ typedef struct cl {
   int             *targets;      /**< list of targets                            */
   int             *keywords;     /**< one keyword, for each concordance line     */
 
+  void            *mapped;       /**< memory-mapped saved query file which range,
+                                      sortidx, targets and keywords point into
+                                      (NULL if they have been allocated)         */
+  size_t           mapped_len;   /**< size of the mapped file in bytes           */
+
   ContextDescriptor *cd;         /**< additional attributes to print -- only
                                       for ``SYSTEM'' corpora                     */
 
@@ -126,6 +131,12 @@ CorpusList *current_corpus;
  */
 CorpusList *corpuslist;
 
+/**
+ * Function that is called before the data of a corpus are modified or discarded
+ * (NULL if not needed).  The CQi server uses it for cursors on subcorpora.
+ */
+extern void (*corpus_change_hook)(CorpusList *cl);
+
 /* ---------------------------------------------------------------------- */
 
 /* this should usually be provided by a FIELD or FIELDLABEL token recognised by flex,
@@ -170,6 +181,8 @@ char *split_subcorpus_name(char *corpusname, char *mother_name);
 
 Boolean save_subcorpus(CorpusList *cl, char *fname);
 
+void detach_subcorpus(CorpusList *cl);
+
 void save_unsaved_subcorpora();
 
 /* Iterate through list of corpora */
@@ -25,6 +25,7 @@
 
 
 #include <sys/types.h>         /* required for regex */
+#include <glib.h>
 
 #include "../cl/globals.h"
 #include "../cl/macros.h"
@@ -33,6 +34,7 @@
 #include "../cl/attributes.h"
 #include "../cl/cdaccess.h"
 #include "../cl/special-chars.h"
+#include "../cl/regopt.h"
 
 #include "cqp.h"
 #include "ranges.h"
@@ -51,6 +53,60 @@
 
 #define RED_THRESHOLD 0.01
 
+/** Minimum number of initial matchlist elements per thread in a parallel simulate() */
+#define SIMULATION_MIN_CHUNK 4096
+
+/** Maximum number of distinct regular expressions in a query that is simulated in parallel */
+#define SIMULATION_MAX_REGEX 64
+
+/**
+ * A slice of the initial matchlist, which is simulated by a single thread in simulate_chunk().
+ *
+ * Each chunk has its own state vectors and label reference tables. Chunks that run
+ * in a worker thread also have private copies of the query's regular expressions
+ * (see eval_regex_match()).
+ */
+typedef struct _SimulationChunk {
+  Matchlist *matchlist;
+  int first;                    /**< first matchlist element of this chunk */
+  int last;                     /**< matchlist element after the end of this chunk */
+  int cut;                      /**< maximal number of matches to find in this chunk (-1 = no limit) */
+  int start_state;
+  int start_offset;
+  int start_transition;
+  int *state_vector;
+  int *target_vector;
+  RefTab *reftab_vector;
+  RefTab *reftab_target_vector;
+  int is_worker;                /**< True iff the chunk is simulated in a worker thread */
+  int n_rx;                     /**< number of regular expressions in the rx_orig and rx_clone tables */
+  CL_Regex *rx_orig;            /**< the regular expressions used by the query ... */
+  CL_Regex *rx_clone;           /**< ... and the thread-private copies used by this chunk */
+} SimulationChunk;
+
+/** The SimulationChunk processed by the current thread (NULL in the main thread) */
+static GPrivate simulation_current_chunk = G_PRIVATE_INIT(NULL);
+
+
+/**
+ * Matches a string against one of the regular expressions of the current query.
+ *
+ * Within a worker thread of a parallel simulate(), the thread's private copy
+ * of the regular expression is used, since cl_regex_match() is not re-entrant.
+ */
+static int
+eval_regex_match(CL_Regex rx, char *str)
+{
+  SimulationChunk *chunk = (SimulationChunk *) g_private_get(&simulation_current_chunk);
+  int i;
+
+  if (chunk)
+    for (i = 0; i < chunk->n_rx; i++)
+      if (chunk->rx_orig[i] == rx)
+        return cl_regex_match(chunk->rx_clone[i], str, 0);
+  return cl_regex_match(rx, str, 0);
+}
+
 
 
 /**
@@ -113,7 +169,9 @@ set_corpus_matchlists(CorpusList *cp,
                       int keep_old_ranges)
 {
   int i;
-  
+
+  detach_subcorpus(cp);
+
   if (keep_old_ranges) {
 
     int rp, mp;
@@ -386,7 +444,7 @@ eval_constraint(AVS avs, int corppos, RefTab labelrefs, RefTab target_labelrefs)
         char *val = cl_struc2str(avs->tag.attr, struc);
         if (val) {
           if (avs->tag.rx)
-            result = cl_regex_match(avs->tag.rx, val, 0); /* pre-compiled regex available */
+            result = eval_regex_match(avs->tag.rx, val); /* pre-compiled regex available */
           else
             result = (0 == strcmp(avs->tag.constraint, val)); /* no pre-compiled regex -> match as plain string */
         }
@@ -1054,8 +1112,8 @@ eval_bool(Constrainttree ctptr, RefTab rt, int corppos)
 
               /* perform a regular expression match of the two */
               return((ctptr->node.op_id == cmp_eq) ?
-                     cl_regex_match(ctptr->node.right->leaf.rx, ls, 0) :
-                     !cl_regex_match(ctptr->node.right->leaf.rx, ls, 0));
+                     eval_regex_match(ctptr->node.right->leaf.rx, ls) :
+                     !eval_regex_match(ctptr->node.right->leaf.rx, ls));
             }
           }
           else {
@@ -1282,6 +1340,494 @@ mark_offrange_cells(Matchlist *matchlist, CorpusList *corpus)
 
 
 
+/*
+ * Index-based evaluation of query-initial patterns
+ *
+ * Boolean combinations of simple attribute-value constraints ([lemma="run" & pos="V.*"])
+ * are evaluated on sorted lists of corpus positions obtained from the index of each
+ * p-attribute. A negated subexpression is represented by the positions that do NOT
+ * match it (is_inverted in the Matchlist), so that "!" never needs a list of all corpus
+ * positions until the very end. Conjunctions enumerate the smaller operand and either
+ * filter it against the other with eval_bool() (if the other one is much larger) or
+ * intersect the two lists, using galloping search when their sizes differ a lot.
+ */
+
+/** Maximum number of leaves in a constraint tree evaluated by index_initial_matchlist() */
+#define INDEX_MAX_TERMS 32
+
+/** In a conjunction, the larger operand is checked with eval_bool() if it is this many times larger than the smaller one */
+#define INDEX_FILTER_RATIO 32
+
+/** Lists are intersected with galloping search if one of them is this many times longer than the other */
+#define INDEX_GALLOP_RATIO 16
+
+/**
+ * A leaf of a constraint tree, resolved to a list of lexicon IDs.
+ */
+typedef struct _IndexTerm {
+  Constrainttree leaf;          /**< the leaf node */
+  Attribute *attr;              /**< the p-attribute it refers to (NULL for a constant) */
+  int *ids;                     /**< sorted lexicon IDs matching the leaf (allocated) */
+  int n_ids;                    /**< number of IDs; -1 if the leaf matches every token */
+  int freq;                     /**< number of corpus positions matching the leaf */
+  int negated;                  /**< True iff the leaf matches the positions NOT in the ID list */
+} IndexTerm;
+
+/**
+ * The leaves of a constraint tree evaluated by index_initial_matchlist().
+ */
+typedef struct _IndexQuery {
+  CorpusList *corpus;
+  int corpus_size;
+  int n_terms;
+  IndexTerm terms[INDEX_MAX_TERMS];
+} IndexQuery;
+
+
+/**
+ * Checks whether a node of a constraint tree is a simple comparison that can be looked up in the index.
+ */
+static int
+index_is_leaf(Constrainttree ctptr)
+{
+  switch (ctptr->type) {
+  case bnode:
+    return ((ctptr->node.op_id == cmp_eq) || (ctptr->node.op_id == cmp_neq))
+      && (ctptr->node.left != NULL) && (ctptr->node.left->type == pa_ref)
+      && (ctptr->node.left->pa_ref.label == NULL) && (ctptr->node.left->pa_ref.attr != NULL)
+      && (ctptr->node.right != NULL) && (ctptr->node.right->type == string_leaf);
+  case id_list:
+    return (ctptr->idlist.label == NULL) && (ctptr->idlist.attr != NULL);
+  case cnode:
+    return True;
+  default:
+    return False;
+  }
+}
+
+/**
+ * Checks whether a constraint tree can be evaluated by index_initial_matchlist().
+ *
+ * This is the case if it consists of &, |, and ! over simple comparisons of p-attributes
+ * with constant values (and at most INDEX_MAX_TERMS of them).
+ *
+ * @param n_leaves  Incremented by the number of leaves in the tree.
+ */
+static int
+index_can_evaluate(Constrainttree ctptr, int *n_leaves)
+{
+  if (ctptr == NULL)
+    return False;
+  if (index_is_leaf(ctptr))
+    return (++(*n_leaves) <= INDEX_MAX_TERMS);
+  if (ctptr->type != bnode)
+    return False;
+  switch (ctptr->node.op_id) {
+  case b_and:
+  case b_or:
+    return index_can_evaluate(ctptr->node.left, n_leaves) && index_can_evaluate(ctptr->node.right, n_leaves);
+  case b_not:
+    return index_can_evaluate(ctptr->node.left, n_leaves);
+  default:
+    return False;
+  }
+}
+
+/**
+ * Looks up the lexicon IDs matching each leaf of a constraint tree, together with their frequencies.
+ */
+static void
+index_resolve_terms(Constrainttree ctptr, IndexQuery *q)
+{
+  IndexTerm *term;
+  Constrainttree rhs;
+  int id;
+
+  if (!index_is_leaf(ctptr)) {
+    index_resolve_terms(ctptr->node.left, q);
+    if (ctptr->node.op_id != b_not)
+      index_resolve_terms(ctptr->node.right, q);
+    return;
+  }
+
+  assert(q->n_terms < INDEX_MAX_TERMS);
+  term = &(q->terms[q->n_terms++]);
+  term->leaf = ctptr;
+  term->attr = NULL;
+  term->ids = NULL;
+  term->n_ids = 0;
+  term->negated = False;
+
+  if (ctptr->type == cnode) {
+    if (ctptr->constnode.val != 0)
+      term->n_ids = -1;
+  }
+  else if (ctptr->type == id_list) {
+    term->attr = ctptr->idlist.attr;
+    term->negated = ctptr->idlist.negated;
+    if (ctptr->idlist.nr_items > 0) {
+      term->ids = (int *) cl_malloc(sizeof(int) * ctptr->idlist.nr_items);
+      memcpy(term->ids, ctptr->idlist.items, sizeof(int) * ctptr->idlist.nr_items);
+      term->n_ids = ctptr->idlist.nr_items;
+    }
+  }
+  else {
+    term->attr = ctptr->node.left->pa_ref.attr;
+    term->negated = (ctptr->node.op_id == cmp_neq);
+    rhs = ctptr->node.right;
+    switch (rhs->leaf.pat_type) {
+    case REGEXP:
+      if (STREQ(rhs->leaf.ctype.sconst, ".*"))
+        term->n_ids = -1;
+      else {
+        term->ids = cl_regex2id(term->attr, rhs->leaf.ctype.sconst, rhs->leaf.canon, &(term->n_ids));
+        if (term->ids == NULL)
+          term->n_ids = 0;
+        else if (term->n_ids == cl_max_id(term->attr)) {
+          /* regex matches every word form */
+          cl_free(term->ids);
+          term->n_ids = -1;
+        }
+      }
+      break;
+    case NORMAL:
+      id = cl_str2id(term->attr, rhs->leaf.ctype.sconst);
+      if (id >= 0) {
+        term->ids = (int *) cl_malloc(sizeof(int));
+        term->ids[0] = id;
+        term->n_ids = 1;
+      }
+      break;
+    case CID:
+      term->ids = (int *) cl_malloc(sizeof(int));
+      term->ids[0] = rhs->leaf.ctype.cidconst;
+      term->n_ids = 1;
+      break;
+    }
+  }
+
+  if (term->n_ids < 0)
+    term->freq = q->corpus_size;
+  else if (term->n_ids == 0)
+    term->freq = 0;
+  else
+    term->freq = cl_idlist2freq(term->attr, term->ids, term->n_ids);
+}
+
+/**
+ * Finds the IndexTerm for a leaf of the constraint tree.
+ */
+static IndexTerm *
+index_find_term(Constrainttree ctptr, IndexQuery *q)
+{
+  int i;
+
+  for (i = 0; i < q->n_terms; i++)
+    if (q->terms[i].leaf == ctptr)
+      return &(q->terms[i]);
+  assert("Internal error in index_find_term(): leaf not resolved" && 0);
+  return NULL;
+}
+
+/**
+ * Estimates the number of corpus positions matching a constraint tree (an upper bound for conjunctions).
+ */
+static int
+index_estimate(Constrainttree ctptr, IndexQuery *q)
+{
+  IndexTerm *term;
+  double n;
+
+  if (index_is_leaf(ctptr)) {
+    term = index_find_term(ctptr, q);
+    return (term->negated) ? q->corpus_size - term->freq : term->freq;
+  }
+  switch (ctptr->node.op_id) {
+  case b_and:
+    return MIN(index_estimate(ctptr->node.left, q), index_estimate(ctptr->node.right, q));
+  case b_or:
+    n = (double) index_estimate(ctptr->node.left, q) + index_estimate(ctptr->node.right, q);
+    return (n > q->corpus_size) ? q->corpus_size : (int) n;
+  default: /* b_not */
+    return q->corpus_size - index_estimate(ctptr->node.left, q);
+  }
+}
+
+/**
+ * Finds the first element >= key in list[lo .. size-1] by exponential search.
+ *
+ * @return  Index of this element, or size if there is none.
+ */
+static int
+index_gallop(int *list, int size, int lo, int key)
+{
+  int hi = lo, step = 1, mid;
+
+  while ((hi < size) && (list[hi] < key)) {
+    lo = hi + 1;
+    hi += step;
+    step <<= 1;
+  }
+  if (hi > size)
+    hi = size;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (list[mid] < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * Computes the intersection (keep_common = True) or difference (keep_common = False) of
+ * two sorted lists of corpus positions.
+ *
+ * If the second list is much longer than the first, each element of the first list is
+ * looked up by galloping search; otherwise, the two lists are merged.
+ *
+ * @return  Number of elements written to out (which must have room for na elements).
+ */
+static int
+index_filter_list(int *a, int na, int *b, int nb, int keep_common, int *out)
+{
+  int i, j = 0, k = 0, found;
+
+  if (nb > INDEX_GALLOP_RATIO * na) {
+    for (i = 0; i < na; i++) {
+      j = index_gallop(b, nb, j, a[i]);
+      found = (j < nb) && (b[j] == a[i]);
+      if (found == keep_common)
+        out[k++] = a[i];
+    }
+  }
+  else {
+    for (i = 0; i < na; i++) {
+      while ((j < nb) && (b[j] < a[i]))
+        j++;
+      found = (j < nb) && (b[j] == a[i]);
+      if (found == keep_common)
+        out[k++] = a[i];
+    }
+  }
+  return k;
+}
+
+/**
+ * Computes the union of two sorted lists of corpus positions.
+ *
+ * @return  Number of elements written to out (which must have room for na + nb elements).
+ */
+static int
+index_merge_lists(int *a, int na, int *b, int nb, int *out)
+{
+  int i = 0, j = 0, k = 0;
+
+  while ((i < na) && (j < nb)) {
+    if (a[i] < b[j])
+      out[k++] = a[i++];
+    else if (a[i] > b[j])
+      out[k++] = b[j++];
+    else {
+      out[k++] = a[i++];
+      j++;
+    }
+  }
+  while (i < na)
+    out[k++] = a[i++];
+  while (j < nb)
+    out[k++] = b[j++];
+  return k;
+}
+
+/**
+ * Combines two (possibly inverted) initial matchlists with a boolean operator.
+ *
+ * Inverted operands are handled by De Morgan's laws, so the result may be inverted as well.
+ * The result is stored in list1; list2 is freed.
+ *
+ * @param is_and  True for a conjunction, False for a disjunction.
+ */
+static void
+index_combine(Matchlist *list1, Matchlist *list2, int is_and)
+{
+  Matchlist *pos, *neg;
+  int *result, size, inverted;
+
+  if (list1->is_inverted == list2->is_inverted) {
+    /* (!A & !B) == !(A | B) and (!A | !B) == !(A & B) */
+    inverted = list1->is_inverted;
+    if (is_and != inverted) {
+      if (list1->tabsize > list2->tabsize) {
+        pos = list2;
+        neg = list1;
+      }
+      else {
+        pos = list1;
+        neg = list2;
+      }
+      result = (int *) cl_malloc(sizeof(int) * MAX(pos->tabsize, 1));
+      size = index_filter_list(pos->start, pos->tabsize, neg->start, neg->tabsize, True, result);
+    }
+    else {
+      result = (int *) cl_malloc(sizeof(int) * MAX(list1->tabsize + list2->tabsize, 1));
+      size = index_merge_lists(list1->start, list1->tabsize, list2->start, list2->tabsize, result);
+    }
+  }
+  else {
+    /* A & !B == A \ B, and A | !B == !(B \ A) */
+    pos = (list1->is_inverted) ? list2 : list1;
+    neg = (list1->is_inverted) ? list1 : list2;
+    inverted = !is_and;
+    if (is_and) {
+      result = (int *) cl_malloc(sizeof(int) * MAX(pos->tabsize, 1));
+      size = index_filter_list(pos->start, pos->tabsize, neg->start, neg->tabsize, False, result);
+    }
+    else {
+      result = (int *) cl_malloc(sizeof(int) * MAX(neg->tabsize, 1));
+      size = index_filter_list(neg->start, neg->tabsize, pos->start, pos->tabsize, False, result);
+    }
+  }
+
+  free_matchlist(list1);
+  free_matchlist(list2);
+  if (size > 0)
+    list1->start = (int *) cl_realloc(result, sizeof(int) * size);
+  else
+    cl_free(result);
+  list1->tabsize = size;
+  list1->is_inverted = inverted;
+}
+
+/**
+ * Computes the (possibly inverted) initial matchlist for a constraint tree from the index.
+ *
+ * @return  False if the evaluation was interrupted.
+ */
+static int
+index_evaluate(Constrainttree ctptr, Matchlist *matchlist, IndexQuery *q)
+{
+  IndexTerm *term;
+  Matchlist other;
+  Constrainttree first, second;
+  int i, k;
+
+  if (index_is_leaf(ctptr)) {
+    term = index_find_term(ctptr, q);
+    if (term->n_ids < 0) {
+      /* an empty inverted list stands for all corpus positions */
+      matchlist->is_inverted = !term->negated;
+    }
+    else {
+      if (term->n_ids > 0)
+        matchlist->start = cl_idlist2cpos_oldstyle(term->attr, term->ids, term->n_ids, 1, &(matchlist->tabsize),
+                                                   (int *) q->corpus->range, q->corpus->size);
+      if (matchlist->start == NULL)
+        matchlist->tabsize = 0;
+      matchlist->is_inverted = term->negated;
+    }
+    return True;
+  }
+
+  switch (ctptr->node.op_id) {
+  case b_not:
+    if (!index_evaluate(ctptr->node.left, matchlist, q))
+      return False;
+    matchlist->is_inverted = !matchlist->is_inverted;
+    return True;
+
+  case b_or:
+    init_matchlist(&other);
+    if (!index_evaluate(ctptr->node.left, matchlist, q) || !index_evaluate(ctptr->node.right, &other, q)) {
+      free_matchlist(&other);
+      return False;
+    }
+    index_combine(matchlist, &other, False);
+    return True;
+
+  default: /* b_and */
+    /* evaluate the more selective operand first */
+    if (index_estimate(ctptr->node.left, q) <= index_estimate(ctptr->node.right, q)) {
+      first = ctptr->node.left;
+      second = ctptr->node.right;
+    }
+    else {
+      first = ctptr->node.right;
+      second = ctptr->node.left;
+    }
+    if (!index_evaluate(first, matchlist, q))
+      return False;
+
+    if (!matchlist->is_inverted && (matchlist->tabsize == 0))
+      return True;
+
+    if (!matchlist->is_inverted && (index_estimate(second, q) > INDEX_FILTER_RATIO * (double) matchlist->tabsize)) {
+      /* the other operand is much less selective: check it directly for each position */
+      if (initial_matchlist_debug && !silent)
+        fprintf(stderr, "index evaluation: checking %d positions against constraint\n", matchlist->tabsize);
+      for (i = 0, k = 0; i < matchlist->tabsize; i++) {
+        if (!EvaluationIsRunning)
+          return False;
+        if (eval_bool(second, NULL, matchlist->start[i]))
+          matchlist->start[k++] = matchlist->start[i];
+      }
+      matchlist->tabsize = k;
+      if (k == 0)
+        cl_free(matchlist->start);
+      return True;
+    }
+
+    init_matchlist(&other);
+    if (!index_evaluate(second, &other, q)) {
+      free_matchlist(&other);
+      return False;
+    }
+    if (initial_matchlist_debug && !silent)
+      fprintf(stderr, "index evaluation: intersecting lists of %d and %d positions\n",
+              matchlist->tabsize, other.tabsize);
+    index_combine(matchlist, &other, True);
+    return True;
+  }
+}
+
+/**
+ * Computes the initial matchlist for a boolean combination of simple constraints from
+ * the index of the p-attributes involved (see index_can_evaluate()).
+ *
+ * The result may be inverted (matchlist->is_inverted), like the lists computed by
+ * calculate_initial_matchlist_1().
+ *
+ * @return  False iff something has gone wrong.
+ */
+static Boolean
+index_initial_matchlist(Constrainttree ctptr, Matchlist *matchlist, CorpusList *corpus)
+{
+  IndexQuery q;
+  int i, ok;
+
+  q.corpus = corpus;
+  q.corpus_size = corpus->mother_size;
+  q.n_terms = 0;
+
+  free_matchlist(matchlist);
+  index_resolve_terms(ctptr, &q);
+  ok = index_evaluate(ctptr, matchlist, &q);
+
+  for (i = 0; i < q.n_terms; i++)
+    cl_free(q.terms[i].ids);
+
+  if (!ok) {
+    free_matchlist(matchlist);
+    return False;
+  }
+  if (!matchlist->is_inverted && mark_offrange_cells(matchlist, corpus))
+    return Setop(matchlist, Reduce, NULL);
+  return True;
+}
+
+
+
 /**
  * Gets the inital list of matches for a query.
  *
@@ -1294,7 +1840,8 @@ calculate_initial_matchlist_1(Constrainttree ctptr,
                               Matchlist *matchlist,
                               CorpusList *corpus)
 {
-  int i;
+  int i, n_leaves, left_indexed;
+  Constrainttree first, second;
   Matchlist left, right;
 
   /* do NOT use free_matchlist here! */
@@ -1304,6 +1851,13 @@ calculate_initial_matchlist_1(Constrainttree ctptr,
 
   if (ctptr) {
 
+    /* boolean combinations of simple constraints are evaluated on the index */
+    n_leaves = 0;
+    if ((ctptr->type == bnode) &&
+        ((ctptr->node.op_id == b_and) || (ctptr->node.op_id == b_or) || (ctptr->node.op_id == b_not)) &&
+        index_can_evaluate(ctptr, &n_leaves))
+      return index_initial_matchlist(ctptr, matchlist, corpus);
+
     if (ctptr->type == bnode) {
       switch(ctptr->node.op_id) {
 
@@ -1341,16 +1895,35 @@ calculate_initial_matchlist_1(Constrainttree ctptr,
 
         /* this is the old code. */
 
-        if (calculate_initial_matchlist_1(ctptr->node.left, &left, corpus)) {
+        /* if only the right operand can be looked up in the index, start from there */
+        n_leaves = 0;
+        left_indexed = index_can_evaluate(ctptr->node.left, &n_leaves);
+        n_leaves = 0;
+        if (!left_indexed && index_can_evaluate(ctptr->node.right, &n_leaves)) {
+          first = ctptr->node.right;
+          second = ctptr->node.left;
+        }
+        else {
+          first = ctptr->node.left;
+          second = ctptr->node.right;
+        }
+
+        if (calculate_initial_matchlist_1(first, &left, corpus)) {
 
-          /* We have b_and. So try to eval the right tree for each
-           * position yielded by the left tree. */
+          if (left.is_inverted) {
+            left.is_inverted = 0;
+            if (!Setop(&left, Complement, NULL))
+              return False;
+          }
+
+          /* We have b_and. So try to eval the other tree for each
+           * position yielded by the first one. */
 
           for (i = 0; i < left.tabsize; i++) {
             if (!EvaluationIsRunning)
               break;
             if (left.start[i] >= 0 &&
-                !eval_bool(ctptr->node.right, NULL, left.start[i]))
+                !eval_bool(second, NULL, left.start[i]))
               /* we're ignoring labels at the moment, so we pass NULL as reftab */
               left.start[i] = -1;
           }
@@ -1385,13 +1958,18 @@ calculate_initial_matchlist_1(Constrainttree ctptr,
         if (calculate_initial_matchlist_1(ctptr->node.left, &left, corpus) &&
             calculate_initial_matchlist_1(ctptr->node.right, &right, corpus)) {
 
-          if (left.is_inverted)
+          /* an inverted list holds the positions that do NOT match, so it must be complemented */
+          if (left.is_inverted) {
+            left.is_inverted = 0;
             if (!Setop(&left, Complement, NULL))
               return False;
+          }
 
-          if (right.is_inverted)
+          if (right.is_inverted) {
+            right.is_inverted = 0;
             if (!Setop(&right, Complement, NULL))
                return False;
+          }
 
           if (!Setop(&left, Union, &right))
             return False;
@@ -1790,7 +2368,8 @@ matchfirstpattern(AVS pattern,
                   Matchlist *matchlist,
                   CorpusList *corpus)
 {
-  int nr_strucs, nr_ok, ok, i, k, start, end, nr_pos, cpos;
+  int nr_strucs, nr_ok, ok, i, k, start, end, nr_pos, cpos, n_values, freq;
+  int *strucs;
   Bitfield bf;
   float red;
   char *val;
@@ -1811,7 +2390,30 @@ matchfirstpattern(AVS pattern,
 
     /* if there is a constraint, match annotated strings first */
     bf = create_bitfield(nr_strucs); /* always use bitfield (the memory overhead is acceptable) */
-    if (pattern->tag.constraint) {
+    if (pattern->tag.constraint && (n_values = cl_max_struc_value(pattern->tag.attr)) >= 0) {
+      /* with a value index, match each distinct annotation only once and look up the regions */
+      clear_all_bits(bf);
+      nr_ok = 0;
+      for (i = 0; (i < n_values) && (EvaluationIsRunning); i++) {
+        val = cl_struc_value2str(pattern->tag.attr, i);
+        if (pattern->tag.rx)
+          ok = cl_regex_match(pattern->tag.rx, val, 0);
+        else
+          ok = (0 == strcmp(pattern->tag.constraint, val));
+        if (pattern->tag.negated)
+          ok = !ok;
+        if (ok) {
+          strucs = cl_struc_value2strucs(pattern->tag.attr, i, &freq);
+          for (k = 0; k < freq; k++)
+            set_bit(bf, strucs[k]);
+          nr_ok += freq;
+          cl_free(strucs);
+        }
+      }
+      if (!EvaluationIsRunning)
+        nr_ok = 0;                /* user abort -> stop query execution */
+    }
+    else if (pattern->tag.constraint) {
       clear_all_bits(bf);
       nr_ok = 0;
       for (i = 0; (i < nr_strucs) && (EvaluationIsRunning); i++) {
@@ -1989,20 +2591,25 @@ matchfirstpattern(AVS pattern,
 
 
 
-/*
- * This function's name is totally useless.
+/**
+ * Simulates the query automaton for the elements of one chunk of the initial matchlist.
+ *
+ * This is the main loop of simulate(); elements which do not start a match are set to -1,
+ * and at most chunk->cut matches are found (unless it is negative).
  */
-void
-simulate(Matchlist *matchlist,
-         int *cut,
-         int start_state,
-         int start_offset, /* start_offset is always set to 0; no idea what it was meant for??? */
-         int *state_vector,
-         int *target_vector,
-         RefTab *reftab_vector,
-         RefTab *reftab_target_vector,
-         int start_transition)
+static void
+simulate_chunk(SimulationChunk *chunk)
 {
+  Matchlist *matchlist = chunk->matchlist;
+  int *cut = &(chunk->cut);
+  int start_state = chunk->start_state;
+  int start_offset = chunk->start_offset;
+  int start_transition = chunk->start_transition;
+  int *state_vector = chunk->state_vector;
+  int *target_vector = chunk->target_vector;
+  RefTab *reftab_vector = chunk->reftab_vector;
+  RefTab *reftab_target_vector = chunk->reftab_target_vector;
+
   int i, p, cpos, effective_cpos, rp;
   int strict_regions_ok, lookahead_constraint, zero_width_pattern;
 
@@ -2024,38 +2631,19 @@ simulate(Matchlist *matchlist,
 
   int percentage, new_percentage; /* for ProgressBar option */
 
-  assert(evalenv->query_corpus);
-  assert(evalenv->query_corpus->size > 0);
-  assert(evalenv->query_corpus->range);
-  assert(matchlist);
-  assert(matchlist->start);
-  assert(matchlist->end);
-
-  /* 
-   * state 0 must neither be final nor error
-   */
-
-  assert(!evalenv->dfa.Final[0] && (evalenv->dfa.E_State != 0));
+  if (chunk->first < chunk->last) {
 
-  if ((evalenv->query_corpus->size == 0) ||
-      (evalenv->query_corpus->range == NULL)) {
-    free_matchlist(matchlist);
-  }
-  else {
-
-    assert(state_vector);
-    assert(target_vector);
-    assert(reftab_vector);
-    assert(reftab_target_vector);
-    
+    /* since the matchlist is sorted, the range for its first element can be found by the same
+     * linear scan that brings us there when the whole matchlist is processed in one chunk */
     rp = 0;
-    i = 0;
+    i = chunk->first;
     percentage = -1;
 
-    while ((i < matchlist->tabsize) && ((*cut) != 0) && EvaluationIsRunning) {
-      
-      if (progress_bar && !evalenv->aligned) {
-        new_percentage = floor(0.5 + (100.0 * i) / matchlist->tabsize);
+    while ((i < chunk->last) && ((*cut) != 0) && EvaluationIsRunning) {
+
+      /* only the main thread updates the progress bar */
+      if (progress_bar && !evalenv->aligned && !chunk->is_worker) {
+        new_percentage = floor(0.5 + (100.0 * (i - chunk->first)) / (chunk->last - chunk->first));
         if (new_percentage > percentage) {
           percentage = new_percentage;
           progress_bar_percentage(0, 0, percentage);
@@ -2139,7 +2727,9 @@ simulate(Matchlist *matchlist,
            * set up some 'global' variables in evalenv (which subroutines may need to use)
            */
 
-          evalenv->rp = rp;        /* current range (in subquery); used to evaluate Anchor constraints */
+          /* current range (in subquery); used to evaluate Anchor constraints (which are never simulated in parallel) */
+          if (!chunk->is_worker)
+            evalenv->rp = rp;
 
           /*
            * all states are inactive / reset label references
@@ -2343,7 +2933,8 @@ simulate(Matchlist *matchlist,
 
                         nr_transitions++;
                         if (nr_transitions == 20000) {
-                          CheckForInterrupts();
+                          if (!chunk->is_worker)
+                            CheckForInterrupts();
                           nr_transitions = 0;
                         }
 
@@ -2509,22 +3100,325 @@ simulate(Matchlist *matchlist,
       } /* case 2: simulate automaton */
 
 
-    }   /* while ((i < matchlist->tabsize) && ... ) ...  [simulate automaton for current matchlist] */
+    }   /* while ((i < chunk->last) && ... ) ...  [simulate automaton for current matchlist] */
     
     /*
      * if we left the execution prematurely ... (interrupt, I guess?)
      */
-    while (i < matchlist->tabsize) {
+    while (i < chunk->last) {
       matchlist->start[i] = -1;
       i++;
     }
+  }
+}
+
+/**
+ * Thread function for simulating a chunk of the initial matchlist in a worker thread.
+ */
+static gpointer
+simulate_chunk_thread(gpointer data)
+{
+  SimulationChunk *chunk = (SimulationChunk *) data;
+
+  g_private_set(&simulation_current_chunk, chunk);
+  simulate_chunk(chunk);
+  g_private_set(&simulation_current_chunk, NULL);
+  return NULL;
+}
+
+/**
+ * Makes sure that the components of an attribute accessed by eval_constraint() and
+ * eval_bool() are loaded before the attribute is used by several threads.
+ */
+static void
+simulation_load_attribute(Attribute *attr)
+{
+  int start, end;
+
+  if (attr == NULL)
+    return;
+  if (attr->any.type == ATT_POS) {
+    (void) cl_cpos2id(attr, 0);
+    (void) cl_id2str(attr, 0);
+  }
+  else if (attr->any.type == ATT_STRUC) {
+    (void) cl_cpos2struc2cpos(attr, 0, &start, &end);
+    if (cl_struc_values(attr))
+      (void) cl_struc2str(attr, 0);
+  }
+}
+
+/**
+ * Adds a regular expression to the list of regexes used by a query (unless it is already there).
+ *
+ * @return  False if there are too many regular expressions in the query.
+ */
+static int
+simulation_add_regex(CL_Regex rx, CL_Regex *rx_list, int *n_rx)
+{
+  int i;
+
+  for (i = 0; i < *n_rx; i++)
+    if (rx_list[i] == rx)
+      return True;
+  if (*n_rx >= SIMULATION_MAX_REGEX)
+    return False;
+  rx_list[(*n_rx)++] = rx;
+  return True;
+}
+
+/**
+ * Checks whether a constraint tree can be evaluated by several threads at once.
+ *
+ * This is not the case for calls to dynamic attributes (which run external programs).
+ * All attributes referenced in the tree are loaded, and its regular expressions are
+ * collected in rx_list, so that each thread can use private copies.
+ */
+static int
+simulation_tree_is_thread_safe(Constrainttree ctptr, CL_Regex *rx_list, int *n_rx)
+{
+  ActualParamList *arg;
+
+  if (ctptr == NULL)
+    return True;
+
+  switch (ctptr->type) {
+  case bnode:
+    return simulation_tree_is_thread_safe(ctptr->node.left, rx_list, n_rx) &&
+      simulation_tree_is_thread_safe(ctptr->node.right, rx_list, n_rx);
+
+  case func:
+    if (ctptr->func.predef < 0)
+      return False;
+    for (arg = ctptr->func.args; arg != NULL; arg = arg->next)
+      if (!simulation_tree_is_thread_safe(arg->param, rx_list, n_rx))
+        return False;
+    return True;
+
+  case sbound:
+    simulation_load_attribute(ctptr->sbound.strucattr);
+    return True;
+
+  case pa_ref:
+    simulation_load_attribute(ctptr->pa_ref.attr);
+    return True;
+
+  case sa_ref:
+    simulation_load_attribute(ctptr->sa_ref.attr);
+    return True;
+
+  case id_list:
+    simulation_load_attribute(ctptr->idlist.attr);
+    return True;
+
+  case string_leaf:
+    if (ctptr->leaf.pat_type == REGEXP)
+      return simulation_add_regex(ctptr->leaf.rx, rx_list, n_rx);
+    return True;
+
+  default:
+    return True;
+  }
+}
+
+/**
+ * Checks whether the current query can be simulated by several threads at once.
+ *
+ * Queries with anchor points (which depend on the range of the query corpus that is
+ * currently being processed) and calls to dynamic attributes are always evaluated
+ * by a single thread.
+ *
+ * @param rx_list  Array of SIMULATION_MAX_REGEX entries that receives the query's regular expressions
+ * @param n_rx     Set to the number of regular expressions in rx_list
+ * @return         True iff simulate() may split the matchlist into chunks
+ */
+static int
+simulation_is_thread_safe(CL_Regex *rx_list, int *n_rx)
+{
+  AVStructure *condition;
+  int p;
+
+  *n_rx = 0;
+
+  for (p = 0; p <= evalenv->MaxPatIndex; p++) {
+    condition = &(evalenv->patternlist[p]);
+    switch (condition->type) {
+    case Anchor:
+      return False;
+
+    case Tag:
+      simulation_load_attribute(condition->tag.attr);
+      if (condition->tag.rx && !simulation_add_regex(condition->tag.rx, rx_list, n_rx))
+        return False;
+      break;
+
+    case Pattern:
+      if (!simulation_tree_is_thread_safe(condition->con.constraint, rx_list, n_rx))
+        return False;
+      break;
+
+    case MatchAll:
+      break;
+    }
+  }
+
+  return simulation_tree_is_thread_safe(evalenv->gconstraint, rx_list, n_rx);
+}
+
+
+/**
+ * Simulates the query automaton for each element of the initial matchlist.
+ *
+ * On return, elements of the matchlist which start a match have their end (and target
+ * and keyword, if allocated) set; all other elements have start set to -1.
+ *
+ * If there are several threads (cl_threads > 1) and the matchlist is large enough, it is
+ * split into chunks which are simulated in parallel. Since each match only depends on its
+ * start position, the results are identical to a single-threaded simulation; a cut is
+ * applied to the merged matchlist afterwards, so it keeps the first matches in corpus order.
+ *
+ * @param matchlist             The initial matchlist
+ * @param cut                   Maximal number of matches to find (-1 = no limit); reduced by the number of matches found
+ * @param start_state           The state of the automaton in which the simulation starts
+ * @param start_offset          Offset added to start positions (always 0)
+ * @param state_vector          State vector for the simulation (one entry per state)
+ * @param target_vector         Target vector for the simulation (one entry per state)
+ * @param reftab_vector         Label reference tables corresponding to state_vector
+ * @param reftab_target_vector  Label reference tables corresponding to target_vector
+ * @param start_transition      The transition for which the initial matchlist was built (-1 = none)
+ */
+void
+simulate(Matchlist *matchlist,
+         int *cut,
+         int start_state,
+         int start_offset, /* start_offset is always set to 0; no idea what it was meant for??? */
+         int *state_vector,
+         int *target_vector,
+         RefTab *reftab_vector,
+         RefTab *reftab_target_vector,
+         int start_transition)
+{
+  SimulationChunk chunks[CL_MAX_THREADS];
+  GThread *workers[CL_MAX_THREADS];
+  CL_Regex rx_list[SIMULATION_MAX_REGEX];
+  int n_chunks, n_rx, chunk_size, remaining, i, k;
+
+  assert(evalenv->query_corpus);
+  assert(evalenv->query_corpus->size > 0);
+  assert(evalenv->query_corpus->range);
+  assert(matchlist);
+  assert(matchlist->start);
+  assert(matchlist->end);
+
+  /* 
+   * state 0 must neither be final nor error
+   */
+
+  assert(!evalenv->dfa.Final[0] && (evalenv->dfa.E_State != 0));
+
+  if ((evalenv->query_corpus->size == 0) ||
+      (evalenv->query_corpus->range == NULL)) {
+    free_matchlist(matchlist);
+    return;
+  }
+
+  assert(state_vector);
+  assert(target_vector);
+  assert(reftab_vector);
+  assert(reftab_target_vector);
+
+  n_chunks = 1;
+  n_rx = 0;
+  if ((cl_threads > 1) && (matchlist->tabsize >= 2 * SIMULATION_MIN_CHUNK) && !debug_simulation
+      && simulation_is_thread_safe(rx_list, &n_rx)) {
+    n_chunks = matchlist->tabsize / SIMULATION_MIN_CHUNK;
+    if (n_chunks > cl_threads)
+      n_chunks = cl_threads;
+  }
+  chunk_size = (matchlist->tabsize + n_chunks - 1) / n_chunks;
+
+  /* the first chunk is simulated by the calling thread, with the state vectors it passed in */
+  for (k = 0; k < n_chunks; k++) {
+    chunks[k].matchlist = matchlist;
+    chunks[k].first = MIN(k * chunk_size, matchlist->tabsize);
+    chunks[k].last = MIN((k + 1) * chunk_size, matchlist->tabsize);
+    chunks[k].cut = *cut;
+    chunks[k].start_state = start_state;
+    chunks[k].start_offset = start_offset;
+    chunks[k].start_transition = start_transition;
+    chunks[k].is_worker = (k > 0);
+    chunks[k].n_rx = 0;
+    chunks[k].rx_orig = rx_list;
+    chunks[k].rx_clone = NULL;
+    if (k == 0) {
+      chunks[k].state_vector = state_vector;
+      chunks[k].target_vector = target_vector;
+      chunks[k].reftab_vector = reftab_vector;
+      chunks[k].reftab_target_vector = reftab_target_vector;
+    }
+    else {
+      chunks[k].state_vector = (int *) cl_malloc(sizeof(int) * evalenv->dfa.Max_States);
+      chunks[k].target_vector = (int *) cl_malloc(sizeof(int) * evalenv->dfa.Max_States);
+      chunks[k].reftab_vector = (RefTab *) cl_malloc(sizeof(RefTab) * evalenv->dfa.Max_States);
+      chunks[k].reftab_target_vector = (RefTab *) cl_malloc(sizeof(RefTab) * evalenv->dfa.Max_States);
+      for (i = 0; i < evalenv->dfa.Max_States; i++) {
+        chunks[k].reftab_vector[i] = new_reftab(evalenv->labels);
+        chunks[k].reftab_target_vector[i] = new_reftab(evalenv->labels);
+      }
+      if (n_rx > 0) {
+        chunks[k].n_rx = n_rx;
+        chunks[k].rx_clone = (CL_Regex *) cl_malloc(sizeof(CL_Regex) * n_rx);
+        for (i = 0; i < n_rx; i++)
+          chunks[k].rx_clone[i] = cl_regex_clone(rx_list[i]);
+      }
+    }
+  }
 
-  }     /* end of the big "else" (unless evalenv->query_corpus->size == 0) */
+  for (k = 1; k < n_chunks; k++)
+    workers[k] = g_thread_new("simulate", simulate_chunk_thread, &chunks[k]);
+  simulate_chunk(&chunks[0]);
+
+  for (k = 1; k < n_chunks; k++) {
+    g_thread_join(workers[k]);
+    free(chunks[k].state_vector);
+    free(chunks[k].target_vector);
+    for (i = 0; i < evalenv->dfa.Max_States; i++) {
+      delete_reftab(chunks[k].reftab_vector[i]);
+      delete_reftab(chunks[k].reftab_target_vector[i]);
+    }
+    free(chunks[k].reftab_vector);
+    free(chunks[k].reftab_target_vector);
+    for (i = 0; i < chunks[k].n_rx; i++) {
+      cl_regopt_successes += chunks[k].rx_clone[i]->optimiser_rejects;
+      cl_delete_regex(chunks[k].rx_clone[i]);
+    }
+    cl_free(chunks[k].rx_clone);
+  }
+
+  /* each chunk has found up to <cut> matches; keep the first ones in corpus order */
+  remaining = *cut;
+  if (remaining >= 0) {
+    for (k = 0; k < n_chunks; k++)
+      for (i = chunks[k].first; i < chunks[k].last; i++)
+        if (matchlist->start[i] >= 0) {
+          if (remaining > 0)
+            remaining--;
+          else {
+            matchlist->start[i] = -1;
+            if (matchlist->target_positions)
+              matchlist->target_positions[i] = -1;
+            if (matchlist->keyword_positions)
+              matchlist->keyword_positions[i] = -1;
+          }
+        }
+    *cut = remaining;
+  }
 }
 
 
 
 
+
 int
 check_alignment_constraints(Matchlist *ml)
 {
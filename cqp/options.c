@@ -137,6 +137,11 @@ CQPOption cqpoptions[] = {
   { "as", "AutoShow",             OptBoolean, &autoshow,               NULL,         1,   NULL,   0,     OPTION_VISIBLE_IN_CQP },
   { NULL, "Timing",               OptBoolean, &timing,                 NULL,         0,   NULL,   0,     OPTION_VISIBLE_IN_CQP },
   { "o",  "Optimize",             OptBoolean, &query_optimize,         NULL,         0,   NULL,   3,     OPTION_VISIBLE_IN_CQP },
+  { "th", "Threads",              OptInteger, &query_threads,          NULL,         1,   NULL,   5,     OPTION_VISIBLE_IN_CQP },
+  { "rxc","RegexCache",           OptInteger, &regex_cache_size,       NULL,         16,  NULL,   10,    OPTION_VISIBLE_IN_CQP },
+  { NULL, "RegexCachePersistent", OptBoolean, &regex_cache_persistent, NULL,         0,   NULL,   10,    OPTION_VISIBLE_IN_CQP },
+  { "bc", "BlockCache",           OptInteger, &block_cache_size,       NULL,         64,  NULL,   11,    OPTION_VISIBLE_IN_CQP },
+  { "ah", "AccessHints",          OptBoolean, &access_hints,           NULL,         1,   NULL,   12,    OPTION_VISIBLE_IN_CQP },
   { "ant","AnchorNumberTarget",   OptInteger, &anchor_number_target,   NULL,         0,   NULL,   0,     OPTION_VISIBLE_IN_CQP },
   { "ank","AnchorNumberKeyword",  OptInteger, &anchor_number_keyword,  NULL,         1,   NULL,   0,     OPTION_VISIBLE_IN_CQP },
   { "es", "ExternalSort",         OptBoolean, &UseExternalSorting,     NULL,         0,   NULL,   0,     OPTION_VISIBLE_IN_CQP },
@@ -268,6 +273,7 @@ cqp_usage(void)
   }
   fprintf(stderr, "    -D corpus    set default corpus to <corpus>\n");
   fprintf(stderr, "    -b num       set hard boundary for kleene star to <num> tokens\n");
+  fprintf(stderr, "    -j num       use up to <num> threads for parallel operations (0 = all processors)\n");
   fprintf(stderr, "    -S           SIG_PIPE handler toggle\n");
   fprintf(stderr, "    -x           insecure mode (when run SETUID)\n");
   if (which_app == cqpserver) {
@@ -275,6 +281,7 @@ cqp_usage(void)
     fprintf(stderr, "    -P  port     listen on port #<port> [default=CQI_PORT]\n");
     fprintf(stderr, "    -L           accept connections from localhost only (loopback)\n");
     fprintf(stderr, "    -q           fork() and quit before accepting connections\n");
+    fprintf(stderr, "    -w num       serve clients from a pool of <num> persistent worker processes\n");
   }
   fprintf(stderr, "    -d mode      activate/deactivate debug mode, where <mode> is one of: \n");
   fprintf(stderr, "       [ ShowSymtab, ShowPatList, ShowEvaltree, ShowDFA, ShowCompDFA,   ]\n");
@@ -501,6 +508,7 @@ set_default_option_values(void)
   private_server = 0;
   server_port = 0;
   server_quit = 0;
+  server_workers = 0;
   localhost = 0;
 
   matching_strategy = standard_match;  /* unfortunately, this is not automatically derived from the defaults */
@@ -511,6 +519,11 @@ set_default_option_values(void)
   /* execute some side effects for default values */
   cl_set_debug_level(activate_cl_debug);
   cl_set_optimize(query_optimize);
+  cl_set_threads(query_threads);
+  cl_set_regex_cache_size(regex_cache_size);
+  cl_set_regex_cache_persistent(regex_cache_persistent);
+  cl_set_block_cache_size(block_cache_size);
+  cl_set_access_hints(access_hints);
 }
 
 
@@ -597,7 +610,11 @@ execute_side_effects(int opt)
     cl_set_debug_level(activate_cl_debug); /* enable / disable CL debugging */
     break;
 
-    /* slot 5 is free */
+  case 5:  /* set Threads <n>; */
+    if (query_threads < 0)
+      query_threads = 0;
+    cl_set_threads(query_threads); /* 0 = one thread per processor */
+    break;
 
   case 6:  /* set PrintMode (ascii | sgml | html | latex); */
     if (printModeString == NULL || strcasecmp(printModeString, "ascii") == 0)
@@ -640,6 +657,23 @@ execute_side_effects(int opt)
     }
     break;
 
+  case 10: /* set RegexCache <MB>; set RegexCachePersistent (on | off); */
+    if (regex_cache_size < 0)
+      regex_cache_size = 0;
+    cl_set_regex_cache_size(regex_cache_size);
+    cl_set_regex_cache_persistent(regex_cache_persistent);
+    break;
+
+  case 11: /* set BlockCache <n>; */
+    if (block_cache_size < 1)
+      block_cache_size = 1;
+    cl_set_block_cache_size(block_cache_size);
+    break;
+
+  case 12: /* set AccessHints (on|off); */
+    cl_set_access_hints(access_hints);
+    break;
+
   default:
     fprintf(stderr, "Unknown side-effect #%d invoked by option %s.\n",
             cqpoptions[opt].side_effect, cqpoptions[opt].opt_name);
@@ -937,13 +971,13 @@ parse_options(int ac, char *av[])
   set_default_option_values();
   switch (which_app) {
   case cqp:
-    valid_options = "+b:cCd:D:ef:FhiI:l:L:mM:pP:r:R:sSvW:x";
+    valid_options = "+b:cCd:D:ef:FhiI:j:l:L:mM:pP:r:R:sSvW:x";
     break;
   case cqpcl:
-    valid_options = "+b:cd:D:E:FhiI:l:L:mM:r:R:sSvW:x";
+    valid_options = "+b:cd:D:E:FhiI:j:l:L:mM:r:R:sSvW:x";
     break;
   case cqpserver:
-    valid_options = "+1b:d:D:FhI:l:LmM:P:qr:Svx";
+    valid_options = "+1b:d:D:FhI:j:l:LmM:P:qr:Svw:x";
     break;
   default:
     cqp_usage();
@@ -961,6 +995,12 @@ parse_options(int ac, char *av[])
       server_quit = 1;
       break;
 
+    case 'w':
+      server_workers = atoi(optarg);
+      if (server_workers < 0)
+        server_workers = 0;
+      break;
+
     case 'x':
       insecure++;
       break;
@@ -1080,6 +1120,13 @@ parse_options(int ac, char *av[])
       hard_boundary = atoi(optarg);
       break;
 
+    case 'j':
+      query_threads = atoi(optarg);
+      if (query_threads < 0)
+        query_threads = 0;
+      cl_set_threads(query_threads);
+      break;
+
     case 'i':
       silent = rangeoutput = True;
       verbose_parser = show_symtab
@@ -76,6 +76,7 @@ int private_server;               /**< cqpserver option: makes CQPserver accept
 int server_port;                  /**< cqpserver option: CQPserver's listening port (if 0, listens on CQI_PORT) */
 int localhost;                    /**< cqpserver option: accept local connections (loopback) only */
 int server_quit;                  /**< cqpserver option: spawn server and return to caller (for CQI::Server.pm) */
+int server_workers;               /**< cqpserver option: number of persistent worker processes (0 = fork per connection) */
 
 int query_lock;                   /**< cqpserver option: safe mode for network/HTTP servers (allow query execution only) */
 int query_lock_violation;         /**< cqpserver option: set for CQPserver's sake to detect attempted query lock violation */
@@ -91,6 +92,11 @@ int hard_cut;                     /**< Query option: use hard cut value for all
 int auto_subquery;                /**< Query option: use auto-subquery mode */
 char *def_unbr_attr;              /**< Query option: unbracketed attribute (attribute matched by "..." patterns) */
 int query_optimize;               /**< Query option: use query optimisation (untested and expensive optimisations) */
+int query_threads;                /**< Query option: number of threads used by parallel operations (0 = one per processor) */
+int regex_cache_size;             /**< Query option: size of CL cache for lexicon lookups with regular expressions (in MB) */
+int regex_cache_persistent;       /**< Query option: keep the regex cache in sidecar files in the corpus data directories */
+int block_cache_size;             /**< Query option: number of decompressed blocks cached for each compressed p-attribute */
+int access_hints;                 /**< Query option: pass memory access hints (madvise) for newly loaded corpus data */
 int anchor_number_target;         /**< Query option: which marker @0 ... @9 will be mapped to the target anchor */
 int anchor_number_keyword;        /**< Query option: which marker @0 ... @9 will be mapped to the keyword anchor */
 
@@ -811,6 +811,43 @@ do_sleep(int duration)
   }
 }
 
+/**
+ * Loads all data files of a corpus into memory ahead of use.
+ *
+ * This is meant for warming up a long-running CQP or cqpserver process
+ * (e.g. from its init file), so that the first queries do not pay for
+ * reading index files from disk page by page.
+ *
+ * @param cl  The corpus (or subcorpus, in which case its mother corpus
+ *            is prefetched).
+ */
+void
+do_prefetch(CorpusList *cl)
+{
+  Attribute *attr;
+  int n_attr = 0, n_comp = 0, n;
+
+  if (!cl || !cl->corpus) {
+    cqpmessage(Warning, "No corpus to prefetch.");
+    return;
+  }
+
+  do_start_timer();
+  for (attr = cl->corpus->attributes; attr; attr = attr->any.next) {
+    n = cl_prefetch_attribute(attr);
+    if (n < 0)
+      cqpmessage(Warning, "Could not prefetch data of attribute %s.%s (%s).",
+                 cl->mother_name, attr->any.name, cl_error_string(n));
+    else {
+      n_attr++;
+      n_comp += n;
+    }
+  }
+  do_timing("Corpus data prefetched");
+  cqpmessage(Info, "Prefetched %d components of %d attributes of corpus %s.",
+             n_comp, n_attr, cl->mother_name);
+}
+
 /**
  * Execute the commands contained within a specified text file.
  */
@@ -991,6 +1028,8 @@ do_cut(CorpusList *cl, int first, int last) {
     first = last = n_matches;        /* delete all matches, ensuring that index does not run out of bounds */
   }
 
+  detach_subcorpus(cl);
+
   /* CQP Tutorial documents cut to respect sort order of NQR (Sec. 3.6: Random subsets)
    * Since it is considered authoritative documentation on CQP, the implementation here has been adjusted in CQP v3.4.15.
    */
@@ -2942,6 +2981,7 @@ expand_dataspace(CorpusList *cl)
     cqpmessage(Warning, "You can only expand subcorpora, not system corpora (unchanged)");
   else if (expansion.size > 0) {
 
+    detach_subcorpus(cl);
     for (i = 0; i < cl->size; i++) {
       if (expansion.direction == ctxtdir_left || expansion.direction == ctxtdir_leftright) {
         res = calculate_leftboundary(cl,
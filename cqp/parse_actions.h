@@ -118,6 +118,8 @@ void do_set_complex_target(CorpusList *cl,
 
 void do_sleep(int duration);
 
+void do_prefetch(CorpusList *cl);
+
 void do_exec(char *fname);
 
 void do_delete_lines_num(CorpusList *cl, int start, int end);
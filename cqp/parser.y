@@ -243,6 +243,7 @@ synchronize(void)
 %token OFF_SYM
 %token NO_SYM
 %token SLEEP_SYM
+%token PREFETCH_SYM
 %token REDUCE_SYM
 %token MAXIMAL_SYM
 
@@ -433,6 +434,7 @@ InteractiveCommand:       Showing
                         | GroupCmd
                         | SortCmd
                         | SleepCmd
+                        | PrefetchCmd
                         | SizeCmd
                         | DumpCmd
                         | UndumpCmd
@@ -929,6 +931,11 @@ LineRange:        INTEGER                  { $$.mindist = $1; $$.maxdist = $1; }
 
 SleepCmd:  SLEEP_SYM INTEGER { do_sleep($2); };
 
+/* ================================================== Prefetch corpus data into memory */
+
+PrefetchCmd:  PREFETCH_SYM OptionalCID { do_prefetch($2 ? $2 : current_corpus); }
+            ;
+
 /* ================================================== CQP Server Mode functions: Size & Dump */
 
 SizeCmd:    SIZE_SYM CID OptionalFIELD { do_size($2, $3); }
@@ -22,6 +22,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <glib.h>
 
 #include "../cl/globals.h"
 #include "../cl/corpus.h"
@@ -62,6 +63,7 @@ delete_interval(CorpusList *cp, int nr)
       (nr >= cp->size))
     return 0;
   else {
+    detach_subcorpus(cp);
     cl_free(cp->sortidx);
 
     cp->range[nr].start = -1;
@@ -96,6 +98,7 @@ delete_intervals(CorpusList *cp, Bitfield intervals, int mode)
   else {
     assert(intervals && (intervals->elements == cp->size));
 
+    detach_subcorpus(cp);
     modified = 0;
 
     switch (mode) {
@@ -431,6 +434,7 @@ RangeSort(CorpusList *c, int mk_sortidx)
     cqpmessage(Error, "Argument to internal function RangeSort() is not a named query result.");
     return;
   }
+  detach_subcorpus(c);
   if (c->sortidx) {
     /* sortidx will now longer be valid after operation and is deleted */
     cqpmessage(Warning,
@@ -525,6 +529,9 @@ RangeSetop(CorpusList *corpus1,
   int *tmp_target, *tmp_keyword;
   int tmp_size;
 
+  /* the vectors of corpus1 are modified in place or replaced */
+  detach_subcorpus(corpus1);
+
   /* switch across the different members of RangeSetOp... */
   switch (operation) {
 
@@ -1028,8 +1035,6 @@ static int srt_ascending;               /**< boolean: sort query into ascending
 static int srt_reverse;                 /**< boolean: sort query on reversed-character-sequence strings
                                              (and reversed sequences OF strings) or not */
 static int text_size;                   /**< When sorting a query - this represents the size of the corpus the query belongs to */
-static int break_ties;                  /**< whether to break ties (by comparison without %cd flags,
-                                             and by line number in the last instance) */
 static unsigned int *random_sort_keys;  /**< random keys for randomized sort order (ties are broken by cpos of matches) */
 
 
@@ -1259,213 +1264,411 @@ SortExternally(void)
   }
 }
   
-/**
- * Defined if a sort cache is to be used in sorting concordance lines.
+/*
+ * The internal sorting algorithm.
  *
- * The sort cache (caching the lexicon IDs of the first two tokens to be compared in each line)
- * is indispensable for the internal sorting algorithm since random accesses to a compressed corpus
- * are painfully slow; when sorting variable length matches such as German NPs on word forms,
- * the current implementation has a hit rate of around 99%.
- */
-#define USE_SORT_CACHE
-/* another tweaking option would be memoization of comparisons results, requiring 2 ints + 1 bit
- * per comp. for storage, probably in a hash; I have no idea how much that would improve the
- * performance, esp. with a fixed hash size; other options are a hash table for identical lines
- * or an incremental sort (sort on first token, group lines for which compare identical, then
- * sort each group on second token, etc.); note that an incremental sort would probably enforce
- * the slightly incorrect semantics of case-/diacritic-insensitive in the current implementation;
- * it might be possible to reuse a custom qsort algorithm implemented for the fdist command (but
- * perhaps I can just fall back on the standard qsort there);
- * external sorting isn't such a bad idea after all :-) */
-
-#ifdef USE_SORT_CACHE
-/** Pointer to the sort cache @see USE_SORT_CACHE */
-static int *sort_id_cache = NULL;
-#endif
-
-/**
- * String comparison function used in query result sorting.
+ * Random accesses to a compressed corpus are painfully slow, and so is re-normalising the
+ * strings for %c and %d in every comparison; therefore the sort strings are never compared
+ * directly.  Instead, each distinct lexicon ID that occurs in a sort interval is ranked
+ * once (after applying the %cd flags and reversal, see srt_rank_types()), and each match
+ * gets a sort key which holds the ranks of the tokens in its sort interval (srt_make_keys()).
+ * Comparing two matches then amounts to comparing two short sequences of integers.
  *
- * This is NOT unicode compatible - it uses a maptable, which is baaaaad, mmkay.
+ * The sort key of a match consists of one or two sections, each of which lists the ranks
+ * of the tokens in the sort interval (in the order in which they are compared) and is
+ * terminated by -1 (so that a shorter interval sorts before a longer interval with the same
+ * prefix):
  *
- * This function can be deleted once it has been checked that
- * all calls to it have been replaced with cl_string_qsort_compare
+ *  - if %c or %d flags are set, the first section contains the ranks of the normalised strings
+ *    (so that equivalent strings have the same rank)
+ *  - the last section always contains the ranks of the strings themselves
  *
+ * This is exactly the two-pass comparison of earlier versions, which compared the normalised
+ * strings first and used the plain strings only to break ties.  Remaining ties are broken by
+ * the original order of the matches, so the sort is stable (and deterministic regardless of
+ * the number of threads).
  *
+ * The index is sorted in chunks by several threads (cl_threads), which are then merged.
+ */
+
+/** Minimum number of matches for each thread in a parallel sort (smaller query results are sorted by a single thread) */
+#define SORT_MIN_CHUNK 16384
+
+static int *srt_keys;                   /**< sort keys of all matches (sequences of ranks, see above) */
+static size_t *srt_key_pos;             /**< offset of the sort key of each match in srt_keys */
+static int *srt_rank_plain;             /**< rank of each lexicon ID (by plain string, reversed if srt_reverse is set) */
+static int *srt_rank_flags;             /**< rank of each lexicon ID by normalised string (only if srt_flags are set) */
+
+/** Range of matches processed by one thread when building sort keys, or chunk of the sort index to be sorted/merged. */
+typedef struct {
+  int first;                            /**< first match (or index position) in the chunk */
+  int middle;                           /**< for a merge: start of the second sorted run */
+  int last;                             /**< end of chunk (last match + 1) */
+  int *src;                             /**< for a merge: the two sorted runs */
+  int *dst;                             /**< for a merge: destination of the merged runs */
+  int ok;                               /**< set to false if a thread failed (e.g. a corpus access error) */
+} SortChunk;
+
+/** Strings compared when ranking lexicon IDs (indexed by ID; non-exported). */
+static char **srt_type_strings;
+
+/** qsort callback for ranking lexicon IDs by the strings in srt_type_strings[] (non-exported). */
 static int
-srt_strcmp(unsigned char *s1, unsigned char *s2, unsigned char *maptable, int reverse)
+srt_type_compare(const void *vid1, const void *vid2)
 {
-  int l1, l2, minl, i, c1, c2, step;
-  unsigned char *p1, *p2;
-
-  step = (reverse) ? -1 : +1;
-  l1 = strlen((char *) s1);
-  l2 = strlen((char *) s2);
+  return strcmp(srt_type_strings[*((const int *) vid1)], srt_type_strings[*((const int *) vid2)]);
+}
 
-  p1 = (reverse) ? s1 + l1 - 1 : s1;
-  p2 = (reverse) ? s2 + l2 - 1 : s2;
+/**
+ * Collects the lexicon IDs of the sort intervals of matches in a chunk (thread function).
+ *
+ * The IDs are written to the last section of each sort key, and are replaced by their
+ * ranks later.
+ *
+ * @param data  Pointer to a SortChunk object with the range of matches.
+ * @return      NULL (the ok member of the SortChunk is cleared on error).
+ */
+static gpointer
+srt_collect_ids(gpointer data)
+{
+  SortChunk *chunk = (SortChunk *) data;
+  int *buf = NULL;
+  int buf_size = 0;
+  int i, k, lo, hi, len, step, *key;
+
+  for (i = chunk->first; i < chunk->last && EvaluationIsRunning; i++) {
+    len = abs(srt_end[i] - srt_start[i]) + 1;
+    step = (srt_end[i] < srt_start[i]) ? -1 : 1;
+    lo = MIN(srt_start[i], srt_end[i]);
+    hi = MAX(srt_start[i], srt_end[i]);
+    if (len > buf_size) {
+      buf_size = 2 * len;
+      buf = (int *) cl_realloc(buf, buf_size * sizeof(int));
+    }
+    if (cl_cpos2id_range(srt_attribute, lo, hi, buf) < 0) {
+      chunk->ok = 0;
+      break;
+    }
+    /* the last section of the key starts after the first one, if there is one */
+    key = srt_keys + srt_key_pos[i] + ((srt_flags) ? len + 1 : 0);
+    for (k = 0; k < len; k++)
+      key[k] = (step > 0) ? buf[k] : buf[len - 1 - k];
+    key[len] = -1;
+  }
+  cl_free(buf);
+  return NULL;
+}
 
-  minl = MIN(l1, l2);
-  
-  for (i = 1; i <= minl; i++) {
-    if (maptable) {
-      c1 = maptable[*p1];
-      c2 = maptable[*p2];
+/**
+ * Ranks all lexicon IDs that occur in sort intervals by their (transformed) strings.
+ *
+ * The strings are reversed if srt_reverse is set, and each string is normalised for
+ * the srt_flags only once.  Plain strings are distinct for different IDs, but different
+ * IDs may have identical normalised strings and are then given the same rank in
+ * srt_rank_flags.  Ranks are computed for IDs that are marked in srt_rank_plain[]
+ * (which should be -1 for all other IDs); only these are needed for the sort keys.
+ *
+ * This is a non-exported function.
+ *
+ * @param lexsize  Number of types in the lexicon of srt_attribute.
+ */
+static void
+srt_rank_types(int lexsize)
+{
+  CorpusCharset charset = srt_cl->corpus->charset;
+  int *types, n_types, i, id, rank;
+  char *s, *temp;
+
+  types = (int *) cl_malloc(lexsize * sizeof(int));
+  n_types = 0;
+  for (id = 0; id < lexsize; id++)
+    if (srt_rank_plain[id] >= 0)
+      types[n_types++] = id;
+
+  srt_type_strings = (char **) cl_calloc(lexsize, sizeof(char *));
+
+  if (srt_flags) {
+    /* normalise the strings first (then reverse them: this may not work as expected the other way round) */
+    for (i = 0; i < n_types; i++) {
+      id = types[i];
+      s = cl_string_canonical(cl_id2str(srt_attribute, id), charset, srt_flags, CL_STRING_CANONICAL_STRDUP);
+      if (srt_reverse) {
+        temp = cl_string_reverse(s, charset);
+        cl_free(s);
+        s = temp;
+      }
+      srt_type_strings[id] = s;
     }
-    else {
-      c1 = *p1;
-      c2 = *p2;
+    qsort(types, n_types, sizeof(int), srt_type_compare);
+    rank = 0;
+    for (i = 0; i < n_types; i++) {
+      if (i > 0 && strcmp(srt_type_strings[types[i - 1]], srt_type_strings[types[i]]) != 0)
+        rank++;
+      srt_rank_flags[types[i]] = rank;
     }
-    p1 += step;
-    p2 += step;
+    for (i = 0; i < n_types; i++)
+      cl_free(srt_type_strings[types[i]]);
+  }
 
-    if (c1 < c2)
-      return -1;
-    else if (c1 > c2)
-      return 1;
+  for (i = 0; i < n_types; i++) {
+    id = types[i];
+    s = cl_id2str(srt_attribute, id);
+    srt_type_strings[id] = (srt_reverse) ? cl_string_reverse(s, charset) : s;
   }
+  qsort(types, n_types, sizeof(int), srt_type_compare);
+  for (i = 0; i < n_types; i++)
+    srt_rank_plain[types[i]] = i;
+  if (srt_reverse)
+    for (i = 0; i < n_types; i++)
+      cl_free(srt_type_strings[types[i]]);
+
+  cl_free(srt_type_strings);
+  cl_free(types);
+}
 
-  if (l1 < l2)
-    return -1;
-  else if (l1 > l2)
-    return 1;
-  else
+/**
+ * Builds the sort keys of all matches in srt_cl (in srt_keys and srt_key_pos).
+ *
+ * The sort intervals must have been set up in srt_start[] and srt_end[].
+ *
+ * This is a non-exported function.
+ *
+ * @param n_threads  Number of threads used to read the lexicon IDs from the corpus.
+ * @return           Boolean: true on success, false if the corpus couldn't be read
+ *                   or the operation was interrupted by the user.
+ */
+static int
+srt_make_keys(int n_threads)
+{
+  SortChunk chunks[CL_MAX_THREADS];
+  GThread *workers[CL_MAX_THREADS];
+  int n_matches = srt_cl->size;
+  int lexsize, chunk_size, i, k, len, ok, *key;
+  size_t total;
+
+  /* compute the layout of the sort keys */
+  srt_key_pos = (size_t *) cl_malloc(n_matches * sizeof(size_t));
+  total = 0;
+  for (i = 0; i < n_matches; i++) {
+    srt_key_pos[i] = total;
+    len = abs(srt_end[i] - srt_start[i]) + 1;
+    total += (srt_flags) ? 2 * (len + 1) : len + 1;
+  }
+  srt_keys = (int *) cl_malloc(total * sizeof(int));
+
+  /* read lexicon IDs from the corpus in parallel (the first chunk is done by the calling thread) */
+  chunk_size = (n_matches + n_threads - 1) / n_threads;
+  for (k = 0; k < n_threads; k++) {
+    chunks[k].first = MIN(k * chunk_size, n_matches);
+    chunks[k].last = MIN((k + 1) * chunk_size, n_matches);
+    chunks[k].ok = 1;
+  }
+  for (k = 1; k < n_threads; k++)
+    workers[k] = g_thread_new("sort", srt_collect_ids, &chunks[k]);
+  srt_collect_ids(&chunks[0]);
+  ok = EvaluationIsRunning;
+  for (k = 0; k < n_threads; k++) {
+    if (k > 0)
+      g_thread_join(workers[k]);
+    if (!chunks[k].ok)
+      ok = 0;
+  }
+  if (!ok)
     return 0;
+
+  /* mark the lexicon IDs that occur and rank them */
+  lexsize = cl_max_id(srt_attribute);
+  if (lexsize <= 0)
+    return 0;
+  srt_rank_plain = (int *) cl_malloc(lexsize * sizeof(int));
+  for (i = 0; i < lexsize; i++)
+    srt_rank_plain[i] = -1;
+  srt_rank_flags = (srt_flags) ? (int *) cl_malloc(lexsize * sizeof(int)) : NULL;
+  for (i = 0; i < n_matches; i++) {
+    len = abs(srt_end[i] - srt_start[i]) + 1;
+    key = srt_keys + srt_key_pos[i] + ((srt_flags) ? len + 1 : 0);
+    for (k = 0; k < len; k++)
+      srt_rank_plain[key[k]] = 0;
+  }
+  srt_rank_types(lexsize);
+
+  /* replace the IDs by their ranks */
+  for (i = 0; i < n_matches; i++) {
+    len = abs(srt_end[i] - srt_start[i]) + 1;
+    key = srt_keys + srt_key_pos[i];
+    if (srt_flags) {
+      for (k = 0; k < len; k++) {
+        key[k] = srt_rank_flags[key[len + 1 + k]];
+        key[len + 1 + k] = srt_rank_plain[key[len + 1 + k]];
+      }
+      key[len] = -1;
+    }
+    else
+      for (k = 0; k < len; k++)
+        key[k] = srt_rank_plain[key[k]];
+  }
+
+  cl_free(srt_rank_plain);
+  cl_free(srt_rank_flags);
+  return 1;
 }
- */
 
 /**
- * Compare two matches according to current sort settings in static variables
- * (qsort callback used in query result sorting).
+ * Compares the sort keys of two matches according to the current sort settings in static variables.
  *
- * This is the primary query-hit-comparison function. It wraps cl_string_qsort_compare
- * for string comparison, but does much more as well, because we are not just comparing
- * individual strings but rather, potentially, whole bundles of strings from various
- * different positions.
+ * This is the primary query-hit-comparison function.  It replaces earlier versions which compared
+ * the token strings directly (and gives the same results).
  *
- * @param vidx1  Pointer to the integer index of the first of the intervals to be
- *               compared (ie an index into an array of start/end positions).
- * @param vidx2  Pointer to the integer index of the second of the intervals to be
- *               compared.
- * @return       Usual returns for qsort callbacks.
+ * @param idx1  Number of the first match.
+ * @param idx2  Number of the second match.
+ * @param ties  Boolean: if false, only the first section of the sort keys is compared (i.e. matches
+ *              are equal if their sort strings are equivalent under the %cd flags); if true, ties
+ *              are broken by the plain sort strings and then by the original order of the matches
+ *              (which is reversed by a descending sort, as in earlier versions).
+ * @return      Usual returns for qsort callbacks.
  */
 static int
-i2compare(const void *vidx1, const void *vidx2)
+srt_compare(int idx1, int idx2, int ties)
 {
-  const int *idx1 = vidx1, *idx2 = vidx2;
+  int *k1, *k2, pass, comp;
 
-  int p1start, p1end;           /* boundaries of sort intervals */
-  int p2start, p2end;
-  int step1, step2;             /* direction of comparison (might actually be different for the two matches *ouch*) */
+  if (idx1 == idx2)
+    return 0;
 
-  int pos1, pos2;
-  int len1, len2, minlen;
-  int pass, i;
+  k1 = srt_keys + srt_key_pos[idx1];
+  k2 = srt_keys + srt_key_pos[idx2];
+  comp = 0;
+  for (pass = (srt_flags) ? 1 : 2; pass <= 2; pass++) {
+    while (*k1 == *k2 && *k1 >= 0) {
+      k1++;
+      k2++;
+    }
+    if (*k1 != *k2) {
+      comp = (*k1 < *k2) ? -1 : 1;
+      break;
+    }
+    if (!ties)
+      break;
+    k1++;                       /* skip terminators */
+    k2++;
+  }
 
-  int comp;                     /* the comparison result */
+  if ((comp == 0) && ties)      /* break ties in order of original matchlist */
+    comp = (idx1 < idx2) ? -1 : 1;
 
+  if (! srt_ascending)          /* adjust sort order for descending sort (ties end up in reverse order) */
+    comp = -comp;
+
+  return comp;
+}
+
+/** qsort callback for sorting the index of a query result (wraps srt_compare; non-exported). */
+static int
+srt_qsort_compare(const void *vidx1, const void *vidx2)
+{
   if (! EvaluationIsRunning)
     return 0;                   /* user interrupt (Ctrl-C) => force qsort to finish quickly */
+  return srt_compare(*((const int *) vidx1), *((const int *) vidx2), 1);
+}
 
-  if (*idx1 == *idx2)
-    return 0;                   /* self-comparison: return equality */
-
-  /* determine start and end position of sort interval for both matches */
-  p1start = srt_start[*idx1];
-  p1end =   srt_end[*idx1];
-  p2start = srt_start[*idx2];
-  p2end =   srt_end[*idx2];
-
-  /* direction of comparison 
-     (might be different if inconsistently set targets are used, but that's the user's fault) */ 
-  step1 = (p1end < p1start) ? -1 : 1;
-  step2 = (p2end < p2start) ? -1 : 1;
-
-  /*
-   * now compare the interval [p1start, p1end] with the interval [p2start, p2end],
-   * incrementing the cpos after each comparison by step1 and step2, respectively
-   * (similar to the standard comparison algorithm in cl_string_qsort_compare() above)
-   */
-  if (SORT_DEBUG)
-    fprintf(stderr, "Comparing [%d,%d](%+d) with [%d,%d](%+d)\n",
-            p1start, p1end, step1, p2start, p2end, step2);
-
-  len1 = abs(p1end - p1start) + 1;
-  len2 = abs(p2end - p2start) + 1;
-  minlen = MIN(len1, len2);
-  comp = 0;
+/** Sorts a chunk of the sort index with qsort (thread function). */
+static gpointer
+srt_sort_chunk(gpointer data)
+{
+  SortChunk *chunk = (SortChunk *) data;
 
-  /* first pass does case-/diacritic-insensitive comparison (may be skipped), second pass does plain comparison */
-  for (pass = (srt_flags) ? 1 : 2 ; pass <= 2 && comp == 0 ; pass++) {
-    pos1 = p1start;
-    pos2 = p2start;
+  qsort(chunk->dst + chunk->first, chunk->last - chunk->first, sizeof(int), srt_qsort_compare);
+  return NULL;
+}
 
-    for (i = 1; (i <= minlen) && (comp == 0); i++) {
-      int id1, id2;
-      unsigned char *s1, *s2;
+/** Merges two sorted runs of the sort index (thread function). */
+static gpointer
+srt_merge_chunk(gpointer data)
+{
+  SortChunk *chunk = (SortChunk *) data;
+  int *src = chunk->src, *dst = chunk->dst;
+  int i = chunk->first, j = chunk->middle, k = chunk->first;
+
+  while (i < chunk->middle && j < chunk->last)
+    dst[k++] = (srt_compare(src[i], src[j], 1) <= 0) ? src[i++] : src[j++];
+  while (i < chunk->middle)
+    dst[k++] = src[i++];
+  while (j < chunk->last)
+    dst[k++] = src[j++];
+  return NULL;
+}
 
-#ifdef USE_SORT_CACHE
-      /* use cache for first comparison only (to avoid repeated overwriting) */
-      if (i == 1) {
-        id1 = sort_id_cache[2*(*idx1)];
-        id2 = sort_id_cache[2*(*idx2)];
-      }
-      else if (i == 2) {
-        id1 = sort_id_cache[2*(*idx1)+1];
-        id2 = sort_id_cache[2*(*idx2)+1];
-      }
-      else {
-        id1 = cl_cpos2id(srt_attribute, pos1);
-        id2 = cl_cpos2id(srt_attribute, pos2);
-      }
-#else
-      id1 = cl_cpos2id(srt_attribute, pos1);
-      id2 = cl_cpos2id(srt_attribute, pos2);
-#endif
-      
-      if (id1 != id2) {         /* same lexicon IDs always compare equal */
-        s1 = (unsigned char *) cl_id2str(srt_attribute, id1);
-        s2 = (unsigned char *) cl_id2str(srt_attribute, id2);
-
-        if (pass == 1)
-          /* compare normalised strings in first pass (srt_flags are set in this case) */
-          comp = cl_string_qsort_compare((char *)s1, (char *)s2, srt_cl->corpus->charset, srt_flags, srt_reverse);
-          /* old version: comp = srt_strcmp(s1, s2, srt_maptable, srt_reverse); */
-        else
-          /* in pass 2, compare without flags. */
-          comp = cl_string_qsort_compare((char *)s1, (char *)s2, srt_cl->corpus->charset, 0,         srt_reverse);
-          /* old version: comp = srt_strcmp(s1, s2, NULL, srt_reverse); */
-      }
+/**
+ * Sorts an index of matches by their sort keys, using up to n_threads threads.
+ *
+ * The index is split into n_threads chunks which are sorted in parallel and then
+ * merged pairwise (again in parallel), until a single sorted run is left.
+ *
+ * This is a non-exported function.
+ *
+ * @param index      The index to sort (an array of match numbers).
+ * @param size       Number of elements in the index.
+ * @param n_threads  Number of threads to use.
+ */
+static void
+srt_sort_index(int *index, int size, int n_threads)
+{
+  SortChunk chunks[CL_MAX_THREADS];
+  GThread *workers[CL_MAX_THREADS];
+  int bounds[CL_MAX_THREADS + 1];
+  int n_runs, chunk_size, k, *src, *dst, *temp;
+
+  chunk_size = (size + n_threads - 1) / n_threads;
+  for (k = 0; k <= n_threads; k++)
+    bounds[k] = MIN(k * chunk_size, size);
+  for (k = 0; k < n_threads; k++) {
+    chunks[k].first = bounds[k];
+    chunks[k].last = bounds[k + 1];
+    chunks[k].dst = index;
+  }
+  for (k = 1; k < n_threads; k++)
+    workers[k] = g_thread_new("sort", srt_sort_chunk, &chunks[k]);
+  srt_sort_chunk(&chunks[0]);
+  for (k = 1; k < n_threads; k++)
+    g_thread_join(workers[k]);
 
-      pos1 += step1;
-      pos2 += step2;
-    }
+  if (n_threads <= 1)
+    return;
 
-    if (comp == 0) {            /* intervals compared equal up to the length of the shorter one -> compare lengths */
-      if (len1 > len2) 
-        comp = 1;
-      else if (len1 < len2) 
-        comp = -1;
+  /* merge runs pairwise until only one is left */
+  src = index;
+  dst = (int *) cl_malloc(size * sizeof(int));
+  for (n_runs = n_threads; n_runs > 1 && EvaluationIsRunning; n_runs = (n_runs + 1) / 2) {
+    for (k = 0; k < n_runs / 2; k++) {
+      chunks[k].first = bounds[2 * k];
+      chunks[k].middle = bounds[2 * k + 1];
+      chunks[k].last = bounds[2 * k + 2];
+      chunks[k].src = src;
+      chunks[k].dst = dst;
     }
-    /* may try without %cd flags to break ties, but only if that variable is set */
-    if (! break_ties)
-      break;
-  } /* endfor each of the two passes */
-
-  if ((comp == 0) && break_ties) {
-    if (idx1 > idx2)            /* break ties in order of original matchlist */
-      comp = 1;
-    else
-      comp = -1;
+    if (n_runs % 2) {           /* an odd run at the end is just copied */
+      memcpy(dst + bounds[n_runs - 1], src + bounds[n_runs - 1], (bounds[n_runs] - bounds[n_runs - 1]) * sizeof(int));
+    }
+    for (k = 1; k < n_runs / 2; k++)
+      workers[k] = g_thread_new("sort", srt_merge_chunk, &chunks[k]);
+    srt_merge_chunk(&chunks[0]);
+    for (k = 1; k < n_runs / 2; k++)
+      g_thread_join(workers[k]);
+    /* boundaries of the merged runs */
+    for (k = 0; 2 * k < n_runs; k++)
+      bounds[k] = bounds[2 * k];
+    bounds[k] = size;
+    temp = src; src = dst; dst = temp;
   }
-
-  if (! srt_ascending)          /* adjust sort order for descending sort */
-    comp = -comp;
-  
-  return comp;
+  if (src != index) {
+    memcpy(index, src, size * sizeof(int));
+    cl_free(src);
+  }
+  else
+    cl_free(dst);
 }
 
-/** Compares two groups of equivalent matches by group sizes (descending), breaking ties through i2compare. */
+/** Compares two groups of equivalent matches by group sizes (descending), breaking ties through srt_compare. */
 static int
 group2compare(const void *vidx1, const void *vidx2)
 {
@@ -1483,7 +1686,7 @@ group2compare(const void *vidx1, const void *vidx2)
   else if (s1 < s2)
     return 1;
   else
-    return i2compare(&(current_sortidx[group_first[*idx1]]), &(current_sortidx[group_first[*idx2]]));
+    return srt_compare(current_sortidx[group_first[*idx1]], current_sortidx[group_first[*idx2]], 0);
 }
 
 /* simulate Perl's spaceship operator A <=> B */
@@ -1537,6 +1740,7 @@ SortSubcorpusRandomize(CorpusList *cl, int seed)
     cqpmessage(Error, "Can't access query result %s (aborted).", cl->name);
     return 0;
   }
+  detach_subcorpus(cl);
   srt_cl = cl; /* has been validated, so it can safely be used by the callback function */
   n_matches = cl->size;
 
@@ -1608,7 +1812,7 @@ SortSubcorpusRandomize(CorpusList *cl, int seed)
 int
 SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir)
 {
-  int i, k, ok;
+  int i, k, ok, n_threads;
   char *srt_att_name;
 
   if (cl == NULL) {
@@ -1623,6 +1827,7 @@ SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir
     cqpmessage(Error, "Can't access query result %s (aborted).", cl->name);
     return 0;
   }
+  detach_subcorpus(cl);
   if (sc == NULL) {             /* sort by corpus position, i.e. delete sortidx */
     if (count_mode) {
       cqpmessage(Error, "Count what? (e.g. 'by word')");
@@ -1646,7 +1851,6 @@ SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir
   srt_cl = cl;
   srt_ascending = sc->sort_ascending;
   srt_reverse = sc->sort_reverse;
-  break_ties = 1;
 
   srt_flags = sc->flags;
   
@@ -1755,31 +1959,32 @@ SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir
     for (i = 0; i < cl->size; i++)
       cl->sortidx[i] = i;
     
-#ifdef USE_SORT_CACHE
-    /* load up the sort cache.... */
-    sort_id_cache = (int *)cl_malloc(cl->size * 2 * sizeof(int));
-    for (i = 0; i < cl->size; i++) {
-      int cpos1 = srt_start[i];
-      int cpos2 = srt_end[i];
-      int len = abs(cpos2 - cpos1) + 1;
-      int step = (cpos2 >= cpos1) ? 1 : -1;
-      sort_id_cache[2*i] = cl_cpos2id(srt_attribute, cpos1);
-      if (len > 1)
-        sort_id_cache[2*i+1] = cl_cpos2id(srt_attribute, cpos1 + step);
-      else
-        sort_id_cache[2*i+1] = 0;
-    }
-#endif
-
     /* the business end... the sorting happens here! */
+    n_threads = 1;
+    if ((cl_threads > 1) && (cl->size >= 2 * SORT_MIN_CHUNK)) {
+      n_threads = cl->size / SORT_MIN_CHUNK;
+      if (n_threads > cl_threads)
+        n_threads = cl_threads;
+    }
     EvaluationIsRunning = 1;
-    qsort(cl->sortidx, cl->size, sizeof(int), i2compare);
-    if (! EvaluationIsRunning) {
-      cqpmessage(Warning, "Sort/count operation aborted by user (reset to default ordering).");
+    if (!srt_make_keys(n_threads)) {
+      if (EvaluationIsRunning)
+        cqpmessage(Error, "Can't read %s attribute for sorting (aborted).", srt_att_name);
+      else
+        cqpmessage(Warning, "Sort/count operation aborted by user (reset to default ordering).");
       if (which_app == cqp) install_signal_handler();
       cl_free(cl->sortidx);
       ok = 0;
     }
+    else {
+      srt_sort_index(cl->sortidx, cl->size, n_threads);
+      if (! EvaluationIsRunning) {
+        cqpmessage(Warning, "Sort/count operation aborted by user (reset to default ordering).");
+        if (which_app == cqp) install_signal_handler();
+        cl_free(cl->sortidx);
+        ok = 0;
+      }
+    }
     EvaluationIsRunning = 0;
     /* note that, unless we are in count mode, this is more or less the end of it.... */
 
@@ -1792,7 +1997,6 @@ SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir
       group_first = cl_malloc(cl->size * sizeof(int)); /* worst case: cl->size groups with f = 1 */
       group_size = cl_malloc(cl->size * sizeof(int));
 
-      break_ties = 0;           /* don't break ties for grouping */
       n_groups = 0;
       first = group_first[n_groups] = 0;
 
@@ -1800,7 +2004,7 @@ SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir
       /* collect equivalent matches into groups */
       for (i = 0; (i < cl->size) && EvaluationIsRunning; i++) {
         if (i > 0) {
-          if (i2compare(current_sortidx + first, current_sortidx + i)) {
+          if (srt_compare(current_sortidx[first], current_sortidx[i], 0)) {  /* don't break ties for grouping */
             group_size[n_groups] = i - first;
             first = group_first[++n_groups] = i;
           }
@@ -1869,10 +2073,8 @@ SortSubcorpus(CorpusList *cl, SortClause sc, int count_mode, struct Redir *redir
       cl_free(group_size);
     } /* endif "we are in count mode!" */
 
-#ifdef USE_SORT_CACHE
-    cl_free(sort_id_cache);
-#endif
-
+    cl_free(srt_keys);
+    cl_free(srt_key_pos);
     cl_free(srt_start);
     cl_free(srt_end);
   } /* end of "if not external sorting" */
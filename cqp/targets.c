@@ -74,6 +74,7 @@ set_target(CorpusList *corp, FieldType t_id, FieldType s_id)
     return 0;
   }
   assert(corp->range);
+  detach_subcorpus(corp);
 
 
   switch (s_id) {
@@ -304,6 +305,7 @@ int evaluate_target(CorpusList *corp,          /* the corpus */
     cqpmessage(Error, "Corpus is empty.");
     return 0;
   }
+  detach_subcorpus(corp);
 
   /*
    * check whether the base field specification is ok
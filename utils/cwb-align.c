@@ -21,6 +21,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <glib.h>
 
 #include "../cl/globals.h"
 #include "../cl/attributes.h"
@@ -83,6 +84,29 @@ int ws2;                        /**< size of target corpus in word tokens (i.e.
 int pre1 = 0;                   /**< number of pre-alignment regions (source corpus) */
 int pre2 = 0;                   /**< number of pre-alignment regions (target corpus) */
 
+/**
+ * A pair of sentence regions to be aligned (one for each pre-aligned region, or a single
+ * job for the global alignment).
+ *
+ * Jobs are aligned in parallel by worker threads (-j option), but their results are
+ * written to the output file in order by the main thread.
+ */
+typedef struct {
+  int f1, l1, f2, l2;           /**< first and last sentence in source and target region */
+  char *message;                /**< progress message printed before the results (or NULL) */
+  int skip;                     /**< boolean: job only prints its message (region not aligned) */
+  int n_lines;                  /**< number of alignment lines computed */
+  int max_lines;                /**< number of alignment lines allocated */
+  int *lines;                   /**< alignment lines (5 integers each: f1, l1, f2, l2, quality) */
+  int done;                     /**< boolean: alignment has been computed */
+} AlignJob;
+
+AlignJob *align_jobs = NULL;    /**< list of alignment jobs */
+int n_align_jobs = 0;           /**< number of alignment jobs */
+int next_align_job = 0;         /**< next job to be taken by a worker thread */
+GMutex align_jobs_lock;         /**< protects <next_align_job> and the <done> flags of the jobs */
+GCond align_job_done;           /**< signalled when a worker has completed a job */
+
 
 /* global options */
 
@@ -96,6 +120,7 @@ char prealign_name[CL_MAX_FILENAME_LENGTH] = "";  /**< pre-alignment given by st
 int prealign_has_values = 0;    /**< boolean: if 1, regions with same ID values are pre-aligned */
 int verbose = 0;                /**< controls printing of some extra progress info */
 int quiet = 0;                  /**< boolean: if 1, turns off progress messages about the alignment. */
+int jobs = 1;                   /**< number of regions aligned in parallel (-j) */
 
 char *registry_directory = NULL; /** string containing location of the registry directory. */
 
@@ -125,6 +150,8 @@ align_usage(void)
   fprintf(stderr, "  -s <x>     set 2:2 alignment split factor to <x>      [1.2]\n");
   fprintf(stderr, "  -w <n>     use best path search beam of width <n>     [50]\n");
   fprintf(stderr, "  -r <reg>   use registry directory <reg>\n");
+  fprintf(stderr, "  -j <n>     align up to <n> pre-aligned regions in parallel\n");
+  fprintf(stderr, "             [0 = one per processor]\n");
   fprintf(stderr, "  -v         verbose\n");
   fprintf(stderr, "  -h         this help page\n\n");
   fprintf(stderr, "Configuration flags:\n");
@@ -170,7 +197,7 @@ align_parse_args(int ac, char *av[], int min_args)
   int c;
 
   progname = av[0];
-  while ((c = getopt(ac, av, "+hvqo:P:S:V:s:w:r:")) != EOF)
+  while ((c = getopt(ac, av, "+hvqo:P:S:V:s:w:r:j:")) != EOF)
     switch (c) {
       /* -P: positional attribute */
     case 'P':
@@ -215,6 +242,12 @@ align_parse_args(int ac, char *av[], int min_args)
           align_usage();
         break;
       }
+      /* -j: number of threads */
+    case 'j':
+      jobs = atoi(optarg);
+      if (jobs <= 0)
+        jobs = g_get_num_processors();
+      break;
       /* -v : verbose */
     case 'v':
       verbose = 1;
@@ -288,36 +321,84 @@ align_print_line(FILE *fd, int f1, int l1, int f2, int l2, int quality)
 }
 
 
+/**
+ * Adds a pair of sentence regions to the list of alignment jobs.
+ *
+ * @param f1       Number of s-attribute instance that is the start point (first) in source corpus.
+ * @param l1       Number of s-attribute instance that is the end point (last) in source corpus.
+ * @param f2       Number of s-attribute instance that is the start point (first) in target corpus.
+ * @param l2       Number of s-attribute instance that is the end point (last) in target corpus.
+ * @param message  Progress message to be printed before the alignment (will be copied; may be NULL).
+ * @param skip     If true, the job only prints its message.
+ */
+void
+align_add_job(int f1, int l1, int f2, int l2, char *message, int skip)
+{
+  AlignJob *job;
+
+  if ((n_align_jobs & 1023) == 0)
+    align_jobs = (AlignJob *) cl_realloc(align_jobs, (n_align_jobs + 1024) * sizeof(AlignJob));
+  job = &align_jobs[n_align_jobs++];
+  job->f1 = f1;
+  job->l1 = l1;
+  job->f2 = f2;
+  job->l2 = l2;
+  job->message = (message) ? cl_strdup(message) : NULL;
+  job->skip = skip;
+  job->n_lines = 0;
+  job->max_lines = 0;
+  job->lines = NULL;
+  job->done = skip;
+}
+
+/**
+ * Adds an alignment line to the results of a job.
+ */
+void
+align_add_line(AlignJob *job, int f1, int l1, int f2, int l2, int quality)
+{
+  int *line;
+
+  if (job->n_lines >= job->max_lines) {
+    /* grow geometrically, so that adding n lines takes O(n) time */
+    job->max_lines = (job->max_lines > 0) ? 2 * job->max_lines : 64;
+    job->lines = (int *) cl_realloc(job->lines, job->max_lines * 5 * sizeof(int));
+  }
+  line = job->lines + 5 * job->n_lines++;
+  line[0] = f1;
+  line[1] = l1;
+  line[2] = f2;
+  line[3] = l2;
+  line[4] = quality;
+}
+
 /**
  * Actually does the alignment.
  *
- * This function run a best_path alignment on sentence regions
- * [f1,l1]x[f2,l2] and writes the result to {outfile}
- * (in .align format).
+ * This function run a best_path alignment on the sentence regions
+ * [f1,l1]x[f2,l2] of an alignment job and stores the resulting
+ * alignment lines in the job.  It may be called from several threads
+ * at the same time (for different jobs).
  *
  * Usage:
  *
- * steps += align_do_alignment(FMS, f1, l1, f2, l2, outfile);
+ * align_do_alignment(FMS, job);
  *
  * @param fms      The feature map to use in best_path alignment.
- * @param if1      Number of s-attribute instance that is the start point (first) in source corpus.
- * @param il1      Number of s-attribute instance that is the end point (last) in source corpus.
- * @param if2      Number of s-attribute instance that is the start point (first) in target corpus.
- * @param il2      Number of s-attribute instance that is the start point (last) in target corpus.
- * @param outfile  File handle to print the alignment lines to.
- * @return         The number of alignment steps created (= number of lines written to outfile).
+ * @param job      The alignment job.
+ * @return         The number of alignment steps created.
  */
 int
-align_do_alignment(FMS fms, int if1, int il1, int if2, int il2, FILE *outfile) {
+align_do_alignment(FMS fms, AlignJob *job) {
   int steps, *out1, *out2, *quality;    /* out-arguments for best_path() */
   int f1 = 0, l1 = 0, f2 = 0, l2 = 0;
   int q1 = 0, q2 = 0;
-  int i, steps_created;
+  int i;
 
-  best_path(fms, if1, il1, if2, il2, beam_width, verbose,
+  /* progress info from best_path() is only readable if regions are aligned one at a time */
+  best_path(fms, job->f1, job->l1, job->f2, job->l2, beam_width, verbose && (jobs <= 1),
             &steps, &out1, &out2, &quality);
 
-  steps_created = 0;
   for (i=0; i < (steps - 1); i++) {
     f1 = out1[i]; l1 = out1[i+1];
     f2 = out2[i]; l2 = out2[i+1];
@@ -328,17 +409,114 @@ align_do_alignment(FMS fms, int if1, int il1, int if2, int il2, FILE *outfile) {
       /* combined quality of two 1:1 alignments */
       if (quality[i] <= split_factor * (q1 + q2)) {
         /* split */
-        align_print_line(outfile, f1, f1+1, f2, f2+1, q1);
-        align_print_line(outfile, f1+1, l1, f2+1, l2, q2);
-        steps_created += 2;
+        align_add_line(job, f1, f1+1, f2, f2+1, q1);
+        align_add_line(job, f1+1, l1, f2+1, l2, q2);
         continue;
       }
       /* else go on and print 2:2 alignment */
     }
-    align_print_line(outfile, f1, l1, f2, l2, quality[i]);
-    steps_created++;
+    align_add_line(job, f1, l1, f2, l2, quality[i]);
+  }
+  return job->n_lines;
+}
+
+/**
+ * Writes the results of an alignment job to the output file and frees them.
+ *
+ * @param job      The alignment job.
+ * @param outfile  File handle to print the alignment lines to.
+ * @return         The number of alignment steps written.
+ */
+int
+align_write_job(AlignJob *job, FILE *outfile)
+{
+  int i, n = job->n_lines;
+
+  for (i = 0; i < n; i++)
+    align_print_line(outfile, job->lines[5*i], job->lines[5*i+1], job->lines[5*i+2], job->lines[5*i+3], job->lines[5*i+4]);
+  cl_free(job->lines);
+  cl_free(job->message);
+  return n;
+}
+
+/**
+ * Worker thread for parallel alignment: takes jobs from the list until all have been started.
+ *
+ * @param data  The FMS object (shared by all threads).
+ * @return      Always NULL.
+ */
+gpointer
+align_worker(gpointer data)
+{
+  FMS fms = (FMS) data;
+  AlignJob *job;
+
+  while (1) {
+    g_mutex_lock(&align_jobs_lock);
+    while (next_align_job < n_align_jobs && align_jobs[next_align_job].skip)
+      next_align_job++;
+    job = (next_align_job < n_align_jobs) ? &align_jobs[next_align_job++] : NULL;
+    g_mutex_unlock(&align_jobs_lock);
+    if (job == NULL)
+      break;
+
+    align_do_alignment(fms, job);
+
+    g_mutex_lock(&align_jobs_lock);
+    job->done = 1;
+    g_cond_broadcast(&align_job_done);
+    g_mutex_unlock(&align_jobs_lock);
+  }
+  return NULL;
+}
+
+/**
+ * Aligns all regions in the list of jobs and writes the results to the output file.
+ *
+ * With -j, the regions are aligned by a pool of worker threads, while the main thread
+ * writes the results in the original order of the jobs.
+ *
+ * @param fms      The feature map to use in best_path alignment.
+ * @param outfile  File handle to print the alignment lines to.
+ * @return         The number of alignment steps created.
+ */
+int
+align_run_jobs(FMS fms, FILE *outfile)
+{
+  GThread **workers;
+  int i, n_workers, steps = 0;
+
+  n_workers = (jobs < n_align_jobs) ? jobs : n_align_jobs;
+  if (n_workers <= 1) {
+    for (i = 0; i < n_align_jobs; i++) {
+      if (!quiet && align_jobs[i].message)
+        printf("%s\n", align_jobs[i].message);
+      if (!align_jobs[i].skip)
+        align_do_alignment(fms, &align_jobs[i]);
+      steps += align_write_job(&align_jobs[i], outfile);
+    }
+    return steps;
+  }
+
+  cl_set_threads(n_workers);    /* CL functions will be called from several threads */
+  workers = (GThread **) cl_malloc(n_workers * sizeof(GThread *));
+  for (i = 0; i < n_workers; i++)
+    workers[i] = g_thread_new("cwb-align", align_worker, fms);
+
+  for (i = 0; i < n_align_jobs; i++) {
+    g_mutex_lock(&align_jobs_lock);
+    while (!align_jobs[i].done)
+      g_cond_wait(&align_job_done, &align_jobs_lock);
+    g_mutex_unlock(&align_jobs_lock);
+    if (!quiet && align_jobs[i].message)
+      printf("%s\n", align_jobs[i].message);
+    steps += align_write_job(&align_jobs[i], outfile);
   }
-  return steps_created;
+
+  for (i = 0; i < n_workers; i++)
+    g_thread_join(workers[i]);
+  cl_free(workers);
+  return steps;
 }
 
 
@@ -360,6 +538,7 @@ main(int argc, char *argv[]) {
   FMS fms;
   FILE *of;                     /* output file */
   int steps = 0;
+  char *message;                /* progress message for alignment job */
 
   /* parse command line and read arguments */
   argindex = align_parse_args(argc, argv, 3);
@@ -493,16 +672,18 @@ main(int argc, char *argv[]) {
     exit(1);
   }
 
+  message = (char *) cl_malloc(2 * CL_MAX_LINE_LENGTH);
+
   /* .align header: <source> <s> <target> <s> */
   fprintf(of, "%s\t%s\t%s\t%s\n", corpus1_name, s_name, corpus2_name, s_name);
 
-  /* DO THE ALIGNMENT */
+  /* DO THE ALIGNMENT: collect the regions to be aligned */
   if (prealign1 == NULL) {
 
     /* neither -S nor -V used: just do a global alignment */
     if (!quiet)
       printf("Running global alignment, please be patient ...\n");
-    steps = align_do_alignment(fms, 0, size1 - 1, 0, size2 - 1, of);
+    align_add_job(0, size1 - 1, 0, size2 - 1, NULL, 0);
 
   } /* end of global alignment */
 
@@ -545,9 +726,8 @@ main(int argc, char *argv[]) {
       }
 
 
-      if (!quiet)
-        printf("Aligning <%s> region #%d = [%d, %d] x [%d, %d]\n", prealign_name, i, f1, l1, f2, l2);
-      steps += align_do_alignment(fms, f1, l1, f2, l2, of);
+      sprintf(message, "Aligning <%s> region #%d = [%d, %d] x [%d, %d]", prealign_name, i, f1, l1, f2, l2);
+      align_add_job(f1, l1, f2, l2, message, 0);
     }
 
   } /* end of -S type alignment */
@@ -578,8 +758,9 @@ main(int argc, char *argv[]) {
       entry = cl_lexhash_find(lh, value);
       if (entry == NULL) {
         /* no match found */
-        if (!quiet)
-          printf("[Skipping source region <%s %s>]\n", prealign_name, value);
+        message = (char *) cl_realloc(message, strlen(value) + 2 * CL_MAX_LINE_LENGTH);
+        sprintf(message, "[Skipping source region <%s %s>]", prealign_name, value);
+        align_add_job(0, 0, 0, 0, message, 1);
       }
       else {
         int j = entry->data.integer;    /* number of target region */
@@ -596,9 +777,9 @@ main(int argc, char *argv[]) {
           exit(1);
         }
 
-        if (!quiet)
-          printf("Aligning <%s %s> regions = [%d, %d] x [%d, %d]\n", prealign_name, value, f1, l1, f2, l2);
-        steps += align_do_alignment(fms, f1, l1, f2, l2, of);
+        message = (char *) cl_realloc(message, strlen(value) + 2 * CL_MAX_LINE_LENGTH);
+        sprintf(message, "Aligning <%s %s> regions = [%d, %d] x [%d, %d]", prealign_name, value, f1, l1, f2, l2);
+        align_add_job(f1, l1, f2, l2, message, 0);
         j++;                    /* go to next target region */
       }
     }
@@ -607,6 +788,11 @@ main(int argc, char *argv[]) {
 
   } /* end of -V type alignment */
 
+  /* now align all regions (in parallel with -j) */
+  steps = align_run_jobs(fms, of);
+  cl_free(align_jobs);
+  cl_free(message);
+
   if (!quiet)
     printf("Alignment complete. [created %d alignment regions]\n", steps);
 
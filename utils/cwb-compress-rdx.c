@@ -22,6 +22,7 @@
 #include "../cl/corpus.h"
 #include "../cl/attributes.h"
 #include "../cl/storage.h"
+#include "../cl/endian.h"
 #include "../cl/bitio.h"
 #include "../cl/compression.h"
 
@@ -50,6 +51,9 @@ FILE *debug_output; /* " = stderr;" init moved to main() for Gnuwin32 compatibil
 /** stores current position in a bit-write-file */
 int codepos = 0;
 
+/** write a skip pointer for every <skip_interval> postings (0 = don't write a skip table) */
+int skip_interval = 256;
+
 #if 0
 
 /* ------------- THIS VARIANT OF THE COMPRESSION CODE NOT USED !! ------- */
@@ -167,6 +171,12 @@ int read_golomb_code_am(int b, BFile *bf)
 /**
  * Compresses the reversed index of a p-attribute.
  *
+ * Unless skip_interval is 0, a table of skip pointers (.crs) is written as
+ * well, with an entry for every skip_interval-th posting of each type: the
+ * corpus position of the preceding posting and the bit offset of the posting's
+ * code from the start of the type's posting list. This allows CL to skip over
+ * parts of long posting lists in lookups restricted to a subcorpus.
+ *
  * @param attr      The attribute to compress the index of.
  * @param output_fn Base name for the compressed RDX files to be written
  *                  (if this is null, filenames will be taken from the
@@ -178,11 +188,13 @@ compress_reversed_index(Attribute *attr, char *output_fn)
   char *s;
   char data_fname[CL_MAX_FILENAME_LENGTH];
   char index_fname[CL_MAX_FILENAME_LENGTH];
+  char skip_fname[CL_MAX_FILENAME_LENGTH];
   
   int nr_elements;
   int element_freq;
   int corpus_size;
-  int last_pos, gap, fpos;
+  int last_pos, gap;
+  off_t fpos;
 
   int b;
 
@@ -190,6 +202,10 @@ compress_reversed_index(Attribute *attr, char *output_fn)
 
   BFile data_file;
   FILE *index_file = NULL;
+  FILE *skip_file = NULL;
+  int *skip_index = NULL;       /* offset of the skip entries of each type in skip_file (in ints) */
+  int skip_pos = 0;             /* current offset in skip_file (in ints) */
+  off_t byte_offset;
 
   PositionStream PStream;
   int new_pos;
@@ -209,6 +225,8 @@ compress_reversed_index(Attribute *attr, char *output_fn)
       fprintf(stderr, "Index compression requires the REVCORP component\n");
       compressrdx_cleanup(1);
     }
+    if (cl_access_hints)
+      memblob_advise(&(comp->data), MEMBLOB_ACCESS_SEQUENTIAL); /* posting lists are read in lexicon order */
 
     if ((comp = ensure_component(attr, CompRevCorpusIdx, 0)) == NULL) {
       fprintf(stderr, "Index compression requires the REVCIDX component\n");
@@ -231,6 +249,7 @@ compress_reversed_index(Attribute *attr, char *output_fn)
   if (output_fn) {
     sprintf(data_fname, "%s.crc", output_fn);
     sprintf(index_fname, "%s.crx", output_fn);
+    sprintf(skip_fname, "%s.crs", output_fn);
   }
   else {
     s = component_full_name(attr, CompCompRF, NULL);
@@ -240,6 +259,10 @@ compress_reversed_index(Attribute *attr, char *output_fn)
     s = component_full_name(attr, CompCompRFX, NULL);
     assert(s && (cl_errno == CDA_OK));
     strcpy(index_fname, s);
+
+    s = component_full_name(attr, CompCompRFSkip, NULL);
+    assert(s && (cl_errno == CDA_OK));
+    strcpy(skip_fname, s);
   }
   
   if (! BFopen(data_fname, "w", &data_file)) {
@@ -256,6 +279,23 @@ compress_reversed_index(Attribute *attr, char *output_fn)
   }
   printf("- writing compressed index offsets to %s\n", index_fname);
 
+  if (skip_interval > 0) {
+    if ((skip_file = fopen(skip_fname, "wb")) == NULL) {
+      fprintf(stderr, "ERROR: can't create file %s\n", skip_fname);
+      perror(skip_fname);
+      compressrdx_cleanup(1);
+    }
+    printf("- writing skip pointers (every %d postings) to %s\n", skip_interval, skip_fname);
+    /* header: skip interval and offsets of each type's entries (filled in at the end) */
+    skip_index = (int *)cl_malloc((nr_elements + 1) * sizeof(int));
+    NwriteInt(skip_interval, skip_file);
+    for (i = 0; i <= nr_elements; i++)
+      NwriteInt(0, skip_file);
+    skip_pos = nr_elements + 2;
+  }
+  else if (unlink(skip_fname) == 0)
+    printf("- removed old skip pointers file %s\n", skip_fname); /* would no longer match the index */
+
   for (i = 0; i < nr_elements; i++) {
     
     element_freq = cl_id2freq(attr, i);
@@ -273,7 +313,14 @@ compress_reversed_index(Attribute *attr, char *output_fn)
     b = compute_ba(element_freq, corpus_size);
     
     fpos = BFposition(&data_file);
-    NwriteInt(fpos, index_file);
+    if (fpos > CL_MAX_FILE_OFFSET) {
+      fprintf(stderr, "ERROR: compressed index exceeds maximum size (%u bytes) at type #%d (on attribute: %s). Aborted.\n",
+              CL_MAX_FILE_OFFSET, i, attr->any.name);
+      compressrdx_cleanup(1);
+    }
+    NwriteInt((int)fpos, index_file);
+    if (skip_file)
+      skip_index[i] = skip_pos;
     
     if (debug)
       fprintf(debug_output, "------------------------------ ID %d (f: %d, b: %d)\n",
@@ -286,6 +333,17 @@ compress_reversed_index(Attribute *attr, char *output_fn)
         compressrdx_cleanup(1);
       }
       
+      if (skip_file && k > 0 && (k % skip_interval) == 0) {
+        /* bit offset of this code from the start of the posting list (which is byte-aligned);
+           must fit into 32 bits, so there are no skip pointers beyond the first 512 MB of a list */
+        byte_offset = BFposition(&data_file) - fpos;
+        if (byte_offset < 0x1FFFFFFF) {
+          NwriteInt(last_pos, skip_file);
+          NwriteInt((int)((unsigned int)byte_offset * 8 + data_file.bits_in_buf), skip_file);
+          skip_pos += 2;
+        }
+      }
+
       gap = new_pos - last_pos;
       last_pos = new_pos;
       
@@ -299,10 +357,26 @@ compress_reversed_index(Attribute *attr, char *output_fn)
     cl_delete_stream(&PStream);
     BFflush(&data_file);
   }
+  if (cl_access_hints)
+    memblob_advise(&(find_component(attr, CompRevCorpus)->data), MEMBLOB_ACCESS_NORMAL);
     
   fclose(index_file);
   BFclose(&data_file);
 
+  if (skip_file) {
+    skip_index[nr_elements] = skip_pos;
+    if (fseek(skip_file, sizeof(int), SEEK_SET) != 0) {
+      perror(skip_fname);
+      compressrdx_cleanup(1);
+    }
+    NwriteInts(skip_index, nr_elements + 1, skip_file);
+    if (fclose(skip_file) != 0) {
+      perror(skip_fname);
+      compressrdx_cleanup(1);
+    }
+    cl_free(skip_index);
+  }
+
   return;
 }
 
@@ -339,6 +413,9 @@ decompress_check_reversed_index(Attribute *attr, char *output_fn)
 
   BFile data_file;
   FILE *index_file;
+  MemBlob skip_blob;
+  int *skips = NULL, n_skips = 0, skip_k = 0;
+  off_t list_start = 0;         /* position of the current posting list in bits */
 
   PositionStream PStream;
   int true_pos;
@@ -386,6 +463,22 @@ decompress_check_reversed_index(Attribute *attr, char *output_fn)
   }
   printf("- reading compressed index offsets from %s\n", index_fname);
 
+  if (skip_interval > 0) {
+    if (output_fn)
+      sprintf(data_fname, "%s.crs", output_fn);
+    else
+      strcpy(data_fname, component_full_name(attr, CompCompRFSkip, NULL));
+    if (!read_file_into_blob(data_fname, MMAPPED, sizeof(int), &skip_blob)) {
+      fprintf(stderr, "ERROR: can't open file %s\n", data_fname);
+      perror(data_fname);
+      compressrdx_cleanup(1);
+    }
+    printf("- reading skip pointers from %s\n", data_fname);
+    if (skip_blob.nr_items < nr_elements + 2 || ntohl(skip_blob.data[0]) != skip_interval) {
+      fprintf(stderr, "ERROR: wrong header in skip pointers file %s. Aborted.\n", data_fname);
+      compressrdx_cleanup(1);
+    }
+  }
 
   for (i = 0; i < nr_elements; i++) {
 
@@ -407,9 +500,27 @@ decompress_check_reversed_index(Attribute *attr, char *output_fn)
       fprintf(debug_output, "------------------------------ ID %d (f: %d, b: %d)\n",
               i, element_freq, b);
 
+    if (skip_interval > 0) {
+      /* in read mode, bits_in_buf holds the bits of the current byte that haven't been read yet */
+      list_start = BFposition(&data_file) * 8 - data_file.bits_in_buf;
+      skips = skip_blob.data + ntohl(skip_blob.data[1 + i]);
+      n_skips = (ntohl(skip_blob.data[2 + i]) - ntohl(skip_blob.data[1 + i])) / 2;
+      skip_k = 0;
+    }
+
     pos = 0;
     for (k = 0; k < element_freq; k++) {
 
+      if (skip_k < n_skips && k == (skip_k + 1) * skip_interval) {
+        if (pos != ntohl(skips[2 * skip_k]) ||
+            BFposition(&data_file) * 8 - data_file.bits_in_buf - list_start != (unsigned int)ntohl(skips[2 * skip_k + 1])) {
+          fprintf(stderr, "ERROR: wrong skip pointer for posting #%d of type #%d (on attribute: %s). Aborted.\n",
+                  k, i, attr->any.name);
+          compressrdx_cleanup(1);
+        }
+        skip_k++;
+      }
+
       gap = read_golomb_code_bf(b, &data_file);
       pos += gap;
 
@@ -431,6 +542,8 @@ decompress_check_reversed_index(Attribute *attr, char *output_fn)
 
   fclose(index_file);
   BFclose(&data_file);
+  if (skip_interval > 0)
+    mfree(&skip_blob);
 
   /* tell the user it's safe to delete the REVCORP and REVCIDX components now */
   printf("!! You can delete the file <%s> now.\n",
@@ -465,7 +578,9 @@ compressrdx_usage(char *msg, int error_code)
   fprintf(stderr, "  -P <att>  compress attribute <att> [default: word]\n");
   fprintf(stderr, "  -A        compress all positional attributes\n");
   fprintf(stderr, "  -r <dir>  set registry directory\n");
-  fprintf(stderr, "  -f <file> set output file prefix (creates <file>.crc and <file>.crx)\n");
+  fprintf(stderr, "  -f <file> set output file prefix (creates <file>.crc, <file>.crx and <file>.crs)\n");
+  fprintf(stderr, "  -s <n>    write skip pointer for every <n>-th posting [default: %d]\n", skip_interval);
+  fprintf(stderr, "            (-s 0 omits the skip pointers file <file>.crs)\n");
   fprintf(stderr, "  -d        debug mode (print messages on stderr)\n");
   fprintf(stderr, "  -D <file> debug mode (write messages to <file>)\n");
   fprintf(stderr, "  -T        skip validation pass ('I trust you')\n");
@@ -529,7 +644,7 @@ main(int argc, char **argv)
 
 
   /* parse arguments */
-  while ((c = getopt(argc, argv, "+TP:r:f:dD:Ah")) != EOF) {
+  while ((c = getopt(argc, argv, "+TP:r:f:s:dD:Ah")) != EOF) {
 
     switch (c) {
       /* T: skip decompression / error checking pass ("I trust you")  */
@@ -557,6 +672,13 @@ main(int argc, char **argv)
       output_fn = optarg;
       break;
       
+      /* s: skip interval (0 = no skip pointers) */
+    case 's':
+      skip_interval = atoi(optarg);
+      if (skip_interval < 0)
+        compressrdx_usage("skip interval must not be negative.", 2);
+      break;
+
       /* d: debug mode */
     case 'd':
       debug++;
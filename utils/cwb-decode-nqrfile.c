@@ -62,6 +62,8 @@ file_length(FILE *fd)
  * (c) then there may be the size of the subcorpus;
  * (d) then there are a whole load of
  * start-end range integer pairs, to the end of the file.
+ * In the memory-mapped format, the magic number is followed by the size and
+ * the offsets of the data columns, and the range pairs start at an aligned offset.
  *
  * The registry is printed iff print_header. The start-end pairs
  * are printed on tab-delimited lines, one line per pair.
@@ -105,13 +107,15 @@ nqrfile_print_info(FILE *fd, int print_header)
       fprintf(stderr, "Read error while reading in data from subcorpus file\n");
       return 0;
     }
-    else if (*((int *)field) == SUBCORPMAGIC || *((int *)field) == SUBCORPMAGIC+1) {
+    else if (*((int *)field) == SUBCORPMAGIC || *((int *)field) == SUBCORPMAGIC+1 || *((int *)field) == SUBCORPMAGIC+2) {
       
       int magic;
+      int *header = (int *)field;
 
       magic = *((int *)field);
 
-      p = ((char *)field) + sizeof(int);
+      /* memory-mapped format: 8 integers (magic, size, alignment, column offsets) before the registry */
+      p = ((char *)field) + ((magic == SUBCORPMAGIC+2) ? 8 : 1) * sizeof(int);
       
       registry = (char *)p;
       
@@ -133,7 +137,16 @@ nqrfile_print_info(FILE *fd, int print_header)
       while ((p - field) % 4)
         p++;
 
-      if (magic == SUBCORPMAGIC) {
+      if (magic == SUBCORPMAGIC+2) {
+        size = header[1];
+        p = field + header[3] * header[2]; /* the range column is aligned to header[2] bytes */
+        if (size > 0 && (header[2] <= 0 || header[3] <= 0 || header[3] * header[2] + size * 2 * sizeof(int) > len)) {
+          fprintf(stderr, "Error: subcorpus file is truncated or corrupt!\n");
+          return 0;
+        }
+        fprintf(stderr, "Note: memory-mapped subcorpus format\n");
+      }
+      else if (magic == SUBCORPMAGIC) {
         size = (len - (p - field)) / (2 * sizeof(int));
       }
       else {
@@ -36,6 +36,7 @@ Corpus *corpus = NULL;
 Attribute *print_list[MAX_ATTRS];    /**< array of attributes selected by user for printing */
 int print_list_index = 0;            /**< Number of atts added to print_list (so far);
                                       *   used with less-than, = top limit for scrolling that array */
+cl_struc_cursor print_cursors[MAX_ATTRS]; /**< region cursors for the s-attributes in print_list (NULL for other attributes) */
 
 /**
  * Represents a single s-attribuite region and its annotation.
@@ -91,6 +92,11 @@ int xml_compatible = 0;          /**< xml-style, for (cwb-encode -x ...); Encode
 void
 decode_cleanup(int error_code)
 {
+  int i;
+
+  for (i = 0; i < print_list_index; i++)
+    if (print_cursors[i])
+      cl_delete_struc_cursor(print_cursors[i]);
   if (corpus != NULL)
     cl_delete_corpus(corpus);
   exit(error_code);
@@ -388,7 +394,9 @@ decode_add_attribute(Attribute *attr)
       return 0;
     }
 
-    print_list[print_list_index++] = attr;
+    print_list[print_list_index] = attr;
+    print_cursors[print_list_index] = (attr->any.type == ATT_STRUC) ? cl_new_struc_cursor(attr) : NULL;
+    print_list_index++;
     return 1;
   }
   else {
@@ -398,6 +406,22 @@ decode_add_attribute(Attribute *attr)
   }
 }
 
+/**
+ * Switches sequential readahead for the p-attributes in the print list on or off
+ * (around a scan of a whole corpus range).
+ *
+ * @param state  1 before the scan, 0 after it.
+ */
+void
+decode_sequential_access(int state)
+{
+  int i;
+
+  for (i = 0; i < print_list_index; i++)
+    if (print_list[i]->any.type == ATT_POS)
+      cl_sequential_access(print_list[i], state);
+}
+
 /**
  * Check the context of the global printValues array, to check that no s-attribute in
  * it is declared more in the main print_list_index as well.
@@ -503,7 +527,7 @@ void
 decode_print_token_sequence(int start_position, int end_position, Attribute *context, int skip_token)
 {
   int alg, aligned_start, aligned_end, aligned_start2, aligned_end2,
-    rng_start, rng_end, snum;
+    rng_start, rng_end;
   int start_context, end_context, dummy;
   int lastposa, i, w;
 
@@ -559,20 +583,17 @@ decode_print_token_sequence(int start_position, int end_position, Attribute *con
   for (w = start_context; w <= end_context; w++) {
     int beg_of_line;
 
-    /* extract s-attribute regions for start and end tags into s_att_regions[] */
+    /* extract s-attribute regions for start and end tags into s_att_regions[];
+     * the cursors step through the regions as w advances, rather than searching for each token */
     N_sar = 0;                  /* counter and index */
     for (i = 0; i < print_list_index; i++) {
-      if (print_list[i]->any.type == ATT_STRUC) {
-        if ( ((snum = cl_cpos2struc(print_list[i], w)) >= 0) &&
-             (cl_struc2cpos(print_list[i], snum, &rng_start, &rng_end)) &&
-             ((w == rng_start) || (w == rng_end)) ) {
+      if (print_cursors[i]) {
+        if ( (cl_struc_cursor_seek(print_cursors[i], w) & (STRUC_LBOUND|STRUC_RBOUND)) &&
+             (cl_struc_cursor_region(print_cursors[i], &rng_start, &rng_end)) ) {
           s_att_regions[N_sar].name = print_list[i]->any.name;
           s_att_regions[N_sar].start = rng_start;
           s_att_regions[N_sar].end = rng_end;
-          if (cl_struc_values(print_list[i]))
-            s_att_regions[N_sar].annot = cl_struc2str(print_list[i], snum);
-          else
-            s_att_regions[N_sar].annot = NULL;
+          s_att_regions[N_sar].annot = cl_struc_cursor_value(print_cursors[i]);
           N_sar++;
         }
       }
@@ -749,14 +770,15 @@ decode_print_token_sequence(int start_position, int end_position, Attribute *con
         case ATT_STRUC:
           /* do not print in encode, concline or xml modes because already done (above) */
           if ((mode != EncodeMode) && (mode != ConclineMode) && (mode != XMLMode)) {
-            if (cl_cpos2struc2cpos(print_list[i], w, &rng_start, &rng_end)) {
+            /* cursor has already been moved to w above */
+            if (print_cursors[i] && cl_struc_cursor_region(print_cursors[i], &rng_start, &rng_end)) {
               /* standard and -L mode don't show tag annotations */
               printf(mode == LispMode ? "(STRUC %s %d %d)" : "<%s>:%d-%d\t",
                   print_list[i]->any.name,
                   rng_start, rng_end);
             }
-            else if (cl_errno != CDA_OK)
-              cl_error("(aborting) cl_cpos2struc2cpos() failed");
+            else if (print_cursors[i] == NULL)
+              cl_error("(aborting) cl_new_struc_cursor() failed");
           }
           break;
 
@@ -1124,8 +1146,10 @@ main(int argc, char **argv)
 
     /* decode_print_surrounding_s_att_values(first_token); */ /* don't do that in "normal" mode, coz it doesn't make sense */
 
+    decode_sequential_access(1);
     for (w = first_token; w <= last; w++)
       decode_print_token_sequence(w, -1, context, 0);
+    decode_sequential_access(0);
 
     if ( (mode == XMLMode) || ((mode == EncodeMode) && xml_compatible) ) {
       printf("</corpus>\n");
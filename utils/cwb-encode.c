@@ -26,6 +26,7 @@
 #include <dirent.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <glib.h>
 
 #include "../cl/globals.h"
 #include "../cl/macros.h"
@@ -34,6 +35,7 @@
 /* byte order conversion functions taken from Corpus Library */
 #include "../cl/endian.h"
 #include "../cl/attributes.h"   /* for DEFAULT_ATT_NAME */
+#include "../cl/makecomps.h"    /* for write_struc_value_index() */
 
 
 /* ---------------------------------------------------------------------- */
@@ -65,6 +67,7 @@
 #define STRUC_RNG  "%s" SUBDIR_SEP_STRING "%s.rng"            /**< CL naming convention for S-attribute RNG files */
 #define STRUC_AVX  "%s" SUBDIR_SEP_STRING "%s.avx"            /**< CL naming convention for S-attribute AVX (attribute-value index) files */
 #define STRUC_AVS  "%s" SUBDIR_SEP_STRING "%s.avs"            /**< CL naming convention for S-attribute AVS (attribute values) files */
+#define STRUC_AVI  "%s" SUBDIR_SEP_STRING "%s.avi"            /**< CL naming convention for S-attribute AVI (value index) files */
 #define POS_CORPUS "%s" SUBDIR_SEP_STRING "%s.corpus"         /**< CL naming convention for P-attribute Corpus files */
 #define POS_LEX    "%s" SUBDIR_SEP_STRING "%s.lexicon"        /**< CL naming convention for P-attribute Lexicon files */
 #define POS_LEXIDX "%s" SUBDIR_SEP_STRING "%s.lexicon.idx"    /**< CL naming convention for P-attribute Lexicon-index files */
@@ -89,14 +92,24 @@ int strip_blanks = 0;                   /**< strip leading and trailing blanks f
 cl_string_list input_files = NULL;      /**< list of input file(s) (-f option(s)) */
 int nr_input_files = 0;                 /**< number of input files (length of list after option processing) */
 int current_input_file = 0;             /**< index of input file currently being processed */
+#if defined(__GNUC__)
+__thread char *current_input_file_name = NULL;  /**< filename of current input file, for error messages
+                                                     (per thread, so -j workers can report the line they are encoding) */
+#else
 char *current_input_file_name = NULL;   /**< filename of current input file, for error messages */
+#endif
 FILE *input_fd = NULL;                  /**< file handle for current input file (or pipe) (text mode!) */
+#if defined(__GNUC__)
+__thread unsigned long input_line = 0;  /**< input line number (reset for each new file) for error messages */
+#else
 unsigned long input_line = 0;           /**< input line number (reset for each new file) for error messages */
+#endif
 char *registry_file = NULL;             /**< if set, auto-generate registry file named {registry_file}, listing declared attributes */
 char *directory = NULL;                 /**< corpus data directory (no longer defaults to current directory) */
 char *corpus_character_set = "latin1";  /**< character set label that is inserted into the registry file */
 CorpusCharset encoding_charset;         /**< a charset object to be generated from corpus_character_set */
 int clean_strings = 0;                  /**< clean up input strings by replacing invalid bytes with '?' */
+int encode_jobs = 1;                    /**< number of threads for encoding p-attributes (-j option) */
 
 /* ---------------------------------------------------------------------- */
 
@@ -159,7 +172,7 @@ int range_ptr = 0;
 typedef struct {
   char *name;                   /**< TODO */
   cl_lexhash lh;                /**< String hash object containing the lexicon for the encoded P attrbute */
-  int position;                 /**< Byte index of the lexicon file in progress; contains total number of bytes
+  unsigned int position;        /**< Byte index of the lexicon file in progress; contains total number of bytes
                                      written so far (== the beginning of the -next- string that is written) */
   int feature_set;              /**< Boolean: is this a feature set attribute? => validate and normalise format */
   FILE *lex_fd;                 /**< file handle of lexicon component */
@@ -331,6 +344,7 @@ encode_usage(void)
   fprintf(stderr, "     * valid charsets: ascii ; latin1 .. latin9 ; arabic, greek, hebrew, cyrillic ; utf8\n");
   fprintf(stderr, "     * iso-8859-1 .. iso-8859-15 are also accepted, but converted to canonical names above\n");
   fprintf(stderr, "  -C        clean strings, replacing invalid bytes with '?' (not in UTF-8 mode)\n");
+  fprintf(stderr, "  -j <n>    encode p-attributes in <n> threads, in parallel with reading the input\n");
   fprintf(stderr, "  -v        verbose mode (show progress messages while encoding)\n");
   fprintf(stderr, "  -q        quiet mode (suppresses most warnings)\n");
   fprintf(stderr, "  -D        debug mode (quiet, sorry, quite the opposite :-)\n");
@@ -824,11 +838,10 @@ range_close(Range *rng, int end_pos)
           /* insert annotation string into lexicon hash (with offset_ptr as data ptr) */
           entry = cl_lexhash_add(rng->lh, rng->annot);
           entry->data.integer = rng->offset;
-          /* update offset (string length + null byte) */
-          rng->offset += strlen(rng->annot) + 1;
-          /* check for integer overflow */
-          if (rng->offset < 0)
+          /* update offset (string length + null byte), checking for integer overflow */
+          if (strlen(rng->annot) + 1 > INT_MAX - rng->offset)
             encode_error("Too many annotation values for <%s> regions (lexicon size > %d bytes)", rng->name, INT_MAX);
+          rng->offset += strlen(rng->annot) + 1;
         }
         rng->num++;
         cl_free(rng->annot);
@@ -1231,7 +1244,7 @@ encode_parse_options(int argc, char **argv)
   cl_string_list dir_files;   /* list of input files found in directory (-F option) */
   int i, l;
 
-  while((c = getopt(argc, argv, "p:P:S:V:0:f:t:F:d:R:U:Bsb:c:CxvqhD")) != EOF)
+  while((c = getopt(argc, argv, "p:P:S:V:0:f:t:F:d:R:U:Bsb:c:Cj:xvqhD")) != EOF)
     switch(c) {
 
       /* -B: strip leading and trailing blanks from tokens and annotations */
@@ -1261,6 +1274,13 @@ encode_parse_options(int argc, char **argv)
       clean_strings++;
       break;
 
+      /* -j: number of threads for encoding p-attributes */
+    case 'j':
+      encode_jobs = atoi(optarg);
+      if (encode_jobs < 1)
+        encode_error("Invalid number of threads specified with the -j flag!");
+      break;
+
       /* -x: translate XML entities and ignore declarations & comments */
     case 'x':
       xml_aware++;
@@ -1456,6 +1476,101 @@ encode_parse_options(int argc, char **argv)
 
 
 
+/**
+ * Encodes one column of a token data line as the next value of a p-attribute.
+ *
+ * The field is modified destructively (blank stripping, XML entity decoding).
+ * Values of different p-attributes may be added from different threads,
+ * but all values of the same attribute must be added by one thread in corpus order.
+ *
+ * @param fc     Column number (zero-indexed) = index of the p-attribute in wattrs[].
+ * @param field  The column's value, or NULL if the column is missing from the input line.
+ */
+void
+encode_add_wattr_value(int fc, char *field)
+{
+  /* id = container for lexicon ID int.
+   * length = temp holder for a strlen return. */
+  int id, length;
+  /* token = token we will store (same as field, except in case of feature sets). */
+  char *token;
+
+  cl_lexhash_entry entry;
+
+  if ((field != NULL) && strip_blanks) { /* need to strip both leading & trailing blanks from field values */
+    length = strlen(field);
+    while ((length > 0) && (field[length-1] == ' ')) {
+      length--;
+      field[length] = '\0';
+    }
+    while (*field == ' ') 
+      field++;
+  }
+  if ((field != NULL) && (field[0] == '\0'))
+    field = NULL;  /* field == NULL -> missing field; field == "" -> empty field; both inserted as __UNDEF__ */
+
+  if ((field != NULL) && xml_aware) 
+    cl_xml_entity_decode(field);
+
+  if (field == NULL)          /* mustn't do this before cl_xml_entity_decode(), because undef_value is a constant */
+    field = undef_value;
+
+  if (wattrs[fc].feature_set) {
+    token = cl_make_set(field, /*split*/ 0);
+    if (token == NULL) {
+      if (! silent) {
+        fprintf(stderr, "Warning: '%s' is not a valid feature set for -P %s/, replaced by empty set | (", 
+                        field, wattrs[fc].name);
+        encode_print_input_lineno();
+        fprintf(stderr, ")\n");
+      }
+      token = cl_strdup("|");
+      /* so we always have to cl_free() token for feature set attributes,
+       * because either cl_make_set or cl_strdup was used */
+    }
+  }
+  else {
+    token = field;
+  }
+
+  /* check annotation length & truncate if necessary (assumes it's ok to modify token[] destructively) */
+  length = strlen(token);
+  if (length >= CL_MAX_LINE_LENGTH) {
+    if (!silent) {
+      fprintf(stderr, "Value of p-attribute '%s' exceeds maximum string length (%d > %d chars), truncated (", 
+              wattrs[fc].name, length, CL_MAX_LINE_LENGTH-1);
+      encode_print_input_lineno();
+      fprintf(stderr, ").\n");
+    }
+    token[CL_MAX_LINE_LENGTH-2] = '$'; /* truncation marker, as e.g. in Emacs */
+    token[CL_MAX_LINE_LENGTH-1] = '\0';
+  }
+
+  id = cl_lexhash_id(wattrs[fc].lh, token);
+  if (id < 0) {
+    /* new entry -> write LEXIDX & LEXICON files */
+    if (strlen(token) + 1 > CL_MAX_FILE_OFFSET - wattrs[fc].position)
+      encode_error("Maximum size of .lexicon file exceeded for %s attribute (> %u bytes)", wattrs[fc].name, CL_MAX_FILE_OFFSET);
+    NwriteInt(wattrs[fc].position, wattrs[fc].lexidx_fd);
+    wattrs[fc].position += strlen(token) + 1;
+    if (EOF == fputs(token, wattrs[fc].lex_fd)) {
+      perror("fputs() write error");
+      encode_error("Error writing .lexicon file for %s attribute.", wattrs[fc].name);
+    }
+    if (EOF == putc('\0', wattrs[fc].lex_fd)) {
+      perror("putc() write error");
+      encode_error("Error writing .lexicon file for %s attribute.", wattrs[fc].name);
+    }
+    entry = cl_lexhash_add(wattrs[fc].lh, token);
+    id = entry->id;
+  }
+
+  if (wattrs[fc].feature_set)
+    cl_free(token); /* string has been allocated by cl_make_set(). See above.  */
+
+  NwriteInt(id, wattrs[fc].corpus_fd);
+}
+
 /**
  * Processes a token data line.
  *
@@ -1469,97 +1584,212 @@ encode_parse_options(int argc, char **argv)
 void
 encode_add_wattr_line(char *str)
 {
-  /* fc = field counter (current column number, zero indexed)
-   * id = container for lexicon ID int.
-   * length = temp holder for a strlen return. */
-  int fc, id, length;
-  /* field = the current column (string).
-   * token = token we will store (same as field, except in case of feature sets).
-   * Both are pointers to suitable chunks of the parameter string. */
-  char *field, *token;
-
-  cl_lexhash_entry entry;
+  int fc;                       /* field counter (current column number, zero indexed) */
+  char *field;                  /* the current column (string) */
 
   /* the following tokenization code messes around with the containts of the str parameter,
    * which (in the usage in this program) means changing linebuf[] in main()! */
   for (field = encode_strtok(str, field_separators), fc = 0;
-       fc < wattr_ptr; 
-       field = encode_strtok(NULL, field_separators), fc++) {
-    /* LOOP across each column in the line... */
-    
-    if ((field != NULL) && strip_blanks) { /* need to strip both leading & trailing blanks from field values */
-      length = strlen(field);
-      while ((length > 0) && (field[length-1] == ' ')) {
-        length--;
-        field[length] = '\0';
-      }
-      while (*field == ' ') 
-        field++;
-    }
-    if ((field != NULL) && (field[0] == '\0'))
-      field = NULL;  /* field == NULL -> missing field; field == "" -> empty field; both inserted as __UNDEF__ */
+       fc < wattr_ptr;
+       field = encode_strtok(NULL, field_separators), fc++)
+    encode_add_wattr_value(fc, field);
+}
 
-    if ((field != NULL) && xml_aware) 
-      cl_xml_entity_decode(field);
 
-    if (field == NULL)          /* mustn't do this before cl_xml_entity_decode(), because undef_value is a constant */
-      field = undef_value;
+/* ======================================== pipelined encoding of p-attributes (-j) */
 
-    if (wattrs[fc].feature_set) {
-      token = cl_make_set(field, /*split*/ 0);
-      if (token == NULL) {
-        if (! silent) {
-          fprintf(stderr, "Warning: '%s' is not a valid feature set for -P %s/, replaced by empty set | (", 
-                          field, wattrs[fc].name);
-          encode_print_input_lineno();
-          fprintf(stderr, ")\n");
-        }
-        token = cl_strdup("|");
-        /* so we always have to cl_free() token for feature set attributes,
-         * because either cl_make_set or cl_strdup was used */
-      }
-    }
-    else {
-      token = field;
-    }
+/*
+ * With -j <n>, the main thread only reads and validates the input, handles XML tags
+ * (s-attributes) and splits token lines into columns.  Token lines are collected in
+ * batches, which are handed to <n> worker threads.  Each worker encodes a fixed subset
+ * of the p-attributes (those with fc % n == worker number), so every attribute sees its
+ * values in corpus order and the output files are identical to those of a sequential run.
+ */
 
-    /* check annotation length & truncate if necessary (assumes it's ok to modify token[] destructively) */
-    length = strlen(token);
-    if (length >= CL_MAX_LINE_LENGTH) {
-      if (!silent) {
-        fprintf(stderr, "Value of p-attribute '%s' exceeds maximum string length (%d > %d chars), truncated (", 
-                wattrs[fc].name, length, CL_MAX_LINE_LENGTH-1);
-        encode_print_input_lineno();
-        fprintf(stderr, ").\n");
-      }
-      token[CL_MAX_LINE_LENGTH-2] = '$'; /* truncation marker, as e.g. in Emacs */
-      token[CL_MAX_LINE_LENGTH-1] = '\0';
-    }
+#define N_BATCHES          4                                /**< number of batches in the ring buffer */
+#define BATCH_LINES        16384                            /**< maximum number of token lines in a batch */
+#define BATCH_TEXT_SIZE    (16 * MAX_INPUT_LINE_LENGTH)     /**< size of the text buffer of a batch */
 
-    id = cl_lexhash_id(wattrs[fc].lh, token);
-    if (id < 0) {
-      /* new entry -> write LEXIDX & LEXICON files */
-      NwriteInt(wattrs[fc].position, wattrs[fc].lexidx_fd);
-      wattrs[fc].position += strlen(token) + 1;
-      if (wattrs[fc].position < 0)
-        encode_error("Maximum size of .lexicon file exceeded for %s attribute (> %d bytes)", wattrs[fc].name, INT_MAX);
-      if (EOF == fputs(token, wattrs[fc].lex_fd)) {
-        perror("fputs() write error");
-        encode_error("Error writing .lexicon file for %s attribute.", wattrs[fc].name);
-      }
-      if (EOF == putc('\0', wattrs[fc].lex_fd)) {
-        perror("putc() write error");
-        encode_error("Error writing .lexicon file for %s attribute.", wattrs[fc].name);
-      }
-      entry = cl_lexhash_add(wattrs[fc].lh, token);
-      id = entry->id;
+/**
+ * A batch of token lines waiting to be encoded by the worker threads.
+ */
+typedef struct {
+  char *text;                   /**< copies of the token lines, split into columns in place */
+  int text_used;                /**< number of bytes of text[] in use */
+  char **fields;                /**< column pointers: BATCH_LINES rows of wattr_ptr entries (NULL = missing column) */
+  unsigned long *input_lines;   /**< input line number of each token line, for warnings */
+  char **file_names;            /**< input file name of each token line, for warnings */
+  int n_lines;                  /**< number of token lines in the batch; an empty batch tells the workers to stop */
+  int pending;                  /**< number of workers that have not finished the batch yet */
+} EncodeBatch;
+
+EncodeBatch batches[N_BATCHES];
+int n_encode_workers = 0;               /**< number of worker threads (0 = encode p-attributes in main thread) */
+GThread *encode_workers[MAXRANGES];
+int encode_worker_nr[MAXRANGES];        /**< worker numbers, passed to the threads by reference */
+unsigned long batches_published = 0;    /**< number of batches handed to the workers so far */
+GMutex batch_lock;                      /**< protects batches_published and the pending counters */
+GCond batch_cond;                       /**< signalled whenever a batch is published or finished */
+
+/**
+ * Main function of a worker thread: encodes its share of the p-attributes for each batch.
+ *
+ * @param data  Pointer to the worker number.
+ */
+gpointer
+encode_worker(gpointer data)
+{
+  int worker = *(int *)data;
+  unsigned long seq;
+  EncodeBatch *batch;
+  char **fields;
+  int i, fc;
+
+  for (seq = 0; ; seq++) {
+    batch = &batches[seq % N_BATCHES];
+    g_mutex_lock(&batch_lock);
+    while (batches_published <= seq)
+      g_cond_wait(&batch_cond, &batch_lock);
+    g_mutex_unlock(&batch_lock);
+
+    if (batch->n_lines == 0)
+      break;                    /* end of input */
+
+    for (i = 0; i < batch->n_lines; i++) {
+      input_line = batch->input_lines[i];
+      current_input_file_name = batch->file_names[i];
+      fields = batch->fields + (size_t)i * wattr_ptr;
+      for (fc = worker; fc < wattr_ptr; fc += n_encode_workers)
+        encode_add_wattr_value(fc, fields[fc]);
     }
 
-    if (wattrs[fc].feature_set)
-      cl_free(token); /* string has been allocated by cl_make_set(). See above.  */
+    g_mutex_lock(&batch_lock);
+    if (--batch->pending == 0)
+      g_cond_broadcast(&batch_cond);
+    g_mutex_unlock(&batch_lock);
+  }
+  return NULL;
+}
+
+/**
+ * Starts the worker threads for pipelined encoding of p-attributes.
+ *
+ * Does nothing unless -j was specified with more than one thread.
+ * The number of workers is capped at the number of p-attributes.
+ */
+void
+encode_start_workers(void)
+{
+  int i;
+
+  if (encode_jobs <= 1 || wattr_ptr == 0)
+    return;
+
+  n_encode_workers = MIN(encode_jobs, wattr_ptr);
+  for (i = 0; i < N_BATCHES; i++) {
+    batches[i].text = (char *)cl_malloc(BATCH_TEXT_SIZE);
+    batches[i].fields = (char **)cl_malloc((size_t)BATCH_LINES * wattr_ptr * sizeof(char *));
+    batches[i].input_lines = (unsigned long *)cl_malloc(BATCH_LINES * sizeof(unsigned long));
+    batches[i].file_names = (char **)cl_malloc(BATCH_LINES * sizeof(char *));
+    batches[i].text_used = 0;
+    batches[i].n_lines = 0;
+    batches[i].pending = 0;
+  }
+  for (i = 0; i < n_encode_workers; i++) {
+    encode_worker_nr[i] = i;
+    encode_workers[i] = g_thread_new("encode", encode_worker, &encode_worker_nr[i]);
+  }
+
+  if (debug)
+    fprintf(stderr, "Encoding %d p-attributes in %d threads.\n", wattr_ptr, n_encode_workers);
+}
+
+/**
+ * Hands the batch currently being filled to the worker threads.
+ *
+ * Blocks until the next slot of the ring buffer has been released by all workers,
+ * and returns with that slot emptied, ready to be filled.
+ */
+void
+encode_publish_batch(void)
+{
+  EncodeBatch *next;
+
+  g_mutex_lock(&batch_lock);
+  batches[batches_published % N_BATCHES].pending = n_encode_workers;
+  batches_published++;
+  g_cond_broadcast(&batch_cond);
+  next = &batches[batches_published % N_BATCHES];
+  while (next->pending > 0)
+    g_cond_wait(&batch_cond, &batch_lock);
+  g_mutex_unlock(&batch_lock);
+
+  next->text_used = 0;
+  next->n_lines = 0;
+}
+
+/**
+ * Queues a token data line for encoding by the worker threads.
+ *
+ * This is the pipelined counterpart of encode_add_wattr_line(): the line is copied
+ * into the current batch and split into columns there, so the input buffer can be reused.
+ *
+ * @param str  A string containing the line to process.
+ */
+void
+encode_queue_wattr_line(char *str)
+{
+  EncodeBatch *batch = &batches[batches_published % N_BATCHES];
+  char *text, *field, **fields;
+  int fc, length;
+
+  length = strlen(str);
+  if (batch->n_lines >= BATCH_LINES || batch->text_used + length + 1 > BATCH_TEXT_SIZE) {
+    encode_publish_batch();
+    batch = &batches[batches_published % N_BATCHES];
+  }
+
+  text = batch->text + batch->text_used;
+  memcpy(text, str, length + 1);
+  batch->text_used += length + 1;
 
-    NwriteInt(id, wattrs[fc].corpus_fd);
-  } /* end for loop (for each column in input data...) */
+  fields = batch->fields + (size_t)batch->n_lines * wattr_ptr;
+  for (field = encode_strtok(text, field_separators), fc = 0;
+       fc < wattr_ptr;
+       field = encode_strtok(NULL, field_separators), fc++)
+    fields[fc] = field;
+
+  batch->input_lines[batch->n_lines] = input_line;
+  batch->file_names[batch->n_lines] = current_input_file_name;
+  batch->n_lines++;
+}
+
+/**
+ * Encodes the remaining token lines and waits for the worker threads to terminate.
+ *
+ * Must be called at the end of input, before the p-attribute files are closed.
+ */
+void
+encode_stop_workers(void)
+{
+  int i;
+
+  if (n_encode_workers == 0)
+    return;
+
+  if (batches[batches_published % N_BATCHES].n_lines > 0)
+    encode_publish_batch();
+  encode_publish_batch();       /* publish empty batch = end of input */
+
+  for (i = 0; i < n_encode_workers; i++)
+    g_thread_join(encode_workers[i]);
+  for (i = 0; i < N_BATCHES; i++) {
+    cl_free(batches[i].text);
+    cl_free(batches[i].fields);
+    cl_free(batches[i].input_lines);
+    cl_free(batches[i].file_names);
+  }
+  n_encode_workers = 0;
 }
  
 /**
@@ -1793,6 +2023,9 @@ main(int argc, char **argv)
   /* lookup hash for (undeclared) structural attributes (inserted as tokens into corpus) */
   undeclared_sattrs = cl_new_lexhash(REP_CHECK_LEXHASH_SIZE);
 
+  /* with -j, p-attributes are encoded by worker threads */
+  encode_start_workers();
+
   /* MAIN LOOP: read one line of input and process it */
   while ( encode_get_input_line(linebuf, MAX_INPUT_LINE_LENGTH) ) {
     if (verbose && (line % 15000 == 0)) {
@@ -1927,7 +2160,10 @@ main(int argc, char **argv)
       
       /* if we haven't handled the line so far, it must be data for the positional attributes */
       if (!handled) {
-        encode_add_wattr_line(buf);
+        if (n_encode_workers > 0)
+          encode_queue_wattr_line(buf);
+        else
+          encode_add_wattr_line(buf);
         line++;                 /* line is now the corpus position of the next token that will be encoded */
         if (line >= CL_MAX_CORPUS_SIZE) {
           /* largest admissible corpus size should be 2^31 - 1 tokens, with maximal cpos = 2^31 - 2 */
@@ -1941,6 +2177,9 @@ main(int argc, char **argv)
     } /* endif (this is a line that should be encoded) */
   } /* endwhile (main loop for each line) */
 
+  /* wait until all p-attribute values have been encoded */
+  encode_stop_workers();
+
   if (verbose) {
     printf("%50s\r", "");       /* clear progress line */
     printf("Total size: %" COMMA_SEP_THOUSANDS_CONVSPEC "d tokens (%.1fM)\n", line, ((float) line) / 1048576);
@@ -2005,6 +2244,16 @@ main(int argc, char **argv)
           perror("fclose() failed");
           encode_error("Error writing .avx file for s-attribute <%s>", rng->name);
         }
+        /* create value index from the .avs and .avx files */
+        {
+          char avs[CL_MAX_LINE_LENGTH], avx[CL_MAX_LINE_LENGTH], avi[CL_MAX_LINE_LENGTH];
+
+          sprintf(avs, STRUC_AVS, rng->dir, rng->name);
+          sprintf(avx, STRUC_AVX, rng->dir, rng->name);
+          sprintf(avi, STRUC_AVI, rng->dir, rng->name);
+          if (!write_struc_value_index(avs, avx, avi))
+            encode_error("Error writing .avi file for s-attribute <%s>", rng->name);
+        }
       }
 
     }
@@ -22,6 +22,7 @@
 #include "../cl/attributes.h"
 #include "../cl/storage.h"
 #include "../cl/bitio.h"
+#include "../cl/compression.h"
 #include "../cl/macros.h"
 
 /** Level of progress-info (inc compression protocol) message output: 0 = none. */
@@ -671,7 +672,8 @@ compute_code_lengths(Attribute *attr, HCD *hc, char *fname)
       BFile bfd;
       FILE *sync;
 
-      int cl, code, pos;
+      int cl, code;
+      off_t pos;
 
       corp = ensure_component(attr, CompCorpus, 0);
       assert(corp);
@@ -720,6 +722,9 @@ compute_code_lengths(Attribute *attr, HCD *hc, char *fname)
         exit(1);
       }
 
+      if (cl_access_hints)
+        memblob_advise(&(corp->data), MEMBLOB_ACCESS_SEQUENTIAL);
+
       for (i = 0; i < hc->length; i++) {
 
         /* SYNCHRONIZE */
@@ -727,7 +732,12 @@ compute_code_lengths(Attribute *attr, HCD *hc, char *fname)
           if (i > 0)
             BFflush(&bfd);
           pos = BFposition(&bfd);
-          NwriteInt(pos, sync);
+          if (pos > CL_MAX_FILE_OFFSET) {
+            fprintf(stderr, "ERROR: compressed item sequence exceeds maximum size (%u bytes) at cpos %d. Aborted.\n",
+                    CL_MAX_FILE_OFFSET, i);
+            exit(1);
+          }
+          NwriteInt((int)pos, sync);
         }
 
         id = cl_cpos2id(attr, i);
@@ -749,6 +759,9 @@ compute_code_lengths(Attribute *attr, HCD *hc, char *fname)
         }
       }
 
+      if (cl_access_hints)
+        memblob_advise(&(corp->data), MEMBLOB_ACCESS_NORMAL);
+
       fclose(sync);
       BFclose(&bfd);
     }
@@ -771,6 +784,10 @@ compute_code_lengths(Attribute *attr, HCD *hc, char *fname)
  * beforehand and made sure that the _uncompressed_ token sequence is
  * used by CL access functions.
  *
+ * The compressed sequence is decoded one synchronisation block at a time
+ * with the same table-driven decoder that the CL uses (huffman_decode_block()),
+ * so this is also a round-trip test of the decoder.
+ *
  * @param attr  The attribute to check.
  * @param fname Base filename to use for the three compressed-attribute files.
  *              Can be NULL, in which case the filenames in the attribute are used.
@@ -778,16 +795,15 @@ compute_code_lengths(Attribute *attr, HCD *hc, char *fname)
 void 
 decode_check_huff(Attribute *attr, char *fname)
 {
-  BFile bfd;
+  MemBlob huf;
   FILE *sync;
   HCD hc;
+  HuffDecoder *hd;
 
-  int pos, size, sync_offset, offset;
+  int pos, size, sync_offset, n, i;
+  size_t offset;
 
-  int l, v;
-  int item, true_item;
-  
-  unsigned char bit;
+  int block[SYNCHRONIZATION], true_block[SYNCHRONIZATION];
 
   char hcd_path[CL_MAX_LINE_LENGTH];
   char huf_path[CL_MAX_LINE_LENGTH];
@@ -826,7 +842,7 @@ decode_check_huff(Attribute *attr, char *fname)
   }
 
   printf("- reading compressed item sequence from %s\n", huf_path);
-  if (!BFopen(huf_path, "r", &bfd)) {
+  if (!read_file_into_blob(huf_path, MMAPPED, sizeof(unsigned char), &huf)) {
     fprintf(stderr, "ERROR: can't open file %s. Aborted.\n", huf_path);
     perror(huf_path);
     exit(1);
@@ -846,49 +862,47 @@ decode_check_huff(Attribute *attr, char *fname)
     exit(1);
   }
 
-  for (pos = 0; pos < hc.length; pos++) {
-
-    if ((pos % SYNCHRONIZATION) == 0) {
-      offset = BFposition(&bfd); /* need to get offset before flushing (because flushing fills the bit buffer and advances offset to the following byte!) */
-      if (pos > 0)
-        BFflush(&bfd);
-      sync_offset = -1;                /* make sure we get an error if read below fails */
-      NreadInt(&sync_offset, sync);
-      if (offset != sync_offset) {
-        fprintf(stderr, "ERROR: wrong sync offset %d (true offset %d) at cpos %d. Aborted.\n",
-                sync_offset, offset, pos);
-        exit(1);
-      }
+  hd = huffman_decoder_new(&hc, 0);
+  offset = 0;
+
+  if (cl_access_hints)
+    memblob_advise(&huf, MEMBLOB_ACCESS_SEQUENTIAL);
+  cl_sequential_access(attr, 1);
+
+  for (pos = 0; pos < hc.length; pos += SYNCHRONIZATION) {
+
+    /* each block must start where the previous one ended (rounded up to the next byte) */
+    sync_offset = -1;                /* make sure we get an error if read below fails */
+    NreadInt(&sync_offset, sync);
+    if (offset != (unsigned int)sync_offset) {
+      fprintf(stderr, "ERROR: wrong sync offset %u (true offset %lu) at cpos %d. Aborted.\n",
+              (unsigned int)sync_offset, (unsigned long)offset, pos);
+      exit(1);
     }
 
-    if (!BFread(&bit, 1, &bfd)) {
+    n = hc.length - pos;
+    if (n > SYNCHRONIZATION)
+      n = SYNCHRONIZATION;
+
+    if (huffman_decode_block(hd, (unsigned char *)huf.data, huf.size, offset, block, n, &offset) < 0) {
       fprintf(stderr, "ERROR reading file %s. Aborted.\n", huf_path);
       exit(1);
     }
 
-    v = (bit ? 1 : 0);
-    l = 1;
-    while (v < hc.min_code[l]) {
-      if (!BFread(&bit, 1, &bfd)) {
-        fprintf(stderr, "ERROR reading file %s. Aborted.\n", huf_path);
-        return;
-      }
-      v <<= 1;
-      if (bit)
-        v++;
-      l++;
-    }
-    item = hc.symbols[hc.symindex[l] + v - hc.min_code[l]];
+    if (cl_cpos2id_range(attr, pos, pos + n - 1, true_block) != CDA_OK)
+      cdperror("(aborting) cl_cpos2id_range() failed");
 
-    true_item = cl_cpos2id(attr, pos);
-    if (item != true_item) {
-      fprintf(stderr, "ERROR: wrong token (id=%d) at cpos %d (correct id=%d). Aborted.\n",
-              item, pos, true_item);
-    }
+    for (i = 0; i < n; i++)
+      if (block[i] != true_block[i]) {
+        fprintf(stderr, "ERROR: wrong token (id=%d) at cpos %d (correct id=%d). Aborted.\n",
+                block[i], pos + i, true_block[i]);
+      }
 
   }
+  cl_sequential_access(attr, 0);
+  huffman_decoder_delete(hd);
   fclose(sync);
-  BFclose(&bfd);
+  mfree(&huf);
 
   /* tell the user it's safe to delete the CORPUS component now */
   printf("!! You can delete the file <%s> now.\n",
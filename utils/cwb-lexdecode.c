@@ -220,6 +220,7 @@ lexdecode_usage(void)
   fprintf(stderr, "  -p <rx>   show lexicon entries matching regexp <rx> only\n");
   fprintf(stderr, "  -c        [with -p <rx>] ignore case\n");
   fprintf(stderr, "  -d        [with -p <rx>] ignore diacritics\n");
+  fprintf(stderr, "  -j <n>    [with -p <rx>] use <n> threads to scan lexicon\n");
   fprintf(stderr, "  -F <file> lookup strings read from <file> ('-' for stdin)\n");
   fprintf(stderr, "  -0        [with -F <file>] show non-existing strings with frequency 0\n");
   fprintf(stderr, "  -N        [with -F <file>] read lexicon IDs from <file>\n");
@@ -259,7 +260,7 @@ main(int argc, char **argv) {
     lexdecode_usage();
 
   /* parse arguments */
-  while ((c = getopt(argc, argv, "+P:Sr:fnlbsp:cdF:O0Nh")) != EOF) {
+  while ((c = getopt(argc, argv, "+P:Sr:fnlbsp:cdj:F:O0Nh")) != EOF) {
 
     switch (c) {
     case 'S':                        /* S: show lexicon size only */
@@ -311,6 +312,10 @@ main(int argc, char **argv) {
       rx_flags |= IGNORE_DIAC;
       break;
 
+    case 'j':                        /* j: number of threads for regex matching */
+      cl_set_threads(atoi(optarg));
+      break;
+
     case 'F':                        /* F: read strings from file ('-' for stdin) */
       input_filename = optarg;
       sort = 0;                      /* reading strings from file disables sorting and pattern matching */
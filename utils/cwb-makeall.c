@@ -16,6 +16,12 @@
  */
 
 
+#include <glib.h>
+#ifndef __MINGW__
+#include <sys/wait.h>
+#include <poll.h>
+#endif
+
 #include "../cl/globals.h"
 #include "../cl/corpus.h"
 #include "../cl/attributes.h"
@@ -26,6 +32,23 @@
 Corpus *corpus;
 /** Name of this program */
 char *progname = NULL;
+/** Whether to report the time taken to create and validate each component (set by -V) */
+int show_timing = 0;
+/** Number of attributes processed in parallel (set by -j) */
+int jobs = 1;
+
+
+/**
+ * Prints the time elapsed since a given moment, if timing is enabled.
+ *
+ * @param start  Start time as returned by g_get_monotonic_time().
+ */
+void
+makeall_print_timing(gint64 start)
+{
+  if (show_timing)
+    printf(" [%.2f s]", (g_get_monotonic_time() - start) / 1e6);
+}
 
 
 /**
@@ -69,11 +92,13 @@ void
 makeall_make_component(Attribute *attr, ComponentID cid)
 {
   int state;
+  gint64 start;
 
   if (! component_ok(attr, cid)) {
 
     printf(" + creating %s ... ", cid_name(cid));
     fflush(stdout);
+    start = g_get_monotonic_time();
     (void) create_component(attr, cid);
 
     state = component_state(attr, cid);
@@ -83,7 +108,9 @@ makeall_make_component(Attribute *attr, ComponentID cid)
       exit(1);
     }
 
-    printf("OK\n");
+    printf("OK");
+    makeall_print_timing(start);
+    printf("\n");
   }
 
 }
@@ -108,6 +135,7 @@ validate_revcorp(Attribute *attr)
   int *ptab;                        /* table of index offsets for each lexicon entry */
   int lexsize, corpsize;
   int i, offset, cpos, id;
+  gint64 start = g_get_monotonic_time();
 
   printf(" ? validating %s ... ", cid_name(CompRevCorpus));
   fflush(stdout);
@@ -136,6 +164,7 @@ validate_revcorp(Attribute *attr)
   }
 
   /* now read token stream, check each token id against REVCORP, and increment its pointer */
+  cl_sequential_access(attr, 1);
   for (cpos = 0; cpos < corpsize; cpos++) {
     id = cl_cpos2id(attr, cpos);
     if ((id < 0) || (id >= lexsize)) {
@@ -150,6 +179,7 @@ validate_revcorp(Attribute *attr)
     }
     ptab[id]++;
   }
+  cl_sequential_access(attr, 0);
 
   /* validate frequencies by comparing final offsets against those calculated from token frequencies */
   offset = 0;
@@ -164,7 +194,9 @@ validate_revcorp(Attribute *attr)
 
   cl_free(ptab);
 
-  printf("OK\n");
+  printf("OK");
+  makeall_print_timing(start);
+  printf("\n");
   return 1;
 }
 
@@ -271,6 +303,176 @@ makeall_do_attribute(Attribute *attr, ComponentID cid, int validate)
 
 }
 
+/**
+ * Frees all data of an attribute after it has been processed.
+ *
+ * This makes the attribute unusable, but it is currently the only way to
+ * free allocated and memory-mapped data.
+ */
+void
+makeall_drop_attribute(Attribute *attr)
+{
+  ComponentID cid;
+
+  for (cid = CompDirectory; cid < CompLast; cid++) /* ordering gleaned from attributes.h */
+    drop_component(attr, cid);
+}
+
+
+#ifndef __MINGW__
+
+/**
+ * A worker process building the components of one attribute (for -j).
+ */
+typedef struct _MakeallWorker {
+  Attribute *attr;                /**< the attribute processed by this worker */
+  pid_t pid;                      /**< process ID of the worker, 0 if the slot is free */
+  int fd;                         /**< read end of a pipe connected to the worker's stdout */
+  char line[CL_MAX_LINE_LENGTH];  /**< incomplete output line */
+  int len;                        /**< number of characters in <line> */
+} MakeallWorker;
+
+/**
+ * Prints all complete lines of output received from a worker, prefixed with the attribute name.
+ *
+ * @param worker  The worker.
+ * @param data    Output received from the worker.
+ * @param n       Number of bytes in <data>; if 0, any incomplete line is printed as well.
+ */
+void
+makeall_worker_output(MakeallWorker *worker, char *data, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++) {
+    if (data[i] != '\n')
+      worker->line[worker->len++] = data[i];
+    if ((data[i] == '\n') || (worker->len >= CL_MAX_LINE_LENGTH - 1)) {
+      printf("[%s] %.*s\n", worker->attr->any.name, worker->len, worker->line);
+      worker->len = 0;
+    }
+  }
+  if ((n == 0) && (worker->len > 0)) {
+    printf("[%s] %.*s\n", worker->attr->any.name, worker->len, worker->line);
+    worker->len = 0;
+  }
+  fflush(stdout);
+}
+
+/**
+ * Processes a list of attributes in up to <jobs> parallel worker processes.
+ *
+ * Each attribute is handled by a separate child process, so that the CL data
+ * structures need not be shared between threads. The memory limit is split evenly
+ * between the workers; if there are fewer attributes than jobs, the remaining
+ * processors are used for building the index of each attribute (cl_threads).
+ * The output of the workers is shown line by line, prefixed with the name of
+ * the attribute.
+ *
+ * @param attrs     The attributes to process.
+ * @param n_attrs   Number of attributes.
+ * @param cid       Component to create (CompLast for all).
+ * @param validate  Whether to validate the REVCORP component.
+ * @return          The number of attributes that failed.
+ */
+int
+makeall_run_workers(Attribute **attrs, int n_attrs, ComponentID cid, int validate)
+{
+  MakeallWorker *workers;
+  struct pollfd *pfd;
+  int n_workers, running, next, failed;
+  int fds[2];
+  int i, k, status;
+  char buf[4096];
+  ssize_t n;
+
+  n_workers = (jobs < n_attrs) ? jobs : n_attrs;
+  if (cl_memory_limit > 0)
+    cl_set_memory_limit((cl_memory_limit / n_workers > 0) ? cl_memory_limit / n_workers : 1);
+  cl_set_threads((jobs / n_workers > 0) ? jobs / n_workers : 1);
+
+  workers = (MakeallWorker *) cl_calloc(n_workers, sizeof(MakeallWorker));
+  pfd = (struct pollfd *) cl_calloc(n_workers, sizeof(struct pollfd));
+
+  running = next = failed = 0;
+  while ((running > 0) || (next < n_attrs)) {
+    /* start workers for the next attributes while there are free slots */
+    for (i = 0; (i < n_workers) && (next < n_attrs); i++) {
+      if (workers[i].pid != 0)
+        continue;
+      if (pipe(fds) < 0) {
+        perror("pipe");
+        exit(1);
+      }
+      fflush(stdout);
+      workers[i].attr = attrs[next++];
+      workers[i].len = 0;
+      workers[i].pid = fork();
+      if (workers[i].pid < 0) {
+        perror("fork");
+        exit(1);
+      }
+      else if (workers[i].pid == 0) {
+        /* worker process: send output through the pipe, then exit */
+        close(fds[0]);
+        dup2(fds[1], 1);
+        close(fds[1]);
+        makeall_do_attribute(workers[i].attr, cid, validate);
+        fflush(stdout);
+        _exit(0);
+      }
+      close(fds[1]);
+      workers[i].fd = fds[0];
+      running++;
+    }
+
+    /* wait for output from any of the running workers */
+    for (i = 0, k = 0; i < n_workers; i++) {
+      if (workers[i].pid != 0) {
+        pfd[k].fd = workers[i].fd;
+        pfd[k].events = POLLIN;
+        pfd[k].revents = 0;
+        k++;
+      }
+    }
+    if (poll(pfd, k, -1) < 0) {
+      perror("poll");
+      exit(1);
+    }
+
+    for (i = 0, k = 0; i < n_workers; i++) {
+      if (workers[i].pid == 0)
+        continue;
+      if (pfd[k++].revents == 0)
+        continue;
+      n = read(workers[i].fd, buf, sizeof(buf));
+      if (n > 0)
+        makeall_worker_output(&workers[i], buf, n);
+      else {
+        /* end of output: collect the worker's exit status */
+        makeall_worker_output(&workers[i], buf, 0);
+        close(workers[i].fd);
+        waitpid(workers[i].pid, &status, 0);
+        if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+          printf("[%s] FAILED\n", workers[i].attr->any.name);
+          failed++;
+        }
+        else
+          printf("[%s] done\n", workers[i].attr->any.name);
+        fflush(stdout);
+        workers[i].pid = 0;
+        running--;
+      }
+    }
+  }
+
+  cl_free(workers);
+  cl_free(pfd);
+  return failed;
+}
+
+#endif
+
 /**
  * Prints a usage message and exits the program.
  */
@@ -280,7 +482,8 @@ makeall_usage(void)
   fprintf(stderr, "\n");
   fprintf(stderr, "Usage:  %s [options] <corpus> [<attribute> ...] \n", progname);
   fprintf(stderr, "\n");
-  fprintf(stderr, "Creates a lexicon and index for each p-attribute of an encoded CWB corpus.\n");
+  fprintf(stderr, "Creates a lexicon and index for each p-attribute of an encoded CWB corpus,\n");
+  fprintf(stderr, "and a value index for each s-attribute with annotations.\n");
   fprintf(stderr, "\n");
   fprintf(stderr, "Options:\n");
   fprintf(stderr, "  -D        debug mode\n");
@@ -288,7 +491,8 @@ makeall_usage(void)
   fprintf(stderr, "  -c <comp> create component <comp> only\n");
   fprintf(stderr, "  -P <att>  work on attribute <att> [default: ALL attributes]\n");
   fprintf(stderr, "  -M <size> limit memory usage to approx. <size> MBytes\n");
-  fprintf(stderr, "  -V        validate index after creating it\n");
+  fprintf(stderr, "  -j <n>    process up to <n> attributes in parallel [0 = one per processor]\n");
+  fprintf(stderr, "  -V        validate index after creating it (and show timings)\n");
   fprintf(stderr, "Part of the IMS Open Corpus Workbench v" VERSION "\n\n");
   exit(2);
 }
@@ -314,6 +518,8 @@ main(int argc, char **argv)
 {
   char *attr_name = NULL;
   Attribute *attribute;
+  Attribute **attrs;
+  int n_attrs;
 
   char *registry_directory = NULL;
   char *corpus_id = NULL;
@@ -334,7 +540,7 @@ main(int argc, char **argv)
   progname = argv[0];
 
   /* parse arguments */
-  while ((c = getopt(argc, argv, "+r:c:P:hDM:V")) != EOF) {
+  while ((c = getopt(argc, argv, "+r:c:P:hDM:Vj:")) != EOF) {
     switch (c) {
 
     /* r: registry directory */
@@ -376,6 +582,13 @@ main(int argc, char **argv)
 
     case 'V':
       validate++;
+      show_timing = 1;
+      break;
+
+    case 'j':
+      jobs = atoi(optarg);
+      if (jobs <= 0)
+        jobs = g_get_num_processors();
       break;
 
     case 'h':
@@ -417,40 +630,76 @@ main(int argc, char **argv)
 
   if (optind < argc) {
     /* process each specified atttribute (at the end of the invocation) */
-    for (i = optind; i < argc; i++) {
-      if ((attribute = cl_new_attribute(corpus, argv[i], ATT_POS)) != NULL) {
-        makeall_do_attribute(attribute, cid, validate);
-        /* TODO why do we not need to drop components here, when the for-loop below needs to?? */
-      }
-      else {
-        fprintf(stderr, "p-attribute %s.%s not defined. Aborted.\n", corpus_id, argv[i]);
+    n_attrs = argc - optind;
+    attrs = (Attribute **) cl_malloc(n_attrs * sizeof(Attribute *));
+    for (i = 0; i < n_attrs; i++) {
+      if ((attrs[i] = cl_new_attribute(corpus, argv[optind + i], ATT_POS)) == NULL) {
+        fprintf(stderr, "p-attribute %s.%s not defined. Aborted.\n", corpus_id, argv[optind + i]);
         exit(1);
       }
     }
   }
   else if (attr_name != NULL) {
     /* process a specified attribute (via the -P option) */
-    if ((attribute = cl_new_attribute(corpus, attr_name, ATT_POS)) != NULL) {
-      makeall_do_attribute(attribute, cid, validate);
-    }
-    else {
+    n_attrs = 1;
+    attrs = (Attribute **) cl_malloc(sizeof(Attribute *));
+    if ((attrs[0] = cl_new_attribute(corpus, attr_name, ATT_POS)) == NULL) {
       fprintf(stderr, "p-attribute %s.%s not defined. Aborted.\n", corpus_id, attr_name);
       exit(1);
     }
   }
   else {
     /* process each p-attribute of the corpus in turn */
+    n_attrs = 0;
     for (attribute = corpus->attributes; attribute; attribute = attribute->any.next)
-      if (attribute->type == ATT_POS) {
-        ComponentID my_cid;
-
-        makeall_do_attribute(attribute, cid, validate);
-        /* now destoy all components; this makes the attribute unusable,
-           but it is currently the only way to free allocated and memory-mapped data */
-        for (my_cid = CompDirectory; my_cid < CompLast; my_cid++) { /* ordering gleaned from attributes.h */
-          drop_component(attribute, my_cid);
+      if (attribute->type == ATT_POS)
+        n_attrs++;
+    attrs = (Attribute **) cl_malloc((n_attrs > 0 ? n_attrs : 1) * sizeof(Attribute *));
+    n_attrs = 0;
+    for (attribute = corpus->attributes; attribute; attribute = attribute->any.next)
+      if (attribute->type == ATT_POS)
+        attrs[n_attrs++] = attribute;
+  }
+
+  if (cid == CompStrucAVI)
+    n_attrs = 0;                  /* only s-attributes have a value index (see below) */
+
+#ifndef __MINGW__
+  if ((jobs > 1) && (n_attrs > 1)) {
+    if (makeall_run_workers(attrs, n_attrs, cid, validate) > 0) {
+      fprintf(stderr, "ERROR. Aborted.\n");
+      exit(1);
+    }
+  }
+  else
+#endif
+  {
+    /* a single attribute (or -j 1): use the available processors for building the index */
+    cl_set_threads(jobs);
+    for (i = 0; i < n_attrs; i++) {
+      makeall_do_attribute(attrs[i], cid, validate);
+      makeall_drop_attribute(attrs[i]);
+    }
+  }
+  cl_free(attrs);
+
+  /* create value indexes for s-attributes with annotations (unless specific p-attributes were requested) */
+  if ((optind >= argc) && (attr_name == NULL) && ((cid == CompLast) || (cid == CompStrucAVI))) {
+    for (attribute = corpus->attributes; attribute; attribute = attribute->any.next) {
+      if ((attribute->type == ATT_STRUC) && cl_struc_values(attribute)) {
+        printf("ATTRIBUTE %s\n", attribute->any.name);
+        if (component_ok(attribute, CompStrucAVI) && (cl_max_struc_value(attribute) < 0)) {
+          /* annotations have been re-encoded by a tool that doesn't know about the value index */
+          Component *avi = find_component(attribute, CompStrucAVI);
+          printf(" ! value index out of date (removed)\n");
+          mfree(&(avi->data));
+          unlink(avi->path);
         }
+        makeall_make_component(attribute, CompStrucAVI);
+        printf(" - value index  OK\n");
+        makeall_drop_attribute(attribute);
       }
+    }
   }
 
   printf("========================================\n");
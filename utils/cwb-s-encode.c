@@ -47,6 +47,7 @@
 #include "../cl/macros.h"
 #include "../cl/storage.h"      /* for NwriteInt() */
 #include "../cl/lexhash.h"
+#include "../cl/makecomps.h"  /* for write_struc_value_index() */
 
 /* ---------------------------------------------------------------------- */
 
@@ -61,6 +62,9 @@
 /** printf format string for path of attribute values of a given structural attribute */
 #define RNG_AVS "%s" SUBDIR_SEP_STRING "%s.avs"
 
+/** printf format string for path of the value index (by distinct values) of a given structural attribute */
+#define RNG_AVI "%s" SUBDIR_SEP_STRING "%s.avi"
+
 
 /* ---------------------------------------------------------------------- */
 
@@ -561,6 +565,19 @@ sencode_close_files(void)
       }
     }
 
+    /* create value index, so that the new annotations can be searched efficiently */
+    if (new_satt.avs && new_satt.avx) {
+      char avs[CL_MAX_LINE_LENGTH], avx[CL_MAX_LINE_LENGTH], avi[CL_MAX_LINE_LENGTH];
+
+      sprintf(avs, RNG_AVS, new_satt.dir, new_satt.name);
+      sprintf(avx, RNG_AVX, new_satt.dir, new_satt.name);
+      sprintf(avi, RNG_AVI, new_satt.dir, new_satt.name);
+      if (!write_struc_value_index(avs, avx, avi)) {
+        fprintf(stderr, "Error writing AVI file\n");
+        exit(1);
+      }
+    }
+
     new_satt.ready = 0;
   }
 }
@@ -753,11 +770,11 @@ sencode_write_region(int start, int end, char *annot)
       /* must add string to hash and to avs file */
       entry = cl_lexhash_add(LH, annot);
       entry->data.integer = new_satt.offset;
-      new_satt.offset += strlen(annot) + 1; /* increment range offset */
-      if (new_satt.offset < 0) {
+      if (strlen(annot) + 1 > INT_MAX - new_satt.offset) {
         fprintf(stderr, "Too many annotation values for <%s> regions (lexicon size > %d bytes)\n", new_satt.name, INT_MAX);
         exit(1);
       }
+      new_satt.offset += strlen(annot) + 1; /* increment range offset */
       if (0 > fprintf(new_satt.avs, "%s%c", annot, 0)) {
         perror("Error writing to AVS file");
         exit(1);
@@ -16,10 +16,13 @@
  */
 
 
+#include <glib.h>
+
 #include "../cl/globals.h"
 #include "../cl/corpus.h"
 #include "../cl/cl.h"
 #include "../cl/special-chars.h"
+#include "../cl/regopt.h"
 
 
 /** maximum value of N (makes life a little easier) */
@@ -50,11 +53,6 @@ struct _Hash {
   int id_list_size[MAX_N];  /**< size of this list */
 
   /* s-attributes */
-  int current_struc[MAX_N]; /**< number of current or next structure */
-  int start_cpos[MAX_N];    /**< start of this structure (cpos) */
-  int end_cpos[MAX_N];      /**< end of this structure (cpos) */
-  int constraint_ok[MAX_N]; /**< whether constraint is satisfied (initialised at start_cpos, reset at end_cpos) */
-  int virtual_id[MAX_N];    /**< virtual ID of a region's annotation string (constant within region) */
   char *source_base[MAX_N]; /**< base pointers to compute virtual IDs (= offsets) from annotation strings */
 
   int is_constraint[MAX_N]; /**< list of flags marking constraint keys ("?...") */
@@ -63,6 +61,47 @@ struct _Hash {
   cl_ngram_hash table;      /**< the actual hash table, a cl_ngram_hash object */
 } Hash;
 
+/**
+ * A range of corpus positions to be scanned (start positions of n-grams).
+ */
+typedef struct {
+  int start;                /**< first cpos of the range */
+  int end;                  /**< last cpos of the range (inclusive) */
+} ScanRange;
+
+/**
+ * A shard of the corpus scanned by a single thread, with its own frequency table.
+ *
+ * The shard also holds the scan state for s-attribute keys (which is updated as the
+ * scan proceeds through the corpus) and thread-private copies of the regular expressions.
+ */
+typedef struct {
+  ScanRange *ranges;        /**< ranges of corpus positions in this shard (sorted, non-overlapping) */
+  int n_ranges;             /**< number of ranges */
+  cl_ngram_hash table;      /**< frequency counts for this shard */
+  int progress_size;        /**< end of scan shown in progress information (0 = don't display progress) */
+
+  /* s-attributes */
+  int current_struc[MAX_N]; /**< number of current or next structure */
+  int start_cpos[MAX_N];    /**< start of this structure (cpos) */
+  int end_cpos[MAX_N];      /**< end of this structure (cpos) */
+  int constraint_ok[MAX_N]; /**< whether constraint is satisfied (initialised at start_cpos, reset at end_cpos) */
+  int virtual_id[MAX_N];    /**< virtual ID of a region's annotation string (constant within region) */
+
+  CL_Regex regex[MAX_N];    /**< regex constraints of s-attribute keys (copies of Hash.regex for worker threads) */
+  CL_Regex regular_rx;      /**< regex for -C option (copy of global regular_rx for worker threads) */
+} ScanShard;
+
+/**
+ * The values of one key in canonical sort order, used to sort n-grams that have been spilled to disk.
+ */
+typedef struct {
+  int att;                  /**< index of the key in the Hash data structure */
+  int n;                    /**< number of distinct values */
+  int *by_rank;             /**< the values (lexicon IDs or virtual IDs) in canonical sort order */
+  int *by_value;            /**< ranks 0 .. n-1, sorted by the value they stand for (for binary search) */
+} KeyRanks;
+
 /* other global variables */
 Corpus *C;                   /**< corpus we're working on */
 char *reg_dir = NULL;        /**< registry directory (NULL -> use default) */
@@ -80,7 +119,10 @@ char *ranges_file = NULL;    /**< file with ranges to scan (pairs of corpus posi
 FILE *ranges_fh = NULL;      /**< corresponding filehandle */
 int quiet = 0;               /**< if set, don't show progress information on stderr */
 int n_buckets = 0;           /**< if set, use fixed number of buckets; otherwise, revert to cl_ngram_hash defaults */
+int jobs = 1;                /**< number of threads scanning the corpus in parallel (-j option) */
+int memory_limit = 0;        /**< if set, spill n-gram hash to temporary files when it grows beyond this size (in MB) */
 int debug_level = 0;         /**< CL debug level */
+int Csize = 0;               /**< corpus size (= number of tokens) */
 
 /**
  * Prints a usage message and exits the program.
@@ -104,6 +146,9 @@ scancorpus_usage(void)
   fprintf(stderr, "Options:\n");
   fprintf(stderr, "  -r <dir>  use registry directory <dir>\n");
   fprintf(stderr, "  -b <n>    use <n> hash buckets [default: adjust dynamically]\n");
+  fprintf(stderr, "  -M <n>    limit hash table to <n> MBytes, spilling to temporary files\n");
+  fprintf(stderr, "            in $TMPDIR [default: no limit]\n");
+  fprintf(stderr, "  -j <n>    scan corpus with <n> threads [0 = one per processor]\n");
   fprintf(stderr, "  -o <file> write frequency table to <file> [default"": standard output]\n");
                                                             /* 'default:' confuses Emacs C-mode */
   fprintf(stderr, "            (compressed if <file> ends in '.gz' or '.bz2')\n");
@@ -136,7 +181,7 @@ scancorpus_parse_options(int argc, char *argv[])
   extern char *optarg;
   int c;
 
-  while ((c = getopt(argc, argv, "+r:b:o:Sf:F:Cs:e:R:qDh")) != EOF) {
+  while ((c = getopt(argc, argv, "+r:b:M:j:o:Sf:F:Cs:e:R:qDh")) != EOF) {
     switch (c) {
     case 'r':                        /* -r <dir> */
       if (reg_dir == NULL)
@@ -149,6 +194,18 @@ scancorpus_parse_options(int argc, char *argv[])
     case 'b':                        /* -b <n> */
       n_buckets = atoi(optarg);
       break;
+    case 'M':                        /* -M <n> */
+      memory_limit = atoi(optarg);
+      if (memory_limit <= 0) {
+        fprintf(stderr, "Error: invalid memory limit -M %s\n", optarg);
+        exit(1);
+      }
+      break;
+    case 'j':                        /* -j <n> */
+      jobs = atoi(optarg);
+      if (jobs <= 0)
+        jobs = g_get_num_processors();
+      break;
     case 'o':                        /* -o <file> */
       if (output_file == NULL)
         output_file = optarg;
@@ -213,11 +270,12 @@ scancorpus_parse_options(int argc, char *argv[])
  * "Regularity" is used as a filter on the corpus iff the -C option
  * is specified.
  *
+ * @param rx The regex object for UTF-8 corpora (global regular_rx or a copy for the current thread).
  * @param s  String containing the token to check.
  * @return   True if the token is regular, otherwise false.
  */
 int
-scancorpus_word_is_regular(char *s)
+scancorpus_word_is_regular(CL_Regex rx, char *s)
 {
   /* bad pointer or empty string or first char is hyphen? not regular */
   if (s == NULL || *s == '\0' || *s == '-')
@@ -225,7 +283,7 @@ scancorpus_word_is_regular(char *s)
 
   /* otherwise, different approach of utf8 versus iso8859 */
   if (C->charset == utf8)
-    return cl_regex_match(regular_rx, s, 0);
+    return cl_regex_match(rx, s, 0);
   else {
     char *p = s;
     while (*p) {
@@ -382,7 +440,7 @@ scancorpus_add_key(char *key)
       if (check_words && !is_constraint) { /* reduce ID list to regular words with -C option (but not for constraint keys) */
         point = mark = 0;
         while (point < list_size) {
-          if (scancorpus_word_is_regular(cl_id2str(att, Hash.id_list[Hash.N][point])))
+          if (scancorpus_word_is_regular(regular_rx, cl_id2str(att, Hash.id_list[Hash.N][point])))
             Hash.id_list[Hash.N][mark++] = Hash.id_list[Hash.N][point];
           point++;
         }
@@ -409,10 +467,6 @@ scancorpus_add_key(char *key)
       fprintf(stderr, "Error: s-attribute %s.%s has no annotations (aborted)\n", corpname, buf);
       exit(1);
     }
-    Hash.current_struc[Hash.N] = -1;
-    Hash.start_cpos[Hash.N] = -1;
-    Hash.end_cpos[Hash.N] = -1;
-    Hash.constraint_ok[Hash.N] = 0;
     Hash.source_base[Hash.N] =  /* should be pointer to start of lexicon data (NULL marks special ``?head'' case) */
       (cl_struc_values(att)) ? cl_struc2str(att, 0) : NULL;
   }
@@ -459,6 +513,23 @@ get_next_range(int *start, int *end)
 }
 
 
+/**
+ * Gets the string for the value of a key in an n-gram (as printed by print_ngram_entry()).
+ *
+ * @param i   index of the key in the Hash data structure (counting constraint keys)
+ * @param id  lexicon ID (p-attribute) or virtual ID (s-attribute) of the value
+ * @return    the string (must not be modified)
+ */
+char *
+ngram_key_string(int i, int id) {
+  if (! Hash.is_structural[i])
+    return cl_id2str(Hash.att[i], id);
+  else if (id < 0)
+    return "";
+  else
+    return Hash.source_base[i] + id;
+}
+
 /**
  * Format n-gram hash entry.
  *
@@ -477,17 +548,7 @@ print_ngram_entry(FILE *fh, cl_ngram_hash_entry entry) {
   k = 0;
   for (i = 0; i < Hash.N; i++) {
     if (! Hash.is_constraint[i]) {
-      if (! Hash.is_structural[i]) {
-        str = cl_id2str(Hash.att[i], entry->ngram[k]);
-      }
-      else {
-        if (entry->ngram[k] < 0) {
-          str = "";
-        }
-        else {
-          str = Hash.source_base[i] + entry->ngram[k];
-        }
-      }
+      str = ngram_key_string(i, entry->ngram[k]);
       fprintf(fh, "\t%s", str);
       k++;
     }
@@ -540,6 +601,489 @@ collate_ngram_entries(const void *a, const void *b) {
 }
 
 
+/**
+ * Collate two values of the same key in canonical sort order (callback for g_qsort_with_data()).
+ *
+ * Distinct IDs with the same string are ordered by ID, so that different IDs are never ranked equal.
+ *
+ * @param a     pointer to first ID (int *)
+ * @param b     pointer to second ID (int *)
+ * @param data  pointer to index of the key in the Hash data structure (int *)
+ */
+int
+collate_key_values(gconstpointer a, gconstpointer b, gpointer data) {
+  int i = *((int *) data);
+  int A = *((const int *) a), B = *((const int *) b);
+  int res = strcmp(ngram_key_string(i, A), ngram_key_string(i, B));
+
+  if (res != 0)
+    return res;
+  return (A < B) ? -1 : (A > B) ? 1 : 0;
+}
+
+/**
+ * Compare two positions in a KeyRanks table by the values they stand for (callback for g_qsort_with_data()).
+ *
+ * @param a     pointer to first rank (int *)
+ * @param b     pointer to second rank (int *)
+ * @param data  the by_rank vector of the table (int *)
+ */
+int
+compare_ranked_values(gconstpointer a, gconstpointer b, gpointer data) {
+  int *by_rank = (int *) data;
+  int A = by_rank[*((const int *) a)], B = by_rank[*((const int *) b)];
+
+  return (A < B) ? -1 : (A > B) ? 1 : 0;
+}
+
+/**
+ * Compare two n-gram hash entries by their integer tuples (callback for g_qsort_with_data()).
+ *
+ * @param a     pointer to first n-gram entry (i.e. a cl_ngram_hash_entry *)
+ * @param b     pointer to second n-gram entry (i.e. a cl_ngram_hash_entry *)
+ * @param data  pointer to n-gram size (int *)
+ */
+int
+compare_ngram_tuples(gconstpointer a, gconstpointer b, gpointer data) {
+  cl_ngram_hash_entry A = *((cl_ngram_hash_entry *) a);
+  cl_ngram_hash_entry B = *((cl_ngram_hash_entry *) b);
+  int k, K = *((int *) data);
+
+  for (k = 0; k < K; k++)
+    if (A->ngram[k] != B->ngram[k])
+      return (A->ngram[k] < B->ngram[k]) ? -1 : 1;
+  return 0;
+}
+
+/**
+ * Looks up the rank of a value in a KeyRanks table.
+ *
+ * @param ranks  the KeyRanks table
+ * @param id     the value (must be in the table)
+ * @return       rank of the value in canonical sort order
+ */
+int
+key_rank(KeyRanks *ranks, int id) {
+  int bot = 0, top = ranks->n - 1, mid;
+
+  while (bot < top) {
+    mid = (bot + top) / 2;
+    if (id <= ranks->by_rank[ranks->by_value[mid]])
+      top = mid;
+    else
+      bot = mid + 1;
+  }
+  assert((ranks->by_rank[ranks->by_value[bot]] == id) && "Oops. Big internal bug.");
+  return ranks->by_value[bot];
+}
+
+/**
+ * Writes the frequency table of an n-gram hash that has been spilled to disk in canonical sort order (-S).
+ *
+ * The n-grams cannot be collected in memory for sorting, so they are counted again with ranks in
+ * canonical sort order instead of IDs, in a second n-gram hash with the same memory limit.  If this
+ * hash spills to disk as well, its iterator returns the n-grams in ascending order of their ranks,
+ * i.e. in canonical sort order; otherwise, the entries held in memory are sorted by rank.
+ * The merged runs of Hash.table are read twice: first to collect and rank the distinct values
+ * of each key, then to re-count the n-grams.
+ *
+ * @param of  output stream
+ * @return    number of n-grams written
+ */
+int
+print_spilled_ngrams_sorted(FILE *of) {
+  KeyRanks ranks[MAX_N];
+  cl_ngram_hash values[MAX_N], sorted;
+  cl_ngram_hash_entry entry, *entry_vec;
+  cl_ngram_hash_entry line;
+  int i, j, k, n_items = 0;
+
+  /* pass 1: collect the distinct values of each key and sort them in canonical order */
+  i = 0;
+  for (k = 0; k < Hash.K; k++) {
+    while (Hash.is_constraint[i])
+      i++;
+    ranks[k].att = i++;
+    values[k] = cl_new_ngram_hash(1, 0);
+  }
+  cl_ngram_hash_iterator_reset(Hash.table);
+  while ((entry = cl_ngram_hash_iterator_next(Hash.table)) != NULL)
+    if (entry->freq >= frequency_threshold)
+      for (k = 0; k < Hash.K; k++)
+        cl_ngram_hash_add(values[k], &(entry->ngram[k]), 1);
+  for (k = 0; k < Hash.K; k++) {
+    entry_vec = cl_ngram_hash_get_entries(values[k], &(ranks[k].n));
+    ranks[k].by_rank = (int *) cl_malloc((ranks[k].n + 1) * sizeof(int));
+    ranks[k].by_value = (int *) cl_malloc((ranks[k].n + 1) * sizeof(int));
+    for (j = 0; j < ranks[k].n; j++)
+      ranks[k].by_rank[j] = entry_vec[j]->ngram[0];
+    cl_free(entry_vec);
+    cl_delete_ngram_hash(values[k]);
+    g_qsort_with_data(ranks[k].by_rank, ranks[k].n, sizeof(int), collate_key_values, &(ranks[k].att));
+    for (j = 0; j < ranks[k].n; j++)
+      ranks[k].by_value[j] = j;
+    g_qsort_with_data(ranks[k].by_value, ranks[k].n, sizeof(int), compare_ranked_values, ranks[k].by_rank);
+  }
+
+  /* pass 2: count the n-grams again as tuples of ranks, subject to the same memory limit */
+  sorted = cl_new_ngram_hash(Hash.K, 0);
+  if (memory_limit > 0)
+    cl_ngram_hash_set_memory_limit(sorted, (size_t) memory_limit * 1024 * 1024, getenv("TMPDIR"));
+  line = (cl_ngram_hash_entry) cl_malloc((Hash.K + 1) * sizeof(int));
+  cl_ngram_hash_iterator_reset(Hash.table);
+  while ((entry = cl_ngram_hash_iterator_next(Hash.table)) != NULL) {
+    if (entry->freq >= frequency_threshold) {
+      for (k = 0; k < Hash.K; k++)
+        line->ngram[k] = key_rank(&ranks[k], entry->ngram[k]);
+      cl_ngram_hash_add(sorted, line->ngram, entry->freq);
+    }
+  }
+  cl_delete_ngram_hash(Hash.table);
+  Hash.table = sorted;
+
+  if (!quiet) {
+    fprintf(stderr, "sorting ... ");
+    fflush(stderr);
+  }
+  if (cl_ngram_hash_spilled(sorted)) {
+    cl_ngram_hash_iterator_reset(sorted);
+    entry_vec = NULL;
+  }
+  else {
+    entry_vec = cl_ngram_hash_get_entries(sorted, &n_items);
+    if (n_items > 0)
+      g_qsort_with_data(entry_vec, n_items, sizeof(cl_ngram_hash_entry), compare_ngram_tuples, &(Hash.K));
+  }
+  if (!quiet) {
+    fprintf(stderr, "saving ... ");
+    fflush(stderr);
+  }
+
+  /* translate ranks back to IDs and print the n-grams */
+  i = 0;
+  while ((entry = (entry_vec) ? ((i < n_items) ? entry_vec[i] : NULL) : cl_ngram_hash_iterator_next(sorted)) != NULL) {
+    line->freq = entry->freq;
+    for (k = 0; k < Hash.K; k++)
+      line->ngram[k] = ranks[k].by_rank[entry->ngram[k]];
+    print_ngram_entry(of, line);
+    i++;
+  }
+  n_items = i;
+
+  cl_free(entry_vec);
+  cl_free(line);
+  for (k = 0; k < Hash.K; k++) {
+    cl_free(ranks[k].by_rank);
+    cl_free(ranks[k].by_value);
+  }
+  return n_items;
+}
+
+/**
+ * Finds the first region of an s-attribute that ends at or after the specified corpus position.
+ *
+ * @param att   The s-attribute.
+ * @param cpos  A corpus position.
+ * @return      Number of the region, or cl_max_struc(att) if all regions end before cpos.
+ */
+int
+scancorpus_find_struc(Attribute *att, int cpos)
+{
+  int bot = 0, top = cl_max_struc(att);
+  int mid, start, end;
+
+  while (bot < top) {
+    mid = (bot + top) / 2;
+    cl_struc2cpos(att, mid, &start, &end);
+    if (end < cpos)
+      bot = mid + 1;
+    else
+      top = mid;
+  }
+  return bot;
+}
+
+/**
+ * Switches sequential readahead for the p-attributes of all keys on or off
+ * (around the scan).
+ *
+ * @param state  1 before the scan, 0 after it.
+ */
+void
+scancorpus_sequential_access(int state)
+{
+  int i;
+
+  for (i = 0; i < Hash.N; i++)
+    if (! Hash.is_structural[i])
+      cl_sequential_access(Hash.att[i], state);
+  if (Hash.frequency_values)
+    cl_sequential_access(Hash.frequency_values, state);
+}
+
+/**
+ * Initialises the scan state of a shard for s-attribute keys.
+ *
+ * The state is set up as if the corpus had been scanned up to the start of the shard's first
+ * range, so that the scan loop moves to the correct region when it processes this position.
+ *
+ * @param shard  The shard to initialise.
+ */
+void
+scancorpus_init_shard(ScanShard *shard)
+{
+  int i, struc;
+
+  for (i = 0; i < Hash.N; i++) {
+    shard->current_struc[i] = -1;
+    shard->start_cpos[i] = -1;
+    shard->end_cpos[i] = -1;
+    shard->constraint_ok[i] = 0;
+    shard->virtual_id[i] = -1;
+    if (Hash.is_structural[i] && shard->n_ranges > 0) {
+      /* the last region ending before the first position of the shard (if any) */
+      struc = scancorpus_find_struc(Hash.att[i], shard->ranges[0].start + Hash.offset[i]) - 1;
+      if (struc >= 0) {
+        shard->current_struc[i] = struc;
+        cl_struc2cpos(Hash.att[i], struc, &(shard->start_cpos[i]), &(shard->end_cpos[i]));
+      }
+    }
+  }
+}
+
+/**
+ * Scans the ranges of a shard and adds all n-grams found to the shard's frequency table.
+ *
+ * This function has the signature of a GThreadFunc so that it can be run in a worker thread.
+ *
+ * @param data  Pointer to a ScanShard object.
+ * @return      Always NULL.
+ */
+gpointer
+scancorpus_scan_shard(gpointer data)
+{
+  ScanShard *shard = (ScanShard *) data;
+  int r, cpos, next_cpos, start_cpos, end_cpos;
+
+  scancorpus_init_shard(shard);
+
+  for (r = 0; r < shard->n_ranges; r++) {
+    start_cpos = shard->ranges[r].start;
+    end_cpos = shard->ranges[r].end;
+
+    /* start the scan loop for this range */
+    for (cpos = start_cpos; cpos <= end_cpos; cpos = next_cpos) {
+      int tuple[MAX_N];
+      int i=0, k, accept;
+
+      next_cpos = cpos + 1;        /* this device allows the code to "skip" to the next matching region for s-attribute constraints */
+
+      if ((shard->progress_size > 0) && ((cpos & 0xffff) == 0)) {
+        int cpK = cpos >> 10;
+        int csK = shard->progress_size >> 10;
+        int entriesK = cl_ngram_hash_size(shard->table) >> 10;
+        fprintf(stderr, "Progress: %7dK / %dK  | %7dK n-grams \r", cpK, csK, entriesK);
+        fflush(stderr);
+      }
+
+      accept = 1;
+      k = 0;
+      for (i = 0; i < Hash.N; i++) { /* don't abort when accept==0, because of side effects for s-attributes */
+        int effective_cpos = cpos + Hash.offset[i];
+        int id, size, bot, top, mid;
+        int *idlist;
+        char *str;
+
+        if (! accept)                 /* once accept==0, no need to compute id's and check constraints */
+          continue;
+
+        if (! Hash.is_structural[i]) { /* p-attribute -> id = lexicon ID */
+          id = cl_cpos2id(Hash.att[i], effective_cpos);
+
+          size = Hash.id_list_size[i]; /* check for optional regex constraint */
+          if (size > 0) {                /* constraint has been compiled into ID list */
+            idlist = Hash.id_list[i]; /* check id against idlist[] (using binary search) */
+            assert((idlist != NULL) && "Oops. Big internal bug.");
+            bot = 0; top = size - 1;
+            while (bot < top) {
+              mid = (bot + top) / 2; /* split [bot, top] into [bot, mid] and [mid+1, top] */
+              if (id <= idlist[mid])
+                top = mid;
+              else
+                bot = mid + 1;
+            }
+            if (id == idlist[bot]) {   /* now id==idlist[bot==top], or id is not in list */
+              if (Hash.is_negated[i])  /* a) id found -> reject if constraint is negated */
+                accept = 0;            
+            } 
+            else {
+              if (Hash.is_negated[i]) {/* b) id not found -> reject unless negated, otherwise must check -C flag */
+                if (check_words && !Hash.is_constraint[i]) {
+                   /* id matching negative constraint may not have been found in idlist[] filtered with -C flag,
+                      so we need to check explicitly that the corresponding string is regular in this case */
+                  str = cl_id2str(Hash.att[i], id);
+                  if (!scancorpus_word_is_regular(shard->regular_rx, str)) accept = 0;
+                }
+              }
+              else accept = 0;
+            }
+          }
+          else if (size == 0) {        /* empty list: constraint cannot be satisfied */
+            accept = 0;
+          }
+          else if (check_words) {      /* no regex, but -C option specified: check now whether word is regular */
+            str = cl_id2str(Hash.att[i], id);
+            if (!scancorpus_word_is_regular(shard->regular_rx, str)) accept = 0;
+          }
+        }
+        else {                             /* s-attribute -> id = offset of annotation string in lexicon data */
+          while (effective_cpos > shard->end_cpos[i]) { /* jump to next region after point when necessary */
+            shard->current_struc[i]++;
+            if (shard->current_struc[i] >= cl_max_struc(Hash.att[i])) { /* finished with last struc */
+              shard->start_cpos[i] = shard->end_cpos[i] = Csize; /* will never be reached */
+              shard->constraint_ok[i] = 0;   /* constraint cannot be fulfilled after end of last region */
+              shard->virtual_id[i] = -1;     /* no annotation (undef) */
+            }
+            else {                         /* update Hash data structure with information for next region */
+              cl_struc2cpos(Hash.att[i], shard->current_struc[i], &(shard->start_cpos[i]), &(shard->end_cpos[i]));
+              if (Hash.source_base[i]) {
+                str = cl_struc2str(Hash.att[i], shard->current_struc[i]);
+                shard->virtual_id[i] = str - Hash.source_base[i];
+              }
+              else {
+                str = "NULL";  /* s-attribute without annotation, allowed for special ``?head'' constrains */
+                shard->virtual_id[i] = -1;
+              }
+              shard->constraint_ok[i] = 1;
+              if (Hash.regex[i] != NULL) {
+                if (cl_regex_match(shard->regex[i], str, 0)) {
+                  if (Hash.is_negated[i]) shard->constraint_ok[i] = 0;  /* negated regex matches -> reject */
+                }
+                else {
+                  if (!Hash.is_negated[i]) shard->constraint_ok[i] = 0; /* plain regex matches -> reject */
+                }
+              }
+              if (check_words && !Hash.is_constraint[i] && !scancorpus_word_is_regular(shard->regular_rx, str))   /* -C flag (ignored for constraint keys) */
+                shard->constraint_ok[i] = 0;
+              /* may jump directly to next region when regex constraint is present (or for ``?head'' constraints) */ 
+              if (Hash.regex[i] != NULL || Hash.source_base[i] == NULL) { 
+                int jump_target;
+                if (shard->constraint_ok[i])
+                  jump_target = shard->start_cpos[i] - Hash.offset[i]; /* convert back from effective_cpos to cpos */
+                else
+                  jump_target = shard->end_cpos[i] + 1 - Hash.offset[i]; /* jump past next region if it doesn't match the constraint */
+                if (jump_target > next_cpos)   /* schedule jump to target after current iteration */
+                  next_cpos = jump_target;
+              }
+            }
+          }
+
+          if (effective_cpos >= shard->start_cpos[i]) { /* when in region, use relevant information in Hash data structure */
+            id = shard->virtual_id[i];
+            if (Hash.regex[i] != NULL || check_words) /* apply stored constraint flag if regex or -C is in effect */
+              if (! shard->constraint_ok[i])            /* (should always be TRUE otherwise, so the condition may be redundant) */
+                accept = 0;
+          }
+          else {                        /* outside region, ID is undef (-1) and any regex constraint fails */
+            id = -1;
+            if (Hash.regex[i] != NULL || Hash.is_constraint[i]) 
+              accept = 0; /* pure constraint keys also fail outside regions */
+            /* note that -C flag is _not_ applied here */
+          }
+        }
+
+        if (! Hash.is_constraint[i]) {
+          tuple[k++] = id;        /* build K-tuple for this corpus position */
+        }
+      }
+
+      if (accept) {
+        if (Hash.frequency_values) /* note that the frequency attribute is always used with offset 0 */
+          cl_ngram_hash_add(shard->table, tuple, Hash.frequency[cl_cpos2id(Hash.frequency_values, cpos)]);
+        else
+          cl_ngram_hash_add(shard->table, tuple, 1);
+      }
+    } /* end of scan loop for current range */
+  }
+
+  return NULL;
+}
+
+/**
+ * Splits the ranges to be scanned into shards of roughly equal size.
+ *
+ * If one of the keys is an s-attribute, shard boundaries are moved to the start of a region
+ * where possible, so that each region is processed by a single thread.
+ *
+ * @param ranges    The ranges to be scanned (sorted, non-overlapping).
+ * @param n_ranges  Number of ranges.
+ * @param shards    Array of n_shards shards to be filled in; the ranges of the shards are
+ *                  allocated as a single block pointed to by shards[0].ranges.
+ * @param n_shards  Number of shards.
+ */
+void
+scancorpus_make_shards(ScanRange *ranges, int n_ranges, ScanShard *shards, int n_shards)
+{
+  ScanRange *shard_ranges;
+  Attribute *boundary_att = NULL;
+  double total, done, limit;
+  int i, r, s, n, cur, split, struc, start, end;
+
+  for (i = 0; i < Hash.N; i++)
+    if (Hash.is_structural[i] && Hash.offset[i] == 0) {
+      boundary_att = Hash.att[i];
+      break;
+    }
+
+  total = 0;
+  for (r = 0; r < n_ranges; r++)
+    total += ranges[r].end - ranges[r].start + 1;
+
+  /* splitting a range adds one range to the list, so there can be at most n_ranges + n_shards ranges */
+  shard_ranges = (ScanRange *) cl_malloc((n_ranges + n_shards) * sizeof(ScanRange));
+  n = 0;
+  r = 0;
+  cur = (n_ranges > 0) ? ranges[0].start : 0;
+  done = 0;
+  for (s = 0; s < n_shards; s++) {
+    shards[s].ranges = shard_ranges + n;
+    shards[s].n_ranges = 0;
+    limit = (s == n_shards - 1) ? total : total * (s + 1) / n_shards;
+    while (r < n_ranges && done < limit) {
+      if (s == n_shards - 1 || done + (ranges[r].end - cur + 1) <= limit) {
+        /* rest of current range belongs to this shard */
+        shard_ranges[n].start = cur;
+        shard_ranges[n].end = ranges[r].end;
+        done += ranges[r].end - cur + 1;
+        r++;
+        if (r < n_ranges)
+          cur = ranges[r].start;
+      }
+      else {
+        /* split current range, if possible at the start of a region */
+        split = cur + (int) (limit - done);
+        if (boundary_att) {
+          struc = scancorpus_find_struc(boundary_att, split);
+          if (struc < cl_max_struc(boundary_att) && cl_struc2cpos(boundary_att, struc, &start, &end) && start > cur && start < split)
+            split = start;
+        }
+        if (split > cur) {
+          shard_ranges[n].start = cur;
+          shard_ranges[n].end = split - 1;
+          n++;
+          shards[s].n_ranges++;
+          done += split - cur;
+          cur = split;
+        }
+        break;                  /* remainder of the range goes to the next shard */
+      }
+      n++;
+      shards[s].n_ranges++;
+    }
+  }
+}
+
+
 /* *************** *\
  *      MAIN()     *
 \* *************** */
@@ -554,9 +1098,13 @@ int
 main (int argc, char *argv[])
 {
   int argind;                      /* will be set to the index of first (non-option) argument in argv[] */
-  int Csize = 0;                   /* corpus size (= number of tokens) */
   Attribute *word;                 /* need default p-attribute to compute corpus size */
-  int cpos, next_cpos, start_cpos, end_cpos, previous_end;
+  int start_cpos, end_cpos, previous_end;
+  ScanRange *ranges = NULL;        /* list of ranges to be scanned */
+  int n_ranges = 0, max_ranges = 0;
+  ScanShard *shards;               /* ranges split into shards for parallel scanning (-j) */
+  GThread **workers;
+  int n_shards, s, i;
 
   /* parse command line options */
   progname = argv[0];
@@ -566,6 +1114,8 @@ main (int argc, char *argv[])
   }
   if (debug_level > 0)
     cl_set_debug_level(debug_level);
+  if (jobs > 1)
+    cl_set_threads(jobs);         /* CL functions will be called from several threads */
 
   /* initialise hash */
   Hash.N = 0;                      /* will be incremented when we process the arguments */
@@ -655,7 +1205,7 @@ main (int argc, char *argv[])
   if (! quiet)
     fprintf(stderr, "Scanning corpus %s for %d-tuples ... \n", corpname, Hash.N);
 
-  /* loop over all the ranges to be scanned (which is just a single range without -R) */
+  /* collect all the ranges to be scanned (which is just a single range without -R) */
   previous_end = -1;
   while (get_next_range(&start_cpos, &end_cpos)) {
     if (start_cpos <= previous_end) { /* this also ensures that start_cpos >= */
@@ -675,143 +1225,71 @@ main (int argc, char *argv[])
     if (end_cpos < start_cpos) {
       fprintf(stderr, "Warning: range [%d, %d] is too small for selected data (skipped).\n",
               start_cpos, end_cpos + Hash.max_offset);
+      continue;
     }
+    if (n_ranges >= max_ranges) {
+      max_ranges = (max_ranges > 0) ? 2 * max_ranges : 64;
+      ranges = (ScanRange *) cl_realloc(ranges, max_ranges * sizeof(ScanRange));
+    }
+    ranges[n_ranges].start = start_cpos;
+    ranges[n_ranges].end = end_cpos;
+    n_ranges++;
+  }
 
-    /* start the scan loop for this range */
-    for (cpos = start_cpos; cpos <= end_cpos; cpos = next_cpos) {
-      int tuple[MAX_N];
-      int i=0, k, accept;
-
-      next_cpos = cpos + 1;        /* this device allows the code to "skip" to the next matching region for s-attribute constraints */
-
-      if ((! quiet) && ((cpos & 0xffff) == 0)) {
-        int cpK = cpos >> 10;
-        int csK = Csize >> 10;
-        int entriesK = cl_ngram_hash_size(Hash.table) >> 10;
-        fprintf(stderr, "Progress: %7dK / %dK  | %7dK n-grams \r", cpK, csK, entriesK);
-        fflush(stderr);
-      }
-
-      accept = 1;
-      k = 0;
-      for (i = 0; i < Hash.N; i++) { /* don't abort when accept==0, because of side effects for s-attributes */
-        int effective_cpos = cpos + Hash.offset[i];
-        int id, size, bot, top, mid;
-        int *idlist;
-        char *str;
-
-        if (! accept)                 /* once accept==0, no need to compute id's and check constraints */
-          continue;
-
-        if (! Hash.is_structural[i]) { /* p-attribute -> id = lexicon ID */
-          id = cl_cpos2id(Hash.att[i], effective_cpos);
-
-          size = Hash.id_list_size[i]; /* check for optional regex constraint */
-          if (size > 0) {                /* constraint has been compiled into ID list */
-            idlist = Hash.id_list[i]; /* check id against idlist[] (using binary search) */
-            assert((idlist != NULL) && "Oops. Big internal bug.");
-            bot = 0; top = size - 1;
-            while (bot < top) {
-              mid = (bot + top) / 2; /* split [bot, top] into [bot, mid] and [mid+1, top] */
-              if (id <= idlist[mid])
-                top = mid;
-              else
-                bot = mid + 1;
-            }
-            if (id == idlist[bot]) {   /* now id==idlist[bot==top], or id is not in list */
-              if (Hash.is_negated[i])  /* a) id found -> reject if constraint is negated */
-                accept = 0;            
-            } 
-            else {
-              if (Hash.is_negated[i]) {/* b) id not found -> reject unless negated, otherwise must check -C flag */
-                if (check_words && !Hash.is_constraint[i]) {
-                   /* id matching negative constraint may not have been found in idlist[] filtered with -C flag,
-                      so we need to check explicitly that the corresponding string is regular in this case */
-                  str = cl_id2str(Hash.att[i], id);
-                  if (!scancorpus_word_is_regular(str)) accept = 0;
-                }
-              }
-              else accept = 0;
-            }
-          }
-          else if (size == 0) {        /* empty list: constraint cannot be satisfied */
-            accept = 0;
-          }
-          else if (check_words) {      /* no regex, but -C option specified: check now whether word is regular */
-            str = cl_id2str(Hash.att[i], id);
-            if (!scancorpus_word_is_regular(str)) accept = 0;
-          }
-        }
-        else {                             /* s-attribute -> id = offset of annotation string in lexicon data */
-          while (effective_cpos > Hash.end_cpos[i]) { /* jump to next region after point when necessary */
-            Hash.current_struc[i]++;
-            if (Hash.current_struc[i] >= cl_max_struc(Hash.att[i])) { /* finished with last struc */
-              Hash.start_cpos[i] = Hash.end_cpos[i] = Csize; /* will never be reached */
-              Hash.constraint_ok[i] = 0;   /* constraint cannot be fulfilled after end of last region */
-              Hash.virtual_id[i] = -1;     /* no annotation (undef) */
-            }
-            else {                         /* update Hash data structure with information for next region */
-              cl_struc2cpos(Hash.att[i], Hash.current_struc[i], &(Hash.start_cpos[i]), &(Hash.end_cpos[i]));
-              if (Hash.source_base[i]) {
-                str = cl_struc2str(Hash.att[i], Hash.current_struc[i]);
-                Hash.virtual_id[i] = str - Hash.source_base[i];
-              }
-              else {
-                str = "NULL";  /* s-attribute without annotation, allowed for special ``?head'' constrains */
-                Hash.virtual_id[i] = -1;
-              }
-              Hash.constraint_ok[i] = 1;
-              if (Hash.regex[i] != NULL) {
-                if (cl_regex_match(Hash.regex[i], str, 0)) {
-                  if (Hash.is_negated[i]) Hash.constraint_ok[i] = 0;  /* negated regex matches -> reject */
-                }
-                else {
-                  if (!Hash.is_negated[i]) Hash.constraint_ok[i] = 0; /* plain regex matches -> reject */
-                }
-              }
-              if (check_words && !Hash.is_constraint[i] && !scancorpus_word_is_regular(str))   /* -C flag (ignored for constraint keys) */
-                Hash.constraint_ok[i] = 0;
-              /* may jump directly to next region when regex constraint is present (or for ``?head'' constraints) */ 
-              if (Hash.regex[i] != NULL || Hash.source_base[i] == NULL) { 
-                int jump_target;
-                if (Hash.constraint_ok[i])
-                  jump_target = Hash.start_cpos[i] - Hash.offset[i]; /* convert back from effective_cpos to cpos */
-                else
-                  jump_target = Hash.end_cpos[i] + 1 - Hash.offset[i]; /* jump past next region if it doesn't match the constraint */
-                if (jump_target > next_cpos)   /* schedule jump to target after current iteration */
-                  next_cpos = jump_target;
-              }
-            }
-          }
-
-          if (effective_cpos >= Hash.start_cpos[i]) { /* when in region, use relevant information in Hash data structure */
-            id = Hash.virtual_id[i];
-            if (Hash.regex[i] != NULL || check_words) /* apply stored constraint flag if regex or -C is in effect */
-              if (! Hash.constraint_ok[i])            /* (should always be TRUE otherwise, so the condition may be redundant) */
-                accept = 0;
-          }
-          else {                        /* outside region, ID is undef (-1) and any regex constraint fails */
-            id = -1;
-            if (Hash.regex[i] != NULL || Hash.is_constraint[i]) 
-              accept = 0; /* pure constraint keys also fail outside regions */
-            /* note that -C flag is _not_ applied here */
-          }
-        }
-
-        if (! Hash.is_constraint[i]) {
-          tuple[k++] = id;        /* build K-tuple for this corpus position */
-        }
-      }
-
-      if (accept) {
-        if (Hash.frequency_values) /* note that the frequency attribute is always used with offset 0 */
-          cl_ngram_hash_add(Hash.table, tuple, Hash.frequency[cl_cpos2id(Hash.frequency_values, cpos)]);
-        else
-          cl_ngram_hash_add(Hash.table, tuple, 1);
-      }
-    } /* end of scan loop for current range */
+  /* split the ranges into one shard per thread, each with its own frequency table */
+  n_shards = (jobs > 1) ? jobs : 1;
+  shards = (ScanShard *) cl_calloc(n_shards, sizeof(ScanShard));
+  scancorpus_make_shards(ranges, n_ranges, shards, n_shards);
+  for (s = 0; s < n_shards; s++) {
+    if (s == 0)
+      shards[s].table = Hash.table;
+    else {
+      shards[s].table = cl_new_ngram_hash(Hash.K, n_buckets);
+      if (n_buckets > 0)
+        cl_ngram_hash_auto_grow(shards[s].table, 0);
+    }
+    if (memory_limit > 0)
+      cl_ngram_hash_set_memory_limit(shards[s].table, (size_t) memory_limit * 1024 * 1024 / n_shards, getenv("TMPDIR"));
+    /* the first shard is scanned by the main thread, which displays its progress */
+    if (! quiet && s == 0)
+      shards[s].progress_size = (n_shards == 1 || shards[s].n_ranges == 0) ? Csize : shards[s].ranges[shards[s].n_ranges - 1].end + 1;
+    for (i = 0; i < Hash.N; i++)
+      shards[s].regex[i] = (s == 0 || Hash.regex[i] == NULL) ? Hash.regex[i] : cl_regex_clone(Hash.regex[i]);
+    shards[s].regular_rx = (s == 0 || regular_rx == NULL) ? regular_rx : cl_regex_clone(regular_rx);
+  }
 
-  } /* end of loop over ranges */
+  /* scan the shards, then merge the frequency tables into the table of the first shard */
+  scancorpus_sequential_access(1);
+  if (n_shards == 1)
+    scancorpus_scan_shard(&shards[0]);
+  else {
+    workers = (GThread **) cl_malloc(n_shards * sizeof(GThread *));
+    for (s = 1; s < n_shards; s++)
+      workers[s] = g_thread_new("scan-corpus", scancorpus_scan_shard, &shards[s]);
+    scancorpus_scan_shard(&shards[0]);
+    /* the merged counts are subject to the full memory limit, not just the first shard's share */
+    if (memory_limit > 0)
+      cl_ngram_hash_set_memory_limit(Hash.table, (size_t) memory_limit * 1024 * 1024, getenv("TMPDIR"));
+    for (s = 1; s < n_shards; s++) {
+      cl_ngram_hash_entry entry;
+
+      g_thread_join(workers[s]);
+      cl_ngram_hash_iterator_reset(shards[s].table);
+      while ((entry = cl_ngram_hash_iterator_next(shards[s].table)) != NULL)
+        cl_ngram_hash_add(Hash.table, entry->ngram, entry->freq);
+      cl_delete_ngram_hash(shards[s].table);
+      for (i = 0; i < Hash.N; i++)
+        if (shards[s].regex[i])
+          cl_delete_regex(shards[s].regex[i]);
+      if (shards[s].regular_rx)
+        cl_delete_regex(shards[s].regular_rx);
+    }
+    cl_free(workers);
+  }
+  scancorpus_sequential_access(0);
+  cl_free(shards[0].ranges);
+  cl_free(shards);
+  cl_free(ranges);
 
   if (! quiet)
     fprintf(stderr, "Scan complete.                                         \n");
@@ -839,7 +1317,11 @@ main (int argc, char *argv[])
     }
     fflush(stderr);
 
-    if (sort_output) {
+    if (sort_output && cl_ngram_hash_spilled(Hash.table)) {
+      /* merged frequency counts from temporary files may not fit into memory, so sort them on disk */
+      n_items = print_spilled_ngrams_sorted(of);
+    }
+    else if (sort_output) {
       entry_vec = cl_ngram_hash_get_entries(Hash.table, &n_items);
       if (frequency_threshold > 1) {
         /* pre-filter list of items to speed up qsort */
@@ -631,9 +631,11 @@ create_feature_maps(char **config,
  *
  * Sim = feature_match(FMS, source_first, source_last, target_first, target_last);
  *
- * Note that the best_path() function simply passes through the FMS to this
- * function. That function makes the decisions about what is the best sequence of
- * alignments - given the results it has got back from this sentence.
+ * The similarity is the sum of the weights of all features shared by the two regions
+ * (counting each occurrence in the region where the feature is less frequent), plus the
+ * weighted character count of the shorter region.  This function computes the sentence
+ * feature vectors from scratch; best_path() uses feature_match_cached() instead, which
+ * keeps the vectors of recently used sentences.
  *
  * @param fms  The feature map (which contains the s-attributes in question)
  * @param f1   Index of first "sentence" (i.e. entry on the s-attribute) of the region to analyse in the source.
@@ -649,71 +651,293 @@ feature_match(FMS fms,
               int f2,
               int l2)
 {
+  FVC fvc1, fvc2;
+  int match;
 
-  int *fcount;
-  int match, j, i, id, *f;
-  int cc1 = 0, cc2 = 0;         /* character count */
-  int from, to;                 /* sentence boundaries (as cpos) */
-  
- 
-  /* get a feature vector from the vstack */
-  fcount = get_fvector(fms);
-
-  for (j = f1; j <= l1; j++) {  /* count features in source region */
-    if (cl_struc2cpos(fms->s1, j, &from, &to)) {
-      for (i = from; i <= to; i++) {    /* process sentence */
-        id = cl_cpos2id(fms->att1, i);
-        if (id >= 0) {
-          f = fms->w2f1[id];
-          cc1 += *(f++);                /* character count */
-          for( ; f < fms->w2f1[id+1]; f++)
-            fcount[*f]++;
-        }
-      }
-    }
+  fvc1 = fvector_cache_new(fms, 1, 2);
+  fvc2 = fvector_cache_new(fms, 2, 2);
+  match = feature_match_cached(fms, fvc1, f1, l1, fvc2, f2, l2);
+  fvector_cache_delete(fvc1);
+  fvector_cache_delete(fvc2);
+
+  return match;
+}
+
+
+/**
+ * Creates a cache of sparse sentence feature vectors (constructor of the FVC class).
+ *
+ * @param fms      The feature maps.
+ * @param which    Side of the alignment: 1 = source corpus, 2 = target corpus.
+ * @param n_slots  Number of sentence vectors to cache (should be larger than the range of
+ *                 sentences accessed at the same time, e.g. beam width + 4 for best_path()).
+ * @return         The new FVC object.
+ */
+FVC
+fvector_cache_new(FMS fms, int which, int n_slots)
+{
+  FVC fvc;
+  int i;
+
+  fvc = (FVC) cl_malloc(sizeof(fvector_cache_t));
+  fvc->fms = fms;
+  fvc->att = (which == 1) ? fms->att1 : fms->att2;
+  fvc->s = (which == 1) ? fms->s1 : fms->s2;
+  fvc->w2f = (which == 1) ? fms->w2f1 : fms->w2f2;
+  fvc->n_slots = (n_slots > 2) ? n_slots : 2;
+  fvc->slot = (fvector_t *) cl_calloc(fvc->n_slots, sizeof(fvector_t));
+  fvc->pair = (fvector_t *) cl_calloc(fvc->n_slots, sizeof(fvector_t));
+  for (i = 0; i < fvc->n_slots; i++)
+    fvc->slot[i].sentence = fvc->pair[i].sentence = -1;
+  memset(fvc->merged, 0, sizeof(fvc->merged));
+  fvc->merged[0].sentence = fvc->merged[1].sentence = -1;
+  fvc->buf = NULL;
+  fvc->buf_size = 0;
+
+  return fvc;
+}
+
+/**
+ * Deletes an FVC object.
+ *
+ * @param fvc  The cache to delete.
+ */
+void
+fvector_cache_delete(FVC fvc)
+{
+  int i;
+
+  for (i = 0; i < fvc->n_slots; i++) {
+    cl_free(fvc->slot[i].feature);
+    cl_free(fvc->slot[i].count);
+    cl_free(fvc->pair[i].feature);
+    cl_free(fvc->pair[i].count);
   }
+  for (i = 0; i < 2; i++) {
+    cl_free(fvc->merged[i].feature);
+    cl_free(fvc->merged[i].count);
+  }
+  cl_free(fvc->slot);
+  cl_free(fvc->pair);
+  cl_free(fvc->buf);
+  cl_free(fvc);
+}
 
-  match = 0;                      /* sum up similarity measure */
-
-  for (j = f2; j <= l2; j++) {  /* compare to features in target region */
-    if (cl_struc2cpos(fms->s2, j, &from, &to)) {
-      for(i=from; i<= to; i++) {        /* process sentence */
-        id = cl_cpos2id(fms->att2, i);
-        if (id >= 0) {
-          f = fms->w2f2[id];
-          cc2 += *(f++);                /* character count */
-          for( ; f < fms->w2f2[id+1]; f++) {
-            if(fcount[*f]>0) {
-              fcount[*f]--;
-              match += fms->fweight[*f];
-            }
-          }
-        }
-      }
+/** Makes sure that a feature vector has room for at least n features (non-exported). */
+static void
+fvector_reserve(fvector_t *v, int n)
+{
+  if (n > v->size) {
+    v->size = (n > 2 * v->size) ? n : 2 * v->size;
+    v->feature = (int *) cl_realloc(v->feature, v->size * sizeof(int));
+    v->count = (int *) cl_realloc(v->count, v->size * sizeof(int));
+  }
+}
+
+/** Comparison function for sorting feature IDs with qsort() (non-exported). */
+static int
+fvector_intcmp(const void *a, const void *b)
+{
+  return *((const int *) a) - *((const int *) b);
+}
+
+/**
+ * Computes the sparse feature vector of a sentence (non-exported).
+ *
+ * The features of all tokens in the sentence are collected in the buffer of the FVC,
+ * sorted, and then counted.
+ */
+static void
+fvector_compute(FVC fvc, fvector_t *v, int sentence)
+{
+  int from, to, n_tokens, n_features, i, k, id, *ids, *features, *f;
+
+  v->sentence = sentence;
+  v->cc = 0;
+  v->n = 0;
+  if (!cl_struc2cpos(fvc->s, sentence, &from, &to))
+    return;
+
+  /* look up token IDs, then count feature entries */
+  n_tokens = to - from + 1;
+  if (n_tokens > fvc->buf_size) {
+    fvc->buf_size = 2 * n_tokens;
+    fvc->buf = (int *) cl_realloc(fvc->buf, fvc->buf_size * sizeof(int));
+  }
+  if (cl_cpos2id_range(fvc->att, from, to, fvc->buf) < 0)
+    return;
+  n_features = 0;
+  for (i = 0; i < n_tokens; i++) {
+    id = fvc->buf[i];
+    if (id >= 0)
+      n_features += fvc->w2f[id + 1] - fvc->w2f[id] - 1;
+  }
+  if (n_tokens + n_features > fvc->buf_size) {
+    fvc->buf_size = 2 * (n_tokens + n_features);
+    fvc->buf = (int *) cl_realloc(fvc->buf, fvc->buf_size * sizeof(int));
+  }
+  ids = fvc->buf;
+  features = fvc->buf + n_tokens;
+
+  /* collect features of all tokens (the first entry of each list is the character count) */
+  k = 0;
+  for (i = 0; i < n_tokens; i++) {
+    id = ids[i];
+    if (id >= 0) {
+      f = fvc->w2f[id];
+      v->cc += *(f++);
+      for ( ; f < fvc->w2f[id + 1]; f++)
+        features[k++] = *f;
     }
   }
-  
-  /* add character count value to match quality */
-  match += fms->fweight[0] * ((cc1 <= cc2) ? cc1 : cc2);
+  qsort(features, k, sizeof(int), fvector_intcmp);
+
+  /* run-length encoding of the sorted feature list */
+  fvector_reserve(v, k);
+  for (i = 0; i < k; i++) {
+    if (v->n > 0 && v->feature[v->n - 1] == features[i])
+      v->count[v->n - 1]++;
+    else {
+      v->feature[v->n] = features[i];
+      v->count[v->n] = 1;
+      v->n++;
+    }
+  }
+}
 
-  /* we have now checked every feature in the FMS ! */
+/**
+ * Gets the sparse feature vector of a sentence from the cache, computing it if necessary (non-exported).
+ *
+ * The returned vector remains valid until another sentence is accessed that maps to the
+ * same cache slot, i.e. at least for the next n_slots - 1 consecutive sentences.
+ */
+static fvector_t *
+fvector_get(FVC fvc, int sentence)
+{
+  fvector_t *v = &(fvc->slot[sentence % fvc->n_slots]);
 
+  if (v->sentence != sentence)
+    fvector_compute(fvc, v, sentence);
+  return v;
+}
 
-  /* clear feature count vector (selectively) */
-  
-  for (j = f1; j <= l1; j++) {  
-    if (cl_struc2cpos(fms->s1, j, &from, &to))
-      for(i = from; i <= to; i++) {
-        id = cl_cpos2id(fms->att1,i);
-        if (id >= 0) {
-          for(f = fms->w2f1[id]+1; f < fms->w2f1[id+1]; f++)
-            fcount[*f]=0;
-        }
-      }
+/** Computes the sum of two sparse feature vectors (non-exported). */
+static void
+fvector_add(fvector_t *dest, fvector_t *a, fvector_t *b)
+{
+  int i = 0, j = 0;
+
+  fvector_reserve(dest, a->n + b->n);
+  dest->sentence = -1;
+  dest->cc = a->cc + b->cc;
+  dest->n = 0;
+  while (i < a->n && j < b->n) {
+    if (a->feature[i] < b->feature[j]) {
+      dest->feature[dest->n] = a->feature[i];
+      dest->count[dest->n++] = a->count[i++];
+    }
+    else if (a->feature[i] > b->feature[j]) {
+      dest->feature[dest->n] = b->feature[j];
+      dest->count[dest->n++] = b->count[j++];
+    }
+    else {
+      dest->feature[dest->n] = a->feature[i];
+      dest->count[dest->n++] = a->count[i++] + b->count[j++];
+    }
+  }
+  for ( ; i < a->n; i++) {
+    dest->feature[dest->n] = a->feature[i];
+    dest->count[dest->n++] = a->count[i];
+  }
+  for ( ; j < b->n; j++) {
+    dest->feature[dest->n] = b->feature[j];
+    dest->count[dest->n++] = b->count[j];
   }
+}
+
+/**
+ * Gets the sparse feature vector of a region of sentences [f, l] (non-exported).
+ *
+ * For a single sentence, this is the cached sentence vector, and for two sentences the
+ * cached pair vector; otherwise, the vectors are added up in the merge buffers of the FVC.
+ */
+static fvector_t *
+fvector_region(FVC fvc, int f, int l)
+{
+  fvector_t *v, *dest;
+  int j, k = 0;
+
+  if (l < f) {
+    v = &(fvc->merged[0]);
+    v->sentence = -1;
+    v->cc = v->n = 0;
+    return v;
+  }
+  if (l == f + 1) {
+    v = &(fvc->pair[f % fvc->n_slots]);
+    if (v->sentence != f) {
+      fvector_add(v, fvector_get(fvc, f), fvector_get(fvc, l));
+      v->sentence = f;
+    }
+    return v;
+  }
+  v = fvector_get(fvc, f);
+  for (j = f + 1; j <= l; j++) {
+    dest = &(fvc->merged[k]);
+    fvector_add(dest, v, fvector_get(fvc, j));
+    v = dest;
+    k = 1 - k;
+  }
+  return v;
+}
 
-  /* put our feature vector back on the vstack */
-  release_fvector(fcount, fms);
+/**
+ * Compute similarity measure for a pair of regions, using cached sentence feature vectors.
+ *
+ * This function returns the same value as feature_match(), but the sentence feature vectors
+ * are taken from (and stored in) the two FVC objects, which is much faster when the same
+ * sentences are compared many times (as in best_path()).  Since the sparse vectors are sorted
+ * by feature ID, the shared features are found in a single merge pass over the two vectors.
+ *
+ * @param fms   The feature maps.
+ * @param fvc1  Cache of sentence vectors for the source corpus.
+ * @param f1    Index of first sentence of the region in the source.
+ * @param l1    Index of last sentence of the region in the source.
+ * @param fvc2  Cache of sentence vectors for the target corpus.
+ * @param f2    Index of first sentence of the region in the target.
+ * @param l2    Index of last sentence of the region in the target.
+ * @return      The similarity measurement for the pair of regions.
+ */
+int
+feature_match_cached(FMS fms, FVC fvc1, int f1, int l1, FVC fvc2, int f2, int l2)
+{
+  fvector_t *a, *b;
+  int *fa, *fb, *ca, *cb, *fweight;
+  int i, j, na, nb, match;
+
+  a = fvector_region(fvc1, f1, l1);
+  b = fvector_region(fvc2, f2, l2);
+  fa = a->feature; ca = a->count; na = a->n;
+  fb = b->feature; cb = b->count; nb = b->n;
+  fweight = fms->fweight;
+
+  /* sum up weights of shared features (each occurrence in the region with fewer occurrences) */
+  match = 0;
+  i = j = 0;
+  while (i < na && j < nb) {
+    if (fa[i] < fb[j])
+      i++;
+    else if (fa[i] > fb[j])
+      j++;
+    else {
+      match += fweight[fa[i]] * ((ca[i] <= cb[j]) ? ca[i] : cb[j]);
+      i++;
+      j++;
+    }
+  }
+
+  /* add character count value to match quality */
+  match += fweight[0] * ((a->cc <= b->cc) ? a->cc : b->cc);
 
   return match;
 }
@@ -893,11 +1117,20 @@ best_path(FMS fms,
 {
 
   BARdesc quality, next_x, next_y;  /* three arrays of ints, basically */
+  FVC fvc1, fvc2;                   /* sentence feature vectors in the beam */
   
+#if defined(__GNUC__)
+  /* output arrays are kept per thread, so that different regions can be aligned in parallel */
+  static __thread int max_out_pos = 0;
+  static __thread int *x_out = NULL;
+  static __thread int *y_out = NULL;
+  static __thread int *q_out = NULL;
+#else
   static int max_out_pos = 0;
   static int *x_out = NULL;
   static int *y_out = NULL;
   static int *q_out = NULL;
+#endif
 
   int ix, iy, iq, id, idmax, index, dx, dy, aux;
   int x_start, x_end, x_max, q_max;     /* beam search stuff */
@@ -916,6 +1149,9 @@ best_path(FMS fms,
   quality = BAR_new(x_ranges+1, y_ranges+1, beam_width);
   next_x  = BAR_new(x_ranges+1, y_ranges+1, beam_width);
   next_y  = BAR_new(x_ranges+1, y_ranges+1, beam_width);
+  /* the beam covers at most beam_width + 2 sentences on either side */
+  fvc1 = fvector_cache_new(fms, 1, beam_width + 4);
+  fvc2 = fvector_cache_new(fms, 2, beam_width + 4);
 
   /* init values at (0,0) position */
   BAR_write(quality, 0,0, 1);    /* this ensures we can't get lost, since any path connected to
@@ -956,9 +1192,9 @@ best_path(FMS fms,
           /*      if ((dx == 2) && (dy == 2)) continue; */ /* 2:2 now allowed again */
           if ((ix - dx >= 0) && (iy - dy >= 0)) {
             aux = BAR_read(quality, ix-dx,iy-dy)
-              + feature_match(fms, 
-                              f1 + ix - dx, f1 + ix - 1,
-                              f2 + iy - dy, f2 + iy - 1);
+              + feature_match_cached(fms,
+                                     fvc1, f1 + ix - dx, f1 + ix - 1,
+                                     fvc2, f2 + iy - dy, f2 + iy - 1);
             if (aux > BAR_read(quality, ix,iy)) {
               BAR_write(quality, ix,iy, aux);
               BAR_write(next_x, ix, iy, ix-dx);
@@ -1015,5 +1251,7 @@ best_path(FMS fms,
   BAR_delete(quality);
   BAR_delete(next_x);
   BAR_delete(next_y);
+  fvector_cache_delete(fvc1);
+  fvector_cache_delete(fvc2);
 }
 
@@ -58,6 +58,47 @@ typedef struct feature_maps_t {
 typedef feature_maps_t *FMS;
 
 
+/**
+ * Sparse feature vector of a single sentence (or of a region of several sentences).
+ *
+ * The features occurring in the sentence are listed in ascending order together with
+ * their frequencies, so that the similarity of two vectors can be computed with a
+ * single merge pass.
+ */
+typedef struct fvector_t {
+  int sentence;                 /**< number of the sentence (-1 if the slot is empty or holds a region) */
+  int cc;                       /**< character count (primary feature) */
+  int n;                        /**< number of distinct features */
+  int size;                     /**< allocated size of <feature> and <count> */
+  int *feature;                 /**< feature IDs (sorted) */
+  int *count;                   /**< frequency of each feature */
+} fvector_t;
+
+/**
+ * The FVC object: a cache of sparse sentence feature vectors for one side of the alignment.
+ *
+ * Vectors are computed when a sentence is first accessed and kept in a small direct-mapped
+ * cache, which is large enough to hold all sentences in the beam of best_path(); the vectors
+ * of two consecutive sentences (for 2:1, 1:2 and 2:2 alignments) are cached in the same way. Since each
+ * FVC has its own buffers, several threads can compute alignments with the same FMS at the
+ * same time, as long as each of them uses its own pair of FVC objects.
+ */
+typedef struct fvector_cache_t {
+  FMS fms;                      /**< the feature maps */
+  Attribute *att;               /**< word attribute of this side */
+  Attribute *s;                 /**< sentence regions of this side */
+  int **w2f;                    /**< feature map of this side */
+  int n_slots;                  /**< number of cached sentence vectors */
+  fvector_t *slot;              /**< the cached sentence vectors */
+  fvector_t *pair;              /**< the cached vectors of sentence pairs (indexed by the first sentence) */
+  fvector_t merged[2];          /**< buffers for vectors of regions with more than one sentence */
+  int *buf;                     /**< buffer for token IDs and feature lists */
+  int buf_size;                 /**< allocated size of <buf> */
+} fvector_cache_t;
+
+typedef fvector_cache_t *FVC;
+
+
 FMS create_feature_maps(char **config, int config_lines,
                         Attribute *w_attr1, Attribute *w_attr2,
                         Attribute *s_attr1, Attribute *s_attr2
@@ -75,6 +116,13 @@ void check_fvectors(FMS fms);
 int feature_match(FMS fms, int f1, int l1, int f2, int l2);
 
 
+FVC fvector_cache_new(FMS fms, int which, int n_slots);
+
+void fvector_cache_delete(FVC fvc);
+
+int feature_match_cached(FMS fms, FVC fvc1, int f1, int l1, FVC fvc2, int f2, int l2);
+
+
 void show_features(FMS fms, int which, char *word);
 
 
@@ -0,0 +1,170 @@
+/* 
+ *  IMS Open Corpus Workbench (CWB)
+ *  Copyright (C) 1993-2006 by IMS, University of Stuttgart
+ *  Copyright (C) 2007-     by the respective contributers (see file AUTHORS)
+ * 
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU General Public License as published by the
+ *  Free Software Foundation; either version 2, or (at your option) any later
+ *  version.
+ * 
+ *  This program is distributed in the hope that it will be useful, but
+ *  WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General
+ *  Public License for more details (in the file "COPYING", or available via
+ *  WWW at http://www.gnu.org/copyleft/gpl.html).
+ */
+
+/*
+ * lexsort-bench: benchmark for the lexicon sort used by cwb-makeall
+ *
+ * Sorts the lexicon of a p-attribute with lexsort() (as cwb-makeall does when it
+ * creates the .lexicon.srt file) and with a plain qsort() using cl_strcmp(), checks
+ * that both give the same order, and reports the time taken by each.  Nothing is
+ * written to the corpus.  This program is not installed (build it with "make bench").
+ */
+
+#include <glib.h>
+
+#include "../cl/globals.h"
+#include "../cl/corpus.h"
+#include "../cl/attributes.h"
+#include "../cl/endian.h"
+#include "../cl/makecomps.h"
+
+
+char *progname = NULL;
+
+char *sort_lexicon;             /**< lexicon strings (for the qsort() comparison function) */
+int *sort_lexidx;               /**< lexicon index in network byte order (ditto) */
+
+
+/**
+ * Compares two lexicon IDs by their strings using cl_strcmp (qsort() callback).
+ */
+int
+bench_compare(const void *idx1, const void *idx2)
+{
+  return cl_strcmp(sort_lexicon + ntohl(sort_lexidx[*(int *)idx1]),
+                   sort_lexicon + ntohl(sort_lexidx[*(int *)idx2]));
+}
+
+/**
+ * Prints a usage message and exits the program.
+ */
+void
+bench_usage(void)
+{
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Usage:  %s [options] <corpus> <attribute>\n\n", progname);
+  fprintf(stderr, "Compares the lexicon sort of cwb-makeall with qsort() on a p-attribute.\n");
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  -r <dir>  use registry directory <dir>\n");
+  fprintf(stderr, "  -j <n>    sort with <n> threads [0 = one per processor; default: 1]\n");
+  fprintf(stderr, "  -n <n>    repeat each sort <n> times and report the fastest run [default: 1]\n");
+  fprintf(stderr, "Part of the IMS Open Corpus Workbench v" VERSION "\n\n");
+  exit(2);
+}
+
+/* *************** *\
+ *      MAIN()     *
+\* *************** */
+
+/**
+ * Main function for lexsort-bench.
+ *
+ * @param argc   Number of command-line arguments.
+ * @param argv   Command-line arguments.
+ */
+int
+main(int argc, char **argv)
+{
+  char *registry_directory = NULL;
+  Corpus *corpus;
+  Attribute *attribute;
+  Component *lex, *lexidx;
+  int *sorted, *check;
+  int repeats = 1, n, i, r, c;
+  gint64 start, t, t_lexsort = 0, t_qsort = 0;
+
+  extern int optind;
+  extern char *optarg;
+
+  progname = argv[0];
+
+  while ((c = getopt(argc, argv, "+r:j:n:h")) != EOF) {
+    switch (c) {
+    case 'r':
+      registry_directory = optarg;
+      break;
+    case 'j':
+      cl_set_threads(atoi(optarg));
+      break;
+    case 'n':
+      repeats = atoi(optarg);
+      if (repeats < 1)
+        repeats = 1;
+      break;
+    case 'h':
+    default:
+      bench_usage();
+    }
+  }
+
+  if (argc - optind != 2)
+    bench_usage();
+
+  if ((corpus = cl_new_corpus(registry_directory, argv[optind])) == NULL) {
+    fprintf(stderr, "Corpus %s not found in registry %s . Aborted.\n", argv[optind],
+            (registry_directory ? registry_directory : central_corpus_directory()));
+    exit(1);
+  }
+  if ((attribute = cl_new_attribute(corpus, argv[optind + 1], ATT_POS)) == NULL) {
+    fprintf(stderr, "p-attribute %s.%s not defined. Aborted.\n", argv[optind], argv[optind + 1]);
+    exit(1);
+  }
+
+  lex = ensure_component(attribute, CompLexicon, 0);
+  lexidx = ensure_component(attribute, CompLexiconIdx, 0);
+  if (lex == NULL || lexidx == NULL) {
+    fprintf(stderr, "Can't load lexicon of %s.%s. Aborted.\n", argv[optind], argv[optind + 1]);
+    exit(1);
+  }
+  sort_lexicon = (char *) lex->data.data;
+  sort_lexidx = lexidx->data.data;
+  n = lexidx->size;
+
+  sorted = (int *) cl_malloc(sizeof(int) * (n > 0 ? n : 1));
+  check = (int *) cl_malloc(sizeof(int) * (n > 0 ? n : 1));
+
+  for (r = 0; r < repeats; r++) {
+    start = g_get_monotonic_time();
+    lexsort(sort_lexicon, sort_lexidx, n, sorted);
+    t = g_get_monotonic_time() - start;
+    if (r == 0 || t < t_lexsort)
+      t_lexsort = t;
+
+    for (i = 0; i < n; i++)
+      check[i] = i;
+    start = g_get_monotonic_time();
+    qsort(check, n, sizeof(int), bench_compare);
+    t = g_get_monotonic_time() - start;
+    if (r == 0 || t < t_qsort)
+      t_qsort = t;
+  }
+
+  printf("%s.%s: %d lexicon entries, %d thread(s)\n", argv[optind], argv[optind + 1], n, cl_threads);
+  printf("lexsort: %8.3f s\n", t_lexsort / 1e6);
+  printf("qsort:   %8.3f s\n", t_qsort / 1e6);
+
+  if (memcmp(check, sorted, sizeof(int) * n) != 0) {
+    fprintf(stderr, "ERROR: sort order of lexsort() differs from qsort()\n");
+    exit(1);
+  }
+
+  cl_free(sorted);
+  cl_free(check);
+  cl_delete_corpus(corpus);
+  return 0;
+}